@@ -0,0 +1,847 @@
+/**
+ *  ReyPIC – Benchmark Source
+ * ===========================
+ *  Times the parts of the simulation that run in benchmark mode, each against the code it replaced
+ *  where there is one, and checks that both give the same result.
+ *
+ *  Timed runs are repeated for at least BENCH_MIN_TIME seconds on each node, and the master prints
+ *  the rates summed over all nodes as a mean per node. The guard cell exchanges and the field
+ *  solver are collective between neighbours, so the nodes agree on their repeat count instead, and
+ *  the master prints the time of the slowest node.
+ */
+
+#include "clsBenchmark.hpp"
+#include <algorithm>
+#include <unistd.h>
+
+using namespace std;
+using namespace reypic;
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Constructor
+ * ===================
+ */
+
+Benchmark::Benchmark() {
+
+    int32_t iRank = -1;
+    MPI_Comm_size(MPI_COMM_WORLD, &m_MPISize);
+    MPI_Comm_rank(MPI_COMM_WORLD, &iRank);
+    m_isMaster = (iRank == 0);
+
+}
+
+// ********************************************************************************************** //
+//                                         Class Methods                                          //
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Run
+ * ===============
+ *  Runs all benchmarks on the set up simulation, ending with nSteps steps of the field solver.
+ */
+
+error_t Benchmark::Run(index_t nSteps, Input_t* pInput, ThreadPool_t* pPool, Grid_t* pGrid,
+                       EMF_t* pEMF, std::vector<Species>& vSpecies) {
+
+    m_Input   = pInput;
+    m_Pool    = pPool;
+    m_Grid    = pGrid;
+    m_EMF     = pEMF;
+    m_Species = &vSpecies;
+    m_Threads = pPool->getThreads();
+
+    benchKernels();
+
+    error_t errMath = benchMath(true);
+    if(errMath != ERR_NONE) return errMath;
+
+    benchGrid();
+    benchHalo();
+    benchOverlap();
+    benchInput();
+
+    benchEMF(nSteps);
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Check
+ * =================
+ *  Runs the result checks of the benchmarks once each, without timing them, and fails if any of
+ *  them finds a mismatch.
+ */
+
+error_t Benchmark::Check(ThreadPool_t* pPool, Grid_t* pGrid, std::vector<Species>& vSpecies) {
+
+    m_Pool    = pPool;
+    m_Grid    = pGrid;
+    m_Species = &vSpecies;
+    m_Threads = pPool->getThreads();
+
+    return benchMath(false);
+}
+
+// ********************************************************************************************** //
+//                                        Member Functions                                        //
+// ********************************************************************************************** //
+
+/**
+ *  Benchmark Kernels
+ * ===================
+ *  Times the array kernels in functions.cpp on the momentum of the largest species, as used for a
+ *  kinetic energy or velocity check, against the plain loops they replaced, and prints the
+ *  bandwidth per node.
+ */
+
+void Benchmark::benchKernels() {
+
+    index_t   nData = 0;
+    double_t* pData = NULL;
+    for(auto& tSpecies : *m_Species) {
+        if(tSpecies.Part.getSize() > nData) {
+            nData = tSpecies.Part.getSize();
+            pData = tSpecies.Part.U1;
+        }
+    }
+
+    index_t nLeast = 0;
+    MPI_Allreduce(&nData, &nLeast, 1, MPI_UINT64_T, MPI_MIN, MPI_COMM_WORLD);
+
+    if(m_isMaster) {
+        printf("  Kernel Benchmark\n");
+        printf(" ==================\n");
+    }
+    if(nLeast == 0) {
+        if(m_isMaster) printf("  Skipped, as a node has no particles\n\n");
+        return;
+    }
+
+    // The plain loops, which the compiler can not vectorise without reordering the sums
+    auto fLoopMin = [&]() {
+        double_t dMin = pData[0];
+        for(index_t i=1; i<nData; i++) if(pData[i] < dMin) dMin = pData[i];
+        return dMin;
+    };
+    auto fLoopMax = [&]() {
+        double_t dMax = pData[0];
+        for(index_t i=1; i<nData; i++) if(pData[i] > dMax) dMax = pData[i];
+        return dMax;
+    };
+    auto fLoopSum = [&]() {
+        double_t dSum = 0.0;
+        for(index_t i=0; i<nData; i++) dSum += pData[i];
+        return dSum;
+    };
+
+    // Each kernel with the number of times it reads the array per call
+    struct kernel {
+        std::function<double_t()> fRun;
+        double_t                  nReads;
+    };
+
+    double_t dMin, dMax, dSum;
+    std::vector<kernel> vKernels = {
+        {fLoopSum, 1.0},
+        {[&]() {return m::sum(pData, nData);}, 1.0},
+        {[&]() {return m::sum(m_Pool, pData, nData);}, 1.0},
+        {fLoopMax, 1.0},
+        {[&]() {return m::max(pData, nData);}, 1.0},
+        {[&]() {return m::max(m_Pool, pData, nData);}, 1.0},
+        {[&]() {return fLoopMin() + fLoopMax() + fLoopSum();}, 3.0},
+        {[&]() {m::minmaxsum(pData, nData, &dMin, &dMax, &dSum); return dSum;}, 1.0},
+        {[&]() {m::minmaxsum(m_Pool, pData, nData, &dMin, &dMax, &dSum); return dSum;}, 1.0},
+    };
+
+    vdouble_t vLocal(vKernels.size(), 0.0);
+    volatile double_t dSink = 0.0;
+    for(size_t iK=0; iK<vKernels.size(); iK++) {
+        double_t dTime = timeRepeated([&]() {dSink = dSink + vKernels[iK].fRun();}, BENCH_MIN_TIME);
+        vLocal[iK] = vKernels[iK].nReads*nData*sizeof(double_t)/dTime;
+    }
+    vdouble_t vRate = reduceNodes(vLocal, MPI_SUM);
+
+    if(m_isMaster) {
+        const char* aName[3] = {"Sum", "Max", "Min, max and sum"};
+        std::vector<column> vCols = {{"Plain loop", "%12.2f"}, {"SIMD", "%12.2f"},
+                                     {"Threaded", "%12.2f"}};
+        printf("  Fewest values per node: %ld\n", (long)nLeast);
+        printTable("GB/s per node", vCols);
+        for(int32_t iRow=0; iRow<3; iRow++) {
+            double_t dScale = 1.0/m_MPISize/1.0e9;
+            printRow(aName[iRow], vCols, {vRate[3*iRow]*dScale, vRate[3*iRow+1]*dScale,
+                                          vRate[3*iRow+2]*dScale});
+        }
+        printf("\n");
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Benchmark Math
+ * ================
+ *  Times a density profile of the kind given in the species input, evaluated point by point with
+ *  Eval() as the loader did before, against EvalBatch() on the same points, and prints the
+ *  evaluation rate per node and the largest difference between the two results. It is run once
+ *  with as many points as the node has grid cells, and once with as many as it has particles.
+ *  Last, all threads of the pool evaluate every point with the same object at once, and the master
+ *  prints how many of those results are not identical to the serial ones.
+ *  Fails if any threaded result differs, or if the two evaluations differ by more than
+ *  BENCH_EVAL_TOL relative to the value. Unless isTimed, each evaluation runs once and only the
+ *  check is printed.
+ */
+
+error_t Benchmark::benchMath(bool isTimed) {
+
+    vstring_t vsVars = {"x1","x2","x3"};
+    string_t  sEq    = "if(x1 > 0.2, exp(-((x2-0.5)/0.2)^2)*(1.0 + 0.1*cos(2*pi*x3)), 0.0)";
+
+    if(m_isMaster && isTimed) {
+        printf("  Math Benchmark\n");
+        printf(" ================\n");
+    }
+    if(m_isMaster && !isTimed) {
+        printf("  Math Check\n");
+        printf(" ============\n");
+    }
+
+    Math_t mFunc;
+    if(!mFunc.setVariables(vsVars) || !mFunc.setEquation(sEq)) {
+        if(m_isMaster) printf("  Benchmark Error: The test equation did not parse\n");
+        return ERR_EXEC;
+    }
+
+    vint_t  vCells = m_Grid->getLocalCells();
+    index_t nParts = 0;
+    for(auto& tSpecies : *m_Species) nParts += tSpecies.Part.getSize();
+
+    const char* aName[2]   = {"Grid cells", "Particles"};
+    index_t     aPoints[2] = {(index_t)vCells[0]*vCells[1]*vCells[2], nParts};
+    int32_t     nThreads   = m_Pool->getThreads();
+
+    // Per size the points, and the Eval and EvalBatch rates
+    vdouble_t vLocal(6, 0.0);
+    double_t  dDiff    = 0.0;
+    double_t  dWrong   = 0.0;
+    double_t  dChecked = 0.0;
+
+    for(int32_t iS=0; iS<2; iS++) {
+
+        index_t nPoints = aPoints[iS];
+        if(nPoints == 0) continue;
+
+        vdouble_t vX1(nPoints), vX2(nPoints), vX3(nPoints);
+        m::linspace(0.0, 1.0, nPoints, vX1.data());
+        m::linspace(1.0, 0.0, nPoints, vX2.data());
+        m::linspace(0.0, 4.0, nPoints, vX3.data());
+
+        const double_t* pVars[3] = {vX1.data(), vX2.data(), vX3.data()};
+        vdouble_t vScalar(nPoints, 0.0), vBatch(nPoints, 0.0);
+
+        std::vector<std::function<void()> > vRuns = {
+            [&]() {
+                for(index_t i=0; i<nPoints; i++) {
+                    double_t aValues[3] = {vX1[i], vX2[i], vX3[i]};
+                    mFunc.Eval(aValues, &vScalar[i]);
+                }
+            },
+            [&]() {mFunc.EvalBatch(pVars, nPoints, vBatch.data());},
+        };
+
+        vLocal[3*iS] = (double_t)nPoints;
+        for(size_t iR=0; iR<vRuns.size(); iR++) {
+            if(isTimed) {
+                vLocal[3*iS+iR+1] = nPoints/timeRepeated(vRuns[iR], BENCH_MIN_TIME);
+            } else {
+                vRuns[iR]();
+            }
+        }
+
+        for(index_t i=0; i<nPoints; i++) {
+            dDiff = max(dDiff, fabs(vScalar[i]-vBatch[i])/max(1.0, fabs(vScalar[i])));
+        }
+
+        // All pool threads evaluate every point at the same time on the one object
+        std::vector<vdouble_t> vThread(nThreads, vdouble_t(nPoints, 0.0));
+        m_Pool->Run([&](int32_t iThread) {
+            for(index_t i=0; i<nPoints; i++) {
+                double_t aValues[3] = {vX1[i], vX2[i], vX3[i]};
+                mFunc.Eval(aValues, &vThread[iThread][i]);
+            }
+        });
+
+        for(int32_t iT=0; iT<nThreads; iT++) {
+            for(index_t i=0; i<nPoints; i++) {
+                if(vThread[iT][i] != vScalar[i]) dWrong++;
+            }
+        }
+        dChecked += (double_t)nPoints*nThreads;
+    }
+
+    // The check results go to all nodes, so they fail together
+    double_t  dMaxDiff   = 0.0;
+    double_t  aCheck[2]  = {dWrong, dChecked};
+    double_t  aAll[2]    = {0.0, 0.0};
+    vdouble_t vSum       = reduceNodes(vLocal, MPI_SUM);
+    MPI_Allreduce(&dDiff, &dMaxDiff, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(aCheck, aAll, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    if(m_isMaster) {
+        printf("  Equation: %s\n", sEq.c_str());
+        if(isTimed) {
+            std::vector<column> vCols = {{"Points/node", "%12.0f"}, {"Eval", "%12.3e"},
+                                         {"EvalBatch", "%12.3e"}, {"Speedup", "%12.2f"}};
+            printTable("Evals/s per node", vCols);
+            for(int32_t iS=0; iS<2; iS++) {
+                if(vSum[3*iS] == 0.0) continue;
+                printRow(aName[iS], vCols, {vSum[3*iS]/m_MPISize, vSum[3*iS+1]/m_MPISize,
+                                            vSum[3*iS+2]/m_MPISize, vSum[3*iS+2]/vSum[3*iS+1]});
+            }
+        }
+        printf("  Largest difference: %.3e\n", dMaxDiff);
+        printf("  Threaded Eval: %.0f of %.0f results differ from the serial ones\n", aAll[0], aAll[1]);
+    }
+
+    if(dMaxDiff > BENCH_EVAL_TOL) {
+        if(m_isMaster) printf("  Benchmark Error: EvalBatch differs from Eval by more than %.1e\n",
+                              BENCH_EVAL_TOL);
+        return ERR_EXEC;
+    }
+    if(aAll[0] > 0.0) {
+        if(m_isMaster) printf("  Benchmark Error: Eval is not safe to call from several threads\n");
+        return ERR_EXEC;
+    }
+    if(m_isMaster) printf("\n");
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Benchmark Cell Lookup
+ * =======================
+ *  Times Grid::cellOf() on the positions of the largest species, in each dimension, against the
+ *  binary search over the cell edges with std::upper_bound that it replaced, and prints the lookup
+ *  rate per node and the number of positions where the two disagree.
+ */
+
+void Benchmark::benchGrid() {
+
+    index_t   nData = 0;
+    double_t* pX[3] = {NULL, NULL, NULL};
+    for(auto& tSpecies : *m_Species) {
+        if(tSpecies.Part.getSize() > nData) {
+            nData = tSpecies.Part.getSize();
+            pX[0] = tSpecies.Part.X1;
+            pX[1] = tSpecies.Part.X2;
+            pX[2] = tSpecies.Part.X3;
+        }
+    }
+
+    index_t nLeast = 0;
+    MPI_Allreduce(&nData, &nLeast, 1, MPI_UINT64_T, MPI_MIN, MPI_COMM_WORLD);
+
+    if(m_isMaster) {
+        printf("  Cell Lookup Benchmark\n");
+        printf(" =======================\n");
+    }
+    if(nLeast == 0) {
+        if(m_isMaster) printf("  Skipped, as a node has no particles\n\n");
+        return;
+    }
+
+    vint_t    vSearch(nData), vBucket(nData);
+    vdouble_t vLocal(9, 0.0);
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+
+        const vdouble_t& vEdge  = m_Grid->gridEdge[iDim];
+        int32_t          nCells = (int32_t)m_Grid->gridDelta[iDim].size();
+        const double_t*  pXD    = pX[iDim];
+
+        std::vector<std::function<void()> > vRuns = {
+            [&]() {
+                for(index_t i=0; i<nData; i++) {
+                    auto    pUpper = upper_bound(vEdge.begin(), vEdge.end(), pXD[i]);
+                    int32_t iCell  = (int32_t)(pUpper - vEdge.begin()) - 1;
+                    vSearch[i] = min(max(iCell, 0), nCells-1);
+                }
+            },
+            [&]() {m_Grid->cellOf(iDim, pXD, nData, vBucket.data());},
+        };
+
+        for(size_t iR=0; iR<vRuns.size(); iR++) {
+            vLocal[3*iDim+iR] = nData/timeRepeated(vRuns[iR], BENCH_MIN_TIME);
+        }
+
+        for(index_t i=0; i<nData; i++) {
+            if(vSearch[i] != vBucket[i]) vLocal[3*iDim+2]++;
+        }
+    }
+    vdouble_t vSum = reduceNodes(vLocal, MPI_SUM);
+
+    if(m_isMaster) {
+        vint_t vCells = m_Grid->getGlobalCells();
+        std::vector<column> vCols = {{"upper_bound", "%12.3e"}, {"cellOf", "%12.3e"},
+                                     {"Speedup", "%12.2f"}, {"Mismatches", "%12.0f"}};
+        printf("  Fewest positions per node: %ld\n", (long)nLeast);
+        printTable("Lookups/s per node", vCols);
+        for(int32_t iDim=0; iDim<3; iDim++) {
+            char sRow[32];
+            snprintf(sRow, 32, "x%d (%d cells)", iDim+1, vCells[iDim]);
+            printRow(sRow, vCols, {vSum[3*iDim]/m_MPISize, vSum[3*iDim+1]/m_MPISize,
+                                   vSum[3*iDim+1]/vSum[3*iDim], vSum[3*iDim+2]});
+        }
+        printf("\n");
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Benchmark Halo
+ * ================
+ *  Times the blocking guard cell exchange of the fields, and the guard cell summation of the
+ *  current, and prints the time per exchange on the slowest node, the data sent per node and
+ *  exchange, and the share of the time spent waiting for the neighbours. The current is cleared
+ *  afterwards.
+ */
+
+void Benchmark::benchHalo() {
+
+    Halo_t*     aHalo[2] = {&m_Grid->fieldHalo, &m_Grid->currentHalo};
+    const char* aName[2] = {"Fields (copy)", "Current (add)"};
+
+    vdouble_t vLocal(6, 0.0);
+
+    for(int32_t iH=0; iH<2; iH++) {
+
+        Halo_t*  pHalo  = aHalo[iH];
+        double_t dWait  = pHalo->getWaitTime();
+        double_t dBytes = pHalo->getBytes();
+        int32_t  nCount = pHalo->getCount();
+
+        double_t dTime = timeCollective([&]() {pHalo->Exchange();}, BENCH_MIN_TIME);
+        nCount = pHalo->getCount() - nCount;
+
+        vLocal[3*iH]   = dTime;
+        vLocal[3*iH+1] = (pHalo->getBytes() - dBytes)/nCount;
+        vLocal[3*iH+2] = (pHalo->getWaitTime() - dWait)/(dTime*nCount);
+    }
+    m_Grid->ClearCurrent();
+
+    vdouble_t vMax = reduceNodes({vLocal[0], vLocal[3]}, MPI_MAX);
+    vdouble_t vSum = reduceNodes(vLocal, MPI_SUM);
+
+    if(m_isMaster) {
+        std::vector<column> vCols = {{"us/exchange", "%12.2f"}, {"MB/node", "%12.3f"},
+                                     {"GB/s/node", "%12.3f"}, {"Wait %", "%12.1f"}};
+        printf("  Halo Benchmark\n");
+        printf(" ================\n");
+        printTable("Exchange", vCols);
+        for(int32_t iH=0; iH<2; iH++) {
+            double_t dBytes = vSum[3*iH+1]/m_MPISize;
+            printRow(aName[iH], vCols, {vMax[iH]*1.0e6, dBytes/1.0e6, dBytes/vMax[iH]/1.0e9,
+                                        100.0*vSum[3*iH+2]/m_MPISize});
+        }
+        printf("\n");
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Benchmark Overlap
+ * ===================
+ *  Times steps of the field solver with each guard cell exchange done before the sweep that needs
+ *  it, against the same steps with the inner cells swept while the exchange runs, as in the main
+ *  loop. Each node layout gets a grid and field solver of its own from the input, with the nodes
+ *  in slabs along each dimension, the layout MPI_Dims_create picks, and the layout of the run.
+ *  Layouts with fewer cells per node than guard cells in a dimension are skipped. The master prints
+ *  the time per step on the slowest node.
+ */
+
+void Benchmark::benchOverlap() {
+
+    if(m_isMaster) {
+        printf("  Overlap Benchmark\n");
+        printf(" ===================\n");
+    }
+    if(!m_EMF->isActive()) {
+        if(m_isMaster) printf("  Skipped, as there is no field solver\n\n");
+        return;
+    }
+
+    vint_t  vTotal  = m_Grid->getGlobalCells();
+    int32_t nGuards = m_Grid->getGuards();
+
+    std::vector<vint_t> vLayouts;
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        vint_t vSlab = {1, 1, 1};
+        vSlab[iDim]  = m_MPISize;
+        vLayouts.push_back(vSlab);
+    }
+    vint_t vBest = {0, 0, 0};
+    MPI_Dims_create(m_MPISize, 3, vBest.data());
+    vLayouts.push_back(vBest);
+    vLayouts.push_back(m_Grid->getNodes());
+
+    std::vector<column> vCols = {{"Cells/node", "%12.0f"}, {"Serial us", "%12.2f"},
+                                 {"Overlap us", "%12.2f"}, {"Speedup", "%12.2f"}};
+    if(m_isMaster) printTable("Nodes", vCols);
+
+    for(size_t iL=0; iL<vLayouts.size(); iL++) {
+
+        const vint_t& vNodes = vLayouts[iL];
+        if(find(vLayouts.begin(), vLayouts.begin()+iL, vNodes) != vLayouts.begin()+iL) continue;
+
+        char sRow[32];
+        snprintf(sRow, 32, "%d x %d x %d", vNodes[0], vNodes[1], vNodes[2]);
+
+        bool isFit = true;
+        for(int32_t iDim=0; iDim<3; iDim++) {
+            if(vTotal[iDim] < vNodes[iDim]*nGuards) isFit = false;
+        }
+        if(!isFit) {
+            if(m_isMaster) printf("  %-18s Skipped, as a node has fewer cells than guard cells\n", sRow);
+            continue;
+        }
+
+        Grid_t tGrid;
+        EMF_t  tEMF;
+        tGrid.setQuiet();
+        tEMF.setQuiet();
+        if(tGrid.Setup(m_Input, vNodes, m_Pool) != ERR_NONE ||
+           tEMF.Setup(m_Input, &tGrid, m_EMF->getTimeStep()) != ERR_NONE) {
+            if(m_isMaster) printf("  %-18s Skipped, as the grid could not be set up\n", sRow);
+            continue;
+        }
+
+        vint_t   vCells = tGrid.getLocalCells();
+        double_t dCells = (double_t)vCells[0]*vCells[1]*vCells[2];
+
+        setupWave(&tGrid);
+        tEMF.setOverlap(false);
+        double_t dSerial  = timeCollective([&]() {tEMF.Advance(&tGrid);}, BENCH_MIN_TIME);
+        tEMF.setOverlap(true);
+        double_t dOverlap = timeCollective([&]() {tEMF.Advance(&tGrid);}, BENCH_MIN_TIME);
+
+        vdouble_t vSum = reduceNodes({dCells}, MPI_SUM);
+        vdouble_t vMax = reduceNodes({dSerial, dOverlap}, MPI_MAX);
+
+        if(m_isMaster) {
+            printRow(sRow, vCols, {vSum[0]/m_MPISize, vMax[0]*1.0e6, vMax[1]*1.0e6, vMax[0]/vMax[1]});
+        }
+    }
+    if(m_isMaster) printf("\n");
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Benchmark Input
+ * =================
+ *  Times the input reader on generated files of about 2 to 13 MB, with hundreds of species that
+ *  each have a profile tabulated as a long expression. The file is read, split into sections and
+ *  every key of every species is looked up. The read rate should not drop with the file size, as
+ *  the reader makes a single pass. Runs on the master only, with the files in TMPDIR or /tmp, which
+ *  are removed afterwards.
+ */
+
+void Benchmark::benchInput() {
+
+    if(!m_isMaster) return;
+
+    std::vector<column> vCols = {{"MB", "%12.2f"}, {"ms/read", "%12.2f"}, {"MB/s", "%12.1f"},
+                                 {"Mismatches", "%12.0f"}};
+
+    printf("  Input Reader Benchmark\n");
+    printf(" ========================\n");
+    printTable("Species", vCols);
+
+    const char* pDir = getenv("TMPDIR");
+    string_t    sDir = (pDir == NULL ? "/tmp" : pDir);
+
+    for(int32_t nSpecies=100; nSpecies<=800; nSpecies*=2) {
+
+        // Generate the file, with a 256 point piecewise linear profile per species
+        string_t  sFile = "# Generated input benchmark\n";
+        vstring_t vFunc(nSpecies);
+        char      cItem[256];
+        sFile += "config {\n  nodes = 1;   # Comment\n  threads = 1;\n}\n";
+        sFile += "simulation {\n  n0 = 1.0e18;\n  dt = 0.05;\n  tmin = 0.0;\n  tmax = 1.0;\n}\n";
+        sFile += "grid {\n  ngrid = 32, 16, 16;\n  xmin = 0.0, 0.0, 0.0;\n  xmax = 10.0, 5.0, 5.0;\n}\n";
+        sFile += "emf {\n}\n";
+        for(int32_t iS=0; iS<nSpecies; iS++) {
+            for(int32_t iP=0; iP<256; iP++) {
+                double_t dX = 10.0*iP/256.0;
+                snprintf(cItem, sizeof(cItem), "%s(x1>=%.6f)*(x1<%.6f)*(%.6f+%.6f*(x1-%.6f))",
+                         (iP == 0 ? "" : "+"), dX, dX+10.0/256.0, 1.0+0.5*sin(0.1*iP+iS),
+                         0.05*cos(0.1*iP+iS), dX);
+                vFunc[iS] += cItem;
+            }
+            snprintf(cItem, sizeof(cItem), "species {\n  # Species %d\n  name        = \"species_%d\";\n"
+                     "  profile     = \"func\";\n  mass        = %d.0;\n  charge      = -1.0;\n",
+                     iS, iS, iS+1);
+            sFile += cItem;
+            sFile += "  profilefunc = \"" + vFunc[iS] + "\";\n";
+            sFile += "  percell     = 2, 2, 2;\n  thermal     = 0.1, 0.1, 0.1;\n}\n";
+        }
+
+        string_t sPath = sDir + "/reypic_input_XXXXXX";
+        int32_t  iFile = mkstemp(&sPath[0]);
+        if(iFile < 0) {
+            printf("  Skipped, as no file could be created in %s\n\n", sDir.c_str());
+            return;
+        }
+        bool isWritten = (write(iFile, sFile.data(), sFile.size()) == (ssize_t)sFile.size());
+        close(iFile);
+        if(!isWritten) {
+            unlink(sPath.c_str());
+            printf("  Skipped, as the file could not be written to %s\n\n", sDir.c_str());
+            return;
+        }
+
+        // Read it, and check the species and the profiles
+        index_t  nWrong = 0;
+        double_t dTime  = timeRepeated([&]() {
+            Input tInput;
+            tInput.setQuiet();
+            nWrong = 0;
+            if(tInput.ReadFile(&sPath[0]) != ERR_NONE || tInput.SplitSections() != ERR_NONE ||
+               tInput.getNumSpecies() != nSpecies) {
+                nWrong = nSpecies;
+                return;
+            }
+            for(int32_t iS=0; iS<nSpecies; iS++) {
+                string_t  sName, sProfile, sFunc;
+                double_t  dMass = 0.0, dCharge = 0.0;
+                vint_t    vPerCell;
+                vdouble_t vThermal;
+                tInput.ReadVariable(INPUT_SPECIES, iS, "name", &sName, INVAR_STRING);
+                tInput.ReadVariable(INPUT_SPECIES, iS, "profile", &sProfile, INVAR_STRING);
+                tInput.ReadVariable(INPUT_SPECIES, iS, "profilefunc", &sFunc, INVAR_STRING);
+                tInput.ReadVariable(INPUT_SPECIES, iS, "mass", &dMass, INVAR_DOUBLE);
+                tInput.ReadVariable(INPUT_SPECIES, iS, "charge", &dCharge, INVAR_DOUBLE);
+                tInput.ReadVariable(INPUT_SPECIES, iS, "percell", &vPerCell, INVAR_VINT);
+                tInput.ReadVariable(INPUT_SPECIES, iS, "thermal", &vThermal, INVAR_VDOUBLE);
+                if(sName != "species_"+to_string(iS) || sFunc != vFunc[iS] || dMass != iS+1.0 ||
+                   vPerCell.size() != 3 || vThermal.size() != 3) {
+                    nWrong++;
+                }
+            }
+        }, BENCH_MIN_TIME);
+
+        unlink(sPath.c_str());
+
+        double_t dMB = sFile.size()/1.0e6;
+        printRow(to_string(nSpecies), vCols, {dMB, dTime*1.0e3, dMB/dTime, (double_t)nWrong});
+    }
+    printf("\n");
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Benchmark EMF
+ * ===============
+ *  Runs nSteps steps of the field solver alone, starting from a smooth field, and reports the cell
+ *  updates per second and the memory traffic that needs, assuming each value is read or written
+ *  only once per sweep. A solver at the bandwidth limit gets close to the STREAM bandwidth of the
+ *  node. Skipped if the input sets up no field solver.
+ */
+
+void Benchmark::benchEMF(index_t nSteps) {
+
+    if(m_isMaster) {
+        printf("  EMF Benchmark\n");
+        printf(" ===============\n");
+    }
+    if(!m_EMF->isActive()) {
+        if(m_isMaster) printf("  Skipped, as there is no field solver\n\n");
+        return;
+    }
+
+    vint_t  vCells = m_Grid->getLocalCells();
+    index_t nCells = (index_t)vCells[0]*vCells[1]*vCells[2];
+
+    setupWave(m_Grid);
+
+    if(m_isMaster) printf("  Steps: %ld\n", (long)nSteps);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    double_t dStart = MPI_Wtime();
+    for(index_t iStep=0; iStep<nSteps; iStep++) {
+        m_EMF->Advance(m_Grid);
+    }
+    double_t dTime = MPI_Wtime() - dStart;
+
+    vdouble_t vSum = reduceNodes({(double_t)nCells*nSteps, m_EMF->getHaloTime()}, MPI_SUM);
+    vdouble_t vMax = reduceNodes({dTime}, MPI_MAX);
+
+    if(m_isMaster && vMax[0] > 0.0) {
+        double_t dRate = vSum[0]/vMax[0];
+        printf("  Run time: %.3f s, guard cell exchange: %.3f s per node\n", vMax[0], vSum[1]/m_MPISize);
+        printf("  Cell updates: %.3e /s, %.3e /s/node, %.3e /s/core\n",
+               dRate, dRate/m_MPISize, dRate/m_MPISize/m_Threads);
+        printf("  Memory traffic: %.2f GB/s per node at %d bytes per cell update\n",
+               dRate/m_MPISize*EMF_CELL_BYTES/1.0e9, EMF_CELL_BYTES);
+        printf("\n");
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Time Repeated
+ * ===============
+ *  Calls fRun until at least dMinSec seconds have passed, and returns the time per call.
+ */
+
+double_t Benchmark::timeRepeated(const std::function<void()>& fRun, double_t dMinSec) {
+
+    int32_t  nRep   = 0;
+    double_t dTime  = 0.0;
+    double_t dStart = MPI_Wtime();
+    do {
+        fRun();
+        nRep++;
+        dTime = MPI_Wtime() - dStart;
+    } while(dTime < dMinSec);
+
+    return dTime/nRep;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Time Collective
+ * =================
+ *  Times fRun like timeRepeated() for runs that communicate with other nodes. The nodes agree on a
+ *  repeat count from a few warm-up calls, so that they all call fRun equally often and the slowest
+ *  takes at least dMinSec seconds. Returns the time per call on this node.
+ */
+
+double_t Benchmark::timeCollective(const std::function<void()>& fRun, double_t dMinSec) {
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    double_t dStart = MPI_Wtime();
+    for(int32_t i=0; i<10; i++) fRun();
+    double_t dWarm = (MPI_Wtime() - dStart)/10.0, dWarmMax = 0.0;
+    MPI_Allreduce(&dWarm, &dWarmMax, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+    int32_t nRep = (int32_t)min(1.0e6, max(10.0, dMinSec/max(dWarmMax, 1.0e-9)));
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    dStart = MPI_Wtime();
+    for(int32_t i=0; i<nRep; i++) fRun();
+
+    return (MPI_Wtime() - dStart)/nRep;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Setup Wave
+ * ============
+ *  Sets E3 on simGrid to a standing wave with up to date guard cells, and clears the current, so
+ *  the fields of a field solver run are neither zero nor denormal.
+ */
+
+void Benchmark::setupWave(Grid_t* simGrid) {
+
+    vint_t vCells = simGrid->getLocalCells();
+    vint_t vStart = simGrid->getLocalStart();
+    vint_t vTotal = simGrid->getGlobalCells();
+
+    simGrid->ClearCurrent();
+    for(int32_t i3=0; i3<vCells[2]; i3++) {
+        for(int32_t i2=0; i2<vCells[1]; i2++) {
+            for(int32_t i1=0; i1<vCells[0]; i1++) {
+                index_t iIdx = simGrid->fieldIndex(i1, i2, i3);
+                simGrid->E3[iIdx] = sin(M_PI*(i1+vStart[0])/vTotal[0])*sin(M_PI*(i2+vStart[1])/vTotal[1]);
+            }
+        }
+    }
+    simGrid->fieldHalo.Exchange();
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Reduce Nodes
+ * ==============
+ *  Reduces the values of all nodes with opReduce. Only the master gets the result.
+ */
+
+vdouble_t Benchmark::reduceNodes(const vdouble_t& vLocal, MPI_Op opReduce) {
+
+    vdouble_t vAll(vLocal.size(), 0.0);
+    MPI_Reduce(vLocal.data(), vAll.data(), (int32_t)vLocal.size(), MPI_DOUBLE, opReduce, 0,
+               MPI_COMM_WORLD);
+
+    return vAll;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Print Table
+ * =============
+ *  Prints the heading line of a result table, with the label of the row names first.
+ */
+
+void Benchmark::printTable(const char* sFirst, const std::vector<column>& vCols) {
+
+    printf("  %-18s", sFirst);
+    for(auto& tCol : vCols) printf(" %12s", tCol.sHead);
+    printf("\n");
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Print Row
+ * ===========
+ *  Prints one row of a result table, with each value in the format of its column.
+ */
+
+void Benchmark::printRow(const string_t& sRow, const std::vector<column>& vCols,
+                         const vdouble_t& vValues) {
+
+    printf("  %-18s", sRow.c_str());
+    for(size_t iC=0; iC<vCols.size() && iC<vValues.size(); iC++) {
+        printf(" ");
+        printf(vCols[iC].sFormat, vValues[iC]);
+    }
+    printf("\n");
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+// End Class Benchmark
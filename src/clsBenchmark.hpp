@@ -0,0 +1,92 @@
+/**
+ * ReyPIC – Benchmark Header
+ */
+
+#ifndef CLASS_BENCHMARK
+#define CLASS_BENCHMARK
+
+// Class-specific macros
+#define BENCH_MIN_TIME  0.1     // Shortest time in seconds a timed run is repeated for
+#define BENCH_EVAL_TOL  1.0e-12 // Largest relative difference allowed between Eval and EvalBatch
+
+#include "config.hpp"
+
+#include "clsThreadPool.hpp"
+#include "clsGrid.hpp"
+#include "clsSpecies.hpp"
+#include "clsEMF.hpp"
+
+typedef reypic::EMF EMF_t;
+
+namespace reypic {
+
+class Benchmark {
+
+public:
+
+   /**
+    * Constructor/Destructor
+    */
+
+    Benchmark();
+    ~Benchmark() {};
+
+   /**
+    * Methods
+    */
+
+    error_t Run(index_t, Input_t*, ThreadPool_t*, Grid_t*, EMF_t*, std::vector<Species>&);
+    error_t Check(ThreadPool_t*, Grid_t*, std::vector<Species>&);
+
+private:
+
+   /**
+    * Structs
+    */
+
+    // A column of a result table, with its heading and the printf format of its values
+    struct column {
+        const char* sHead;
+        const char* sFormat;
+    };
+
+   /**
+    * Member Functions
+    */
+
+    void      benchKernels();
+    error_t   benchMath(bool);
+    void      benchGrid();
+    void      benchHalo();
+    void      benchOverlap();
+    void      benchInput();
+    void      benchEMF(index_t);
+
+    double_t  timeRepeated(const std::function<void()>&, double_t);
+    double_t  timeCollective(const std::function<void()>&, double_t);
+    void      setupWave(Grid_t*);
+    vdouble_t reduceNodes(const vdouble_t&, MPI_Op);
+    void      printTable(const char*, const std::vector<column>&);
+    void      printRow(const string_t&, const std::vector<column>&, const vdouble_t&);
+
+   /**
+    * Member Variables
+    */
+
+    // Parallelisation
+    int32_t  m_MPISize   = 0;               // Number of nodes
+    bool     m_isMaster  = false;           // True if this node is master
+    int32_t  m_Threads   = 1;               // Threads per node
+
+    // The simulation parts under test
+    Input_t*              m_Input   = NULL;
+    ThreadPool_t*         m_Pool    = NULL;
+    Grid_t*               m_Grid    = NULL;
+    EMF_t*                m_EMF     = NULL;
+    std::vector<Species>* m_Species = NULL;
+
+};
+
+} // End NameSpace
+
+#endif
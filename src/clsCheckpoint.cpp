@@ -0,0 +1,390 @@
+/**
+ *  ReyPIC – Checkpoint Source
+ * ============================
+ *  Writes and reads checkpoints that a run can be restarted from.
+ *
+ *  A checkpoint is a directory step_<step> holding one binary file per node, which is written with
+ *  a few large sequential writes and without any communication beyond agreeing on success. Each
+ *  file holds, in native byte order:
+ *  1. A header with the node count, node layout, grid size, step and time.
+ *  2. The node boundaries of each dimension, and the seed and particle count of each species.
+ *  3. The E, B and J arrays of the node, including guard cells.
+ *  4. For each species, the x1, x2, x3, u1, u2, u3 and w arrays, followed by the tags.
+ *  When all nodes have written their file, the master points the file latest at the new directory
+ *  and removes the previous one, so an interrupted checkpoint never replaces a good one.
+ *  The random generators are only used when loading particles, with a stream per cell derived from
+ *  the species seed, so there is no generator state to save. The seeds are stored instead, and
+ *  must match on restart.
+ *  A restart requires the same number of nodes, node layout, grid size, guard cells, species and
+ *  seeds, and a time that matches tmin and dt. The node boundaries, which load balancing may have
+ *  moved, are taken from the checkpoint.
+ */
+
+#include "clsCheckpoint.hpp"
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace reypic;
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Constructor
+ * ===================
+ */
+
+Checkpoint::Checkpoint() {
+
+    // Read MPI setup
+    MPI_Comm_size(MPI_COMM_WORLD, &m_MPISize);
+    MPI_Comm_rank(MPI_COMM_WORLD, &m_MPIRank);
+    m_isMaster = (m_MPIRank == 0);
+
+}
+
+// ********************************************************************************************** //
+//                                       Main Class Methods                                       //
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Setup
+ * =================
+ *  Reads the checkpoint settings from the simulation section of the input file
+ */
+
+error_t Checkpoint::Setup(Input_t* simInput) {
+
+    error_t errVal = ERR_NONE;
+
+    errVal = simInput->ReadVariable(INPUT_SIM, 0, "checkpoint", &m_Every, INVAR_INT);
+    if(errVal != ERR_NONE) return errVal;
+
+    errVal = simInput->ReadVariable(INPUT_SIM, 0, "checkpath", &m_Path, INVAR_STRING);
+    if(errVal != ERR_NONE) return errVal;
+
+    errVal = simInput->ReadVariable(INPUT_SIM, 0, "restart", &m_Restart, INVAR_INT);
+    if(errVal != ERR_NONE) return errVal;
+
+    if(m_Every < 0) m_Every = 0;
+
+    if(m_isMaster) {
+        if(m_Every > 0) {
+            printf("  Checkpoints: every %d steps to %s/\n", m_Every, m_Path.c_str());
+        }
+        if(m_Restart) {
+            printf("  Restart: from %s/\n", m_Path.c_str());
+        }
+    }
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Write
+ * =================
+ *  Writes the checkpoint of step iStep at time dTime. All nodes must call it. Returns ERR_EXEC on
+ *  all nodes if any node failed, in which case the previous checkpoint is kept.
+ */
+
+error_t Checkpoint::Write(index_t iStep, double_t dTime, Grid_t* simGrid, vector<Species>& vSpecies) {
+
+    double_t tStart = MPI_Wtime();
+
+    string_t sDir = stepDir(iStep);
+    if(m_isMaster) {
+        mkdir(m_Path.c_str(), 0755);
+        mkdir(sDir.c_str(), 0755);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    header  tHead;
+    vint_t  vNodes  = simGrid->getNodes();
+    vint_t  vCoords = simGrid->getCoords();
+    vint_t  vNGrid  = simGrid->getGlobalCells();
+    index_t nField  = simGrid->getFieldSize();
+    int32_t nSpecies = (int32_t)vSpecies.size();
+
+    memset(&tHead, 0, sizeof(tHead));
+    strncpy(tHead.aMagic, CHK_MAGIC, sizeof(tHead.aMagic));
+    tHead.nRanks     = m_MPISize;
+    tHead.iRank      = m_MPIRank;
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        tHead.aNodes[iDim]  = vNodes[iDim];
+        tHead.aCoords[iDim] = vCoords[iDim];
+        tHead.aNGrid[iDim]  = vNGrid[iDim];
+    }
+    tHead.nGuards    = simGrid->getGuards();
+    tHead.nSpecies   = nSpecies;
+    tHead.nFields    = CHK_FIELDS;
+    tHead.nFieldSize = nField;
+    tHead.iStep      = iStep;
+    tHead.dTime      = dTime;
+
+    vint_t          vBounds;
+    vint_t          vSeed(nSpecies);
+    vector<index_t> vCount(nSpecies);
+    for(const vint_t& vDim : simGrid->getBounds()) {
+        vBounds.insert(vBounds.end(), vDim.begin(), vDim.end());
+    }
+    for(int32_t iS=0; iS<nSpecies; iS++) {
+        vSeed[iS]  = vSpecies[iS].getSeed();
+        vCount[iS] = vSpecies[iS].Part.getSize();
+    }
+
+    const double_t* aFields[CHK_FIELDS] = {simGrid->E1, simGrid->E2, simGrid->E3,
+                                           simGrid->B1, simGrid->B2, simGrid->B3,
+                                           simGrid->J1, simGrid->J2, simGrid->J3};
+
+    // Write this node's file
+    bool    isOK   = true;
+    index_t nBytes = 0;
+    string_t sFile = rankFile(sDir, m_MPIRank);
+    FILE*   pFile  = fopen(sFile.c_str(), "wb");
+
+    auto writeBlock = [&](const void* pData, size_t nSize) {
+        if(isOK && nSize > 0) isOK = (fwrite(pData, 1, nSize, pFile) == nSize);
+        nBytes += nSize;
+    };
+
+    if(pFile == NULL) {
+        isOK = false;
+    } else {
+        writeBlock(&tHead, sizeof(tHead));
+        writeBlock(vBounds.data(), vBounds.size()*sizeof(int32_t));
+        writeBlock(vSeed.data(), nSpecies*sizeof(int32_t));
+        writeBlock(vCount.data(), nSpecies*sizeof(index_t));
+        for(int32_t iF=0; iF<CHK_FIELDS; iF++) {
+            writeBlock(aFields[iF], nField*sizeof(double_t));
+        }
+        for(int32_t iS=0; iS<nSpecies; iS++) {
+            Particles_t& tPart = vSpecies[iS].Part;
+            const double_t* aPart[7] = {tPart.X1, tPart.X2, tPart.X3, tPart.U1, tPart.U2, tPart.U3, tPart.W};
+            for(int32_t iA=0; iA<7; iA++) {
+                writeBlock(aPart[iA], vCount[iS]*sizeof(double_t));
+            }
+            writeBlock(tPart.Tag, vCount[iS]*sizeof(index_t));
+        }
+        if(fclose(pFile) != 0) isOK = false;
+    }
+
+    int32_t isFailed = !isOK, isAnyFailed = 0;
+    MPI_Allreduce(&isFailed, &isAnyFailed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    if(isAnyFailed) {
+        if(m_isMaster) printf("  Checkpoint Error: writing %s failed\n", sDir.c_str());
+        return ERR_EXEC;
+    }
+
+    // Point latest at the new checkpoint, then remove the previous one
+    if(m_isMaster) {
+        string_t sLatest = m_Path + "/latest";
+        string_t sTemp   = sLatest + ".tmp";
+        FILE*    pLatest = fopen(sTemp.c_str(), "w");
+        if(pLatest != NULL) {
+            fprintf(pLatest, "%s\n", sDir.substr(m_Path.size()+1).c_str());
+            fclose(pLatest);
+            rename(sTemp.c_str(), sLatest.c_str());
+        }
+        if(m_LastDir != "" && m_LastDir != sDir) {
+            for(int32_t iRank=0; iRank<m_MPISize; iRank++) {
+                remove(rankFile(m_LastDir, iRank).c_str());
+            }
+            rmdir(m_LastDir.c_str());
+        }
+    }
+    m_LastDir = sDir;
+
+    double_t dBytes = (double_t)nBytes, dSum = 0.0;
+    MPI_Reduce(&dBytes, &dSum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    m_Count++;
+    m_Bytes += dSum;
+    m_Time  += MPI_Wtime() - tStart;
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Read
+ * ================
+ *  Reads the latest checkpoint into the grid and species, after checking that it matches the
+ *  current setup, and returns its step and time. All nodes must call it. The species are left with
+ *  their tiles and node boundaries to be updated by Species::Rebalance().
+ */
+
+error_t Checkpoint::Read(Grid_t* simGrid, vector<Species>& vSpecies, index_t* pStep, double_t* pTime) {
+
+    // The master finds the latest checkpoint
+    char cDir[256] = "";
+    if(m_isMaster) {
+        FILE* pLatest = fopen((m_Path + "/latest").c_str(), "r");
+        if(pLatest != NULL) {
+            if(fscanf(pLatest, "%255s", cDir) != 1) cDir[0] = '\0';
+            fclose(pLatest);
+        }
+    }
+    MPI_Bcast(cDir, sizeof(cDir), MPI_CHAR, 0, MPI_COMM_WORLD);
+    if(cDir[0] == '\0') {
+        if(m_isMaster) printf("  Checkpoint Error: no checkpoint found in %s/\n", m_Path.c_str());
+        return ERR_SETUP;
+    }
+
+    string_t sDir  = m_Path + "/" + cDir;
+    string_t sFile = rankFile(sDir, m_MPIRank);
+    FILE*    pFile = fopen(sFile.c_str(), "rb");
+    bool     isOK  = (pFile != NULL);
+
+    auto readBlock = [&](void* pData, size_t nSize) {
+        if(isOK && nSize > 0) isOK = (fread(pData, 1, nSize, pFile) == nSize);
+    };
+
+    // Check the header against the current setup
+    header tHead;
+    memset(&tHead, 0, sizeof(tHead));
+    readBlock(&tHead, sizeof(tHead));
+
+    vint_t  vNodes   = simGrid->getNodes();
+    vint_t  vCoords  = simGrid->getCoords();
+    vint_t  vNGrid   = simGrid->getGlobalCells();
+    int32_t nSpecies = (int32_t)vSpecies.size();
+
+    bool isMatch = isOK && strncmp(tHead.aMagic, CHK_MAGIC, sizeof(tHead.aMagic)) == 0;
+    isMatch = isMatch && tHead.nRanks == m_MPISize && tHead.iRank == m_MPIRank;
+    for(int32_t iDim=0; iDim<3 && isMatch; iDim++) {
+        isMatch = tHead.aNodes[iDim] == vNodes[iDim] && tHead.aCoords[iDim] == vCoords[iDim] &&
+                  tHead.aNGrid[iDim] == vNGrid[iDim];
+    }
+    isMatch = isMatch && tHead.nGuards == simGrid->getGuards() && tHead.nSpecies == nSpecies &&
+              tHead.nFields == CHK_FIELDS;
+
+    vint_t          vBounds(isMatch ? vNodes[0]+vNodes[1]+vNodes[2]+3 : 0);
+    vint_t          vSeed(isMatch ? nSpecies : 0);
+    vector<index_t> vCount(isMatch ? nSpecies : 0);
+    readBlock(vBounds.data(), vBounds.size()*sizeof(int32_t));
+    readBlock(vSeed.data(), vSeed.size()*sizeof(int32_t));
+    readBlock(vCount.data(), vCount.size()*sizeof(index_t));
+    for(int32_t iS=0; iS<nSpecies && isMatch; iS++) {
+        isMatch = (vSeed[iS] == vSpecies[iS].getSeed());
+    }
+
+    // The boundaries must be the same in every file
+    vint_t vMaster = vBounds;
+    vMaster.resize(vNodes[0]+vNodes[1]+vNodes[2]+3, 0);
+    MPI_Bcast(vMaster.data(), (int)vMaster.size(), MPI_INT, 0, MPI_COMM_WORLD);
+    isMatch = isMatch && (vMaster == vBounds);
+
+    int32_t aLocal[2] = {!isOK, !isMatch}, aAny[2];
+    MPI_Allreduce(aLocal, aAny, 2, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    if(aAny[0] || aAny[1]) {
+        if(pFile != NULL) fclose(pFile);
+        if(m_isMaster) {
+            if(aAny[0]) {
+                printf("  Checkpoint Error: cannot read %s on all nodes\n", sDir.c_str());
+            } else {
+                printf("  Checkpoint Error: %s does not match the nodes, grid or species of this run\n",
+                       sDir.c_str());
+            }
+        }
+        return ERR_SETUP;
+    }
+
+    // Restore the node boundaries, then the fields
+    vector<vint_t> vGridBounds(3);
+    index_t        iPos = 0;
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        vGridBounds[iDim].assign(vBounds.begin()+iPos, vBounds.begin()+iPos+vNodes[iDim]+1);
+        iPos += vNodes[iDim]+1;
+    }
+
+    error_t errVal  = simGrid->SetBounds(vGridBounds);
+    int32_t isBad   = (errVal != ERR_NONE || tHead.nFieldSize != simGrid->getFieldSize());
+    int32_t isAnyBad = 0;
+    MPI_Allreduce(&isBad, &isAnyBad, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    if(isAnyBad) {
+        fclose(pFile);
+        if(m_isMaster) printf("  Checkpoint Error: node boundaries in %s are not valid\n", sDir.c_str());
+        return ERR_SETUP;
+    }
+
+    double_t* aFields[CHK_FIELDS] = {simGrid->E1, simGrid->E2, simGrid->E3,
+                                     simGrid->B1, simGrid->B2, simGrid->B3,
+                                     simGrid->J1, simGrid->J2, simGrid->J3};
+    for(int32_t iF=0; iF<CHK_FIELDS; iF++) {
+        readBlock(aFields[iF], tHead.nFieldSize*sizeof(double_t));
+    }
+
+    // Replace the particles
+    for(int32_t iS=0; iS<nSpecies && isOK; iS++) {
+        Particles_t& tPart = vSpecies[iS].Part;
+        tPart.Clear();
+        if(!tPart.Resize(vCount[iS])) {
+            isOK = false;
+            break;
+        }
+        double_t* aPart[7] = {tPart.X1, tPart.X2, tPart.X3, tPart.U1, tPart.U2, tPart.U3, tPart.W};
+        for(int32_t iA=0; iA<7; iA++) {
+            readBlock(aPart[iA], vCount[iS]*sizeof(double_t));
+        }
+        readBlock(tPart.Tag, vCount[iS]*sizeof(index_t));
+    }
+    fclose(pFile);
+
+    int32_t isFailed = !isOK, isAnyFailed = 0;
+    MPI_Allreduce(&isFailed, &isAnyFailed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    if(isAnyFailed) {
+        if(m_isMaster) printf("  Checkpoint Error: reading %s failed\n", sDir.c_str());
+        return ERR_SETUP;
+    }
+
+    m_LastDir = sDir;
+    *pStep    = tHead.iStep;
+    *pTime    = tHead.dTime;
+
+    if(m_isMaster) {
+        printf("  Restarted from %s at step %lu\n", sDir.c_str(), (unsigned long)tHead.iStep);
+    }
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+//                                        Member Functions                                        //
+// ********************************************************************************************** //
+
+/**
+ *  Step Directory
+ * ================
+ *  Returns the directory of the checkpoint of step iStep
+ */
+
+string_t Checkpoint::stepDir(index_t iStep) {
+
+    char cName[32];
+    snprintf(cName, sizeof(cName), "step_%06lu", (unsigned long)iStep);
+
+    return m_Path + "/" + cName;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Rank File
+ * ===========
+ *  Returns the file of node iRank in checkpoint directory sDir
+ */
+
+string_t Checkpoint::rankFile(const string_t& sDir, int32_t iRank) {
+
+    char cName[32];
+    snprintf(cName, sizeof(cName), "/rank_%05d.chk", iRank);
+
+    return sDir + cName;
+}
+
+// ********************************************************************************************** //
+
+// End Class Checkpoint
@@ -0,0 +1,103 @@
+/**
+ * ReyPIC – Checkpoint Header
+ */
+
+#ifndef CLASS_CHECKPOINT
+#define CLASS_CHECKPOINT
+
+// Class-specific macros
+#define CHK_MAGIC    "RPCHK01"  // First bytes of each checkpoint file, with the format version
+#define CHK_FIELDS   9          // Field arrays in a checkpoint: E, B and J
+
+#include "config.hpp"
+
+#include "clsInput.hpp"
+#include "clsGrid.hpp"
+#include "clsSpecies.hpp"
+
+namespace reypic {
+
+class Checkpoint {
+
+public:
+
+   /**
+    * Constructor/Destructor
+    */
+
+    Checkpoint();
+    ~Checkpoint() {};
+
+   /**
+    * Setters/Getters/Checks
+    */
+
+    double_t getTime()  const {return m_Time;};
+    int32_t  getCount() const {return m_Count;};
+    double_t getBytes() const {return m_Bytes;};
+
+    bool     isRestart() const {return m_Restart != 0;};
+    bool     isCheckpointStep(index_t iStep) const {return m_Every > 0 && iStep % m_Every == 0;};
+
+   /**
+    * Methods
+    */
+
+    error_t Setup(Input_t*);
+    error_t Write(index_t, double_t, Grid_t*, std::vector<Species>&);
+    error_t Read(Grid_t*, std::vector<Species>&, index_t*, double_t*);
+
+private:
+
+   /**
+    * Structs
+    */
+
+    // Fixed part of the file of one node
+    struct header {
+        char     aMagic[8];
+        int32_t  nRanks;
+        int32_t  iRank;
+        int32_t  aNodes[3];
+        int32_t  aCoords[3];
+        int32_t  aNGrid[3];
+        int32_t  nGuards;
+        int32_t  nSpecies;
+        int32_t  nFields;
+        index_t  nFieldSize;                  // Values per field array, including guards
+        index_t  iStep;                       // Steps done
+        double_t dTime;                       // Simulation time
+    };
+
+   /**
+    * Member Functions
+    */
+
+    string_t stepDir(index_t);
+    string_t rankFile(const string_t&, int32_t);
+
+   /**
+    * Member Variables
+    */
+
+    int32_t   m_MPISize  =  0;
+    int32_t   m_MPIRank  = -1;
+    bool      m_isMaster = false;
+
+    // Settings
+    int32_t   m_Every    = 0;                 // [checkpoint] Steps between checkpoints, 0 for none
+    string_t  m_Path     = "checkpoint";      // [checkpath]  Directory of the checkpoints
+    int32_t   m_Restart  = 0;                 // [restart]    Start from the latest checkpoint if not 0
+
+    string_t  m_LastDir  = "";                // Directory of the last checkpoint written
+
+    // Statistics
+    double_t  m_Time     = 0.0;               // Time spent in Write()
+    int32_t   m_Count    = 0;                 // Checkpoints written
+    double_t  m_Bytes    = 0.0;               // Bytes written by all nodes
+
+}; // End Class Checkpoint
+
+} // End NameSpace
+
+#endif
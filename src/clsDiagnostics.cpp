@@ -0,0 +1,756 @@
+/**
+ *  ReyPIC – Diagnostics Source
+ * =============================
+ *  Writes the grid fields and the particle phase space to one shared file per dump.
+ *
+ *  Each dump file starts with the length of its text header in bytes as an 8 byte integer, and the
+ *  header describing the layout. The header is padded to a multiple of 8 bytes and followed by the
+ *  global cell edges of each dimension, the fields, and the particles:
+ *  - Each field is a global array of the interior cells with x1 running fastest. Every node writes
+ *    its own block of it through a subarray file view, in one collective write per field.
+ *  - Each species is written as DIAG_ARRAYS arrays over all its particles, in the order x1, x2,
+ *    x3, u1, u2, u3, w and tag. The particles of a node follow those of the lower ranks.
+ *  All values are 8 bytes in native byte order, and nothing is gathered on a single node.
+ *  The particle arrays are written in rounds of at most [chunk] MB per node, while each field goes
+ *  out in a single write. [chunk] is also given to MPI-IO as the collective buffer size, so MPI-IO
+ *  splits the field writes into pieces of that size itself.
+ *
+ *  A dump is first copied into a staging buffer, so the simulation can carry on while it is
+ *  written. With [async], a writer thread on each node writes the staged dumps in order, and the
+ *  main loop only pays for the copy. There are [queue] buffers, which keep their allocations. When
+ *  all are busy, the nodes agree to either wait for one (a late dump) or, with [drop], skip the
+ *  dump. The writer threads make collective MPI-IO calls on their own communicator, which needs
+ *  MPI_THREAD_MULTIPLE, so without it the dumps are written synchronously.
+ *
+ *  Every [history] steps, the particle count, kinetic energy and largest |u| of each species, the
+ *  field energy and the fewest and most particles on a node are reduced over all nodes, and the
+ *  master adds a line to history.txt. The values of a step go out in a single non-blocking
+ *  reduction, which is completed at the next step, so it does not hold up the main loop.
+ */
+
+#include "clsDiagnostics.hpp"
+#include <sys/stat.h>
+#include <cerrno>
+
+using namespace std;
+using namespace reypic;
+
+static const int32_t DIAG_FIELDS = 9;
+static const char*   aFieldNames[DIAG_FIELDS] = {"e1", "e2", "e3", "b1", "b2", "b3", "j1", "j2", "j3"};
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Constructor
+ * ===================
+ */
+
+Diagnostics::Diagnostics() {
+
+    int32_t iRank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &iRank);
+    m_isMaster = (iRank == 0);
+
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Destructor
+ * ==================
+ */
+
+Diagnostics::~Diagnostics() {
+
+    Finish();
+    Free();
+}
+
+// ********************************************************************************************** //
+//                                       Main Class Methods                                       //
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Setup
+ * =================
+ *  Reads the diagnostics section of the input file. Without the section, or with every = 0, no
+ *  dumps are written. The master creates the output directory if it does not exist.
+ */
+
+error_t Diagnostics::Setup(Input_t* simInput, Grid_t* simGrid, vector<Species>& vSpecies) {
+
+    error_t errVal = ERR_NONE;
+
+    Free();
+
+    m_Fields.assign(aFieldNames, aFieldNames+DIAG_FIELDS);
+
+    errVal = simInput->ReadVariable(INPUT_DIAG, 0, "every", &m_Every, INVAR_INT);
+    if(errVal != ERR_NONE) return errVal;
+
+    errVal = simInput->ReadVariable(INPUT_DIAG, 0, "path", &m_Path, INVAR_STRING);
+    if(errVal != ERR_NONE) return errVal;
+
+    errVal = simInput->ReadVariable(INPUT_DIAG, 0, "fields", &m_Fields, INVAR_VSTRING);
+    if(errVal != ERR_NONE) return errVal;
+
+    errVal = simInput->ReadVariable(INPUT_DIAG, 0, "particles", &m_Particles, INVAR_INT);
+    if(errVal != ERR_NONE) return errVal;
+
+    errVal = simInput->ReadVariable(INPUT_DIAG, 0, "chunk", &m_Chunk, INVAR_INT);
+    if(errVal != ERR_NONE) return errVal;
+
+    errVal = simInput->ReadVariable(INPUT_DIAG, 0, "async", &m_Async, INVAR_INT);
+    if(errVal != ERR_NONE) return errVal;
+
+    errVal = simInput->ReadVariable(INPUT_DIAG, 0, "queue", &m_Depth, INVAR_INT);
+    if(errVal != ERR_NONE) return errVal;
+
+    errVal = simInput->ReadVariable(INPUT_DIAG, 0, "drop", &m_Drop, INVAR_INT);
+    if(errVal != ERR_NONE) return errVal;
+
+    errVal = simInput->ReadVariable(INPUT_DIAG, 0, "history", &m_History, INVAR_INT);
+    if(errVal != ERR_NONE) return errVal;
+
+    if(m_Every < 0) m_Every = 0;
+    if(m_History < 0) m_History = 0;
+    if(m_Chunk < 1 || m_Chunk > 1024) {
+        if(m_isMaster) printf("  Diagnostics Error: chunk must be between 1 and 1024 MB\n");
+        return ERR_SETUP;
+    }
+    if(m_Depth < 1) {
+        if(m_isMaster) printf("  Diagnostics Error: queue must be at least 1\n");
+        return ERR_SETUP;
+    }
+
+    // Fields by name
+    m_FieldIdx.clear();
+    for(const string_t& sField : m_Fields) {
+        int32_t iField = -1;
+        for(int32_t iF=0; iF<DIAG_FIELDS; iF++) {
+            if(sField == aFieldNames[iF]) iField = iF;
+        }
+        if(iField < 0) {
+            if(m_isMaster) printf("  Diagnostics Error: unknown field '%s'\n", sField.c_str());
+            return ERR_SETUP;
+        }
+        m_FieldIdx.push_back(iField);
+    }
+
+    m_NGrid = simGrid->getGlobalCells();
+    m_Edges = simGrid->gridEdge;
+    m_Species.clear();
+    for(auto& tSpecies : vSpecies) {
+        m_Species.push_back(tSpecies.getName());
+    }
+
+    MPI_Comm_dup(simGrid->getComm(), &m_Comm);
+    MPI_Comm_dup(simGrid->getComm(), &m_IOComm);
+
+    if(m_History > 0 || m_Every > 0) {
+        int32_t isMade = 1;
+        if(m_isMaster) {
+            struct stat tStat;
+            if(mkdir(m_Path.c_str(), 0755) != 0 && errno != EEXIST) isMade = 0;
+            if(stat(m_Path.c_str(), &tStat) != 0 || !S_ISDIR(tStat.st_mode)) isMade = 0;
+        }
+        MPI_Bcast(&isMade, 1, MPI_INT, 0, m_Comm);
+        if(!isMade) {
+            if(m_isMaster) printf("  Diagnostics Error: cannot create the directory %s\n", m_Path.c_str());
+            return ERR_SETUP;
+        }
+    }
+
+    if(m_History > 0) {
+        if(!m_Reduce.Setup(simGrid->getComm())) {
+            if(m_isMaster) printf("  Diagnostics Error: could not create the history reduction\n");
+            return ERR_SETUP;
+        }
+        if(m_isMaster) {
+            printf("  History: every %d steps to %s/history.txt\n", m_History, m_Path.c_str());
+        }
+    }
+
+    if(m_Every == 0) {
+        if(m_isMaster) printf("  Dumps: none\n");
+        return ERR_NONE;
+    }
+
+    int32_t iLevel = MPI_THREAD_SINGLE;
+    MPI_Query_thread(&iLevel);
+    if(m_Async && iLevel < MPI_THREAD_MULTIPLE) {
+        if(m_isMaster) printf("  Warning: MPI library does not support MPI_THREAD_MULTIPLE, writing synchronously\n");
+        m_Async = 0;
+    }
+    if(!m_Async) m_Depth = 1;
+
+    m_Buffers.assign(m_Depth, dump());
+    m_Busy.assign(m_Depth, 0);
+    m_Queue.clear();
+    m_WriteErr = ERR_NONE;
+    m_Stop     = false;
+
+    if(m_isMaster) {
+        printf("  Dumps: every %d steps to %s/\n", m_Every, m_Path.c_str());
+        printf("  Fields: %d, particles: %s\n", (int)m_FieldIdx.size(), (m_Particles ? "yes" : "no"));
+        printf("  Collective writes: %d MB per node\n", m_Chunk);
+        if(m_Async) {
+            printf("  Asynchronous: %d buffers, %s when full\n", m_Depth, (m_Drop ? "drop" : "wait"));
+        } else {
+            printf("  Asynchronous: no\n");
+        }
+    }
+    MPI_Barrier(m_Comm);
+
+    if(m_Async) {
+        m_Writer = thread(&Diagnostics::writer, this, simGrid->getPool());
+    }
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Write
+ * =================
+ *  Writes the dump of step iStep at time dTime, or queues it for the writer thread. All nodes must
+ *  call it. Returns ERR_DIAG if this or an earlier queued dump failed.
+ */
+
+error_t Diagnostics::Write(index_t iStep, double_t dTime, Grid_t* simGrid, vector<Species>& vSpecies) {
+
+    double_t tStart = MPI_Wtime();
+
+    if(!m_Async) {
+        stageDump(iStep, dTime, simGrid, vSpecies, m_Buffers[0]);
+        error_t errVal = writeDump(m_Buffers[0]);
+        m_WriteTime += MPI_Wtime() - tStart;
+        m_Time      += MPI_Wtime() - tStart;
+        return errVal;
+    }
+
+    // All nodes must agree on failing, waiting or dropping, or the collective calls would not match
+    int32_t iBuf;
+    int32_t aLocal[2], aAny[2];
+    {
+        lock_guard<mutex> lHold(m_Lock);
+        iBuf      = freeBuffer();
+        aLocal[0] = (m_WriteErr != ERR_NONE);
+        aLocal[1] = (iBuf < 0);
+    }
+    MPI_Allreduce(aLocal, aAny, 2, MPI_INT, MPI_MAX, m_Comm);
+    if(aAny[0]) return ERR_DIAG;
+
+    if(aAny[1]) {
+        if(m_Drop) {
+            m_Dropped++;
+            m_Time += MPI_Wtime() - tStart;
+            return ERR_NONE;
+        }
+        m_Late++;
+        {
+            unique_lock<mutex> lHold(m_Lock);
+            m_Freed.wait(lHold, [&]() {return (iBuf = freeBuffer()) >= 0 || m_WriteErr != ERR_NONE;});
+            aLocal[0] = (m_WriteErr != ERR_NONE);
+        }
+        MPI_Allreduce(aLocal, aAny, 1, MPI_INT, MPI_MAX, m_Comm);
+        if(aAny[0]) return ERR_DIAG;
+    }
+
+    stageDump(iStep, dTime, simGrid, vSpecies, m_Buffers[iBuf]);
+    {
+        lock_guard<mutex> lHold(m_Lock);
+        m_Busy[iBuf] = 1;
+        m_Queue.push_back(iBuf);
+        m_MaxDepth = max(m_MaxDepth, (int32_t)m_Queue.size());
+    }
+    m_Wake.notify_one();
+
+    m_Time += MPI_Wtime() - tStart;
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: History
+ * ===================
+ *  Completes the history reduction started at the last call and writes its line. If iStep is a
+ *  history step, adds the values of this node and starts the reduction for step iStep at time
+ *  dTime. All nodes must call it every step. Returns ERR_DIAG if the file could not be written.
+ */
+
+error_t Diagnostics::History(index_t iStep, double_t dTime, Grid_t* simGrid, vector<Species>& vSpecies) {
+
+    if(m_History == 0) return ERR_NONE;
+
+    double_t tStart = MPI_Wtime();
+
+    error_t errVal = ERR_NONE;
+    if(m_Reduce.Complete()) errVal = writeHistory();
+
+    if(iStep % m_History == 0) {
+
+        index_t nNode = 0;
+        for(auto& tSpecies : vSpecies) {
+            double_t dEnergy, dMaxU;
+            tSpecies.Moments(simGrid, &dEnergy, &dMaxU);
+            m_Reduce.Add(RED_SUM, (double_t)tSpecies.Part.getSize());
+            m_Reduce.Add(RED_SUM, dEnergy);
+            m_Reduce.Add(RED_MAX, dMaxU);
+            nNode += tSpecies.Part.getSize();
+        }
+
+        // Field energy of the local cells
+        vint_t   vCells = simGrid->getLocalCells();
+        vint_t   vStart = simGrid->getLocalStart();
+        double_t dEnergyE = 0.0, dEnergyB = 0.0;
+        for(int32_t i3=0; i3<vCells[2]; i3++) {
+            for(int32_t i2=0; i2<vCells[1]; i2++) {
+                double_t dArea = simGrid->gridDelta[1][vStart[1]+i2]*simGrid->gridDelta[2][vStart[2]+i3];
+                index_t  iIdx  = simGrid->fieldIndex(0, i2, i3);
+                for(int32_t i1=0; i1<vCells[0]; i1++) {
+                    double_t dVol = 0.5*dArea*simGrid->gridDelta[0][vStart[0]+i1];
+                    index_t  iC   = iIdx+i1;
+                    dEnergyE += dVol*(simGrid->E1[iC]*simGrid->E1[iC] + simGrid->E2[iC]*simGrid->E2[iC] +
+                                      simGrid->E3[iC]*simGrid->E3[iC]);
+                    dEnergyB += dVol*(simGrid->B1[iC]*simGrid->B1[iC] + simGrid->B2[iC]*simGrid->B2[iC] +
+                                      simGrid->B3[iC]*simGrid->B3[iC]);
+                }
+            }
+        }
+        m_Reduce.Add(RED_SUM, dEnergyE);
+        m_Reduce.Add(RED_SUM, dEnergyB);
+        m_Reduce.Add(RED_MIN, (double_t)nNode);
+        m_Reduce.Add(RED_MAX, (double_t)nNode);
+
+        m_HistStep = iStep;
+        m_HistAt   = dTime;
+        m_Reduce.Start();
+    }
+
+    m_HistTime += MPI_Wtime() - tStart;
+
+    return errVal;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Finish
+ * ==================
+ *  Writes the last history line, waits for the queued dumps to be written and stops the writer
+ *  thread. Must be called before MPI_Finalize. Returns ERR_DIAG if a queued dump or the history
+ *  failed.
+ */
+
+error_t Diagnostics::Finish() {
+
+    int32_t isFinalized = 0;
+    MPI_Finalized(&isFinalized);
+
+    error_t errHist = ERR_NONE;
+    if(!isFinalized && m_Reduce.Complete()) errHist = writeHistory();
+    if(m_HistFile != NULL) {
+        fclose(m_HistFile);
+        m_HistFile = NULL;
+    }
+
+    if(!m_Writer.joinable()) return errHist;
+
+    double_t tStart = MPI_Wtime();
+
+    {
+        lock_guard<mutex> lHold(m_Lock);
+        m_Stop = true;
+    }
+    m_Wake.notify_one();
+    m_Writer.join();
+
+    m_Time += MPI_Wtime() - tStart;
+
+    return (m_WriteErr != ERR_NONE ? m_WriteErr : errHist);
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Free
+ * ================
+ *  Releases the communicators and the history reduction
+ */
+
+void Diagnostics::Free() {
+
+    int32_t isFinalized = 0;
+    MPI_Finalized(&isFinalized);
+    if(isFinalized) return;
+
+    m_Reduce.Free();
+
+    if(m_Comm != MPI_COMM_NULL) {
+        MPI_Comm_free(&m_Comm);
+    }
+    if(m_IOComm != MPI_COMM_NULL) {
+        MPI_Comm_free(&m_IOComm);
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+//                                        Member Functions                                        //
+// ********************************************************************************************** //
+
+/**
+ *  Stage Dump
+ * ============
+ *  Copies the interior of the written fields and the particle arrays into tDump, and finds where
+ *  this node's particles go in the file. The buffers keep their allocations between dumps.
+ */
+
+void Diagnostics::stageDump(index_t iStep, double_t dTime, Grid_t* simGrid, vector<Species>& vSpecies,
+                            dump& tDump) {
+
+    tDump.iStep  = iStep;
+    tDump.dTime  = dTime;
+    tDump.vStart = simGrid->getLocalStart();
+    tDump.vCells = simGrid->getLocalCells();
+
+    const double_t* aGrid[DIAG_FIELDS] = {simGrid->E1, simGrid->E2, simGrid->E3,
+                                          simGrid->B1, simGrid->B2, simGrid->B3,
+                                          simGrid->J1, simGrid->J2, simGrid->J3};
+
+    vint_t  vCells = tDump.vCells;
+    index_t nLocal = (index_t)vCells[0]*vCells[1]*vCells[2];
+
+    tDump.vFields.resize(m_FieldIdx.size());
+    for(size_t iF=0; iF<m_FieldIdx.size(); iF++) {
+        tDump.vFields[iF].resize(nLocal);
+        const double_t* pSrc = aGrid[m_FieldIdx[iF]];
+        double_t*       pDst = tDump.vFields[iF].data();
+        for(int32_t i3=0; i3<vCells[2]; i3++) {
+            for(int32_t i2=0; i2<vCells[1]; i2++) {
+                memcpy(pDst, pSrc + simGrid->fieldIndex(0, i2, i3), vCells[0]*sizeof(double_t));
+                pDst += vCells[0];
+            }
+        }
+    }
+
+    // Particles, with the tags stored bit for bit in the last array
+    int32_t nSpecies = (m_Particles ? (int32_t)vSpecies.size() : 0);
+    tDump.vCount.assign(nSpecies, 0);
+    tDump.vOffset.assign(nSpecies, 0);
+    tDump.vTotal.assign(nSpecies, 0);
+    tDump.vRounds.assign(nSpecies, 0);
+    tDump.vPart.resize(nSpecies);
+
+    for(int32_t iS=0; iS<nSpecies; iS++) {
+        Particles_t& tPart = vSpecies[iS].Part;
+        index_t      nPart = tPart.getSize();
+        const double_t* aSrc[DIAG_ARRAYS-1] = {tPart.X1, tPart.X2, tPart.X3,
+                                               tPart.U1, tPart.U2, tPart.U3, tPart.W};
+        tDump.vCount[iS] = nPart;
+        tDump.vPart[iS].resize(DIAG_ARRAYS*nPart);
+        double_t* pDst = tDump.vPart[iS].data();
+        for(int32_t iA=0; iA<DIAG_ARRAYS-1; iA++) {
+            memcpy(pDst + iA*nPart, aSrc[iA], nPart*sizeof(double_t));
+        }
+        memcpy(pDst + (DIAG_ARRAYS-1)*nPart, tPart.Tag, nPart*sizeof(index_t));
+    }
+
+    if(nSpecies > 0) {
+        vector<index_t> vMax(nSpecies, 0);
+        MPI_Exscan(tDump.vCount.data(), tDump.vOffset.data(), nSpecies, MPI_UINT64_T, MPI_SUM, m_Comm);
+        MPI_Allreduce(tDump.vCount.data(), tDump.vTotal.data(), nSpecies, MPI_UINT64_T, MPI_SUM, m_Comm);
+        MPI_Allreduce(tDump.vCount.data(), vMax.data(), nSpecies, MPI_UINT64_T, MPI_MAX, m_Comm);
+
+        int32_t iRank;
+        MPI_Comm_rank(m_Comm, &iRank);
+        if(iRank == 0) tDump.vOffset.assign(nSpecies, 0);
+
+        index_t nPerRound = ((index_t)m_Chunk << 20)/sizeof(double_t);
+        for(int32_t iS=0; iS<nSpecies; iS++) {
+            tDump.vRounds[iS] = (vMax[iS] + nPerRound - 1)/nPerRound;
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Write Dump
+ * ============
+ *  Writes tDump to its file with collective MPI-IO. The master writes the header and the cell
+ *  edges. Returns ERR_DIAG on all nodes if any node failed.
+ */
+
+error_t Diagnostics::writeDump(const dump& tDump) {
+
+    char cFile[1024];
+    snprintf(cFile, sizeof(cFile), "%s/dump_%06lu.rpd", m_Path.c_str(), (unsigned long)tDump.iStep);
+
+    // The offsets in the header depend on its length, so it is redone until the data start fits
+    uint64_t nHead = 0;
+    index_t  iData = sizeof(uint64_t);
+    string_t sHeader;
+    while(true) {
+        sHeader = headerText(tDump, iData);
+        nHead   = (sHeader.size() + 7)/8*8;
+        if(sizeof(uint64_t) + nHead <= iData) break;
+        iData = sizeof(uint64_t) + nHead;
+    }
+    nHead = iData - sizeof(uint64_t);
+    sHeader.resize(nHead, ' ');
+
+    MPI_Info tInfo;
+    MPI_Info_create(&tInfo);
+    MPI_Info_set(tInfo, "cb_buffer_size", to_string((index_t)m_Chunk << 20).c_str());
+
+    MPI_File tFile;
+    int32_t  errMPI = MPI_File_open(m_IOComm, cFile, MPI_MODE_CREATE | MPI_MODE_WRONLY, tInfo, &tFile);
+    if(errMPI != MPI_SUCCESS) {
+        MPI_Info_free(&tInfo);
+        if(m_isMaster) printf("  Diagnostics Error: cannot open %s\n", cFile);
+        return ERR_DIAG;
+    }
+    MPI_File_set_size(tFile, 0);
+
+    int32_t    isFailed = 0;
+    MPI_Status tStatus;
+
+    // Header and cell edges
+    MPI_Offset iPos = iData;
+    if(m_isMaster) {
+        errMPI = MPI_File_write_at(tFile, 0, &nHead, 1, MPI_UINT64_T, &tStatus);
+        isFailed |= (errMPI != MPI_SUCCESS);
+        errMPI = MPI_File_write_at(tFile, sizeof(uint64_t), sHeader.data(), (int)nHead, MPI_CHAR, &tStatus);
+        isFailed |= (errMPI != MPI_SUCCESS);
+    }
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        int32_t nEdges = (int32_t)m_Edges[iDim].size();
+        if(m_isMaster) {
+            errMPI = MPI_File_write_at(tFile, iPos, m_Edges[iDim].data(), nEdges, MPI_DOUBLE, &tStatus);
+            isFailed |= (errMPI != MPI_SUCCESS);
+        }
+        iPos += nEdges*sizeof(double_t);
+    }
+
+    // Fields, each node writing its block through a subarray view
+    int32_t aGlobal[3] = {m_NGrid[0], m_NGrid[1], m_NGrid[2]};
+    int32_t aLocal[3]  = {tDump.vCells[0], tDump.vCells[1], tDump.vCells[2]};
+    int32_t aStart[3]  = {tDump.vStart[0], tDump.vStart[1], tDump.vStart[2]};
+    int32_t nLocal     = aLocal[0]*aLocal[1]*aLocal[2];
+    index_t nGlobal    = (index_t)aGlobal[0]*aGlobal[1]*aGlobal[2];
+
+    MPI_Datatype tBlock;
+    MPI_Type_create_subarray(3, aGlobal, aLocal, aStart, MPI_ORDER_FORTRAN, MPI_DOUBLE, &tBlock);
+    MPI_Type_commit(&tBlock);
+
+    for(size_t iF=0; iF<tDump.vFields.size(); iF++) {
+        MPI_File_set_view(tFile, iPos, MPI_DOUBLE, tBlock, "native", tInfo);
+        errMPI = MPI_File_write_all(tFile, tDump.vFields[iF].data(), nLocal, MPI_DOUBLE, &tStatus);
+        isFailed |= (errMPI != MPI_SUCCESS);
+        iPos += nGlobal*sizeof(double_t);
+    }
+
+    MPI_File_set_view(tFile, 0, MPI_BYTE, MPI_BYTE, "native", tInfo);
+    MPI_Type_free(&tBlock);
+
+    // Particles, array by array in rounds of at most m_Chunk MB
+    index_t nPerRound = ((index_t)m_Chunk << 20)/sizeof(double_t);
+    for(size_t iS=0; iS<tDump.vCount.size(); iS++) {
+        index_t nCount = tDump.vCount[iS];
+        for(int32_t iA=0; iA<DIAG_ARRAYS; iA++) {
+            const double_t* pSrc  = tDump.vPart[iS].data() + iA*nCount;
+            MPI_Offset      iBase = iPos + (iA*tDump.vTotal[iS] + tDump.vOffset[iS])*sizeof(double_t);
+            for(index_t iR=0; iR<tDump.vRounds[iS]; iR++) {
+                index_t iFrom = min(nCount, iR*nPerRound);
+                index_t nSize = min(nCount, iFrom+nPerRound) - iFrom;
+                errMPI = MPI_File_write_at_all(tFile, iBase + iFrom*sizeof(double_t), pSrc + iFrom,
+                                               (int)nSize, MPI_DOUBLE, &tStatus);
+                isFailed |= (errMPI != MPI_SUCCESS);
+            }
+        }
+        iPos += DIAG_ARRAYS*tDump.vTotal[iS]*sizeof(double_t);
+    }
+
+    MPI_File_close(&tFile);
+    MPI_Info_free(&tInfo);
+
+    int32_t isAnyFailed = 0;
+    MPI_Allreduce(&isFailed, &isAnyFailed, 1, MPI_INT, MPI_LOR, m_IOComm);
+    if(isAnyFailed) {
+        if(m_isMaster) printf("  Diagnostics Error: writing %s failed\n", cFile);
+        return ERR_DIAG;
+    }
+
+    m_Dumps++;
+    m_Bytes += (double_t)iPos;
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Header Text
+ * =============
+ *  Returns the header of the dump file for tDump, as lines of name = value, with the cell edges
+ *  starting at byte iData. Offsets are in bytes from the start of the file.
+ */
+
+string_t Diagnostics::headerText(const dump& tDump, index_t iData) {
+
+    index_t nGlobal = (index_t)m_NGrid[0]*m_NGrid[1]*m_NGrid[2];
+    index_t iPos    = iData;
+    char    cLine[256];
+
+    string_t sHeader = "ReyPIC dump\n";
+
+    snprintf(cLine, sizeof(cLine), "step = %lu\ntime = %.17g\n", (unsigned long)tDump.iStep, tDump.dTime);
+    sHeader += cLine;
+    snprintf(cLine, sizeof(cLine), "ngrid = %d, %d, %d\nedges = %lu\n",
+             m_NGrid[0], m_NGrid[1], m_NGrid[2], (unsigned long)iPos);
+    sHeader += cLine;
+    iPos += (m_Edges[0].size() + m_Edges[1].size() + m_Edges[2].size())*sizeof(double_t);
+
+    for(int32_t iF : m_FieldIdx) {
+        snprintf(cLine, sizeof(cLine), "field %s = %lu\n", aFieldNames[iF], (unsigned long)iPos);
+        sHeader += cLine;
+        iPos += nGlobal*sizeof(double_t);
+    }
+
+    for(size_t iS=0; iS<tDump.vTotal.size(); iS++) {
+        snprintf(cLine, sizeof(cLine), "species %s = %lu, %lu\n", m_Species[iS].c_str(),
+                 (unsigned long)tDump.vTotal[iS], (unsigned long)iPos);
+        sHeader += cLine;
+        iPos += DIAG_ARRAYS*tDump.vTotal[iS]*sizeof(double_t);
+    }
+
+    sHeader += "end\n";
+
+    return sHeader;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Free Buffer
+ * =============
+ *  Returns the index of a staging buffer that is not queued, or -1. Call with m_Lock held.
+ */
+
+int32_t Diagnostics::freeBuffer() {
+
+    for(int32_t iBuf=0; iBuf<(int32_t)m_Busy.size(); iBuf++) {
+        if(!m_Busy[iBuf]) return iBuf;
+    }
+
+    return -1;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Writer
+ * ========
+ *  Main function of the writer thread. Writes queued dumps in order until stopped and the queue is
+ *  empty. A dump stays in the queue while it is written, so its buffer is not reused.
+ */
+
+void Diagnostics::writer(ThreadPool_t* simPool) {
+
+    simPool->Unpin();
+
+    while(true) {
+
+        int32_t iBuf;
+        {
+            unique_lock<mutex> lHold(m_Lock);
+            m_Wake.wait(lHold, [this]() {return m_Stop || !m_Queue.empty();});
+            if(m_Queue.empty()) return;
+            iBuf = m_Queue.front();
+        }
+
+        double_t tStart = MPI_Wtime();
+        error_t  errVal = writeDump(m_Buffers[iBuf]);
+
+        {
+            lock_guard<mutex> lHold(m_Lock);
+            m_Queue.pop_front();
+            m_Busy[iBuf] = 0;
+            m_WriteTime += MPI_Wtime() - tStart;
+            if(errVal != ERR_NONE) m_WriteErr = errVal;
+        }
+        m_Freed.notify_all();
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Write History
+ * ===============
+ *  Writes the completed history reduction as a line of history.txt. The master opens the file on
+ *  the first line, and starts a new one with a header if that is the first history step. Otherwise,
+ *  as after a restart, it keeps the lines of the earlier steps and drops those from this step on,
+ *  which the run before the restart wrote after its checkpoint. Returns ERR_DIAG if the file could
+ *  not be opened.
+ */
+
+error_t Diagnostics::writeHistory() {
+
+    m_Lines++;
+    if(!m_isMaster) return ERR_NONE;
+
+    if(m_HistFile == NULL) {
+        bool      isNew = (m_HistStep == (index_t)m_History);
+        string_t  sFile = m_Path + "/history.txt";
+        vstring_t vKeep;
+        if(!isNew) {
+            ifstream tOld(sFile);
+            string_t sLine;
+            while(getline(tOld, sLine)) {
+                if(sLine.empty()) continue;
+                if(sLine[0] == '#' || strtoll(sLine.c_str(), NULL, 10) < (long long)m_HistStep) {
+                    vKeep.push_back(sLine);
+                }
+            }
+            isNew = vKeep.empty();
+        }
+        m_HistFile = fopen(sFile.c_str(), "w");
+        if(m_HistFile == NULL) {
+            printf("  Diagnostics Error: could not open %s\n", sFile.c_str());
+            return ERR_DIAG;
+        }
+        for(const string_t& sLine : vKeep) {
+            fprintf(m_HistFile, "%s\n", sLine.c_str());
+        }
+        if(isNew) {
+            fprintf(m_HistFile, "# step time");
+            for(const string_t& sName : m_Species) {
+                fprintf(m_HistFile, " count_%s energy_%s umax_%s", sName.c_str(), sName.c_str(), sName.c_str());
+            }
+            fprintf(m_HistFile, " energy_e energy_b node_min node_max\n");
+        }
+    }
+
+    fprintf(m_HistFile, "%ld %.10e", (long)m_HistStep, m_HistAt);
+    for(int32_t iSlot=0; iSlot<m_Reduce.getSize(); iSlot++) {
+        fprintf(m_HistFile, " %.10e", m_Reduce.getResult(iSlot));
+    }
+    fprintf(m_HistFile, "\n");
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+
+// End Class Diagnostics
@@ -0,0 +1,157 @@
+/**
+ * ReyPIC – Diagnostics Header
+ */
+
+#ifndef CLASS_DIAGNOSTICS
+#define CLASS_DIAGNOSTICS
+
+// Class-specific macros
+#define DIAG_ARRAYS  8      // Arrays per particle in a dump: x1, x2, x3, u1, u2, u3, w and tag
+
+#include "config.hpp"
+
+#include "clsInput.hpp"
+#include "clsGrid.hpp"
+#include "clsSpecies.hpp"
+#include "clsReduction.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+typedef reypic::Reduction Reduction_t;
+
+namespace reypic {
+
+class Diagnostics {
+
+public:
+
+   /**
+    * Constructor/Destructor
+    */
+
+    Diagnostics();
+    Diagnostics(const Diagnostics&) = delete;
+    ~Diagnostics();
+
+    Diagnostics& operator=(const Diagnostics&) = delete;
+
+   /**
+    * Setters/Getters/Checks
+    */
+
+    double_t getTime()      const {return m_Time;};
+    double_t getWriteTime() const {return m_WriteTime;};
+    int32_t  getDumps()     const {return m_Dumps;};
+    double_t getBytes()     const {return m_Bytes;};
+    int32_t  getLate()      const {return m_Late;};
+    int32_t  getDropped()   const {return m_Dropped;};
+    int32_t  getMaxDepth()  const {return m_MaxDepth;};
+    int32_t  getLines()     const {return m_Lines;};
+    double_t getHistTime()  const {return m_HistTime;};
+    double_t getHistWait()  const {return m_Reduce.getWaitTime();};
+    bool     isAsync()      const {return m_Async != 0;};
+
+    bool     isDumpStep(index_t iStep) const {return m_Every > 0 && iStep % m_Every == 0;};
+
+   /**
+    * Methods
+    */
+
+    error_t Setup(Input_t*, Grid_t*, std::vector<Species>&);
+    error_t Write(index_t, double_t, Grid_t*, std::vector<Species>&);
+    error_t History(index_t, double_t, Grid_t*, std::vector<Species>&);
+    error_t Finish();
+    void    Free();
+
+private:
+
+   /**
+    * Structs
+    */
+
+    // The data of one dump, copied out of the grid and species
+    struct dump {
+        index_t              iStep  = 0;
+        double_t             dTime  = 0.0;
+        vint_t               vStart = {0, 0, 0};  // Global index of the first local cell
+        vint_t               vCells = {0, 0, 0};  // Local cells
+        vvdouble_t           vFields;             // Interior of each field, x1 fastest
+        std::vector<index_t> vCount;              // Particles per species on this node
+        std::vector<index_t> vOffset;             // Particles per species on lower ranks
+        std::vector<index_t> vTotal;              // Particles per species on all nodes
+        std::vector<index_t> vRounds;             // Collective writes per particle array
+        vvdouble_t           vPart;               // Particle arrays per species, back to back
+    };
+
+   /**
+    * Member Functions
+    */
+
+    void    stageDump(index_t, double_t, Grid_t*, std::vector<Species>&, dump&);
+    error_t writeDump(const dump&);
+    string_t headerText(const dump&, index_t);
+    int32_t freeBuffer();
+    error_t writeHistory();
+    void    writer(ThreadPool_t*);
+
+   /**
+    * Member Variables
+    */
+
+    bool        m_isMaster  = false;
+    MPI_Comm    m_Comm      = MPI_COMM_NULL;      // Private copy of the grid communicator for staging
+    MPI_Comm    m_IOComm    = MPI_COMM_NULL;      // Private copy of the grid communicator for writing
+
+    // Settings
+    int32_t     m_Every     = 0;                  // [every]     Steps between dumps, 0 for none
+    string_t    m_Path      = ".";                // [path]      Directory of the dump files
+    vstring_t   m_Fields;                         // [fields]    Names of the fields to write
+    int32_t     m_Particles = 1;                  // [particles] Write particles if not 0
+    int32_t     m_Chunk     = 64;                 // [chunk]     MB per collective write
+    int32_t     m_Async     = 0;                  // [async]     Write on a separate thread if not 0
+    int32_t     m_Depth     = 2;                  // [queue]     Staging buffers for async writes
+    int32_t     m_Drop      = 0;                  // [drop]      Skip dumps when all buffers are busy
+    int32_t     m_History   = 0;                  // [history]   Steps between history lines, 0 for none
+
+    vint_t      m_FieldIdx;                       // Index into aFieldNames of each written field
+    vint_t      m_NGrid     = {0, 0, 0};          // Global cells
+    vvdouble_t  m_Edges;                          // Global cell edges per dimension
+    vstring_t   m_Species;                        // Species names
+
+    std::vector<dump> m_Buffers;                  // Staging buffers, reused between dumps
+
+    // History of scalars, reduced over nodes while the next step runs
+    Reduction_t m_Reduce;
+    FILE*       m_HistFile  = NULL;               // Opened by the master on the first line
+    index_t     m_HistStep  = 0;                  // Step of the reduction in flight
+    double_t    m_HistAt    = 0.0;                // Time of the reduction in flight
+
+    // Writer thread state, guarded by m_Lock
+    std::thread             m_Writer;
+    std::mutex              m_Lock;
+    std::condition_variable m_Wake;               // Signals a queued dump or stop to the writer
+    std::condition_variable m_Freed;              // Signals a buffer becoming free
+    std::deque<int32_t>     m_Queue;              // Buffers waiting or being written, in order
+    std::vector<char>       m_Busy;               // Buffers in the queue
+    error_t                 m_WriteErr = ERR_NONE;
+    bool                    m_Stop     = false;
+
+    // Statistics
+    double_t    m_Time      = 0.0;                // Time spent in Write() and Finish()
+    double_t    m_WriteTime = 0.0;                // Time spent writing files
+    int32_t     m_Dumps     = 0;                  // Dumps written
+    double_t    m_Bytes     = 0.0;                // Bytes written by all nodes
+    int32_t     m_Late      = 0;                  // Dumps that waited for a free buffer
+    int32_t     m_Dropped   = 0;                  // Dumps skipped because no buffer was free
+    int32_t     m_MaxDepth  = 0;                  // Most dumps queued at once
+    int32_t     m_Lines     = 0;                  // History lines written
+    double_t    m_HistTime  = 0.0;                // Time spent in History()
+
+}; // End Class Diagnostics
+
+} // End NameSpace
+
+#endif
@@ -0,0 +1,434 @@
+/**
+ *  ReyPIC – EMF Source
+ * =====================
+ *  Advances E and B on the grid with the Yee FDTD scheme.
+ *
+ *  The grid nodes are the cell corners. As for the current from the deposition, E1 at (i1,i2,i3)
+ *  lies on the edge from node i1 to i1+1 at nodes i2 and i3, and similarly for E2 and E3. B1 at
+ *  (i1,i2,i3) lies on the face at node i1 between nodes i2 to i2+1 and i3 to i3+1, and similarly
+ *  for B2 and B3. On the non-uniform grid, the curl of E then uses the cell widths, and the curl
+ *  of B the node spacings, as in the integral form of the Maxwell equations.
+ *  The box boundaries are perfect conductors.
+ */
+
+#include "clsEMF.hpp"
+#include <algorithm>
+
+using namespace std;
+using namespace reypic;
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Constructor
+ * ===================
+ */
+
+EMF::EMF() {
+
+    int32_t iRank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &iRank);
+    m_isMaster = (iRank == 0);
+
+}
+
+// ********************************************************************************************** //
+//                                       Main Class Methods                                       //
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Setup
+ * =================
+ *  Reads the emf section and sets up the solver for the time step dt. Fails if dt is above the
+ *  Courant limit of the smallest cells.
+ */
+
+error_t EMF::Setup(Input_t* simInput, Grid_t* simGrid, double_t dt) {
+
+    error_t errVal = ERR_NONE;
+
+    m_TimeStep = dt;
+
+    string_t sSolver = "yee";
+    errVal = simInput->ReadVariable(INPUT_EMF, 0, "solver", &sSolver, INVAR_STRING);
+    if(errVal != ERR_NONE) return errVal;
+    if(sSolver == "yee") {
+        m_Solver = EMF_YEE;
+    } else
+    if(sSolver == "none") {
+        m_Solver = EMF_NONE;
+    } else {
+        if(m_isMaster) {
+            printf("  EMF Error: Unknown solver '%s' (yee or none)\n", sSolver.c_str());
+        }
+        return ERR_SETUP;
+    }
+
+    errVal = simInput->ReadVariable(INPUT_EMF, 0, "blocksize", &m_BlockSize, INVAR_VINT);
+    if(errVal != ERR_NONE) return errVal;
+    if(m_BlockSize.size() != 2 || m_BlockSize[0] < 0 || m_BlockSize[1] < 0) {
+        if(m_isMaster) {
+            printf("  EMF Error: blocksize must be two values of 0 or more\n");
+        }
+        return ERR_SETUP;
+    }
+
+    if(m_Solver == EMF_NONE) {
+        if(m_isMaster) printf("  Field solver: none\n");
+        return ERR_NONE;
+    }
+
+    // Courant condition on the smallest cell in each dimension
+    double_t dSum = 0.0;
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        const vdouble_t& vDelta = simGrid->gridDelta[iDim];
+        double_t dMin = *min_element(vDelta.begin(), vDelta.end());
+        dSum += 1.0/(dMin*dMin);
+    }
+    double_t dCourant = dt*sqrt(dSum);
+    if(dCourant >= 1.0) {
+        if(m_isMaster) {
+            printf("  EMF Error: Time step %g is above the Courant limit %g of the smallest cells\n",
+                   dt, 1.0/sqrt(dSum));
+        }
+        return ERR_SETUP;
+    }
+
+    Rebalance(simGrid);
+
+    if(m_isMaster) {
+        printf("  Field solver: Yee FDTD, Courant number %.3f\n", dCourant);
+        string_t sBlock1 = (m_BlockSize[0] > 0 ? to_string(m_BlockSize[0]) : "all");
+        string_t sBlock2 = (m_BlockSize[1] > 0 ? to_string(m_BlockSize[1]) : "all");
+        printf("  Solver blocks: %s x %s cells in x1 and x2\n", sBlock1.c_str(), sBlock2.c_str());
+    }
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Advance
+ * ===================
+ *  Advances E and B by one time step with the current on the grid. B takes two half steps around
+ *  the full step of E, so that both are at the same time for the next push. Expects the guard
+ *  cells of E to be up to date, and leaves those of B out of date.
+ *  The sweep after each guard cell exchange overlaps with it, see haloSweep().
+ */
+
+void EMF::Advance(Grid_t* simGrid) {
+
+    if(m_Solver == EMF_NONE) return;
+
+    double_t dStart = MPI_Wtime();
+
+    advanceB(simGrid, EMF_SWEEP_ALL);
+    haloSweep(&m_HaloB, [&](value_t iPart) {advanceE(simGrid, iPart);});
+    applyConductor(simGrid);
+    haloSweep(&m_HaloE, [&](value_t iPart) {advanceB(simGrid, iPart);});
+
+    m_Time += MPI_Wtime() - dStart;
+    m_Steps++;
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Rebalance
+ * =====================
+ *  Sets up the coefficients and guard cell exchanges for the current node box and field arrays.
+ *  Must be called after the grid boundaries moved.
+ */
+
+void EMF::Rebalance(Grid_t* simGrid) {
+
+    if(m_Solver == EMF_NONE) return;
+
+    setupCoefficients(simGrid);
+
+    m_HaloE.Setup(simGrid->getComm(), simGrid->getLocalCells(), simGrid->getGuards(),
+                  {simGrid->E1, simGrid->E2, simGrid->E3});
+    m_HaloB.Setup(simGrid->getComm(), simGrid->getLocalCells(), simGrid->getGuards(),
+                  {simGrid->B1, simGrid->B2, simGrid->B3});
+
+    return;
+}
+
+// ********************************************************************************************** //
+//                                        Member Functions                                        //
+// ********************************************************************************************** //
+
+/**
+ *  Setup Coefficients
+ * ====================
+ *  Precomputes the factors of the curl stencils, so the sweeps do not divide. Guard cells outside
+ *  the box use the width of the end cell.
+ */
+
+void EMF::setupCoefficients(Grid_t* simGrid) {
+
+    vint_t     vDims   = simGrid->getFieldDims();
+    vint_t     vStart  = simGrid->getLocalStart();
+    vint_t     vCells  = simGrid->getGlobalCells();
+    int32_t    nGuards = simGrid->getGuards();
+    vvdouble_t vDual   = simGrid->getInvDual();
+
+    m_CoefB.assign(3, vdouble_t());
+    m_CoefE.assign(3, vdouble_t());
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        m_CoefB[iDim].resize(vDims[iDim]);
+        m_CoefE[iDim].resize(vDims[iDim]);
+        for(int32_t i=0; i<vDims[iDim]; i++) {
+            int32_t iCell = min(max(i - nGuards + vStart[iDim], 0), vCells[iDim]-1);
+            m_CoefB[iDim][i] = 0.5*m_TimeStep/simGrid->gridDelta[iDim][iCell];
+            m_CoefE[iDim][i] = m_TimeStep*vDual[iDim][i];
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Advance B
+ * ===========
+ *  Half step of B = B - dt/2 curl E on the iPart cells. The stencil reads E one cell above.
+ */
+
+void EMF::advanceB(Grid_t* simGrid, value_t iPart) {
+
+    double_t*       pB1 = simGrid->B1;
+    double_t*       pB2 = simGrid->B2;
+    double_t*       pB3 = simGrid->B3;
+    const double_t* pE1 = simGrid->E1;
+    const double_t* pE2 = simGrid->E2;
+    const double_t* pE3 = simGrid->E3;
+
+    int32_t         nGuards = simGrid->getGuards();
+    const double_t* pC1 = m_CoefB[0].data() + nGuards;
+    const double_t* pC2 = m_CoefB[1].data() + nGuards;
+    const double_t* pC3 = m_CoefB[2].data() + nGuards;
+
+    vint_t  vDims = simGrid->getFieldDims();
+    index_t nS2   = vDims[0];
+    index_t nS3   = (index_t)vDims[0]*vDims[1];
+
+    sweep(simGrid, [=](index_t iIdx, int32_t i1, int32_t nRow, int32_t i2, int32_t i3) {
+
+        double_t* __restrict__       b1 = pB1 + iIdx;
+        double_t* __restrict__       b2 = pB2 + iIdx;
+        double_t* __restrict__       b3 = pB3 + iIdx;
+        const double_t* __restrict__ e1 = pE1 + iIdx;
+        const double_t* __restrict__ e2 = pE2 + iIdx;
+        const double_t* __restrict__ e3 = pE3 + iIdx;
+        const double_t* __restrict__ c1 = pC1 + i1;
+        double_t                     c2 = pC2[i2];
+        double_t                     c3 = pC3[i3];
+
+        for(int32_t k=0; k<nRow; k++) {
+            b1[k] += c3*(e2[k+nS3] - e2[k]) - c2*(e3[k+nS2] - e3[k]);
+            b2[k] += c1[k]*(e3[k+1] - e3[k]) - c3*(e1[k+nS3] - e1[k]);
+            b3[k] += c2*(e1[k+nS2] - e1[k]) - c1[k]*(e2[k+1] - e2[k]);
+        }
+    }, iPart, 0, 1);
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Advance E
+ * ===========
+ *  Full step of E = E + dt (curl B - J) on the iPart cells. The stencil reads B one cell below.
+ */
+
+void EMF::advanceE(Grid_t* simGrid, value_t iPart) {
+
+    double_t*       pE1 = simGrid->E1;
+    double_t*       pE2 = simGrid->E2;
+    double_t*       pE3 = simGrid->E3;
+    const double_t* pB1 = simGrid->B1;
+    const double_t* pB2 = simGrid->B2;
+    const double_t* pB3 = simGrid->B3;
+    const double_t* pJ1 = simGrid->J1;
+    const double_t* pJ2 = simGrid->J2;
+    const double_t* pJ3 = simGrid->J3;
+
+    int32_t         nGuards = simGrid->getGuards();
+    const double_t* pC1 = m_CoefE[0].data() + nGuards;
+    const double_t* pC2 = m_CoefE[1].data() + nGuards;
+    const double_t* pC3 = m_CoefE[2].data() + nGuards;
+
+    vint_t   vDims = simGrid->getFieldDims();
+    index_t  nS2   = vDims[0];
+    index_t  nS3   = (index_t)vDims[0]*vDims[1];
+    double_t dt    = m_TimeStep;
+
+    sweep(simGrid, [=](index_t iIdx, int32_t i1, int32_t nRow, int32_t i2, int32_t i3) {
+
+        double_t* __restrict__       e1 = pE1 + iIdx;
+        double_t* __restrict__       e2 = pE2 + iIdx;
+        double_t* __restrict__       e3 = pE3 + iIdx;
+        const double_t* __restrict__ b1 = pB1 + iIdx;
+        const double_t* __restrict__ b2 = pB2 + iIdx;
+        const double_t* __restrict__ b3 = pB3 + iIdx;
+        const double_t* __restrict__ j1 = pJ1 + iIdx;
+        const double_t* __restrict__ j2 = pJ2 + iIdx;
+        const double_t* __restrict__ j3 = pJ3 + iIdx;
+        const double_t* __restrict__ c1 = pC1 + i1;
+        double_t                     c2 = pC2[i2];
+        double_t                     c3 = pC3[i3];
+
+        for(int32_t k=0; k<nRow; k++) {
+            e1[k] += c2*(b3[k] - b3[k-nS2]) - c3*(b2[k] - b2[k-nS3]) - dt*j1[k];
+            e2[k] += c3*(b1[k] - b1[k-nS3]) - c1[k]*(b3[k] - b3[k-1]) - dt*j2[k];
+            e3[k] += c1[k]*(b2[k] - b2[k-1]) - c2*(b1[k] - b1[k-nS2]) - dt*j3[k];
+        }
+    }, iPart, 1, 0);
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Apply Conductor
+ * =================
+ *  Zeroes the components of E along the lower box boundaries owned by this node. Along the upper
+ *  boundaries, they are in the guard cells outside the box, which stay zero.
+ */
+
+void EMF::applyConductor(Grid_t* simGrid) {
+
+    vint_t vStart = simGrid->getLocalStart();
+    vint_t vCells = simGrid->getLocalCells();
+
+    double_t* pE[3] = {simGrid->E1, simGrid->E2, simGrid->E3};
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        if(vStart[iDim] > 0) continue;
+
+        // The other two dimensions span the boundary plane
+        int32_t iA = (iDim+1) % 3;
+        int32_t iB = (iDim+2) % 3;
+        for(int32_t b=0; b<vCells[iB]; b++) {
+            for(int32_t a=0; a<vCells[iA]; a++) {
+                int32_t aIdx[3];
+                aIdx[iDim] = 0;
+                aIdx[iA]   = a;
+                aIdx[iB]   = b;
+                index_t iIdx = simGrid->fieldIndex(aIdx[0], aIdx[1], aIdx[2]);
+                pE[iA][iIdx] = 0.0;
+                pE[iB][iIdx] = 0.0;
+            }
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Halo Sweep
+ * ============
+ *  Exchanges the guard cells of pHalo and then calls fSweep(iPart) on the cells that need them.
+ *  With overlap, fSweep first does the inner cells while the exchange runs, and then the cells
+ *  next to the boundary once it has finished. Otherwise the exchange completes first, and fSweep
+ *  does all cells.
+ */
+
+template<typename F> void EMF::haloSweep(Halo_t* pHalo, const F& fSweep) {
+
+    double_t dTick = MPI_Wtime();
+    if(!m_Overlap) {
+        pHalo->Exchange();
+        m_HaloTime += MPI_Wtime() - dTick;
+        fSweep(EMF_SWEEP_ALL);
+        return;
+    }
+
+    pHalo->Start();
+    m_HaloTime += MPI_Wtime() - dTick;
+
+    fSweep(EMF_SWEEP_INNER);
+
+    dTick = MPI_Wtime();
+    pHalo->Finish();
+    m_HaloTime += MPI_Wtime() - dTick;
+
+    fSweep(EMF_SWEEP_OUTER);
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Sweep
+ * =======
+ *  Calls fRow(iIdx, i1, nRow, i2, i3) for rows of the local cells, where the row starts at local
+ *  cell (i1,i2,i3) with field index iIdx and has nRow cells along x1.
+ *  The node threads each take a slab of x3 planes. Within it, the rows are grouped in blocks of
+ *  m_BlockSize cells in x1 and x2, and each block is swept through the whole slab before the next,
+ *  so the planes a stencil reads around a row are still in cache when the next plane needs them.
+ *  Blocking x1 shortens the unit stride rows, which costs more in prefetching than it gains unless
+ *  a few rows of all arrays do not fit in cache, so by default only x2 is blocked.
+ *  The inner cells are those at least iLow cells above the lower and iHigh cells below the upper
+ *  end of the local cells in every dimension, and iPart selects all cells, only the inner ones, or
+ *  only the rest.
+ */
+
+template<typename F> void EMF::sweep(Grid_t* simGrid, const F& fRow, value_t iPart, int32_t iLow,
+                                     int32_t iHigh) {
+
+    vint_t  vCells   = simGrid->getLocalCells();
+    int32_t nThreads = simGrid->getThreads();
+
+    int32_t nBlock1 = (m_BlockSize[0] > 0 ? min(m_BlockSize[0], vCells[0]) : vCells[0]);
+    int32_t nBlock2 = (m_BlockSize[1] > 0 ? min(m_BlockSize[1], vCells[1]) : vCells[1]);
+
+    // Splits a row of the block into its inner part and the cells on either side of it
+    auto fPart = [&](int32_t i1, int32_t nRow, int32_t i2, int32_t i3) {
+        if(iPart == EMF_SWEEP_ALL) {
+            fRow(simGrid->fieldIndex(i1, i2, i3), i1, nRow, i2, i3);
+            return;
+        }
+        bool    isInner = (i2 >= iLow && i2 < vCells[1]-iHigh && i3 >= iLow && i3 < vCells[2]-iHigh);
+        int32_t iFrom   = (isInner ? min(max(i1, iLow), i1+nRow) : i1+nRow);
+        int32_t iTo     = (isInner ? max(min(i1+nRow, vCells[0]-iHigh), iFrom) : i1+nRow);
+        if(iPart == EMF_SWEEP_INNER) {
+            if(iTo > iFrom) fRow(simGrid->fieldIndex(iFrom, i2, i3), iFrom, iTo-iFrom, i2, i3);
+            return;
+        }
+        if(iFrom > i1)     fRow(simGrid->fieldIndex(i1, i2, i3), i1, iFrom-i1, i2, i3);
+        if(iTo < i1+nRow)  fRow(simGrid->fieldIndex(iTo, i2, i3), iTo, i1+nRow-iTo, i2, i3);
+    };
+
+    simGrid->getPool()->Run([&](int32_t iT) {
+        int32_t iFrom = (vCells[2]*iT)/nThreads;
+        int32_t iTo   = (vCells[2]*(iT+1))/nThreads;
+        for(int32_t iB2=0; iB2<vCells[1]; iB2+=nBlock2) {
+            int32_t iEnd2 = min(iB2+nBlock2, vCells[1]);
+            for(int32_t iB1=0; iB1<vCells[0]; iB1+=nBlock1) {
+                int32_t nRow = min(nBlock1, vCells[0]-iB1);
+                for(int32_t i3=iFrom; i3<iTo; i3++) {
+                    for(int32_t i2=iB2; i2<iEnd2; i2++) {
+                        fPart(iB1, nRow, i2, i3);
+                    }
+                }
+            }
+        }
+    });
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+// End Class EMF
@@ -0,0 +1,105 @@
+/**
+ * ReyPIC – EMF Header
+ */
+
+#ifndef CLASS_EMF
+#define CLASS_EMF
+
+// Class-specific macros
+#define EMF_NONE        0   // Fields are left as they are
+#define EMF_YEE         1   // Yee FDTD solver
+#define EMF_CELL_BYTES  240 // Bytes read and written per cell in a full step, with perfect cache reuse
+#define EMF_SWEEP_ALL   0   // Sweep all local cells
+#define EMF_SWEEP_INNER 1   // Sweep the cells whose stencil does not reach the guard cells
+#define EMF_SWEEP_OUTER 2   // Sweep the cells whose stencil reaches the guard cells
+
+#include "config.hpp"
+
+#include "clsInput.hpp"
+#include "clsGrid.hpp"
+#include "clsHalo.hpp"
+
+typedef reypic::Input Input_t;
+typedef reypic::Grid  Grid_t;
+typedef reypic::Halo  Halo_t;
+
+namespace reypic {
+
+class EMF {
+
+public:
+
+   /**
+    * Constructor/Destructor
+    */
+
+    EMF();
+    ~EMF() {};
+
+   /**
+    * Setters/Getters/Checks
+    */
+
+    void     setQuiet()          {m_isMaster = false;};
+    void     setOverlap(bool isOverlap) {m_Overlap = isOverlap;};
+
+    double_t getTime()     const {return m_Time;};
+    double_t getTimeStep() const {return m_TimeStep;};
+    double_t getHaloTime() const {return m_HaloTime;};
+    int32_t  getSteps()    const {return m_Steps;};
+    vint_t   getBlockSize() const {return m_BlockSize;};
+
+    bool     isActive()    const {return m_Solver != EMF_NONE;};
+
+   /**
+    * Methods
+    */
+
+    error_t Setup(Input_t*, Grid_t*, double_t);
+    void    Advance(Grid_t*);
+    void    Rebalance(Grid_t*);
+
+private:
+
+   /**
+    * Member Functions
+    */
+
+    void setupCoefficients(Grid_t*);
+    void advanceB(Grid_t*, value_t);
+    void advanceE(Grid_t*, value_t);
+    void applyConductor(Grid_t*);
+
+    template<typename F> void haloSweep(Halo_t*, const F&);
+    template<typename F> void sweep(Grid_t*, const F&, value_t iPart=EMF_SWEEP_ALL, int32_t iLow=0,
+                                    int32_t iHigh=0);
+
+   /**
+    * Member Variables
+    */
+
+    bool       m_isMaster  = false;
+
+    // Settings
+    value_t    m_Solver    = EMF_YEE;        // [solver]    Field solver
+    vint_t     m_BlockSize = {0, 8};         // [blocksize] Cells per block in x1 and x2, 0 for all
+    double_t   m_TimeStep  = 1.0;            //             Time step of the simulation
+    bool       m_Overlap   = true;           //             Sweep the inner cells during exchanges
+
+    // Coefficients per local field index including guards, per dimension
+    vvdouble_t m_CoefB;                      // Half time step over the cell width
+    vvdouble_t m_CoefE;                      // Time step over the node spacing
+
+    Halo_t     m_HaloE;                      // Guard cell exchange for E only
+    Halo_t     m_HaloB;                      // Guard cell exchange for B only
+
+    // Statistics
+    double_t   m_Time      = 0.0;            // Time spent in Advance()
+    double_t   m_HaloTime  = 0.0;            // Time spent exchanging guard cells in Advance()
+    int32_t    m_Steps     = 0;              // Number of steps taken
+
+}; // End Class EMF
+
+} // End NameSpace
+
+#endif
@@ -3,6 +3,7 @@
  */
 
 #include "clsGrid.hpp"
+#include <algorithm>
 
 using namespace std;
 using namespace reypic;
@@ -23,6 +24,56 @@ Grid::Grid() {
 
 }
 
+// ********************************************************************************************** //
+
+/**
+ *  Class Destructor
+ * ==================
+ */
+
+Grid::~Grid() {
+
+    fieldHalo.Free();
+    currentHalo.Free();
+    free(m_FieldData);
+    free(m_CurrData);
+
+    int32_t isFinalized = 0;
+    MPI_Finalized(&isFinalized);
+    if(!isFinalized && m_Comm != MPI_COMM_NULL) MPI_Comm_free(&m_Comm);
+
+}
+
+// ********************************************************************************************** //
+//                                      Setters and Getters                                       //
+// ********************************************************************************************** //
+
+/**
+ *  Local Box Boundaries
+ * ======================
+ *  Returns the lower and upper bounds of the cells owned by this node, excluding guard cells
+ */
+
+vdouble_t Grid::getLocalMin() {
+
+    vdouble_t vMin(3);
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        vMin[iDim] = gridEdge[iDim][m_LocStart[iDim]];
+    }
+
+    return vMin;
+}
+
+vdouble_t Grid::getLocalMax() {
+
+    vdouble_t vMax(3);
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        vMax[iDim] = gridEdge[iDim][m_LocStart[iDim]+m_LocCells[iDim]];
+    }
+
+    return vMax;
+}
+
 // ********************************************************************************************** //
 //                                       Main Class Methods                                       //
 // ********************************************************************************************** //
@@ -33,10 +84,14 @@ Grid::Grid() {
  *  Sets up the grid
  */
 
-error_t Grid::Setup(Input_t* simInput) {
+error_t Grid::Setup(Input_t* simInput, vint_t vNodes, ThreadPool_t* simPool) {
 
     error_t errVal = ERR_NONE;
 
+    m_Nodes   = vNodes;
+    m_Pool    = simPool;
+    m_Threads = simPool->getThreads();
+
     errVal = simInput->ReadVariable(INPUT_GRID, 0, "ngrid", &m_NGrid, INVAR_VINT);
     if(errVal != ERR_NONE) return errVal;
 
@@ -58,16 +113,368 @@ error_t Grid::Setup(Input_t* simInput) {
     errVal = simInput->ReadVariable(INPUT_GRID, 0, "gridfunc", &m_GridFunc, INVAR_VSTRING);
     if(errVal != ERR_NONE) return errVal;
 
+    errVal = simInput->ReadVariable(INPUT_GRID, 0, "guards", &m_Guards, INVAR_INT);
+    if(errVal != ERR_NONE) return errVal;
+
+    string_t sDeposit = "private";
+    errVal = simInput->ReadVariable(INPUT_GRID, 0, "deposit", &sDeposit, INVAR_STRING);
+    if(errVal != ERR_NONE) return errVal;
+    if(sDeposit == "private") {
+        m_Deposit = DEP_PRIVATE;
+    } else
+    if(sDeposit == "colour") {
+        m_Deposit = DEP_COLOUR;
+    } else
+    if(sDeposit == "atomic") {
+        m_Deposit = DEP_ATOMIC;
+    } else {
+        if(m_isMaster) {
+            printf("  Grid Error: Unknown deposit '%s' (private, colour or atomic)\n", sDeposit.c_str());
+        }
+        return ERR_SETUP;
+    }
+
+    errVal = simInput->ReadVariable(INPUT_GRID, 0, "tilesize", &m_TileSize, INVAR_VINT);
+    if(errVal != ERR_NONE) return errVal;
+    if(m_TileSize.size() == 1) {
+        m_TileSize.assign(3, m_TileSize[0]);
+    }
+    if(m_TileSize.size() != 3 || m_TileSize[0] < 0 || m_TileSize[1] < 0 || m_TileSize[2] < 0 ||
+       (m_TileSize[0] == 0) != (m_TileSize[1] == 0) || (m_TileSize[0] == 0) != (m_TileSize[2] == 0)) {
+        if(m_isMaster) {
+            printf("  Grid Error: tilesize must be 0, or one or three positive values\n");
+        }
+        return ERR_SETUP;
+    }
+
     // Set up grid resolution vectors
     if(!setupGridDelta()) return ERR_SETUP;
 
+    // Set up cell edges and lookup table
+    if(!setupCellLookup()) return ERR_SETUP;
+
+    // Split the grid between nodes
+    if(!setupDecomposition()) return ERR_SETUP;
+
+    // Allocate local field arrays
+    if(!setupFields()) return ERR_SETUP;
+
+    // Allocate current buffers
+    if(!setupCurrent()) return ERR_SETUP;
+
     return ERR_NONE;
 }
 
+/**
+ *  Cell Lookup
+ * =============
+ *  Returns the index of the cell in dimension iDim that contains position dX.
+ *  Positions outside the grid are clamped to the first or last cell.
+ *  The bucket table is set up so that a bucket is never wider than the smallest cell, or for
+ *  strongly refined grids at most GRID_BUCKETS buckets per cell on average, so the forward scan
+ *  from the bucket's first cell is usually zero or one step.
+ */
+
+int32_t Grid::cellOf(int32_t iDim, double_t dX) const {
+
+    const vint_t&    vBucket = m_Bucket[iDim];
+    const vdouble_t& vEdge   = gridEdge[iDim];
+    int32_t          nCells  = (int32_t)gridDelta[iDim].size();
+    double_t         dPos    = (dX - vEdge[0])*m_BucketScale[iDim];
+
+    if(!(dPos > 0.0)) return 0;
+    if(dPos >= (double_t)vBucket.size()) return nCells-1;
+
+    int32_t iCell = vBucket[(size_t)dPos];
+    while(iCell < nCells-1 && dX >= vEdge[iCell+1]) iCell++;
+
+    return iCell;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Cell Lookup (Array)
+ * =====================
+ *  Looks up the cells in dimension iDim of nX positions in pX and writes them to pCell
+ */
+
+void Grid::cellOf(int32_t iDim, const double_t* pX, index_t nX, int32_t* pCell) const {
+
+    const int32_t*  pBucket = m_Bucket[iDim].data();
+    const double_t* pEdge   = gridEdge[iDim].data();
+    int32_t         nCells  = (int32_t)gridDelta[iDim].size();
+    double_t        dScale  = m_BucketScale[iDim];
+    double_t        dMax    = (double_t)m_Bucket[iDim].size();
+    double_t        dMin    = pEdge[0];
+
+    for(index_t i=0; i<nX; i++) {
+
+        double_t dPos = (pX[i] - dMin)*dScale;
+        int32_t  iCell;
+
+        if(!(dPos > 0.0)) {
+            iCell = 0;
+        } else
+        if(dPos >= dMax) {
+            iCell = nCells-1;
+        } else {
+            iCell = pBucket[(size_t)dPos];
+            while(iCell < nCells-1 && pX[i] >= pEdge[iCell+1]) iCell++;
+        }
+
+        pCell[i] = iCell;
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Current Arrays
+ * ================
+ *  Writes to pJ the three arrays that thread iThread deposits current into. These are the thread's
+ *  private buffers for the private strategy, and J1, J2, J3 otherwise.
+ *  Deposited values are charge flux through the cell faces. ReduceCurrent() turns them into
+ *  current density.
+ */
+
+void Grid::currentArrays(int32_t iThread, double_t** pJ) {
+
+    double_t* pBase = J1;
+    if(m_CurrData != NULL) {
+        pBase = (double_t*)m_CurrData + 3*(index_t)iThread*m_FieldStride;
+    }
+
+    pJ[0] = pBase;
+    pJ[1] = pBase + m_FieldStride;
+    pJ[2] = pBase + 2*m_FieldStride;
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Clear Current
+ * ===============
+ *  Zeroes J before deposition. With private buffers, J is overwritten by ReduceCurrent() instead,
+ *  and the buffers are zeroed there as they are read.
+ */
+
+void Grid::ClearCurrent() {
+
+    if(m_CurrData != NULL) return;
+
+    memset(J1, 0, 3*m_FieldStride*sizeof(double_t));
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Reduce Current
+ * ================
+ *  Completes the current after all species are deposited:
+ *  1. For the private strategy, the thread buffers are summed into J in parallel. Each thread sums
+ *     one contiguous slice over all buffers and zeroes it for the next step.
+ *  2. Guard cells are added onto the nodes owning them.
+ *  3. The charge flux is divided by the area of the face it passes through, which on the
+ *     non-uniform grid is the product of the node spacings in the other two dimensions. This is
+ *     split over the threads by x3 plane.
+ */
+
+void Grid::ReduceCurrent() {
+
+    if(m_CurrData != NULL) {
+
+        index_t   nTotal = 3*m_FieldStride;
+        index_t   nSlice = ((nTotal + 8*m_Threads - 1)/(8*m_Threads))*8;
+        double_t* pBuf   = (double_t*)m_CurrData;
+
+        m_Pool->Run([=](int32_t iT) {
+            index_t iFrom = min(nTotal, iT*nSlice);
+            index_t iTo   = min(nTotal, iFrom+nSlice);
+            for(index_t i=iFrom; i<iTo; i++) {
+                J1[i] = 0.0;
+            }
+            for(int32_t iB=0; iB<m_Threads; iB++) {
+                double_t* pSrc = pBuf + iB*nTotal;
+                for(index_t i=iFrom; i<iTo; i++) {
+                    J1[i]  += pSrc[i];
+                    pSrc[i] = 0.0;
+                }
+            }
+        });
+    }
+
+    currentHalo.Exchange();
+
+    const double_t* pInv1 = m_InvDual[0].data();
+    const double_t* pInv2 = m_InvDual[1].data();
+    const double_t* pInv3 = m_InvDual[2].data();
+
+    int32_t nPlanes = m_FieldDims[2];
+    m_Pool->Run([=](int32_t iT) {
+        int32_t iFrom = (nPlanes*iT)/m_Threads;
+        int32_t iTo   = (nPlanes*(iT+1))/m_Threads;
+        for(int32_t i3=iFrom; i3<iTo; i3++) {
+            index_t iIdx = (index_t)i3*m_FieldDims[0]*m_FieldDims[1];
+            for(int32_t i2=0; i2<m_FieldDims[1]; i2++) {
+                double_t dA1 = pInv2[i2]*pInv3[i3];
+                for(int32_t i1=0; i1<m_FieldDims[0]; i1++) {
+                    J1[iIdx] *= dA1;
+                    J2[iIdx] *= pInv1[i1]*pInv3[i3];
+                    J3[iIdx] *= pInv1[i1]*pInv2[i2];
+                    iIdx++;
+                }
+            }
+        }
+    });
+
+    return;
+}
+
+// ********************************************************************************************** //
+/**
+ *  Rebalance
+ * ===========
+ *  Moves the node boundaries so that each slab of nodes along a dimension gets an equal share of
+ *  the load in vLoad, which holds the load per global cell plane for each dimension, summed over
+ *  all nodes. Every node must call it with the same loads.
+ *  A boundary only moves within the two nodes next to it, so each new block only overlaps the old
+ *  blocks of itself and its neighbours, and a particle is at most one node away from its new node.
+ *  Blocks keep at least m_Guards cells. The fields are reallocated and the local E and B moved to
+ *  their new nodes, while J and the guard cells are left to be filled by the next step.
+ *  Sets pMoved to whether any boundary moved.
+ */
+
+error_t Grid::Rebalance(const vvdouble_t& vLoad, bool* pMoved) {
+
+    vector<vint_t> vBounds = m_Bounds;
+    *pMoved = false;
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+
+        int32_t nNodes = m_Nodes[iDim];
+        int32_t nGrid  = m_NGrid[iDim];
+        if(nNodes < 2) continue;
+
+        vdouble_t vSum(nGrid+1, 0.0);
+        for(int32_t i=0; i<nGrid; i++) {
+            vSum[i+1] = vSum[i] + vLoad[iDim][i];
+        }
+        if(!(vSum[nGrid] > 0.0)) continue;
+
+        const vint_t& vOld = m_Bounds[iDim];
+        vint_t        vNew = vOld;
+        bool          isValid = true;
+
+        for(int32_t iNode=1; iNode<nNodes; iNode++) {
+
+            // Plane closest to an equal share of the load
+            double_t dTarget = vSum[nGrid]*iNode/nNodes;
+            int32_t  iPlane  = (int32_t)(lower_bound(vSum.begin(), vSum.end(), dTarget) - vSum.begin());
+            if(iPlane > 0 && dTarget-vSum[iPlane-1] < vSum[iPlane]-dTarget) iPlane--;
+
+            int32_t iLow  = max(vNew[iNode-1] + m_Guards, vOld[iNode-1] + 1);
+            int32_t iHigh = min(nGrid - (nNodes-iNode)*m_Guards, vOld[iNode+1] - 1);
+            if(iLow > iHigh) {
+                isValid = false;
+                break;
+            }
+            vNew[iNode] = min(max(iPlane, iLow), iHigh);
+        }
+
+        // Only keep boundaries that lower the largest slab load
+        double_t dOldMax = 0.0, dNewMax = 0.0;
+        for(int32_t iNode=0; iNode<nNodes && isValid; iNode++) {
+            dOldMax = max(dOldMax, vSum[vOld[iNode+1]] - vSum[vOld[iNode]]);
+            dNewMax = max(dNewMax, vSum[vNew[iNode+1]] - vSum[vNew[iNode]]);
+        }
+
+        if(isValid && dNewMax < dOldMax) {
+            vBounds[iDim] = vNew;
+            *pMoved = true;
+        }
+    }
+
+    if(!*pMoved) return ERR_NONE;
+
+    return applyBounds(vBounds, true);
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Set Bounds
+ * ============
+ *  Sets the node boundaries to vBounds, as returned by getBounds() on a grid with the same nodes
+ *  and cells. The fields are reallocated and left zero. Used on restart.
+ */
+
+error_t Grid::SetBounds(const vector<vint_t>& vBounds) {
+
+    if(vBounds.size() != 3) return ERR_SETUP;
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        if(vBounds[iDim].size() != m_Bounds[iDim].size()) return ERR_SETUP;
+        if(vBounds[iDim].front() != 0 || vBounds[iDim].back() != m_NGrid[iDim]) return ERR_SETUP;
+        for(size_t iNode=1; iNode<vBounds[iDim].size(); iNode++) {
+            if(vBounds[iDim][iNode] - vBounds[iDim][iNode-1] < m_Guards) return ERR_SETUP;
+        }
+    }
+
+    if(vBounds == m_Bounds) return ERR_NONE;
+
+    return applyBounds(vBounds, false);
+}
+
 // ********************************************************************************************** //
 //                                        Member Functions                                        //
 // ********************************************************************************************** //
 
+/**
+ *  Apply Bounds
+ * ==============
+ *  Moves the node boundaries to vBounds and reallocates the fields. If doMove is true, the local E
+ *  and B are moved to their new nodes, otherwise the fields are left zero.
+ */
+
+error_t Grid::applyBounds(const vector<vint_t>& vBounds, bool doMove) {
+
+    // Keep the old fields until they are moved
+    vector<vint_t> vOldBounds = m_Bounds;
+    vint_t         vOldStart  = m_LocStart;
+    vint_t         vOldDims   = m_FieldDims;
+    index_t        nOldStride = m_FieldStride;
+    void*          pOldData   = m_FieldData;
+
+    m_FieldData = NULL;
+    m_Bounds    = vBounds;
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        m_LocStart[iDim] = m_Bounds[iDim][m_Coords[iDim]];
+        m_LocCells[iDim] = m_Bounds[iDim][m_Coords[iDim]+1] - m_LocStart[iDim];
+    }
+    m_Rebalances++;
+
+    if(!setupFields()) {
+        free(pOldData);
+        return ERR_EXEC;
+    }
+    if(doMove) {
+        moveFields((const double_t*)pOldData, nOldStride, vOldStart, vOldDims, vOldBounds);
+    }
+    free(pOldData);
+
+    if(!setupCurrent()) return ERR_EXEC;
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+
 /**
  *  The setupGridDelta
  * ====================
@@ -145,6 +552,8 @@ bool Grid::setupGridDelta() {
                 m::linspace(delMin, 2*delAvg-delMin, nGrid-linHigher, aEval+linHigher);
             }
 
+            vEval.assign(aEval, aEval+nGrid);
+
             valMin = m::min(aEval, nGrid);
             valMax = m::max(aEval, nGrid);
 
@@ -170,15 +579,19 @@ bool Grid::setupGridDelta() {
             // Evaluate function by normalisint it to the span of the grid (xMax - xMin)
             // including an offset determined by delMin
 
-            vdouble_t vdEval = {0.0,1.0*nGrid};
+            double_t  aN[nGrid];
+            double_t  aNTot[nGrid];
             double_t  aEval[nGrid] = {0.0};
             double_t  dScale, valMin, valMax, valSum;
 
             for(index_t i=0; i<nGrid; i++) {
-                vdEval[0] = i+0.5;
-                if(!mFunc.Eval(vdEval,&aEval[i])) return false;
+                aN[i]    = i+0.5;
+                aNTot[i] = 1.0*nGrid;
             }
 
+            const double_t* pVars[2] = {aN, aNTot};
+            if(!mFunc.EvalBatch(pVars, nGrid, aEval)) return false;
+
             // Invert array so that highest value gives highest density, and offset to max value
             valMax = m::max(aEval, nGrid);
             m::scale(aEval, nGrid, -1);
@@ -208,4 +621,357 @@ bool Grid::setupGridDelta() {
 
 // ********************************************************************************************** //
 
+/**
+ *  The setupCellLookup
+ * =====================
+ *  Builds the cumulative cell edges and a table of uniform buckets over each axis, holding the
+ *  first cell overlapping each bucket.
+ */
+
+bool Grid::setupCellLookup() {
+
+    gridEdge.assign(3, vdouble_t());
+    m_Bucket.assign(3, vint_t());
+    m_BucketScale.assign(3, 0.0);
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+
+        const vdouble_t& vDelta = gridDelta[iDim];
+        vdouble_t&       vEdge  = gridEdge[iDim];
+        size_t           nCells = vDelta.size();
+
+        if(nCells < 1) return false;
+
+        double_t delMin = m::min(vDelta.data(), nCells);
+        if(delMin <= 0.0) {
+            if(m_isMaster) {
+                printf("  Grid Error: Non-positive cell size in x%d, check gridmin against the grid span\n", iDim+1);
+            }
+            return false;
+        }
+
+        // Cumulative edges, with the last one set to xmax to avoid round-off at the boundary
+        vEdge.resize(nCells+1);
+        vEdge[0] = m_XMin[iDim];
+        for(size_t i=0; i<nCells; i++) {
+            vEdge[i+1] = vEdge[i] + vDelta[i];
+        }
+        vEdge[nCells] = m_XMax[iDim];
+
+        double_t dSpan   = m_XMax[iDim] - m_XMin[iDim];
+        size_t   nBucket = (size_t)ceil(dSpan/delMin);
+        if(nBucket < nCells)              nBucket = nCells;
+        if(nBucket > GRID_BUCKETS*nCells) nBucket = GRID_BUCKETS*nCells;
+
+        m_BucketScale[iDim] = nBucket/dSpan;
+        m_Bucket[iDim].resize(nBucket);
+
+        size_t iCell = 0;
+        for(size_t iB=0; iB<nBucket; iB++) {
+            double_t xBucket = vEdge[0] + iB/m_BucketScale[iDim];
+            while(iCell < nCells-1 && xBucket >= vEdge[iCell+1]) iCell++;
+            m_Bucket[iDim][iB] = (int32_t)iCell;
+        }
+    }
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  The setupDecomposition
+ * ========================
+ *  Splits the grid into a 3D Cartesian grid of nodes. Dimensions set to 0 in the nodes input are
+ *  chosen by MPI_Dims_create. If none are 0, their product must be the number of MPI processes.
+ *  Each node owns a contiguous block of cells, and only allocates its own block plus m_Guards
+ *  layers of guard cells. The blocks are separated by cell planes, and start out with equal
+ *  numbers of cells.
+ */
+
+bool Grid::setupDecomposition() {
+
+    int32_t aDims[3]    = {0, 0, 0};
+    int32_t aPeriods[3] = {0, 0, 0};
+    int32_t nFixed      = 1;
+    int32_t nFree       = 0;
+
+    if(m_Nodes.size() != 3) {
+        if(m_isMaster) {
+            printf("  Grid Error: Invalid nodes entry with %d values (n1, n2, n3)\n", (int)m_Nodes.size());
+        }
+        return false;
+    }
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        aDims[iDim] = m_Nodes[iDim] > 0 ? m_Nodes[iDim] : 0;
+        if(aDims[iDim] > 0) nFixed *= aDims[iDim]; else nFree++;
+    }
+
+    // MPI_Dims_create aborts if the fixed dimensions can not make up all processes
+    if(nFree == 0 && nFixed != m_MPISize) {
+        if(m_isMaster) {
+            printf("  Grid Error: Nodes %d x %d x %d need %d MPI processes, not %d\n",
+                   aDims[0], aDims[1], aDims[2], nFixed, m_MPISize);
+        }
+        return false;
+    }
+
+    if(m_MPISize % nFixed != 0) {
+        if(m_isMaster) {
+            printf("  Grid Error: Nodes %d x %d x %d do not match %d MPI processes\n",
+                   aDims[0], aDims[1], aDims[2], m_MPISize);
+        }
+        return false;
+    }
+
+    MPI_Dims_create(m_MPISize, 3, aDims);
+
+    if(m_Guards < 1) {
+        if(m_isMaster) {
+            printf("  Grid Error: Invalid guards entry %d (guards >= 1)\n", m_Guards);
+        }
+        return false;
+    }
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        if(m_NGrid[iDim] < aDims[iDim]*m_Guards) {
+            if(m_isMaster) {
+                printf("  Grid Error: Too many nodes (%d) in x%d for %d cells and %d guard cells\n",
+                       aDims[iDim], iDim+1, m_NGrid[iDim], m_Guards);
+            }
+            return false;
+        }
+    }
+
+    // Keep world ranks so that m_MPIRank is also the rank in m_Comm
+    MPI_Cart_create(MPI_COMM_WORLD, 3, aDims, aPeriods, 0, &m_Comm);
+    MPI_Cart_coords(m_Comm, m_MPIRank, 3, &m_Coords[0]);
+
+    m_Bounds.assign(3, vint_t());
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        index_t nGrid = m_NGrid[iDim];
+        m_Bounds[iDim].resize(aDims[iDim]+1);
+        for(int32_t iNode=0; iNode<=aDims[iDim]; iNode++) {
+            m_Bounds[iDim][iNode] = (int32_t)((nGrid*iNode)/aDims[iDim]);
+        }
+        m_Nodes[iDim]    = aDims[iDim];
+        m_LocStart[iDim] = m_Bounds[iDim][m_Coords[iDim]];
+        m_LocCells[iDim] = m_Bounds[iDim][m_Coords[iDim]+1] - m_LocStart[iDim];
+    }
+
+    if(m_isMaster) {
+        printf("  Domain decomposition: %d x %d x %d nodes, %d guard cells\n",
+               m_Nodes[0], m_Nodes[1], m_Nodes[2], m_Guards);
+    }
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  The setupFields
+ * =================
+ *  Allocates E, B and J on the local cells plus guard cells as one aligned block, and sets up the
+ *  guard cell exchange for E and B
+ */
+
+bool Grid::setupFields() {
+
+    index_t nAlign = 64/sizeof(double_t);
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        m_FieldDims[iDim] = m_LocCells[iDim] + 2*m_Guards;
+    }
+    m_FieldSize = (index_t)m_FieldDims[0]*m_FieldDims[1]*m_FieldDims[2];
+
+    // Pad each array to keep all of them aligned
+    index_t nStride = ((m_FieldSize + nAlign - 1)/nAlign)*nAlign;
+    m_FieldStride   = nStride;
+
+    free(m_FieldData);
+    m_FieldData = NULL;
+    if(posix_memalign(&m_FieldData, 64, 9*nStride*sizeof(double_t)) != 0) {
+        printf("  Grid Error: Failed to allocate field arrays on node %d\n", m_MPIRank);
+        return false;
+    }
+    memset(m_FieldData, 0, 9*nStride*sizeof(double_t));
+
+    double_t* pData = (double_t*)m_FieldData;
+    E1 = pData + 0*nStride;
+    E2 = pData + 1*nStride;
+    E3 = pData + 2*nStride;
+    B1 = pData + 3*nStride;
+    B2 = pData + 4*nStride;
+    B3 = pData + 5*nStride;
+    J1 = pData + 6*nStride;
+    J2 = pData + 7*nStride;
+    J3 = pData + 8*nStride;
+
+    if(!fieldHalo.Setup(m_Comm, m_LocCells, m_Guards, {E1, E2, E3, B1, B2, B3})) return false;
+
+    if(m_isMaster && m_Rebalances == 0) {
+        printf("  Field arrays: %d x %d x %d cells per node including guards\n",
+               m_FieldDims[0], m_FieldDims[1], m_FieldDims[2]);
+    }
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  The setupCurrent
+ * ==================
+ *  Sets up the guard cell summation for J, the inverse node spacings used to turn deposited charge
+ *  flux into current density, and for the private strategy one set of J arrays per thread. With
+ *  particle tiles, the species deposit per tile and the deposit strategy is not used.
+ *  The node spacing is the distance between the centres of the two cells sharing the node, and at
+ *  the ends of the grid the width of the end cell.
+ */
+
+bool Grid::setupCurrent() {
+
+    if(!currentHalo.Setup(m_Comm, m_LocCells, m_Guards, {J1, J2, J3}, HALO_ADD)) return false;
+
+    m_InvDual.assign(3, vdouble_t());
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        int32_t nLast = m_NGrid[iDim]-1;
+        m_InvDual[iDim].resize(m_FieldDims[iDim]);
+        for(int32_t i=0; i<m_FieldDims[iDim]; i++) {
+            int32_t iNode = i - m_Guards + m_LocStart[iDim];
+            int32_t iLow  = min(max(iNode-1, 0), nLast);
+            int32_t iHigh = min(max(iNode,   0), nLast);
+            m_InvDual[iDim][i] = 2.0/(gridDelta[iDim][iLow] + gridDelta[iDim][iHigh]);
+        }
+    }
+
+    free(m_CurrData);
+    m_CurrData = NULL;
+    bool isTiled = (m_TileSize[0] > 0);
+    if(m_Deposit == DEP_PRIVATE && m_Threads > 1 && !isTiled) {
+        index_t nBytes = 3*m_Threads*m_FieldStride*sizeof(double_t);
+        if(posix_memalign(&m_CurrData, 64, nBytes) != 0) {
+            printf("  Grid Error: Failed to allocate current buffers on node %d\n", m_MPIRank);
+            return false;
+        }
+        memset(m_CurrData, 0, nBytes);
+    }
+
+    if(m_isMaster && m_Rebalances == 0) {
+        const char* aDeposit[3] = {"private buffers", "colouring", "atomics"};
+        printf("  Current deposition: %s, %d threads\n", (isTiled ? "tiles" : aDeposit[m_Deposit]), m_Threads);
+    }
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Move Fields
+ * =============
+ *  Moves E and B from the arrays of the old blocks to the new ones after the boundaries changed.
+ *  pOld holds the six arrays nStride apart, with first cell vStart and dimensions vDims including
+ *  guards, and vBounds are the old boundaries. Each node sends the part of its old block inside
+ *  each neighbour's new block, and receives the part of each neighbour's old block inside its own.
+ */
+
+void Grid::moveFields(const double_t* pOld, index_t nStride, const vint_t& vStart, const vint_t& vDims,
+                      const vector<vint_t>& vBounds) {
+
+    double_t* pNew[6] = {E1, E2, E3, B1, B2, B3};
+
+    vvdouble_t          vSend(27), vRecv(27);
+    vector<vint_t>      vRecvBox(27);
+    vector<MPI_Request> vRequests;
+
+    for(int32_t iDir=0; iDir<27; iDir++) {
+
+        int32_t aOff[3] = {iDir%3 - 1, (iDir/3)%3 - 1, iDir/9 - 1};
+        int32_t aNeighbour[3];
+        bool    isOutside = false;
+
+        for(int32_t iDim=0; iDim<3; iDim++) {
+            aNeighbour[iDim] = m_Coords[iDim] + aOff[iDim];
+            if(aNeighbour[iDim] < 0 || aNeighbour[iDim] >= m_Nodes[iDim]) isOutside = true;
+        }
+        if(isOutside) continue;
+
+        // Global cells sent, as the old block cut with the neighbour's new block, and received, as
+        // the neighbour's old block cut with the new block
+        int32_t aSend[6], aRecv[6];
+        int32_t nSend = 1, nRecv = 1;
+        for(int32_t iDim=0; iDim<3; iDim++) {
+            int32_t iN = aNeighbour[iDim];
+            aSend[iDim]   = max(vBounds[iDim][m_Coords[iDim]], m_Bounds[iDim][iN]);
+            aSend[iDim+3] = min(vBounds[iDim][m_Coords[iDim]+1], m_Bounds[iDim][iN+1]);
+            aRecv[iDim]   = max(vBounds[iDim][iN], m_LocStart[iDim]);
+            aRecv[iDim+3] = min(vBounds[iDim][iN+1], m_LocStart[iDim]+m_LocCells[iDim]);
+            nSend *= max(0, aSend[iDim+3]-aSend[iDim]);
+            nRecv *= max(0, aRecv[iDim+3]-aRecv[iDim]);
+        }
+
+        if(nSend > 0) {
+            vdouble_t& vBuf = vSend[iDir];
+            vBuf.reserve(6*(index_t)nSend);
+            for(int32_t iF=0; iF<6; iF++) {
+                for(int32_t i3=aSend[2]; i3<aSend[5]; i3++) {
+                    for(int32_t i2=aSend[1]; i2<aSend[4]; i2++) {
+                        index_t iRow = iF*nStride + (aSend[0]-vStart[0]+m_Guards)
+                                     + vDims[0]*((index_t)(i2-vStart[1]+m_Guards)
+                                     + vDims[1]*(index_t)(i3-vStart[2]+m_Guards));
+                        vBuf.insert(vBuf.end(), pOld+iRow, pOld+iRow+(aSend[3]-aSend[0]));
+                    }
+                }
+            }
+        }
+        if(nRecv > 0) {
+            vRecv[iDir].resize(6*(index_t)nRecv);
+            vRecvBox[iDir] = vint_t(aRecv, aRecv+6);
+        }
+
+        // The node itself keeps what it already has
+        if(iDir == 13) {
+            vRecv[iDir].swap(vSend[iDir]);
+            continue;
+        }
+
+        int32_t iRank;
+        MPI_Cart_rank(m_Comm, aNeighbour, &iRank);
+        if(nRecv > 0) {
+            MPI_Request rRecv;
+            MPI_Irecv(vRecv[iDir].data(), 6*nRecv, MPI_DOUBLE, iRank, 26-iDir, m_Comm, &rRecv);
+            vRequests.push_back(rRecv);
+        }
+        if(nSend > 0) {
+            MPI_Request rSend;
+            MPI_Isend(vSend[iDir].data(), 6*nSend, MPI_DOUBLE, iRank, iDir, m_Comm, &rSend);
+            vRequests.push_back(rSend);
+        }
+    }
+    MPI_Waitall((int)vRequests.size(), vRequests.data(), MPI_STATUSES_IGNORE);
+
+    for(int32_t iDir=0; iDir<27; iDir++) {
+        if(vRecv[iDir].empty()) continue;
+        const vint_t&   vBox  = vRecvBox[iDir];
+        const double_t* pBuf  = vRecv[iDir].data();
+        int32_t         nRow  = vBox[3]-vBox[0];
+        for(int32_t iF=0; iF<6; iF++) {
+            for(int32_t i3=vBox[2]; i3<vBox[5]; i3++) {
+                for(int32_t i2=vBox[1]; i2<vBox[4]; i2++) {
+                    index_t iIdx = fieldIndex(vBox[0]-m_LocStart[0], i2-m_LocStart[1], i3-m_LocStart[2]);
+                    memcpy(pNew[iF]+iIdx, pBuf, nRow*sizeof(double_t));
+                    pBuf += nRow;
+                }
+            }
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
 // End Class Grid
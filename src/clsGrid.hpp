@@ -5,14 +5,21 @@
 #ifndef CLASS_GRID
 #define CLASS_GRID
 
+// Class-specific macros
+#define GRID_BUCKETS 16     // Max lookup buckets per cell
+
 #include "config.hpp"
 #include "functions.hpp"
 
 #include "clsInput.hpp"
 #include "clsMath.hpp"
+#include "clsHalo.hpp"
+#include "clsThreadPool.hpp"
 
 typedef reypic::Input Input_t;
 typedef reypic::Math  Math_t;
+typedef reypic::Halo  Halo_t;
+typedef reypic::ThreadPool ThreadPool_t;
 
 namespace reypic {
 
@@ -25,26 +32,73 @@ public:
     */
 
     Grid();
-    ~Grid() {};
+    ~Grid();
 
    /**
     * Setters/Getters/Checks
     */
 
-    vdouble_t getBoxMin() {return m_XMin;};
-    vdouble_t getBoxMax() {return m_XMax;};
+    void      setQuiet()      {m_isMaster = false;};
+
+    vdouble_t getBoxMin()     {return m_XMin;};
+    vdouble_t getBoxMax()     {return m_XMax;};
+    vdouble_t getLocalMin();
+    vdouble_t getLocalMax();
+
+    MPI_Comm  getComm()       {return m_Comm;};
+    vint_t    getNodes()      {return m_Nodes;};
+    vint_t    getCoords()     {return m_Coords;};
+    vint_t    getGlobalCells(){return m_NGrid;};
+    vint_t    getLocalStart() {return m_LocStart;};
+    vint_t    getLocalCells() {return m_LocCells;};
+    int32_t   getGuards()     {return m_Guards;};
+    vint_t    getFieldDims()  {return m_FieldDims;};
+    index_t   getFieldSize()  {return m_FieldSize;};
+    value_t   getDeposit()    {return m_Deposit;};
+    int32_t   getThreads()    {return m_Threads;};
+    ThreadPool_t* getPool()   {return m_Pool;};
+    vint_t    getTileSize()   {return m_TileSize;};
+    std::vector<vint_t> getBounds() {return m_Bounds;};
+    vvdouble_t getInvDual()   {return m_InvDual;};
+
+    // Index into field arrays of local cell (i1,i2,i3), where guard cells have i < 0 or i >= cells
+    index_t   fieldIndex(int32_t i1, int32_t i2, int32_t i3) const {
+        return (i1+m_Guards) + m_FieldDims[0]*((index_t)(i2+m_Guards) + m_FieldDims[1]*(index_t)(i3+m_Guards));
+    };
 
    /**
     * Methods
     */
 
-    error_t Setup(Input_t*);
+    error_t Setup(Input_t*, vint_t, ThreadPool_t*);
+    int32_t cellOf(int32_t, double_t) const;
+    void    cellOf(int32_t, const double_t*, index_t, int32_t*) const;
+    void    currentArrays(int32_t, double_t**);
+    void    ClearCurrent();
+    void    ReduceCurrent();
+    error_t Rebalance(const vvdouble_t&, bool*);
+    error_t SetBounds(const std::vector<vint_t>&);
 
    /**
     * Properties
     */
 
-    vvdouble_t gridDelta;
+    vvdouble_t gridDelta;                    // Cell widths per dimension
+    vvdouble_t gridEdge;                     // Cell edges per dimension, ngrid+1 values
+
+    // Field arrays on local cells including guard cells, x1 running fastest
+    double_t*  E1 = NULL;                    // Electric field
+    double_t*  E2 = NULL;
+    double_t*  E3 = NULL;
+    double_t*  B1 = NULL;                    // Magnetic field
+    double_t*  B2 = NULL;
+    double_t*  B3 = NULL;
+    double_t*  J1 = NULL;                    // Current density
+    double_t*  J2 = NULL;
+    double_t*  J3 = NULL;
+
+    Halo_t     fieldHalo;                    // Guard cell exchange for E and B
+    Halo_t     currentHalo;                  // Guard cell summation for J
 
 private:
 
@@ -53,13 +107,30 @@ private:
      */
 
     bool setupGridDelta();
+    bool setupCellLookup();
+    bool setupDecomposition();
+    bool setupFields();
+    bool setupCurrent();
+    void moveFields(const double_t*, index_t, const vint_t&, const vint_t&, const std::vector<vint_t>&);
+    error_t applyBounds(const std::vector<vint_t>&, bool);
 
     /**
      * Member Variables
      */
 
     // General
-    double_t   m_Grid[];                     // The grid
+    void*      m_FieldData = NULL;           // Single allocation holding all field arrays
+    vint_t     m_FieldDims = {1, 1, 1};      // Local field array dimensions including guards
+    index_t    m_FieldSize = 0;              // Number of values per field array
+    index_t    m_FieldStride = 0;            // Distance between field arrays, padded for alignment
+
+    // Current deposition
+    value_t    m_Deposit  = DEP_PRIVATE;     // [deposit]    Thread reduction strategy
+    int32_t    m_Threads  = 1;               //              Number of threads depositing current
+    ThreadPool_t* m_Pool  = NULL;            //              Node threads running the kernels
+    void*      m_CurrData = NULL;            //              Private current buffers per thread
+    vvdouble_t m_InvDual;                    //              Inverse node spacing per local node
+    vint_t     m_TileSize = {0, 0, 0};       // [tilesize]   Cells per particle tile, 0 for no tiles
 
     // Parallelisation
     int32_t    m_MPISize  =  0;              // Number of nodes
@@ -75,6 +146,20 @@ private:
     vdouble_t  m_LinPoint = {0.0, 0.0, 0.0}; // [linpoint]   Defines the minimum point for linear
     vstring_t  m_GridFunc = {"","",""};      // [gridfunc]   Function for grid cell size
 
+    // Domain decomposition
+    MPI_Comm   m_Comm     = MPI_COMM_NULL;   //              Cartesian communicator
+    vint_t     m_Nodes    = {0, 0, 0};       // [nodes]      Number of nodes per dimension
+    vint_t     m_Coords   = {0, 0, 0};       //              Coordinates of this node
+    vint_t     m_LocStart = {0, 0, 0};       //              First global cell owned by this node
+    vint_t     m_LocCells = {1, 1, 1};       //              Number of cells owned by this node
+    int32_t    m_Guards   = 2;               // [guards]     Number of guard cell layers
+    std::vector<vint_t> m_Bounds;            //              First cell of each node per dimension, and the end
+    int32_t    m_Rebalances = 0;             //              Number of times the boundaries were moved
+
+    // Cell lookup
+    std::vector<vint_t> m_Bucket;            //              First cell overlapping each bucket
+    vdouble_t  m_BucketScale;                //              Buckets per unit length
+
 }; // End Class Grid
 
 } // End NameSpace
@@ -0,0 +1,333 @@
+/**
+ *  ReyPIC – Halo Source
+ * ======================
+ *  Guard cell exchange for a set of 3D field arrays with the same shape.
+ *
+ *  Each array holds the local cells plus nGuards layers of guard cells on all sides, with x1
+ *  running fastest. All 26 neighbours, including edges and corners, are exchanged at once so the
+ *  guard cells are complete after a single Start()/Finish() pair, and work on the interior can be
+ *  done in between.
+ *  The faces, edges and corners are described by MPI subarray datatypes, so nothing is packed by
+ *  hand, and the sends and receives are persistent requests set up once.
+ *
+ *  In add mode the exchange runs the other way, for quantities like the current that are deposited
+ *  into guard cells. Each guard region is sent to the node that owns those cells, received into a
+ *  buffer, and added onto the owner's cells in Finish().
+ */
+
+#include "clsHalo.hpp"
+
+using namespace std;
+using namespace reypic;
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Constructor
+ * ===================
+ */
+
+Halo::Halo() {
+
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Destructor
+ * ==================
+ */
+
+Halo::~Halo() {
+
+    Free();
+}
+
+// ********************************************************************************************** //
+//                                       Main Class Methods                                       //
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Setup
+ * =================
+ *  Sets up the exchange on the Cartesian communicator mComm for arrays with vCells local cells
+ *  per dimension and nGuards guard layers. Neighbours outside a non-periodic boundary are
+ *  MPI_PROC_NULL, and their guard cells are left untouched, or dropped in add mode.
+ *  The exchange uses its own copy of the communicator, so several halos can share a grid.
+ */
+
+bool Halo::Setup(MPI_Comm mComm, vint_t vCells, int32_t nGuards, vector<double_t*> vArrays, value_t iMode) {
+
+    Free();
+
+    int32_t aDims[3], aPeriods[3], aCoords[3];
+    int32_t aSize[3];
+
+    MPI_Cart_get(mComm, 3, aDims, aPeriods, aCoords);
+    MPI_Comm_dup(mComm, &m_Comm);
+    m_Mode = iMode;
+    m_Size = vint_t(3);
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        if(vCells[iDim] < nGuards) {
+            printf("  Halo Error: Fewer local cells than guard cells in x%d\n", iDim+1);
+            return false;
+        }
+        aSize[iDim]  = vCells[iDim] + 2*nGuards;
+        m_Size[iDim] = aSize[iDim];
+    }
+
+    vector<int32_t> vRecvRank, vSendRank;
+    vector<int32_t> vRecvTag,  vSendTag;
+
+    double_t dBytes = 0.0;
+
+    for(int32_t iDir=0; iDir<27; iDir++) {
+
+        int32_t aOff[3] = {iDir%3 - 1, (iDir/3)%3 - 1, iDir/9 - 1};
+        if(aOff[0] == 0 && aOff[1] == 0 && aOff[2] == 0) continue;
+
+        int32_t aSub[3], aSend[3], aRecv[3];
+        int32_t aNeighbour[3];
+        bool    isOutside = false;
+
+        for(int32_t iDim=0; iDim<3; iDim++) {
+            switch(aOff[iDim]) {
+                case -1:
+                    aSub[iDim]  = nGuards;
+                    aSend[iDim] = nGuards;
+                    aRecv[iDim] = 0;
+                    break;
+                case 0:
+                    aSub[iDim]  = vCells[iDim];
+                    aSend[iDim] = nGuards;
+                    aRecv[iDim] = nGuards;
+                    break;
+                case 1:
+                    aSub[iDim]  = nGuards;
+                    aSend[iDim] = vCells[iDim];
+                    aRecv[iDim] = vCells[iDim] + nGuards;
+                    break;
+            }
+
+            aNeighbour[iDim] = aCoords[iDim] + aOff[iDim];
+            if(aPeriods[iDim]) {
+                aNeighbour[iDim] = (aNeighbour[iDim] + aDims[iDim]) % aDims[iDim];
+            } else
+            if(aNeighbour[iDim] < 0 || aNeighbour[iDim] >= aDims[iDim]) {
+                isOutside = true;
+            }
+        }
+
+        int32_t iRank = MPI_PROC_NULL;
+        if(!isOutside) {
+            MPI_Cart_rank(mComm, aNeighbour, &iRank);
+        }
+
+        // In add mode the guard region is sent, and the received values are added to the cells
+        // that would otherwise have been sent
+        if(m_Mode == HALO_ADD) {
+            m_AddBox.push_back({aSend[0], aSend[1], aSend[2], aSub[0], aSub[1], aSub[2]});
+            swap(aSend, aRecv);
+        }
+
+        MPI_Datatype tSend, tRecv;
+        MPI_Type_create_subarray(3, aSize, aSub, aSend, MPI_ORDER_FORTRAN, MPI_DOUBLE, &tSend);
+        MPI_Type_create_subarray(3, aSize, aSub, aRecv, MPI_ORDER_FORTRAN, MPI_DOUBLE, &tRecv);
+        MPI_Type_commit(&tSend);
+        MPI_Type_commit(&tRecv);
+        m_Types.push_back(tSend);
+        m_Types.push_back(tRecv);
+
+        // Data sent towards direction d arrives from direction -d, which has index 26-d
+        vSendRank.push_back(iRank);
+        vRecvRank.push_back(iRank);
+        vSendTag.push_back(iDir);
+        vRecvTag.push_back(26-iDir);
+
+        if(iRank != MPI_PROC_NULL) {
+            dBytes += (double_t)aSub[0]*aSub[1]*aSub[2]*sizeof(double_t);
+        }
+    }
+
+    // In add mode each direction is received into its own contiguous buffer
+    if(m_Mode == HALO_ADD) {
+        index_t nBuffer = 0;
+        for(size_t iArr=0; iArr<vArrays.size(); iArr++) {
+            for(int32_t iDir=0; iDir<HALO_DIRS; iDir++) {
+                m_BufOffset.push_back(nBuffer);
+                nBuffer += (index_t)m_AddBox[iDir][3]*m_AddBox[iDir][4]*m_AddBox[iDir][5];
+            }
+        }
+        m_Buffer.assign(nBuffer, 0.0);
+        m_Arrays = vArrays;
+    }
+
+    // Receives are posted first so that they are ready when the sends arrive
+    for(size_t iArr=0; iArr<vArrays.size(); iArr++) {
+        for(int32_t iDir=0; iDir<HALO_DIRS; iDir++) {
+            MPI_Request rRecv;
+            int32_t     iTag = vRecvTag[iDir] + 27*(int32_t)iArr;
+            if(m_Mode == HALO_ADD) {
+                int32_t nCount = m_AddBox[iDir][3]*m_AddBox[iDir][4]*m_AddBox[iDir][5];
+                MPI_Recv_init(&m_Buffer[m_BufOffset[iArr*HALO_DIRS+iDir]], nCount, MPI_DOUBLE,
+                              vRecvRank[iDir], iTag, m_Comm, &rRecv);
+            } else {
+                MPI_Recv_init(vArrays[iArr], 1, m_Types[2*iDir+1], vRecvRank[iDir], iTag, m_Comm, &rRecv);
+            }
+            m_Requests.push_back(rRecv);
+            m_RecvRank.push_back(vRecvRank[iDir]);
+        }
+    }
+    for(size_t iArr=0; iArr<vArrays.size(); iArr++) {
+        for(int32_t iDir=0; iDir<HALO_DIRS; iDir++) {
+            MPI_Request rSend;
+            MPI_Send_init(vArrays[iArr], 1, m_Types[2*iDir], vSendRank[iDir],
+                          vSendTag[iDir] + 27*(int32_t)iArr, m_Comm, &rSend);
+            m_Requests.push_back(rSend);
+        }
+    }
+
+    m_BytesPerExchange = dBytes*vArrays.size();
+    m_isSetup = true;
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Start
+ * =================
+ *  Starts the exchange. The interior cells may be read, but guard cells and the cells next to the
+ *  boundary must not be written until Finish() returns.
+ */
+
+void Halo::Start() {
+
+    if(!m_isSetup || m_isActive) return;
+
+    MPI_Startall((int)m_Requests.size(), m_Requests.data());
+    m_isActive = true;
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Finish
+ * ==================
+ *  Waits for the exchange started by Start() to complete, and in add mode adds the received guard
+ *  cells onto the local cells
+ */
+
+void Halo::Finish() {
+
+    if(!m_isActive) return;
+
+    double_t tStart = MPI_Wtime();
+    MPI_Waitall((int)m_Requests.size(), m_Requests.data(), MPI_STATUSES_IGNORE);
+
+    if(m_Mode == HALO_ADD) {
+        for(size_t iArr=0; iArr<m_Arrays.size(); iArr++) {
+            for(int32_t iDir=0; iDir<HALO_DIRS; iDir++) {
+                if(m_RecvRank[iArr*HALO_DIRS+iDir] == MPI_PROC_NULL) continue;
+                addBuffer(m_Arrays[iArr], &m_Buffer[m_BufOffset[iArr*HALO_DIRS+iDir]], m_AddBox[iDir]);
+            }
+        }
+    }
+
+    m_WaitTime += MPI_Wtime() - tStart;
+    m_Bytes    += m_BytesPerExchange;
+    m_Count++;
+    m_isActive  = false;
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Exchange
+ * ====================
+ *  Blocking exchange
+ */
+
+void Halo::Exchange() {
+
+    Start();
+    Finish();
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Free
+ * ================
+ *  Releases requests and datatypes
+ */
+
+void Halo::Free() {
+
+    int32_t isFinalized = 0;
+    MPI_Finalized(&isFinalized);
+    if(isFinalized) return;
+
+    Finish();
+
+    for(auto& rItem : m_Requests) {
+        MPI_Request_free(&rItem);
+    }
+    for(auto& tItem : m_Types) {
+        MPI_Type_free(&tItem);
+    }
+
+    if(m_Comm != MPI_COMM_NULL) {
+        MPI_Comm_free(&m_Comm);
+    }
+
+    m_Requests.clear();
+    m_Types.clear();
+    m_RecvRank.clear();
+    m_Arrays.clear();
+    m_Buffer.clear();
+    m_BufOffset.clear();
+    m_AddBox.clear();
+    m_isSetup = false;
+
+    return;
+}
+
+// ********************************************************************************************** //
+//                                        Member Functions                                        //
+// ********************************************************************************************** //
+
+/**
+ *  Add Buffer
+ * ============
+ *  Adds a received buffer onto the region of pArray given by vBox as offset and size per dimension
+ */
+
+void Halo::addBuffer(double_t* pArray, const double_t* pBuffer, const vint_t& vBox) {
+
+    index_t nS2 = (index_t)m_Size[0];
+    index_t nS3 = (index_t)m_Size[0]*m_Size[1];
+
+    for(int32_t i3=0; i3<vBox[5]; i3++) {
+        for(int32_t i2=0; i2<vBox[4]; i2++) {
+            double_t* pRow = pArray + vBox[0] + (vBox[1]+i2)*nS2 + (vBox[2]+i3)*nS3;
+            for(int32_t i1=0; i1<vBox[3]; i1++) {
+                pRow[i1] += *pBuffer++;
+            }
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+// End Class Halo
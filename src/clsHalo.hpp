@@ -0,0 +1,88 @@
+/**
+ * ReyPIC – Halo Header
+ */
+
+#ifndef CLASS_HALO
+#define CLASS_HALO
+
+// Class-specific macros
+#define HALO_DIRS    26     // Number of neighbours in 3D
+#define HALO_COPY    0      // Copy neighbour cells into guard cells
+#define HALO_ADD     1      // Add guard cells onto neighbour cells
+
+#include "config.hpp"
+
+namespace reypic {
+
+class Halo {
+
+public:
+
+   /**
+    * Constructor/Destructor
+    */
+
+    Halo();
+    Halo(const Halo&) = delete;
+    ~Halo();
+
+    Halo& operator=(const Halo&) = delete;
+
+   /**
+    * Setters/Getters
+    */
+
+    double_t getWaitTime() const {return m_WaitTime;};
+    double_t getBytes()    const {return m_Bytes;};
+    int32_t  getCount()    const {return m_Count;};
+
+   /**
+    * Methods
+    */
+
+    bool Setup(MPI_Comm, vint_t, int32_t, std::vector<double_t*>, value_t iMode=HALO_COPY);
+    void Start();
+    void Finish();
+    void Exchange();
+    void Free();
+
+private:
+
+   /**
+    * Member Functions
+    */
+
+    void addBuffer(double_t*, const double_t*, const vint_t&);
+
+   /**
+    * Member Variables
+    */
+
+    bool                     m_isSetup  = false;
+    bool                     m_isActive = false;
+    value_t                  m_Mode     = HALO_COPY;
+    MPI_Comm                 m_Comm     = MPI_COMM_NULL; // Private copy of the Cartesian communicator
+
+    std::vector<MPI_Datatype> m_Types;             // Send and receive subarray per direction
+    std::vector<MPI_Request>  m_Requests;          // Persistent requests, receives first
+    std::vector<int32_t>      m_RecvRank;          // Source rank of each receive
+
+    // Add mode
+    std::vector<double_t*>    m_Arrays;            // Arrays being exchanged
+    std::vector<double_t>     m_Buffer;            // Receive buffers, per array and direction
+    std::vector<index_t>      m_BufOffset;         // Start of each receive buffer
+    std::vector<vint_t>       m_AddBox;            // Target region per direction as offset and size
+    vint_t                    m_Size;              // Array dimensions including guards
+
+    // Statistics
+    double_t                 m_WaitTime = 0.0;     // Time spent in Finish()
+    double_t                 m_Bytes    = 0.0;     // Bytes sent by this node
+    int32_t                  m_Count    = 0;       // Number of exchanges
+
+    double_t                 m_BytesPerExchange = 0.0;
+
+}; // End Class Halo
+
+} // End NameSpace
+
+#endif
@@ -3,6 +3,7 @@
  */
 
 #include "clsInput.hpp"
+#include <algorithm>
 
 using namespace std;
 using namespace reypic;
@@ -12,10 +13,15 @@ using namespace reypic;
 /**
  *  Class Constructor
  * ===================
+ *  May be created before MPI is initialised, in which case no process prints anything
  */
 
 Input::Input() {
 
+    int32_t isInit = 0;
+    MPI_Initialized(&isInit);
+    if(!isInit) return;
+
     // Read MPI setup
     MPI_Comm_size(MPI_COMM_WORLD, &m_MPISize);
     MPI_Comm_rank(MPI_COMM_WORLD, &m_MPIRank);
@@ -45,22 +51,104 @@ int32_t Input::getNumSpecies() {
 /**
  *  Method :: ReadFile
  * ====================
- *  Reads the input file into buffer and strips comments and line endings.
+ *  Reads the input file into buffer and strips comments, line endings, tabs and the spaces outside
+ *  of strings, in a single pass that also records the root sections and where the value of each
+ *  of their keys is in the buffer. A # outside of a string starts a comment, and braces and
+ *  separators inside strings are left alone.
  */
 
 error_t Input::ReadFile(char* cFile) {
 
     // Read File into buffer
-    ifstream tmpFile(cFile);
+    ifstream tmpFile(cFile, ios::binary);
+    if(!tmpFile) {
+        if(m_isMaster) {
+            printf("  Could not open input file %s\n", cFile);
+        }
+        return ERR_INPUTFILE;
+    }
     tmpFile.seekg(0, ios::end);
     size_t iSize = tmpFile.tellg();
     string_t tmpBuffer(iSize, ' ');
     tmpFile.seekg(0);
     tmpFile.read(&tmpBuffer[0], iSize);
 
+    m_Buffer.clear();
+    m_Buffer.reserve(iSize);
+    m_Sections.clear();
+
+    bool     inString  = false;
+    bool     isClosed  = true;  // No } without a matching {
+    bool     hasKey    = false; // A key has been read, and its value not yet ended by ;
+    index_t  iLev      = 0;
+    size_t   iToken    = 0;     // Start of the current section name or key in m_Buffer
+    size_t   iValue    = 0;     // Start of the current value in m_Buffer
+    string_t sKey;
+
+    for(size_t i=0; i<iSize; i++) {
+
+        char cChar = tmpBuffer[i];
+
+        if(cChar == '\n' || cChar == '\r' || cChar == '\t') continue;
+
+        if(inString) {
+            if(cChar == '"') inString = false;
+            m_Buffer += cChar;
+            continue;
+        }
+
+        switch(cChar) {
+
+            case ' ':
+                continue;
+
+            case '#':
+                while(i+1 < iSize && tmpBuffer[i+1] != '\n' && tmpBuffer[i+1] != '\r') i++;
+                continue;
+
+            case '"':
+                inString = true;
+                break;
+
+            case '{':
+                iLev++;
+                if(iLev == 1) {
+                    m_Sections.push_back(section());
+                    m_Sections.back().sName = m_Buffer.substr(iToken);
+                    hasKey = false;
+                }
+                break;
+
+            case '}':
+                if(iLev == 0) {
+                    isClosed = false;
+                } else {
+                    iLev--;
+                }
+                break;
+
+            case '=':
+                if(iLev == 1 && !hasKey) {
+                    sKey   = m_Buffer.substr(iToken);
+                    iValue = m_Buffer.size()+1;
+                    hasKey = true;
+                }
+                break;
+
+            case ';':
+                if(iLev == 1 && hasKey) {
+                    m_Sections.back().mKeys[sKey] = make_pair(iValue, m_Buffer.size()-iValue);
+                }
+                hasKey = false;
+                break;
+        }
+
+        m_Buffer += cChar;
+        if(cChar == '{' || cChar == '}' || cChar == ';') iToken = m_Buffer.size();
+    }
+
     // Check for closed quotes
-    size_t nQuotes = count(tmpBuffer.begin(),tmpBuffer.end(),'"');
-    if(nQuotes%2 == 1) {
+    if(inString) {
         if(m_isMaster) {
             printf("  Input file malformed. Check that all strings have been closed.\n");
         }
@@ -68,29 +156,13 @@ error_t Input::ReadFile(char* cFile) {
     }
 
     // Check for closed sections
-    size_t nSecStart = count(tmpBuffer.begin(),tmpBuffer.end(),'{');
-    size_t nSecEnd   = count(tmpBuffer.begin(),tmpBuffer.end(),'}');
-    if(nSecStart != nSecEnd) {
+    if(iLev != 0 || !isClosed) {
         if(m_isMaster) {
-            printf("  Input file malformed. Check that all ections have been closed.\n");
+            printf("  Input file malformed. Check that all sections have been closed.\n");
         }
         return ERR_INPUTFILE;
     }
 
-    // Strip comments, line endings and redundant spaces
-    regex rxComments("#.*?\n");
-    regex rxEndLine("\r?\n|\r");
-    regex rxSpaces(" +(?=(?:[^\"]*\"[^\"]*\")*[^\"]*$)");
-    regex rxOther("\t");
-
-    tmpBuffer = regex_replace(tmpBuffer,rxComments,"");
-    tmpBuffer = regex_replace(tmpBuffer,rxEndLine,"");
-    tmpBuffer = regex_replace(tmpBuffer,rxSpaces,"");
-    tmpBuffer = regex_replace(tmpBuffer,rxOther,"");
-
-    // Set class buffer and return
-    m_Buffer = tmpBuffer;
-
     return ERR_NONE;
 }
 
@@ -99,87 +171,61 @@ error_t Input::ReadFile(char* cFile) {
 /**
  *  Method :: SplitSections
  * =========================
- *  Splits the input file buffer into root sections
+ *  Sorts the root sections of the input file by type
  */
 
 error_t Input::SplitSections() {
 
-    index_t  iLev = 0;
-    size_t   nLen;
-    string_t sTemp;
-
-    value_t iSection   = INPUT_NONE;
-    bool    hasConf    = false;
-    bool    hasSim     = false;
-    bool    hasGrid    = false;
-    bool    hasEMF     = false;
-    bool    hasSpecies = false;
-
-    for(char& cChar : m_Buffer) {
-
-        sTemp += cChar;
-
-        if(cChar == '{') {
-            iLev++;
-            if(iLev == 1) {
-                if(sTemp.compare("config{") == 0)     iSection = INPUT_CONF;
-                if(sTemp.compare("simulation{") == 0) iSection = INPUT_SIM;
-                if(sTemp.compare("grid{") == 0)       iSection = INPUT_GRID;
-                if(sTemp.compare("emf{") == 0)        iSection = INPUT_EMF;
-                if(sTemp.compare("species{") == 0)    iSection = INPUT_SPECIES;
-                sTemp = "";
+    m_Config      = -1;
+    m_Simulation  = -1;
+    m_Grid        = -1;
+    m_EMF         = -1;
+    m_Diagnostics = -1;
+    m_Species.clear();
+
+    for(int32_t iSec=0; iSec<(int32_t)m_Sections.size(); iSec++) {
+
+        const string_t& sName = m_Sections[iSec].sName;
+
+        if(sName == "config") {
+            m_Config = iSec;
+            if(m_isMaster) {
+                printf("  Found config section\n");
             }
         }
-
-        if(cChar == '}') {
-            iLev--;
-            if(iLev == 0) {
-                nLen  = sTemp.length();
-                sTemp = sTemp.substr(0,nLen-1);
-                switch(iSection) {
-                    case INPUT_CONF:
-                        m_Config = sTemp;
-                        if(m_isMaster) {
-                            printf("  Found config section\n");
-                        }
-                        hasConf = true;
-                        break;
-                    case INPUT_SIM:
-                        m_Simulation = sTemp;
-                        if(m_isMaster) {
-                            printf("  Found simulation section\n");
-                        }
-                        hasSim = true;
-                        break;
-                    case INPUT_GRID:
-                        m_Grid = sTemp;
-                        if(m_isMaster) {
-                            printf("  Found grid section\n");
-                        }
-                        hasGrid = true;
-                        break;
-                    case INPUT_EMF:
-                        m_EMF = sTemp;
-                        if(m_isMaster) {
-                            printf("  Found emf section\n");
-                        }
-                        hasEMF = true;
-                        break;
-                    case INPUT_SPECIES:
-                        m_Species.push_back(sTemp);
-                        if(m_isMaster) {
-                            printf("  Found species section (%d)\n", (int)m_Species.size());
-                        }
-                        hasSpecies = true;
-                        break;
-                }
-                sTemp    = "";
-                iSection = INPUT_NONE;
+        if(sName == "simulation") {
+            m_Simulation = iSec;
+            if(m_isMaster) {
+                printf("  Found simulation section\n");
+            }
+        }
+        if(sName == "grid") {
+            m_Grid = iSec;
+            if(m_isMaster) {
+                printf("  Found grid section\n");
+            }
+        }
+        if(sName == "emf") {
+            m_EMF = iSec;
+            if(m_isMaster) {
+                printf("  Found emf section\n");
+            }
+        }
+        if(sName == "species") {
+            m_Species.push_back(iSec);
+            if(m_isMaster) {
+                printf("  Found species section (%d)\n", (int)m_Species.size());
+            }
+        }
+        if(sName == "diagnostics") {
+            m_Diagnostics = iSec;
+            if(m_isMaster) {
+                printf("  Found diagnostics section\n");
             }
         }
     }
 
-    if(hasConf && hasSim && hasGrid && hasEMF && hasSpecies) {
+    if(m_Config >= 0 && m_Simulation >= 0 && m_Grid >= 0 && m_EMF >= 0 && m_Species.size() > 0) {
         if(m_isMaster) {
             printf("\n");
         }
@@ -192,68 +238,55 @@ error_t Input::SplitSections() {
 // ********************************************************************************************** //
 
 /**
- *  Method :: ReadFile
- * ====================
- *  Reads the input file into buffer and strips comments and line endings.
+ *  Method :: ReadVariable
+ * ========================
+ *  Parses the value of key sVar in section iSection into pReturn as type iType. The value is
+ *  looked up in the keys recorded by ReadFile, and pReturn is left as it is if there is none.
  */
 
 error_t Input::ReadVariable(value_t iSection, index_t iIndex, string_t sVar, void *pReturn, value_t iType) {
 
-    string_t sBuffer, sSection, sTemp, sValue;
-    bool     getVal = false;
+    string_t sSection;
+    int32_t  iSec = -1;
 
-    // Get correct buffer
+    // Get correct section
     switch(iSection) {
         case INPUT_CONF:
-            sBuffer  = m_Config;
+            iSec     = m_Config;
             sSection = "config";
             break;
         case INPUT_SIM:
-            sBuffer  = m_Simulation;
+            iSec     = m_Simulation;
             sSection = "simulation";
             break;
         case INPUT_GRID:
-            sBuffer  = m_Grid;
+            iSec     = m_Grid;
             sSection = "grid";
             break;
         case INPUT_EMF:
-            sBuffer  = m_EMF;
+            iSec     = m_EMF;
             sSection = "emf";
             break;
         case INPUT_SPECIES:
-            sBuffer  = m_Species[iIndex];
+            if(iIndex < m_Species.size()) iSec = m_Species[iIndex];
             sSection = "species("+to_string(iIndex)+")";
             break;
+        case INPUT_DIAG:
+            iSec     = m_Diagnostics;
+            sSection = "diagnostics";
+            break;
         case INPUT_NONE:
             return ERR_ANY;
             break;
     }
+    if(iSec < 0) return ERR_NONE;
 
-    // Find variable
-    for(char& cChar : sBuffer) {
+    // Find variable, the last one if it is set more than once
+    auto itKey = m_Sections[iSec].mKeys.find(sVar);
+    if(itKey == m_Sections[iSec].mKeys.end()) return ERR_NONE;
 
-        sTemp += cChar;
-
-        if(cChar == '=') {
-            if(sTemp.compare(sVar+"=") == 0) {
-                getVal = true;
-                sTemp  = "";
-            }
-        }
-
-        if(cChar == ';') {
-            if(getVal) {
-                sValue = sTemp;
-            }
-            sTemp  = "";
-            getVal = false;
-        }
-    }
-
-    // Check value
-    size_t nLen = sValue.length();
-    if(nLen < 1) return ERR_NONE;
-    sValue = sValue.substr(0,nLen-1);
+    string_t sValue = m_Buffer.substr(itKey->second.first, itKey->second.second);
+    size_t   nLen   = sValue.length();
 
     // if(m_isMaster) {
     //     cout << "  Value: " << sValue << " (" << nLen << ")" << endl;
@@ -279,7 +312,7 @@ error_t Input::ReadVariable(value_t iSection, index_t iIndex, string_t sVar, voi
             break;
 
         case INVAR_STRING:
-            if(nLen < 2) {
+            if(nLen < 1) {
                 errParse = ERR_INPUTVAR;
                 break;
             }
@@ -350,12 +383,20 @@ error_t Input::ReadVariable(value_t iSection, index_t iIndex, string_t sVar, voi
 vstring_t Input::strExplode(const string_t& sString) {
 
     vstring_t vsReturn;
-    regex     rxCSV(",(?=([^\"]*\"[^\"]*\")*[^\"]*$)");
-
-    sregex_token_iterator rxIt(sString.begin(), sString.end(), rxCSV, -1);
-    sregex_token_iterator reg_end;
-    for(; rxIt != reg_end; ++rxIt) {
-        vsReturn.push_back(stripQuotes(rxIt->str()));
+    string_t  sElem;
+    bool      inString = false;
+
+    for(char cChar : sString) {
+        if(cChar == '"') inString = !inString;
+        if(cChar == ',' && !inString) {
+            vsReturn.push_back(stripQuotes(sElem));
+            sElem.clear();
+        } else {
+            sElem += cChar;
+        }
+    }
+    if(sElem.length() > 0 || vsReturn.empty()) {
+        vsReturn.push_back(stripQuotes(sElem));
     }
 
     return vsReturn;
@@ -371,8 +412,8 @@ vstring_t Input::strExplode(const string_t& sString) {
 
 string_t Input::stripQuotes(const string_t& sString) {
 
-    regex    rxQuote("\"");
-    string_t sReturn = regex_replace(sString,rxQuote,"");
+    string_t sReturn = sString;
+    sReturn.erase(remove(sReturn.begin(), sReturn.end(), '"'), sReturn.end());
 
     return sReturn;
 }
@@ -6,7 +6,7 @@
 #define CLASS_INPUT
 
 #include "config.hpp"
-#include <regex>
+#include <map>
 
 namespace reypic {
 
@@ -26,6 +26,7 @@ public:
     */
 
     int32_t getNumSpecies();
+    void    setQuiet() {m_isMaster = false;};
 
    /**
     * Methods
@@ -37,6 +38,16 @@ public:
 
 private:
 
+   /**
+    * Structs
+    */
+
+    // A root section of the buffer, with the value of each key as offset and length in the buffer
+    struct section {
+        string_t sName;
+        std::map<string_t, std::pair<size_t,size_t> > mKeys;
+    };
+
    /**
     * Member Variables
     */
@@ -47,12 +58,16 @@ private:
     bool      m_isMaster    = false; // True if this node is master
 
     // Buffers
-    string_t  m_Buffer;              // Full input file buffer
-    string_t  m_Config;              // Config section
-    string_t  m_Simulation;          // Simulation section
-    string_t  m_Grid;                // Grid section
-    string_t  m_EMF;                 // EMF section
-    vstring_t m_Species;             // Vector of species sections
+    string_t  m_Buffer;              // Input file without comments, line endings and spaces
+    std::vector<section> m_Sections; // Root sections in file order
+
+    // Sections by type, as index into m_Sections
+    int32_t   m_Config      = -1;    // Config section
+    int32_t   m_Simulation  = -1;    // Simulation section
+    int32_t   m_Grid        = -1;    // Grid section
+    int32_t   m_EMF         = -1;    // EMF section
+    vint_t    m_Species;             // Vector of species sections
+    int32_t   m_Diagnostics = -1;    // Diagnostics section, optional
 
    /**
     * Member Functions
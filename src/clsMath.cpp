@@ -61,6 +61,12 @@ bool Math::setEquation(string_t sEquation) {
     bool okParser = eqParser();
     if(!okParser) return false;
 
+    bool okCompile = eqCompile();
+    if(!okCompile) return false;
+
+    bool okOptimise = eqOptimise();
+    if(!okOptimise) return false;
+
     m_Parsed = true;
     return true;
 }
@@ -72,94 +78,71 @@ bool Math::setEquation(string_t sEquation) {
 /**
  *  Evaluate the Parsed Function
  * ==============================
- *  Takes vector of variables and vector of values as input
- *  Using Reverse Polish notation
- *  https://en.wikipedia.org/wiki/Reverse_Polish_notation
+ *  Takes vector of values in the same order as the variables set by setVariables()
  */
 
-bool Math::Eval(vdouble_t vdValues, double_t* pReturn) {
+bool Math::Eval(const vdouble_t& vdValues, double_t* pReturn) const {
+
+    if(m_WVariable.size() != vdValues.size()) {
+        printf("  Math Eval Error: Values vector must be the same length as variables vector\n");
+        return false;
+    }
+
+    return Eval(vdValues.data(), pReturn);
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Evaluate the Parsed Function from Array
+ * =========================================
+ *  Takes array of values in the same order as the variables set by setVariables()
+ *  Runs the compiled program from eqCompile() on a stack local to the call. It does not allocate
+ *  or modify the object, so one Math object can be evaluated from many threads at once.
+ */
 
-    vdouble_t vdStack;
-    double_t  dValue;
+bool Math::Eval(const double_t* pValues, double_t* pReturn) const {
 
     if(!m_Parsed) {
         printf("  Math Eval Error: No valid equation to evaluate\n");
         return false;
     }
 
-    if(m_WVariable.size() != vdValues.size()) {
-        printf("  Math Eval Error: Values vector must be the same length as variables vector\n");
+    if(!evalProgram(m_Program, pValues, pReturn)) {
+        printf("  Math Eval Error: Invalid arguments to function mod\n");
         return false;
     }
 
-    for(auto tItem : m_ParseTree) {
+    return true;
+}
 
-        switch(tItem.type) {
+// ********************************************************************************************** //
 
-            case MP_NUMBER:
-                vdStack.push_back(tItem.value);
-                break;
+/**
+ *  Evaluate the Parsed Function over Arrays
+ * ==========================================
+ *  Takes one array per variable, in the same order as set by setVariables(), each holding the
+ *  values of nPoints points, and writes nPoints results to pReturn.
+ *  The points are evaluated in blocks of MATH_BLOCK so that each opcode runs as a unit-stride
+ *  loop over the block. Like Eval(), it is safe to call from many threads at once.
+ */
 
-            case MP_VARIABLE:
-                dValue = 0.0;
-                if(evalVariable(tItem.content, &vdValues, &dValue)) {
-                    vdStack.push_back(dValue);
-                } else {
-                    printf("  Math Eval Error: Unknown variable %s\n",tItem.content.c_str());
-                    return false;
-                }
-                break;
+bool Math::EvalBatch(const double_t* const* pValues, index_t nPoints, double_t* pReturn) const {
 
-            case MP_CONST:
-                dValue = 0.0;
-                if(evalConstant(tItem.content, &dValue)) {
-                    vdStack.push_back(dValue);
-                } else {
-                    printf("  Math Eval Error: Unknown constant %s\n",tItem.content.c_str());
-                    return false;
-                }
-                break;
+    if(!m_Parsed) {
+        printf("  Math Eval Error: No valid equation to evaluate\n");
+        return false;
+    }
 
-            case MP_FUNC:
-                dValue = 0.0;
-                if(evalFunction(tItem.content, &vdStack, &dValue)) {
-                    vdStack.push_back(dValue);
-                } else {
-                    printf("  Math Eval Error: Unknown function %s\n",tItem.content.c_str());
-                    return false;
-                }
-                break;
+    for(index_t iStart=0; iStart<nPoints; iStart+=MATH_BLOCK) {
 
-            case MP_LOGICAL:
-                dValue = 0.0;
-                if(evalLogical(tItem.content, &vdStack, &dValue)) {
-                    vdStack.push_back(dValue);
-                } else {
-                    printf("  Math Eval Error: Unknown logic operator %s\n",tItem.content.c_str());
-                    return false;
-                }
-                break;
+        int32_t nBlock = (int32_t)min((index_t)MATH_BLOCK, nPoints-iStart);
 
-            case MP_MATH:
-                dValue = 0.0;
-                if(evalMath(tItem.content, &vdStack, &dValue)) {
-                    vdStack.push_back(dValue);
-                } else {
-                    printf("  Math Eval Error: Unknown operator %s\n",tItem.content.c_str());
-                    return false;
-                }
-                break;
+        if(!evalBlock(pValues, iStart, nBlock, pReturn+iStart)) {
+            printf("  Math Eval Error: Invalid arguments to function mod\n");
+            return false;
         }
-
-        // cout << "  Stack: ";
-        // for(auto dValue : vdStack) {
-        //     cout << dValue << " ";
-        // }
-        // cout << "| Current: " << tItem.content << endl;
     }
-    // cout << endl;
-
-    *pReturn = vdStack.front();
 
     return true;
 }
@@ -205,8 +188,8 @@ bool Math::eqLexer() {
         if(cCurr == '(' || cCurr == ')' || cCurr == ',') {
             idCurr = MT_SEPARATOR;
         }
-        // Check if unary minus
-        if( cCurr == '-' &&
+        // Check if unary minus. A closing bracket ends an operand, so '-' after it is binary
+        if( cCurr == '-' && cPrev != ')' &&
             !(idPrev == MT_NUMBER || idPrev == MT_WORD || (idPrev == MT_NONE && cPrev != '#')) ) {
             cCurr = '_';
         }
@@ -472,6 +455,231 @@ bool Math::eqParser() {
 
 // ********************************************************************************************** //
 
+/**
+ *  The Equation Compiler
+ * =======================
+ *  Lowers the parse tree from eqParser() into a flat program of opcodes. Variables are resolved
+ *  to their index in the values vector, constants to numbers, and the stack depth is checked so
+ *  that evalProgram() can run on a fixed size stack without further checks.
+ */
+
+bool Math::eqCompile() {
+
+    vector<instr> vProgram;
+    int32_t       iDepth = 0;
+
+    for(auto tItem : m_ParseTree) {
+
+        instr    iItem  = {MO_INVALID, 0, 0.0};
+        double_t dValue = 0.0;
+
+        switch(tItem.type) {
+            case MP_NUMBER:
+                iItem.op    = MO_NUMBER;
+                iItem.value = tItem.value;
+                break;
+            case MP_VARIABLE:
+                iItem.op    = opVariable(tItem.content, &iItem.slot);
+                break;
+            case MP_CONST:
+                iItem.op    = opConstant(tItem.content, &dValue);
+                iItem.value = dValue;
+                break;
+            case MP_FUNC:
+                iItem.op    = opFunction(tItem.content);
+                break;
+            case MP_LOGICAL:
+                iItem.op    = opLogical(tItem.content);
+                break;
+            case MP_MATH:
+                iItem.op    = opMath(tItem.content);
+                break;
+            case MP_END:
+                continue;
+        }
+
+        if(iItem.op == MO_INVALID) {
+            printf("  Math Error: Unknown item '%s'\n", tItem.content.c_str());
+            return false;
+        }
+
+        // Each opcode consumes its arguments and pushes one value
+        int32_t nArgs = opArity(iItem.op);
+        if(iDepth < nArgs) {
+            printf("  Math Error: Too few arguments for '%s'\n", tItem.content.c_str());
+            return false;
+        }
+        iDepth += 1 - nArgs;
+        if(iDepth > MATH_STACK) {
+            printf("  Math Error: Equation exceeds maximum stack depth of %d\n", MATH_STACK);
+            return false;
+        }
+
+        vProgram.push_back(iItem);
+    }
+
+    if(iDepth != 1) {
+        printf("  Math Error: Equation does not evaluate to a single value\n");
+        return false;
+    }
+
+    m_Program = vProgram;
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  The Equation Optimiser
+ * ========================
+ *  Rewrites the program from eqCompile() so that it does less work per evaluation:
+ *  - Operations where all arguments are constant are folded into a single number.
+ *  - Identities like x+0, x-0, x*1, x/1, x^1, --x and if() on a constant are removed.
+ *  - x^0 becomes 1, x^2 becomes sqr(x), x^0.5 becomes sqrt(x) and 0-x becomes -x.
+ *  Each stack entry tracks where its instructions start in the output, so that an operation can
+ *  drop or keep the instructions of its arguments.
+ */
+
+bool Math::eqOptimise() {
+
+    struct node {
+        size_t   start;   // Index of first instruction in vOut
+        bool     isConst; // True if the entry is a single MO_NUMBER
+        double_t value;   // The value if constant
+    };
+
+    vector<instr> vOut;
+    vector<node>  vStack;
+
+    auto isValue = [](const node& nItem, double_t dValue) {
+        return nItem.isConst && nItem.value == dValue;
+    };
+
+    for(const instr& iItem : m_Program) {
+
+        int32_t nArgs = opArity(iItem.op);
+
+        if(nArgs == 0) {
+            vStack.push_back(node({vOut.size(), iItem.op == MO_NUMBER, iItem.value}));
+            vOut.push_back(iItem);
+            continue;
+        }
+
+        node*  pArg   = &vStack[vStack.size()-nArgs];
+        size_t iStart = pArg[0].start;
+        bool   isFold = true;
+
+        for(int32_t k=0; k<nArgs; k++) {
+            isFold = isFold && pArg[k].isConst;
+        }
+
+        // Fold constant operations by evaluating them. A failed evaluation (mod of non-integers)
+        // is left in the program so the error is reported by Eval.
+        if(isFold) {
+            vector<instr> vFold;
+            double_t      dValue = 0.0;
+            for(int32_t k=0; k<nArgs; k++) {
+                vFold.push_back(instr({MO_NUMBER, 0, pArg[k].value}));
+            }
+            vFold.push_back(iItem);
+            if(evalProgram(vFold, NULL, &dValue)) {
+                vOut.resize(iStart);
+                vStack.resize(vStack.size()-nArgs);
+                vStack.push_back(node({iStart, true, dValue}));
+                vOut.push_back(instr({MO_NUMBER, 0, dValue}));
+                continue;
+            }
+        }
+
+        int32_t  iKeep  = -1;         // Argument the operation reduces to
+        bool     isSet  = false;      // True if the operation reduces to the constant dSet
+        double_t dSet   = 0.0;
+        value_t  iUnary = MO_INVALID; // Unary opcode replacing a power with constant exponent
+
+        switch(iItem.op) {
+            case MO_ADD:
+                if(isValue(pArg[1], 0.0)) iKeep = 0; else
+                if(isValue(pArg[0], 0.0)) iKeep = 1;
+                break;
+            case MO_SUB:
+                if(isValue(pArg[1], 0.0)) iKeep = 0;
+                break;
+            case MO_MUL:
+                if(isValue(pArg[1], 1.0)) iKeep = 0; else
+                if(isValue(pArg[0], 1.0)) iKeep = 1;
+                break;
+            case MO_DIV:
+                if(isValue(pArg[1], 1.0)) iKeep = 0;
+                break;
+            case MO_POW:
+                if(isValue(pArg[1], 1.0)) iKeep  = 0;       else
+                if(isValue(pArg[1], 0.0)) isSet  = true;    else
+                if(isValue(pArg[1], 2.0)) iUnary = MO_SQR;  else
+                if(isValue(pArg[1], 0.5)) iUnary = MO_SQRT;
+                dSet = 1.0;
+                break;
+            case MO_IF:
+                if(pArg[0].isConst) iKeep = (pArg[0].value == EVAL_TRUE) ? 1 : 2;
+                break;
+        }
+
+        if(iKeep >= 0) {
+            // Replace the operation by the instructions of one of its arguments
+            size_t iEnd = (iKeep+1 < nArgs) ? pArg[iKeep+1].start : vOut.size();
+            node   nKeep = pArg[iKeep];
+            vector<instr> vKeep(vOut.begin()+nKeep.start, vOut.begin()+iEnd);
+            vOut.resize(iStart);
+            vOut.insert(vOut.end(), vKeep.begin(), vKeep.end());
+            vStack.resize(vStack.size()-nArgs);
+            vStack.push_back(node({iStart, nKeep.isConst, nKeep.value}));
+            continue;
+        }
+
+        if(isSet) {
+            vOut.resize(iStart);
+            vStack.resize(vStack.size()-nArgs);
+            vStack.push_back(node({iStart, true, dSet}));
+            vOut.push_back(instr({MO_NUMBER, 0, dSet}));
+            continue;
+        }
+
+        if(iUnary != MO_INVALID) {
+            // Drop the constant second argument
+            vOut.pop_back();
+            vStack.resize(vStack.size()-nArgs);
+            vStack.push_back(node({iStart, false, 0.0}));
+            vOut.push_back(instr({iUnary, 0, 0.0}));
+            continue;
+        }
+
+        if(iItem.op == MO_SUB && isValue(pArg[0], 0.0)) {
+            // 0-x is -x, drop the leading zero
+            vOut.erase(vOut.begin()+iStart);
+            vStack.resize(vStack.size()-nArgs);
+            vStack.push_back(node({iStart, false, 0.0}));
+            vOut.push_back(instr({MO_NEG, 0, 0.0}));
+            continue;
+        }
+
+        if(iItem.op == MO_NEG && vOut.back().op == MO_NEG) {
+            // Double negation
+            vOut.pop_back();
+            continue;
+        }
+
+        vStack.resize(vStack.size()-nArgs);
+        vStack.push_back(node({iStart, false, 0.0}));
+        vOut.push_back(iItem);
+    }
+
+    m_Program = vOut;
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
 /**
  *  Function :: validOperator
  * ===========================
@@ -661,258 +869,292 @@ void Math::precedenceMath(string_t sOperator, int32_t* pPrecedence, int32_t* pAs
 // ********************************************************************************************** //
 
 /**
- *  Function :: evalVariable
- * ==========================
- *  Evaluate input variable set by setVariables()
+ *  Function :: opVariable
+ * ========================
+ *  Resolves a variable set by setVariables() to its index in the values vector
  */
 
-bool Math::evalVariable(string_t sVariable, vdouble_t* pValues, double_t* pReturn) {
+value_t Math::opVariable(const string_t& sVariable, int32_t* pSlot) {
 
-    size_t iPos = 0;
+    int32_t iPos = 0;
 
     for(auto sItem : m_WVariable) {
         if(sItem == sVariable) {
-            *pReturn = pValues->at(iPos);
-            return true;
+            *pSlot = iPos;
+            return MO_VARIABLE;
         }
         iPos++;
     }
 
-    return false;
+    return MO_INVALID;
 }
 
 // ********************************************************************************************** //
 
 /**
- *  Function :: evalConstant
- * ==========================
- *  Evaluate constant
+ *  Function :: opConstant
+ * ========================
+ *  Resolves a constant to its value
  */
 
-bool Math::evalConstant(string_t sVariable, double_t* pReturn) {
+value_t Math::opConstant(const string_t& sVariable, double_t* pValue) {
 
     if(sVariable == "pi") {
-        *pReturn = M_PI;
-        return true;
+        *pValue = M_PI;
+        return MO_NUMBER;
     }
 
-    return false;
+    return MO_INVALID;
 }
 
 // ********************************************************************************************** //
 
 /**
- *  Function :: evalFunction
- * ==========================
- *  Evaluate math function
+ *  Function :: opFunction
+ * ========================
+ *  Returns the opcode of a math function
  */
 
-bool Math::evalFunction(string_t sVariable, vdouble_t* pStack, double_t* pReturn) {
+value_t Math::opFunction(const string_t& sVariable) {
 
-    if(pStack->size() < 1) return false;
+    if(sVariable == "sin") return MO_SIN;
+    if(sVariable == "cos") return MO_COS;
+    if(sVariable == "tan") return MO_TAN;
+    if(sVariable == "exp") return MO_EXP;
+    if(sVariable == "log") return MO_LOG;
+    if(sVariable == "abs") return MO_ABS;
+    if(sVariable == "mod") return MO_MOD;
+    if(sVariable == "if")  return MO_IF;
 
-    bool isValid = false;
+    return MO_INVALID;
+}
 
-    if(sVariable == "sin") {
-        *pReturn = sin(pStack->back());
-        pStack->pop_back();
-        isValid = true;
-    } else
-    if(sVariable == "cos") {
-        *pReturn = cos(pStack->back());
-        pStack->pop_back();
-        isValid = true;
-    } else
-    if(sVariable == "tan") {
-        *pReturn = tan(pStack->back());
-        pStack->pop_back();
-        isValid = true;
-    } else
-    if(sVariable == "exp") {
-        *pReturn = exp(pStack->back());
-        pStack->pop_back();
-        isValid = true;
-    } else
-    if(sVariable == "log") {
-        *pReturn = log(pStack->back());
-        pStack->pop_back();
-        isValid = true;
-    } else
-    if(sVariable == "mod") {
+// ********************************************************************************************** //
 
-        if(pStack->size() < 2) return false;
+/**
+ *  Function :: opLogical
+ * =======================
+ *  Returns the opcode of a logic operator
+ */
 
-        double_t dValL = pStack->back(); pStack->pop_back();
-        double_t dValR = pStack->back(); pStack->pop_back();
+value_t Math::opLogical(const string_t& sVariable) {
 
-        if(dValL == floor(dValL) && dValR == floor(dValR)) {
-            *pReturn = (int)floor(dValL)%(int)floor(dValR);
-            isValid = true;
-        } else {
-            isValid = false;
-        }
-    } else
-    if(sVariable == "if") {
+    if(sVariable == "&&") return MO_AND;
+    if(sVariable == "||") return MO_OR;
+    if(sVariable == "==") return MO_EQ;
+    if(sVariable == "<")  return MO_LT;
+    if(sVariable == ">")  return MO_GT;
+    if(sVariable == ">=") return MO_GE;
+    if(sVariable == "<=") return MO_LE;
+    if(sVariable == "!=") return MO_NE;
+    if(sVariable == "<>") return MO_NE;
 
-        if(pStack->size() < 3) return false;
+    return MO_INVALID;
+}
 
-        double_t dFalse = pStack->back(); pStack->pop_back();
-        double_t dTrue  = pStack->back(); pStack->pop_back();
-        double_t dBool  = pStack->back(); pStack->pop_back();
+// ********************************************************************************************** //
 
-        if(dBool == EVAL_TRUE) {
-            *pReturn = dTrue;
-        } else {
-            *pReturn = dFalse;
-        }
+/**
+ *  Function :: opMath
+ * ====================
+ *  Returns the opcode of a math operator
+ */
 
-        isValid = true;
-    }
+value_t Math::opMath(const string_t& sVariable) {
+
+    if(sVariable == "_") return MO_NEG;
+    if(sVariable == "+") return MO_ADD;
+    if(sVariable == "-") return MO_SUB;
+    if(sVariable == "*") return MO_MUL;
+    if(sVariable == "/") return MO_DIV;
+    if(sVariable == "^") return MO_POW;
 
-    return isValid;
+    return MO_INVALID;
 }
 
 // ********************************************************************************************** //
 
 /**
- *  Function :: evalLogical
- * =========================
- *  Evaluate logic operator
+ *  Function :: opArity
+ * =====================
+ *  Returns the number of stack values consumed by an opcode
  */
 
-bool Math::evalLogical(string_t sVariable, vdouble_t* pStack, double_t* pReturn) {
-
-    if(pStack->size() < 2) {
-        return false;
+int32_t Math::opArity(value_t iOp) const {
+
+    switch(iOp) {
+        case MO_NUMBER:
+        case MO_VARIABLE:
+            return 0;
+        case MO_NEG:
+        case MO_SIN:
+        case MO_COS:
+        case MO_TAN:
+        case MO_EXP:
+        case MO_LOG:
+        case MO_ABS:
+        case MO_SQR:
+        case MO_SQRT:
+            return 1;
+        case MO_IF:
+            return 3;
     }
 
-    bool     isValid = false;
-    double_t dValR   = pStack->back(); pStack->pop_back();
-    double_t dValL   = pStack->back(); pStack->pop_back();
+    return 2;
+}
 
-    if(sVariable == "&&") {
-        if(dValL && dValR) {
-            *pReturn = EVAL_TRUE;
-        } else {
-            *pReturn = EVAL_FALSE;
-        }
-        isValid = true;
-    } else
-    if(sVariable == "||") {
-        if(dValL || dValR) {
-            *pReturn = EVAL_TRUE;
-        } else {
-            *pReturn = EVAL_FALSE;
-        }
-        isValid = true;
-    } else
-    if(sVariable == "==") {
-        if(dValL == dValR) {
-            *pReturn = EVAL_TRUE;
-        } else {
-            *pReturn = EVAL_FALSE;
-        }
-        isValid = true;
-    } else
-    if(sVariable == "<") {
-        if(dValL < dValR) {
-            *pReturn = EVAL_TRUE;
-        } else {
-            *pReturn = EVAL_FALSE;
-        }
-        isValid = true;
-    } else
-    if(sVariable == ">") {
-        if(dValL > dValR) {
-            *pReturn = EVAL_TRUE;
-        } else {
-            *pReturn = EVAL_FALSE;
-        }
-        isValid = true;
-    } else
-    if(sVariable == ">=") {
-        if(dValL >= dValR) {
-            *pReturn = EVAL_TRUE;
-        } else {
-            *pReturn = EVAL_FALSE;
-        }
-        isValid = true;
-    } else
-    if(sVariable == "<=") {
-        if(dValL <= dValR) {
-            *pReturn = EVAL_TRUE;
-        } else {
-            *pReturn = EVAL_FALSE;
-        }
-        isValid = true;
-    } else
-    if(sVariable == "!=" || sVariable == "<>") {
-        if(dValL != dValR) {
-            *pReturn = EVAL_TRUE;
-        } else {
-            *pReturn = EVAL_FALSE;
+// ********************************************************************************************** //
+
+/**
+ *  Function :: evalProgram
+ * =========================
+ *  Runs a compiled program on a fixed size stack
+ *  Using Reverse Polish notation
+ *  https://en.wikipedia.org/wiki/Reverse_Polish_notation
+ *  Returns false only if mod is called with non-integer arguments
+ */
+
+bool Math::evalProgram(const vector<instr>& vProgram, const double_t* pValues, double_t* pReturn) const {
+
+    double_t aStack[MATH_STACK];
+    int32_t  iTop = -1;
+
+    for(const instr& iItem : vProgram) {
+
+        switch(iItem.op) {
+
+            case MO_NUMBER:   aStack[++iTop] = iItem.value;          break;
+            case MO_VARIABLE: aStack[++iTop] = pValues[iItem.slot];  break;
+
+            case MO_NEG: aStack[iTop] = -aStack[iTop];                      break;
+            case MO_ADD: iTop--; aStack[iTop] += aStack[iTop+1];            break;
+            case MO_SUB: iTop--; aStack[iTop] -= aStack[iTop+1];            break;
+            case MO_MUL: iTop--; aStack[iTop] *= aStack[iTop+1];            break;
+            case MO_DIV: iTop--; aStack[iTop] /= aStack[iTop+1];            break;
+            case MO_POW: iTop--; aStack[iTop] = pow(aStack[iTop],aStack[iTop+1]); break;
+
+            case MO_AND: iTop--; aStack[iTop] = (aStack[iTop] && aStack[iTop+1]) ? EVAL_TRUE : EVAL_FALSE; break;
+            case MO_OR:  iTop--; aStack[iTop] = (aStack[iTop] || aStack[iTop+1]) ? EVAL_TRUE : EVAL_FALSE; break;
+            case MO_EQ:  iTop--; aStack[iTop] = (aStack[iTop] == aStack[iTop+1]) ? EVAL_TRUE : EVAL_FALSE; break;
+            case MO_LT:  iTop--; aStack[iTop] = (aStack[iTop] <  aStack[iTop+1]) ? EVAL_TRUE : EVAL_FALSE; break;
+            case MO_GT:  iTop--; aStack[iTop] = (aStack[iTop] >  aStack[iTop+1]) ? EVAL_TRUE : EVAL_FALSE; break;
+            case MO_GE:  iTop--; aStack[iTop] = (aStack[iTop] >= aStack[iTop+1]) ? EVAL_TRUE : EVAL_FALSE; break;
+            case MO_LE:  iTop--; aStack[iTop] = (aStack[iTop] <= aStack[iTop+1]) ? EVAL_TRUE : EVAL_FALSE; break;
+            case MO_NE:  iTop--; aStack[iTop] = (aStack[iTop] != aStack[iTop+1]) ? EVAL_TRUE : EVAL_FALSE; break;
+
+            case MO_SIN:  aStack[iTop] = sin(aStack[iTop]);          break;
+            case MO_COS:  aStack[iTop] = cos(aStack[iTop]);          break;
+            case MO_TAN:  aStack[iTop] = tan(aStack[iTop]);          break;
+            case MO_EXP:  aStack[iTop] = exp(aStack[iTop]);          break;
+            case MO_LOG:  aStack[iTop] = log(aStack[iTop]);          break;
+            case MO_ABS:  aStack[iTop] = fabs(aStack[iTop]);         break;
+            case MO_SQR:  aStack[iTop] = aStack[iTop]*aStack[iTop]; break;
+            case MO_SQRT: aStack[iTop] = sqrt(aStack[iTop]);         break;
+
+            case MO_MOD:
+                // Note: Operand order is kept from the original string evaluator
+                iTop--;
+                if(aStack[iTop] != floor(aStack[iTop]) || aStack[iTop+1] != floor(aStack[iTop+1])) {
+                    return false;
+                }
+                aStack[iTop] = (int)floor(aStack[iTop+1])%(int)floor(aStack[iTop]);
+                break;
+
+            case MO_IF:
+                iTop -= 2;
+                aStack[iTop] = (aStack[iTop] == EVAL_TRUE) ? aStack[iTop+1] : aStack[iTop+2];
+                break;
         }
-        isValid = true;
     }
 
-    return isValid;
+    *pReturn = aStack[0];
+
+    return true;
 }
 
 // ********************************************************************************************** //
 
 /**
- *  Function :: evalMath
- * ======================
- *  Evaluate math operator
+ *  Function :: evalBlock
+ * =======================
+ *  Runs the compiled program on a block of nBlock points starting at iStart
+ *  Each stack entry holds one value per point in the block
+ *  Returns false only if mod is called with non-integer arguments
  */
 
-bool Math::evalMath(string_t sVariable, vdouble_t* pStack, double_t* pReturn) {
+bool Math::evalBlock(const double_t* const* pValues, index_t iStart, int32_t nBlock, double_t* pReturn) const {
 
-    bool isValid = false;
+    double_t aStack[MATH_STACK][MATH_BLOCK];
+    int32_t  iTop = -1;
 
-    if(sVariable == "_") {
-        if(pStack->size() < 1) return false;
-        double_t dVal  = pStack->back(); pStack->pop_back();
-        *pReturn       = -dVal;
-        isValid        = true;
-    } else
-    if(sVariable == "+") {
-        if(pStack->size() < 2) return false;
-        double_t dValR = pStack->back(); pStack->pop_back();
-        double_t dValL = pStack->back(); pStack->pop_back();
-        *pReturn       = dValL + dValR;
-        isValid        = true;
-    } else
-    if(sVariable == "-") {
-        if(pStack->size() < 2) return false;
-        double_t dValR = pStack->back(); pStack->pop_back();
-        double_t dValL = pStack->back(); pStack->pop_back();
-        *pReturn       = dValL - dValR;
-        isValid        = true;
-    } else
-    if(sVariable == "*") {
-        if(pStack->size() < 2) return false;
-        double_t dValR = pStack->back(); pStack->pop_back();
-        double_t dValL = pStack->back(); pStack->pop_back();
-        *pReturn       = dValL * dValR;
-        isValid        = true;
-    } else
-    if(sVariable == "/") {
-        if(pStack->size() < 2) return false;
-        double_t dValR = pStack->back(); pStack->pop_back();
-        double_t dValL = pStack->back(); pStack->pop_back();
-        *pReturn       = dValL / dValR;
-        isValid        = true;
-    } else
-    if(sVariable == "^") {
-        if(pStack->size() < 2) return false;
-        double_t dValR = pStack->back(); pStack->pop_back();
-        double_t dValL = pStack->back(); pStack->pop_back();
-        *pReturn       = pow(dValL,dValR);
-        isValid        = true;
+    for(const instr& iItem : m_Program) {
+
+        double_t* pA;
+        double_t* pB;
+        double_t* pC;
+
+        // Pop the arguments; pA is the first argument and where the result is stored
+        switch(opArity(iItem.op)) {
+            case 0:  iTop += 1; pA = aStack[iTop]; pB = NULL;           pC = NULL;           break;
+            case 1:             pA = aStack[iTop]; pB = NULL;           pC = NULL;           break;
+            case 2:  iTop -= 1; pA = aStack[iTop]; pB = aStack[iTop+1]; pC = NULL;           break;
+            default: iTop -= 2; pA = aStack[iTop]; pB = aStack[iTop+1]; pC = aStack[iTop+2]; break;
+        }
+
+        switch(iItem.op) {
+
+            case MO_NUMBER:
+                for(int32_t i=0; i<nBlock; i++) pA[i] = iItem.value;
+                break;
+
+            case MO_VARIABLE: {
+                const double_t* pVar = pValues[iItem.slot] + iStart;
+                for(int32_t i=0; i<nBlock; i++) pA[i] = pVar[i];
+                break;
+            }
+
+            case MO_NEG: for(int32_t i=0; i<nBlock; i++) pA[i] = -pA[i];              break;
+            case MO_ADD: for(int32_t i=0; i<nBlock; i++) pA[i] += pB[i];              break;
+            case MO_SUB: for(int32_t i=0; i<nBlock; i++) pA[i] -= pB[i];              break;
+            case MO_MUL: for(int32_t i=0; i<nBlock; i++) pA[i] *= pB[i];              break;
+            case MO_DIV: for(int32_t i=0; i<nBlock; i++) pA[i] /= pB[i];              break;
+            case MO_POW: for(int32_t i=0; i<nBlock; i++) pA[i] = pow(pA[i],pB[i]);    break;
+
+            case MO_AND: for(int32_t i=0; i<nBlock; i++) pA[i] = (pA[i] && pB[i]) ? EVAL_TRUE : EVAL_FALSE; break;
+            case MO_OR:  for(int32_t i=0; i<nBlock; i++) pA[i] = (pA[i] || pB[i]) ? EVAL_TRUE : EVAL_FALSE; break;
+            case MO_EQ:  for(int32_t i=0; i<nBlock; i++) pA[i] = (pA[i] == pB[i]) ? EVAL_TRUE : EVAL_FALSE; break;
+            case MO_LT:  for(int32_t i=0; i<nBlock; i++) pA[i] = (pA[i] <  pB[i]) ? EVAL_TRUE : EVAL_FALSE; break;
+            case MO_GT:  for(int32_t i=0; i<nBlock; i++) pA[i] = (pA[i] >  pB[i]) ? EVAL_TRUE : EVAL_FALSE; break;
+            case MO_GE:  for(int32_t i=0; i<nBlock; i++) pA[i] = (pA[i] >= pB[i]) ? EVAL_TRUE : EVAL_FALSE; break;
+            case MO_LE:  for(int32_t i=0; i<nBlock; i++) pA[i] = (pA[i] <= pB[i]) ? EVAL_TRUE : EVAL_FALSE; break;
+            case MO_NE:  for(int32_t i=0; i<nBlock; i++) pA[i] = (pA[i] != pB[i]) ? EVAL_TRUE : EVAL_FALSE; break;
+
+            case MO_SIN:  for(int32_t i=0; i<nBlock; i++) pA[i] = sin(pA[i]);   break;
+            case MO_COS:  for(int32_t i=0; i<nBlock; i++) pA[i] = cos(pA[i]);   break;
+            case MO_TAN:  for(int32_t i=0; i<nBlock; i++) pA[i] = tan(pA[i]);   break;
+            case MO_EXP:  for(int32_t i=0; i<nBlock; i++) pA[i] = exp(pA[i]);   break;
+            case MO_LOG:  for(int32_t i=0; i<nBlock; i++) pA[i] = log(pA[i]);   break;
+            case MO_ABS:  for(int32_t i=0; i<nBlock; i++) pA[i] = fabs(pA[i]);  break;
+            case MO_SQR:  for(int32_t i=0; i<nBlock; i++) pA[i] = pA[i]*pA[i]; break;
+            case MO_SQRT: for(int32_t i=0; i<nBlock; i++) pA[i] = sqrt(pA[i]);  break;
+
+            case MO_MOD:
+                // Note: Operand order is kept from the original string evaluator
+                for(int32_t i=0; i<nBlock; i++) {
+                    if(pA[i] != floor(pA[i]) || pB[i] != floor(pB[i])) return false;
+                    pA[i] = (int)floor(pB[i])%(int)floor(pA[i]);
+                }
+                break;
+
+            case MO_IF:
+                for(int32_t i=0; i<nBlock; i++) pA[i] = (pA[i] == EVAL_TRUE) ? pB[i] : pC[i];
+                break;
+        }
     }
 
-    return isValid;
+    for(int32_t i=0; i<nBlock; i++) pReturn[i] = aStack[0][i];
+
+    return true;
 }
 
 // ********************************************************************************************** //
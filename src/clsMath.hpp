@@ -31,6 +31,38 @@
 #define EVAL_TRUE    1.0
 #define EVAL_FALSE   0.0
 
+#define MATH_STACK   64
+#define MATH_BLOCK   64
+
+// Compiled opcodes
+#define MO_INVALID  -1
+#define MO_NUMBER    0
+#define MO_VARIABLE  1
+#define MO_NEG       2
+#define MO_ADD       3
+#define MO_SUB       4
+#define MO_MUL       5
+#define MO_DIV       6
+#define MO_POW       7
+#define MO_AND       8
+#define MO_OR        9
+#define MO_EQ       10
+#define MO_LT       11
+#define MO_GT       12
+#define MO_GE       13
+#define MO_LE       14
+#define MO_NE       15
+#define MO_SIN      16
+#define MO_COS      17
+#define MO_TAN      18
+#define MO_EXP      19
+#define MO_LOG      20
+#define MO_ABS      21
+#define MO_MOD      22
+#define MO_IF       23
+#define MO_SQR      24
+#define MO_SQRT     25
+
 // Includes
 #include "config.hpp"
 #include <cctype>
@@ -59,7 +91,9 @@ public:
     * Methods
     */
 
-    bool Eval(vdouble_t, double_t*);
+    bool Eval(const vdouble_t&, double_t*) const;
+    bool Eval(const double_t*, double_t*) const;
+    bool EvalBatch(const double_t* const*, index_t, double_t*) const;
 
    /**
     * Properties
@@ -77,12 +111,20 @@ private:
         double_t value;
     };
 
+    struct instr {
+        value_t  op;    // Opcode
+        int32_t  slot;  // Variable index for MO_VARIABLE
+        double_t value; // Literal value for MO_NUMBER
+    };
+
    /**
     * Member Functions
     */
 
     bool    eqLexer();
     bool    eqParser();
+    bool    eqCompile();
+    bool    eqOptimise();
 
     value_t validOperator(string_t*);
     value_t validWord(string_t*);
@@ -92,11 +134,15 @@ private:
     void    precedenceLogical(string_t, int32_t*, int32_t*);
     void    precedenceMath(string_t, int32_t*, int32_t*);
 
-    bool    evalVariable(string_t, vdouble_t*, double_t*);
-    bool    evalConstant(string_t, double_t*);
-    bool    evalFunction(string_t, vdouble_t*, double_t*);
-    bool    evalLogical(string_t, vdouble_t*, double_t*);
-    bool    evalMath(string_t, vdouble_t*, double_t*);
+    value_t opVariable(const string_t&, int32_t*);
+    value_t opConstant(const string_t&, double_t*);
+    value_t opFunction(const string_t&);
+    value_t opLogical(const string_t&);
+    value_t opMath(const string_t&);
+    int32_t opArity(value_t) const;
+
+    bool    evalProgram(const std::vector<instr>&, const double_t*, double_t*) const;
+    bool    evalBlock(const double_t* const*, index_t, int32_t, double_t*) const;
 
    /**
     * Member Variables
@@ -113,6 +159,7 @@ private:
     vstring_t          m_WVariable;
     std::vector<token> m_Tokens;
     std::vector<token> m_ParseTree;
+    std::vector<instr> m_Program;
 
 };
 
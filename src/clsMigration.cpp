@@ -0,0 +1,230 @@
+/**
+ *  ReyPIC – Migration Source
+ * ===========================
+ *  Moves particles that have left the node to the neighbour that owns their new position.
+ *
+ *  The species flag their leavers during the push and pack them by direction, removing them from
+ *  their arrays. The packed particles of each species go to each of the 26 neighbours as a single
+ *  message. The particle counts are exchanged first, one message per neighbour holding the counts
+ *  of all species, so the receives can be sized before the particles are sent. All messages are
+ *  non-blocking, and every species is in flight at the same time.
+ *  A particle moves less than a cell per step, so it can only reach a neighbour. Particles leaving
+ *  through the outer boundary of the box have no neighbour to go to, and are dropped.
+ */
+
+#include "clsMigration.hpp"
+
+using namespace std;
+using namespace reypic;
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Constructor
+ * ===================
+ */
+
+Migration::Migration() {
+
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Destructor
+ * ==================
+ */
+
+Migration::~Migration() {
+
+    Free();
+}
+
+// ********************************************************************************************** //
+//                                       Main Class Methods                                       //
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Setup
+ * =================
+ *  Finds the neighbours of this node on the Cartesian communicator mComm, and allocates counts and
+ *  buffers for nSpecies species. Neighbours outside a non-periodic boundary are MPI_PROC_NULL.
+ */
+
+bool Migration::Setup(MPI_Comm mComm, int32_t nSpecies) {
+
+    Free();
+
+    int32_t aDims[3], aPeriods[3], aCoords[3];
+
+    MPI_Cart_get(mComm, 3, aDims, aPeriods, aCoords);
+    MPI_Comm_dup(mComm, &m_Comm);
+
+    m_Rank.assign(MIGR_DIRS, MPI_PROC_NULL);
+    for(int32_t iDir=0; iDir<MIGR_DIRS; iDir++) {
+
+        int32_t aOff[3] = {iDir%3 - 1, (iDir/3)%3 - 1, iDir/9 - 1};
+        if(aOff[0] == 0 && aOff[1] == 0 && aOff[2] == 0) continue;
+
+        int32_t aNeighbour[3];
+        bool    isOutside = false;
+
+        for(int32_t iDim=0; iDim<3; iDim++) {
+            aNeighbour[iDim] = aCoords[iDim] + aOff[iDim];
+            if(aPeriods[iDim]) {
+                aNeighbour[iDim] = (aNeighbour[iDim] + aDims[iDim]) % aDims[iDim];
+            } else
+            if(aNeighbour[iDim] < 0 || aNeighbour[iDim] >= aDims[iDim]) {
+                isOutside = true;
+            }
+        }
+
+        if(!isOutside) {
+            MPI_Cart_rank(mComm, aNeighbour, &m_Rank[iDir]);
+        }
+    }
+
+    m_Species = nSpecies;
+    m_SendCount.assign(MIGR_DIRS*nSpecies, 0);
+    m_RecvCount.assign(MIGR_DIRS*nSpecies, 0);
+    m_SendBuf.assign(nSpecies, vvdouble_t(MIGR_DIRS));
+    m_RecvBuf.assign(nSpecies, vvdouble_t(MIGR_DIRS));
+    m_Requests.reserve(2*MIGR_DIRS*(nSpecies+1));
+    m_isSetup = true;
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Exchange
+ * ====================
+ *  Collects the leavers of all species flagged in the last push and sends them to the neighbours.
+ *  Data sent towards direction d arrives from direction -d, which has index 26-d, and the tags
+ *  carry the direction so that messages between the same two nodes are told apart. Count messages
+ *  use tags 0 to 26, and the particles of species s use tags 27*(s+1) and up.
+ *  Returns ERR_EXEC on all nodes if any node could not store the particles it received.
+ */
+
+error_t Migration::Exchange(vector<Species>& vSpecies) {
+
+    if(!m_isSetup) return ERR_NONE;
+
+    double_t tStart = MPI_Wtime();
+
+    // Remove leavers from the species and pack them
+    for(int32_t iS=0; iS<m_Species; iS++) {
+        vSpecies[iS].PackLeavers(m_SendBuf[iS]);
+        for(int32_t iDir=0; iDir<MIGR_DIRS; iDir++) {
+            index_t nSend = m_SendBuf[iS][iDir].size()/PART_ARRAYS;
+            m_SendCount[iDir*m_Species+iS] = nSend;
+            m_RecvCount[iDir*m_Species+iS] = 0;
+            if(m_Rank[iDir] == MPI_PROC_NULL) {
+                m_Lost += nSend;
+            } else {
+                m_Sent += nSend;
+            }
+        }
+    }
+
+    // Exchange counts for all species
+    m_Requests.clear();
+    for(int32_t iDir=0; iDir<MIGR_DIRS; iDir++) {
+        if(m_Rank[iDir] == MPI_PROC_NULL) continue;
+        MPI_Request rRecv;
+        MPI_Irecv(&m_RecvCount[iDir*m_Species], m_Species, MPI_UINT64_T, m_Rank[iDir],
+                  26-iDir, m_Comm, &rRecv);
+        m_Requests.push_back(rRecv);
+    }
+    for(int32_t iDir=0; iDir<MIGR_DIRS; iDir++) {
+        if(m_Rank[iDir] == MPI_PROC_NULL) continue;
+        MPI_Request rSend;
+        MPI_Isend(&m_SendCount[iDir*m_Species], m_Species, MPI_UINT64_T, m_Rank[iDir],
+                  iDir, m_Comm, &rSend);
+        m_Requests.push_back(rSend);
+    }
+    MPI_Waitall((int)m_Requests.size(), m_Requests.data(), MPI_STATUSES_IGNORE);
+
+    // Exchange particles, skipping empty messages on both sides
+    m_Requests.clear();
+    for(int32_t iS=0; iS<m_Species; iS++) {
+        for(int32_t iDir=0; iDir<MIGR_DIRS; iDir++) {
+            index_t nRecv = m_RecvCount[iDir*m_Species+iS];
+            if(nRecv == 0) continue;
+            MPI_Request rRecv;
+            m_RecvBuf[iS][iDir].resize(nRecv*PART_ARRAYS);
+            MPI_Irecv(m_RecvBuf[iS][iDir].data(), (int)(nRecv*PART_ARRAYS), MPI_DOUBLE, m_Rank[iDir],
+                      26-iDir + 27*(iS+1), m_Comm, &rRecv);
+            m_Requests.push_back(rRecv);
+        }
+    }
+    for(int32_t iS=0; iS<m_Species; iS++) {
+        for(int32_t iDir=0; iDir<MIGR_DIRS; iDir++) {
+            index_t nSend = m_SendCount[iDir*m_Species+iS];
+            if(nSend == 0 || m_Rank[iDir] == MPI_PROC_NULL) continue;
+            MPI_Request rSend;
+            MPI_Isend(m_SendBuf[iS][iDir].data(), (int)(nSend*PART_ARRAYS), MPI_DOUBLE, m_Rank[iDir],
+                      iDir + 27*(iS+1), m_Comm, &rSend);
+            m_Requests.push_back(rSend);
+        }
+    }
+    MPI_Waitall((int)m_Requests.size(), m_Requests.data(), MPI_STATUSES_IGNORE);
+
+    // Add arrivals to the species
+    int32_t isFailed = 0;
+    for(int32_t iS=0; iS<m_Species; iS++) {
+        for(int32_t iDir=0; iDir<MIGR_DIRS; iDir++) {
+            index_t nRecv = m_RecvCount[iDir*m_Species+iS];
+            if(nRecv == 0) continue;
+            if(!vSpecies[iS].AppendParticles(m_RecvBuf[iS][iDir].data(), nRecv)) isFailed = 1;
+        }
+    }
+
+    int32_t isAnyFailed = 0;
+    MPI_Allreduce(&isFailed, &isAnyFailed, 1, MPI_INT, MPI_MAX, m_Comm);
+
+    m_Time += MPI_Wtime() - tStart;
+
+    if(isAnyFailed) {
+        int32_t iRank = 0;
+        MPI_Comm_rank(m_Comm, &iRank);
+        if(iRank == 0) printf("  Migration Error: a node could not store the particles it received\n");
+        return ERR_EXEC;
+    }
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Free
+ * ================
+ *  Releases the communicator and buffers
+ */
+
+void Migration::Free() {
+
+    int32_t isFinalized = 0;
+    MPI_Finalized(&isFinalized);
+    if(isFinalized) return;
+
+    if(m_Comm != MPI_COMM_NULL) {
+        MPI_Comm_free(&m_Comm);
+    }
+
+    m_Rank.clear();
+    m_SendCount.clear();
+    m_RecvCount.clear();
+    m_SendBuf.clear();
+    m_RecvBuf.clear();
+    m_Requests.clear();
+    m_isSetup = false;
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+// End Class Migration
@@ -0,0 +1,73 @@
+/**
+ * ReyPIC – Migration Header
+ */
+
+#ifndef CLASS_MIGRATION
+#define CLASS_MIGRATION
+
+// Class-specific macros
+#define MIGR_DIRS    27     // Directions including the node itself
+
+#include "config.hpp"
+
+#include "clsSpecies.hpp"
+
+namespace reypic {
+
+class Migration {
+
+public:
+
+   /**
+    * Constructor/Destructor
+    */
+
+    Migration();
+    Migration(const Migration&) = delete;
+    ~Migration();
+
+    Migration& operator=(const Migration&) = delete;
+
+   /**
+    * Setters/Getters
+    */
+
+    double_t getTime() const {return m_Time;};
+    index_t  getSent() const {return m_Sent;};
+    index_t  getLost() const {return m_Lost;};
+
+   /**
+    * Methods
+    */
+
+    bool Setup(MPI_Comm, int32_t);
+    error_t Exchange(std::vector<Species>&);
+    void Free();
+
+private:
+
+   /**
+    * Member Variables
+    */
+
+    bool                 m_isSetup  = false;
+    MPI_Comm             m_Comm     = MPI_COMM_NULL; // Private copy of the Cartesian communicator
+    int32_t              m_Species  = 0;             // Number of species
+
+    vint_t               m_Rank;                     // Neighbour rank per direction
+    std::vector<index_t> m_SendCount;                // Particles sent per direction and species
+    std::vector<index_t> m_RecvCount;                // Particles received per direction and species
+    std::vector<vvdouble_t> m_SendBuf;               // Packed leavers per species and direction
+    std::vector<vvdouble_t> m_RecvBuf;               // Received particles per species and direction
+    std::vector<MPI_Request> m_Requests;
+
+    // Statistics
+    double_t             m_Time     = 0.0;           // Time spent in Exchange()
+    index_t              m_Sent     = 0;             // Particles sent to other nodes
+    index_t              m_Lost     = 0;             // Particles that left the simulation box
+
+}; // End Class Migration
+
+} // End NameSpace
+
+#endif
@@ -0,0 +1,265 @@
+/**
+ *  ReyPIC – Particles Source
+ * ===========================
+ *  Structure of arrays particle store. All particle attributes are kept in separate contiguous
+ *  arrays carved out of a single aligned allocation. The capacity is padded so that every array
+ *  starts on a PART_ALIGN boundary, and grows geometrically so that appending particles does not
+ *  reallocate on every call.
+ */
+
+#include "clsParticles.hpp"
+#include <new>
+
+using namespace std;
+using namespace reypic;
+
+static_assert(sizeof(index_t) == sizeof(double_t), "Tag array must have the same size as double_t");
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Constructor
+ * ===================
+ */
+
+Particles::Particles() {
+
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Copy Constructor
+ * ==================
+ *  Throws std::bad_alloc if the copy cannot be allocated, as a constructor has no other way to
+ *  report it, and an empty copy would silently lose the particles
+ */
+
+Particles::Particles(const Particles& pOther) {
+
+    if(pOther.m_Capacity == 0) return;
+    if(!Reserve(pOther.m_Capacity)) throw bad_alloc();
+
+    memcpy(m_Data, pOther.m_Data, PART_ARRAYS*m_Capacity*sizeof(double_t));
+    m_Size = pOther.m_Size;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Move Constructor
+ * ==================
+ */
+
+Particles::Particles(Particles&& pOther) {
+
+    m_Data     = pOther.m_Data;
+    m_Size     = pOther.m_Size;
+    m_Capacity = pOther.m_Capacity;
+    setPointers();
+
+    pOther.m_Data     = NULL;
+    pOther.m_Size     = 0;
+    pOther.m_Capacity = 0;
+    pOther.setPointers();
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Destructor
+ * ==================
+ */
+
+Particles::~Particles() {
+
+    free(m_Data);
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Assignment
+ * ============
+ *  Copy and swap
+ */
+
+Particles& Particles::operator=(Particles pOther) {
+
+    Swap(pOther);
+
+    return *this;
+}
+
+// ********************************************************************************************** //
+//                                       Main Class Methods                                       //
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Reserve
+ * ===================
+ *  Makes sure there is room for at least nCapacity particles. Existing particles are kept.
+ */
+
+bool Particles::Reserve(index_t nCapacity) {
+
+    if(nCapacity <= m_Capacity) return true;
+
+    // Pad capacity so that each array is a multiple of the alignment
+    index_t nAlign = PART_ALIGN/sizeof(double_t);
+    nCapacity = ((nCapacity + nAlign - 1)/nAlign)*nAlign;
+
+    void* pData = NULL;
+    if(posix_memalign(&pData, PART_ALIGN, PART_ARRAYS*nCapacity*sizeof(double_t)) != 0) {
+        printf("  Particles Error: Failed to allocate %lu particles\n", (unsigned long)nCapacity);
+        return false;
+    }
+
+    // Copy existing particles array by array into the new layout
+    if(m_Data != NULL) {
+        for(index_t iArr=0; iArr<PART_ARRAYS; iArr++) {
+            memcpy((double_t*)pData + iArr*nCapacity, (double_t*)m_Data + iArr*m_Capacity,
+                   m_Size*sizeof(double_t));
+        }
+        free(m_Data);
+    }
+
+    m_Data     = pData;
+    m_Capacity = nCapacity;
+    setPointers();
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Append
+ * ==================
+ *  Adds nAppend particles at the end of the arrays and sets pFirst to the index of the first one.
+ *  The new particles are not initialised. Capacity grows by at least PART_GROWTH.
+ */
+
+bool Particles::Append(index_t nAppend, index_t* pFirst) {
+
+    index_t nNew = m_Size + nAppend;
+
+    if(nNew > m_Capacity) {
+        index_t nGrow = (index_t)(PART_GROWTH*m_Capacity);
+        if(!Reserve(nNew > nGrow ? nNew : nGrow)) return false;
+    }
+
+    *pFirst = m_Size;
+    m_Size  = nNew;
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Resize
+ * ==================
+ *  Sets the number of particles. Shrinking keeps the allocation. Returns false, and leaves the
+ *  particles as they were, if the allocation failed.
+ */
+
+bool Particles::Resize(index_t nSize) {
+
+    if(nSize > m_Capacity && !Reserve(nSize)) return false;
+    m_Size = nSize;
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Copy
+ * ================
+ *  Copies all attributes of particle iFrom to particle iTo
+ */
+
+void Particles::Copy(index_t iFrom, index_t iTo) {
+
+    X1[iTo]  = X1[iFrom];
+    X2[iTo]  = X2[iFrom];
+    X3[iTo]  = X3[iFrom];
+    U1[iTo]  = U1[iFrom];
+    U2[iTo]  = U2[iFrom];
+    U3[iTo]  = U3[iFrom];
+    W[iTo]   = W[iFrom];
+    Tag[iTo] = Tag[iFrom];
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Clear
+ * =================
+ *  Removes all particles, but keeps the allocation
+ */
+
+void Particles::Clear() {
+
+    m_Size = 0;
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Swap
+ * ================
+ *  Exchanges the particles of two stores without copying them
+ */
+
+void Particles::Swap(Particles& pOther) {
+
+    swap(m_Data,     pOther.m_Data);
+    swap(m_Size,     pOther.m_Size);
+    swap(m_Capacity, pOther.m_Capacity);
+    setPointers();
+    pOther.setPointers();
+
+    return;
+}
+
+// ********************************************************************************************** //
+//                                        Member Functions                                        //
+// ********************************************************************************************** //
+
+/**
+ *  Function :: setPointers
+ * =========================
+ *  Points the attribute arrays into the allocation
+ */
+
+void Particles::setPointers() {
+
+    double_t* pData = (double_t*)m_Data;
+
+    if(pData == NULL) {
+        X1 = X2 = X3 = U1 = U2 = U3 = W = NULL;
+        Tag = NULL;
+        return;
+    }
+
+    X1  = pData;
+    X2  = pData + 1*m_Capacity;
+    X3  = pData + 2*m_Capacity;
+    U1  = pData + 3*m_Capacity;
+    U2  = pData + 4*m_Capacity;
+    U3  = pData + 5*m_Capacity;
+    W   = pData + 6*m_Capacity;
+    Tag = (index_t*)(pData + 7*m_Capacity);
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+// End Class Particles
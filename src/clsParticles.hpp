@@ -0,0 +1,84 @@
+/**
+ * ReyPIC – Particles Header
+ */
+
+#ifndef CLASS_PARTICLES
+#define CLASS_PARTICLES
+
+// Class-specific macros
+#define PART_ALIGN   64     // Alignment of particle arrays in bytes
+#define PART_ARRAYS  8      // Number of particle arrays
+#define PART_GROWTH  1.5    // Capacity growth factor
+
+#include "config.hpp"
+
+namespace reypic {
+
+class Particles {
+
+public:
+
+   /**
+    * Constructor/Destructor
+    */
+
+    Particles();
+    Particles(const Particles&);
+    Particles(Particles&&);
+    ~Particles();
+
+    Particles& operator=(Particles);
+
+   /**
+    * Setters/Getters
+    */
+
+    index_t getSize()     const {return m_Size;};
+    index_t getCapacity() const {return m_Capacity;};
+
+   /**
+    * Methods
+    */
+
+    bool    Reserve(index_t);
+    bool    Append(index_t, index_t*);
+    bool    Resize(index_t);
+    void    Copy(index_t, index_t);
+    void    Clear();
+    void    Swap(Particles&);
+
+   /**
+    * Properties
+    */
+
+    // Particle arrays, each PART_ALIGN aligned and of length getCapacity()
+    double_t* X1  = NULL; // Position
+    double_t* X2  = NULL;
+    double_t* X3  = NULL;
+    double_t* U1  = NULL; // Momentum
+    double_t* U2  = NULL;
+    double_t* U3  = NULL;
+    double_t* W   = NULL; // Weight
+    index_t*  Tag = NULL; // Tag
+
+private:
+
+   /**
+    * Member Functions
+    */
+
+    void setPointers();
+
+   /**
+    * Member Variables
+    */
+
+    void*   m_Data     = NULL; // Single allocation holding all arrays
+    index_t m_Size     = 0;    // Number of particles
+    index_t m_Capacity = 0;    // Number of particles allocated
+
+}; // End Class Particles
+
+} // End NameSpace
+
+#endif
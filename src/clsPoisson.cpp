@@ -0,0 +1,944 @@
+/**
+ *  ReyPIC – Poisson Source
+ * =========================
+ *  Solves for the electrostatic field of the particles loaded at setup.
+ *
+ *  The potential phi lives on the grid nodes and is zero on the box walls, which are grounded
+ *  conductors as for the field solver. Multiplied by the node volume, Poisson's equation on the
+ *  non-uniform grid is
+ *      A phi = (K1 x M2 x M3 + M1 x K2 x M3 + M1 x M2 x K3) phi = Q,
+ *  where Q is the charge on the nodes from the linear weights of the deposition, Kd is the
+ *  second difference over the cell widths in dimension d, and Md holds the node spacings. Then
+ *  E = -grad phi on the cell edges has a divergence that matches the charge in the sense of the
+ *  current deposition, so Gauss's law holds from the first step on.
+ *
+ *  When x1 and x2 have fixed resolution, the sine transform diagonalises K1 and K2, and each pair
+ *  of modes leaves a tridiagonal system in x3 for any x3 resolution. The data is moved from the
+ *  node blocks to slabs of x3 planes for the transforms, and to slabs of x2 modes for the
+ *  tridiagonal solves. Otherwise, A is solved by conjugate gradients, with the direct solve for
+ *  the mean cell widths in x1 and x2 as preconditioner, which keeps the iteration count
+ *  independent of the grid size.
+ */
+
+#include "clsPoisson.hpp"
+#include <algorithm>
+
+using namespace std;
+using namespace reypic;
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Constructor
+ * ===================
+ */
+
+Poisson::Poisson() {
+
+    MPI_Comm_size(MPI_COMM_WORLD, &m_MPISize);
+    MPI_Comm_rank(MPI_COMM_WORLD, &m_MPIRank);
+    m_isMaster = (m_MPIRank == 0);
+
+}
+
+// ********************************************************************************************** //
+//                                       Main Class Methods                                       //
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Setup
+ * =================
+ *  Reads the poisson settings of the emf section. The auto method is fft if x1 and x2 have fixed
+ *  resolution, and pcg otherwise.
+ */
+
+error_t Poisson::Setup(Input_t* simInput, Grid_t* simGrid) {
+
+    error_t errVal = ERR_NONE;
+
+    string_t sMethod = "auto";
+    errVal = simInput->ReadVariable(INPUT_EMF, 0, "poisson", &sMethod, INVAR_STRING);
+    if(errVal != ERR_NONE) return errVal;
+
+    errVal = simInput->ReadVariable(INPUT_EMF, 0, "tolerance", &m_Tolerance, INVAR_DOUBLE);
+    if(errVal != ERR_NONE) return errVal;
+
+    errVal = simInput->ReadVariable(INPUT_EMF, 0, "maxiter", &m_MaxIter, INVAR_INT);
+    if(errVal != ERR_NONE) return errVal;
+
+    if(m_Tolerance <= 0.0 || m_MaxIter < 1) {
+        if(m_isMaster) printf("  Poisson Error: tolerance and maxiter must be positive\n");
+        return ERR_SETUP;
+    }
+
+    // The transforms need a fixed cell width in x1 and x2
+    bool isUniform = true;
+    for(int32_t iDim=0; iDim<2; iDim++) {
+        const vdouble_t& vDelta = simGrid->gridDelta[iDim];
+        double_t dMean = (simGrid->gridEdge[iDim].back() - simGrid->gridEdge[iDim].front())/vDelta.size();
+        for(double_t dDelta : vDelta) {
+            if(fabs(dDelta - dMean) > 1.0e-12*dMean) isUniform = false;
+        }
+        m_Width[iDim] = dMean;
+    }
+
+    if(sMethod == "auto") {
+        m_Method = (isUniform ? POIS_FFT : POIS_PCG);
+    } else
+    if(sMethod == "fft") {
+        m_Method = POIS_FFT;
+        if(!isUniform) {
+            if(m_isMaster) printf("  Poisson Error: fft needs fixed resolution in x1 and x2\n");
+            return ERR_SETUP;
+        }
+    } else
+    if(sMethod == "pcg") {
+        m_Method = POIS_PCG;
+    } else
+    if(sMethod == "none") {
+        m_Method = POIS_NONE;
+    } else {
+        if(m_isMaster) {
+            printf("  Poisson Error: Unknown poisson '%s' (auto, fft, pcg or none)\n", sMethod.c_str());
+        }
+        return ERR_SETUP;
+    }
+
+    if(m_isMaster) {
+        const char* aMethod[3] = {"none", "sine transforms in x1 and x2", "conjugate gradients"};
+        printf("  Poisson solver: %s\n", aMethod[m_Method]);
+    }
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Solve
+ * =================
+ *  Sets E to the electrostatic field of the charge of all species, and reports the time, the
+ *  iterations and the residual. The work arrays are only kept during the solve. All nodes must
+ *  call it. Returns ERR_INIT if conjugate gradients did not converge.
+ */
+
+error_t Poisson::Solve(Grid_t* simGrid, vector<Species>& vSpecies) {
+
+    if(m_Method == POIS_NONE) return ERR_NONE;
+
+    double_t dStart = MPI_Wtime();
+
+    error_t errVal = setupLayout(simGrid);
+    if(errVal != ERR_NONE) return errVal;
+
+    index_t nSize = simGrid->getFieldSize();
+    vint_t  vDims = simGrid->getFieldDims();
+    vint_t  vCells = simGrid->getLocalCells();
+
+    // Node charge, with the guard nodes added onto their owners
+    vdouble_t vB(nSize, 0.0);
+    for(auto& tSpecies : vSpecies) {
+        tSpecies.AddCharge(simGrid, vB.data());
+    }
+    {
+        Halo_t tHalo;
+        if(!tHalo.Setup(m_Comm, vCells, simGrid->getGuards(), {vB.data()}, HALO_ADD)) return ERR_INIT;
+        tHalo.Exchange();
+    }
+
+    // Only the unknown nodes of the node block take part
+    vdouble_t vMask(nSize, 0.0);
+    vint_t    vFrom(3), vTo(3), vStart = simGrid->getLocalStart();
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        vFrom[iDim] = m_Box[m_MPIRank][iDim]   - vStart[iDim];
+        vTo[iDim]   = m_Box[m_MPIRank][3+iDim] - vStart[iDim];
+    }
+    for(int32_t i3=vFrom[2]; i3<vTo[2]; i3++) {
+        for(int32_t i2=vFrom[1]; i2<vTo[1]; i2++) {
+            for(int32_t i1=vFrom[0]; i1<vTo[0]; i1++) {
+                vMask[simGrid->fieldIndex(i1, i2, i3)] = 1.0;
+            }
+        }
+    }
+    for(index_t i=0; i<nSize; i++) vB[i] *= vMask[i];
+
+    vdouble_t vX(nSize, 0.0), vR(nSize, 0.0), vZ(nSize, 0.0), vP(nSize, 0.0), vAP(nSize, 0.0);
+    Halo_t    tHaloP;
+    if(!tHaloP.Setup(m_Comm, vCells, simGrid->getGuards(), {vP.data()})) return ERR_INIT;
+
+    double_t dNormB = sqrt(dot(simGrid, vB.data(), vB.data()));
+    m_Iterations    = 0;
+    m_Residual      = 0.0;
+
+    if(dNormB > 0.0) {
+
+        if(m_Method == POIS_FFT) {
+            precondition(simGrid, vB.data(), vX.data());
+        } else {
+
+            // Conjugate gradients from phi = 0
+            vR = vB;
+            precondition(simGrid, vR.data(), vZ.data());
+            vP = vZ;
+            double_t dRZ = dot(simGrid, vR.data(), vZ.data());
+
+            while(m_Iterations < m_MaxIter) {
+                tHaloP.Exchange();
+                applyOperator(simGrid, vP.data(), vAP.data());
+                double_t dAlpha = dRZ/dot(simGrid, vP.data(), vAP.data());
+                for(index_t i=0; i<nSize; i++) {
+                    vX[i] += dAlpha*vP[i];
+                    vR[i] -= dAlpha*vAP[i];
+                }
+                m_Iterations++;
+                if(sqrt(dot(simGrid, vR.data(), vR.data())) <= m_Tolerance*dNormB) break;
+
+                precondition(simGrid, vR.data(), vZ.data());
+                double_t dRZNew = dot(simGrid, vR.data(), vZ.data());
+                double_t dBeta  = dRZNew/dRZ;
+                dRZ = dRZNew;
+                for(index_t i=0; i<nSize; i++) {
+                    vP[i] = vZ[i] + dBeta*vP[i];
+                }
+            }
+        }
+
+        // Residual of the final potential, which is left in vP with its guard cells
+        vP = vX;
+        tHaloP.Exchange();
+        applyOperator(simGrid, vP.data(), vAP.data());
+        for(index_t i=0; i<nSize; i++) {
+            vR[i] = vB[i] - vAP[i];
+        }
+        m_Residual = sqrt(dot(simGrid, vR.data(), vR.data()))/dNormB;
+    }
+
+    // E = -grad phi on the cell edges
+    const double_t* pPhi = vP.data();
+    index_t         nS2  = vDims[0];
+    index_t         nS3  = (index_t)vDims[0]*vDims[1];
+    int32_t         nG   = simGrid->getGuards();
+    for(int32_t i3=0; i3<vCells[2]; i3++) {
+        for(int32_t i2=0; i2<vCells[1]; i2++) {
+            index_t iIdx = simGrid->fieldIndex(0, i2, i3);
+            for(int32_t i1=0; i1<vCells[0]; i1++) {
+                simGrid->E1[iIdx] = -(pPhi[iIdx+1]   - pPhi[iIdx])*m_InvWidth[0][i1+nG];
+                simGrid->E2[iIdx] = -(pPhi[iIdx+nS2] - pPhi[iIdx])*m_InvWidth[1][i2+nG];
+                simGrid->E3[iIdx] = -(pPhi[iIdx+nS3] - pPhi[iIdx])*m_InvWidth[2][i3+nG];
+                iIdx++;
+            }
+        }
+    }
+    simGrid->fieldHalo.Exchange();
+
+    // Release the work arrays
+    m_Slab  = vdouble_t();
+    m_Modes = vdouble_t();
+    m_Send  = vdouble_t();
+    m_Recv  = vdouble_t();
+    m_Work.clear();
+    m_Sweep.clear();
+
+    m_Time = MPI_Wtime() - dStart;
+
+    bool isFailed = (m_Method == POIS_PCG && m_Residual > m_Tolerance);
+    if(m_isMaster) {
+        if(dNormB == 0.0) {
+            printf("  Poisson solve: no charge, E is zero\n");
+        } else
+        if(m_Method == POIS_FFT) {
+            printf("  Poisson solve: direct, residual %.2e, %.3f s\n", m_Residual, m_Time);
+        } else {
+            printf("  Poisson solve: %d iterations, residual %.2e, %.3f s\n", m_Iterations, m_Residual, m_Time);
+        }
+        if(isFailed) {
+            printf("  Poisson Error: No convergence to tolerance %.1e in %d iterations\n", m_Tolerance, m_MaxIter);
+        }
+    }
+
+    return (isFailed ? ERR_INIT : ERR_NONE);
+}
+
+// ********************************************************************************************** //
+//                                        Member Functions                                        //
+// ********************************************************************************************** //
+
+/**
+ *  Setup Plan
+ * ============
+ *  Precomputes the FFT of length nLen
+ */
+
+void Poisson::setupPlan(index_t nLen, plan& tPlan) {
+
+    index_t nSize = 1;
+    while(nSize < nLen) nSize <<= 1;
+    bool isPow2 = (nSize == nLen);
+    if(!isPow2) {
+        while(nSize < 2*nLen-1) nSize <<= 1;
+    }
+
+    tPlan.nLen  = nLen;
+    tPlan.nSize = nSize;
+    tPlan.vTwiddle.resize(nSize/2);
+    for(index_t k=0; k<nSize/2; k++) {
+        tPlan.vTwiddle[k] = polar(1.0, -2.0*M_PI*k/nSize);
+    }
+
+    tPlan.vChirp.clear();
+    tPlan.vKernel.clear();
+    if(isPow2) return;
+
+    // Chirp w(n) = exp(-i pi n^2/nLen), with n^2 taken modulo 2 nLen to keep the angle small
+    tPlan.vChirp.resize(nLen);
+    for(index_t n=0; n<nLen; n++) {
+        tPlan.vChirp[n] = polar(1.0, -M_PI*((n*n) % (2*nLen))/nLen);
+    }
+    tPlan.vKernel.assign(nSize, complex_t(0.0, 0.0));
+    tPlan.vKernel[0] = conj(tPlan.vChirp[0]);
+    for(index_t n=1; n<nLen; n++) {
+        tPlan.vKernel[n]       = conj(tPlan.vChirp[n]);
+        tPlan.vKernel[nSize-n] = conj(tPlan.vChirp[n]);
+    }
+    fftPow2(tPlan.vKernel.data(), tPlan);
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Setup Layout
+ * ==============
+ *  Sets up the unknowns of all nodes, the slabs, the operator factors and the transforms for the
+ *  current node blocks. Returns ERR_INIT if a dimension has no unknown nodes between the walls.
+ */
+
+error_t Poisson::setupLayout(Grid_t* simGrid) {
+
+    m_Comm    = simGrid->getComm();
+    m_Pool    = simGrid->getPool();
+    m_Threads = simGrid->getThreads();
+    m_NGrid   = simGrid->getGlobalCells();
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        if(m_NGrid[iDim] < 2) {
+            if(m_isMaster) printf("  Poisson Error: needs at least 2 cells in x%d\n", iDim+1);
+            return ERR_INIT;
+        }
+    }
+
+    vint_t  vDims   = simGrid->getFieldDims();
+    vint_t  vStart  = simGrid->getLocalStart();
+    int32_t nGuards = simGrid->getGuards();
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        m_Unknowns[iDim] = m_NGrid[iDim] - 1;
+    }
+
+    // Unknown nodes owned by each node
+    vector<vint_t> vBounds = simGrid->getBounds();
+    m_Box.assign(m_MPISize, vint_t(6, 0));
+    for(int32_t iRank=0; iRank<m_MPISize; iRank++) {
+        int32_t aCoords[3];
+        MPI_Cart_coords(m_Comm, iRank, 3, aCoords);
+        for(int32_t iDim=0; iDim<3; iDim++) {
+            m_Box[iRank][iDim]   = max(vBounds[iDim][aCoords[iDim]], 1);
+            m_Box[iRank][3+iDim] = max(vBounds[iDim][aCoords[iDim]+1], m_Box[iRank][iDim]);
+        }
+    }
+
+    m_SlabFrom.resize(m_MPISize+1);
+    m_ModeFrom.resize(m_MPISize+1);
+    for(int32_t iRank=0; iRank<=m_MPISize; iRank++) {
+        m_SlabFrom[iRank] = 1 + (int32_t)(((index_t)m_Unknowns[2]*iRank)/m_MPISize);
+        m_ModeFrom[iRank] = (int32_t)(((index_t)m_Unknowns[1]*iRank)/m_MPISize);
+    }
+
+    // Operator factors on the local field indices
+    vvdouble_t vDual = simGrid->getInvDual();
+    m_Dual.assign(3, vdouble_t());
+    m_InvWidth.assign(3, vdouble_t());
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        m_Dual[iDim].resize(vDims[iDim]);
+        m_InvWidth[iDim].resize(vDims[iDim]);
+        for(int32_t i=0; i<vDims[iDim]; i++) {
+            int32_t iCell = min(max(i - nGuards + vStart[iDim], 0), m_NGrid[iDim]-1);
+            m_Dual[iDim][i]     = 1.0/vDual[iDim][i];
+            m_InvWidth[iDim][i] = 1.0/simGrid->gridDelta[iDim][iCell];
+        }
+    }
+
+    // Eigenvalues of K and M for the transforms, and the x3 factors
+    m_Mu.assign(2, vdouble_t());
+    for(int32_t iDim=0; iDim<2; iDim++) {
+        m_Mu[iDim].resize(m_Unknowns[iDim]);
+        for(int32_t k=0; k<m_Unknowns[iDim]; k++) {
+            double_t dSin = sin(0.5*M_PI*(k+1)/m_NGrid[iDim]);
+            m_Mu[iDim][k] = 4.0*dSin*dSin/(m_Width[iDim]*m_Width[iDim]);
+        }
+    }
+    const vdouble_t& vDelta3 = simGrid->gridDelta[2];
+    m_InvWidth3.resize(m_NGrid[2]);
+    m_Dual3.assign(m_NGrid[2]+1, 0.0);
+    for(int32_t i=0; i<m_NGrid[2]; i++) {
+        m_InvWidth3[i] = 1.0/vDelta3[i];
+    }
+    for(int32_t n=1; n<m_NGrid[2]; n++) {
+        m_Dual3[n] = 0.5*(vDelta3[n-1] + vDelta3[n]);
+    }
+
+    // Sine transforms of N-1 values use FFTs of length 2N
+    index_t nWork = 0;
+    for(int32_t iDim=0; iDim<2; iDim++) {
+        setupPlan(2*(index_t)m_NGrid[iDim], m_Plan[iDim]);
+        nWork = max(nWork, m_Plan[iDim].nLen + (m_Plan[iDim].vChirp.empty() ? 0 : m_Plan[iDim].nSize));
+    }
+    m_Work.assign(m_Threads, vector<complex_t>(nWork));
+
+    index_t nPlane = (index_t)m_Unknowns[0]*m_Unknowns[1];
+    m_Slab.assign((index_t)(m_SlabFrom[m_MPIRank+1] - m_SlabFrom[m_MPIRank])*nPlane, 0.0);
+    m_Modes.assign((index_t)(m_ModeFrom[m_MPIRank+1] - m_ModeFrom[m_MPIRank])*m_Unknowns[2]*m_Unknowns[0], 0.0);
+    m_Sweep.assign(m_Threads, vdouble_t((index_t)m_Unknowns[2]*m_Unknowns[0]));
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  FFT Power of Two
+ * ==================
+ *  In-place radix-2 FFT of length tPlan.nSize. The complex products are written out, as the
+ *  library's operator checks for infinities and NaN in a call that is much slower.
+ */
+
+void Poisson::fftPow2(complex_t* pX, const plan& tPlan) {
+
+    index_t nSize = tPlan.nSize;
+
+    // Bit reversal
+    for(index_t i=1, j=0; i<nSize; i++) {
+        index_t nBit = nSize >> 1;
+        for(; j & nBit; nBit >>= 1) j ^= nBit;
+        j ^= nBit;
+        if(i < j) swap(pX[i], pX[j]);
+    }
+
+    const complex_t* pTw = tPlan.vTwiddle.data();
+    for(index_t nLen=2; nLen<=nSize; nLen<<=1) {
+        index_t nHalf = nLen >> 1;
+        index_t nStep = nSize/nLen;
+        for(index_t i=0; i<nSize; i+=nLen) {
+            for(index_t k=0; k<nHalf; k++) {
+                complex_t tU = pX[i+k];
+                complex_t tX = pX[i+k+nHalf];
+                complex_t tW = pTw[k*nStep];
+                complex_t tV(tX.real()*tW.real() - tX.imag()*tW.imag(),
+                             tX.real()*tW.imag() + tX.imag()*tW.real());
+                pX[i+k]       = tU + tV;
+                pX[i+k+nHalf] = tU - tV;
+            }
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  FFT
+ * =====
+ *  In-place FFT of length tPlan.nLen. Other lengths than powers of two use pWork, which must hold
+ *  tPlan.nSize values.
+ */
+
+void Poisson::fft(complex_t* pX, complex_t* pWork, const plan& tPlan) {
+
+    if(tPlan.vChirp.empty()) {
+        fftPow2(pX, tPlan);
+        return;
+    }
+
+    index_t          nLen   = tPlan.nLen;
+    index_t          nSize  = tPlan.nSize;
+    const complex_t* pChirp = tPlan.vChirp.data();
+    const complex_t* pKern  = tPlan.vKernel.data();
+
+    for(index_t n=0; n<nLen; n++) {
+        pWork[n] = complex_t(pX[n].real()*pChirp[n].real() - pX[n].imag()*pChirp[n].imag(),
+                             pX[n].real()*pChirp[n].imag() + pX[n].imag()*pChirp[n].real());
+    }
+    for(index_t n=nLen; n<nSize; n++) pWork[n] = 0.0;
+
+    // Convolution with the conjugate chirp, with the inverse FFT done by conjugation
+    fftPow2(pWork, tPlan);
+    for(index_t n=0; n<nSize; n++) {
+        pWork[n] = complex_t(  pWork[n].real()*pKern[n].real() - pWork[n].imag()*pKern[n].imag(),
+                             -(pWork[n].real()*pKern[n].imag() + pWork[n].imag()*pKern[n].real()));
+    }
+    fftPow2(pWork, tPlan);
+
+    double_t dScale = 1.0/nSize;
+    for(index_t k=0; k<nLen; k++) {
+        double_t dRe =  pWork[k].real()*dScale;
+        double_t dIm = -pWork[k].imag()*dScale;
+        pX[k] = complex_t(dRe*pChirp[k].real() - dIm*pChirp[k].imag(), dRe*pChirp[k].imag() + dIm*pChirp[k].real());
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  DST Pair
+ * ==========
+ *  Sine transforms X(k) = sum x(n) sin(pi k n/N) for k,n from 1 to N-1 of two lines pA and pB
+ *  with stride nStride, in place, where 2N is the length of tPlan. pB may be NULL.
+ *  Both are done with one complex FFT of the odd extension of pA + i pB, whose transform is
+ *  -2i (XA + i XB). The transform is its own inverse up to a factor 2/N.
+ */
+
+void Poisson::dstPair(double_t* pA, double_t* pB, index_t nStride, complex_t* pWork, const plan& tPlan) {
+
+    index_t    nLen = tPlan.nLen;
+    index_t    nN   = nLen/2;
+    complex_t* pY   = pWork;
+
+    pY[0]  = 0.0;
+    pY[nN] = 0.0;
+    for(index_t n=1; n<nN; n++) {
+        complex_t tV(pA[(n-1)*nStride], (pB == NULL ? 0.0 : pB[(n-1)*nStride]));
+        pY[n]      = tV;
+        pY[nLen-n] = -tV;
+    }
+
+    fft(pY, pWork+nLen, tPlan);
+
+    for(index_t k=1; k<nN; k++) {
+        pA[(k-1)*nStride] = -0.5*pY[k].imag();
+        if(pB != NULL) pB[(k-1)*nStride] = 0.5*pY[k].real();
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Transpose
+ * ===========
+ *  Sends vSendCount values of m_Send to each node and receives vRecvCount values from each into
+ *  m_Recv, both in node order
+ */
+
+void Poisson::transpose(const vint_t& vSendCount, const vint_t& vRecvCount) {
+
+    vint_t vSendOff(m_MPISize, 0), vRecvOff(m_MPISize, 0);
+    for(int32_t iRank=1; iRank<m_MPISize; iRank++) {
+        vSendOff[iRank] = vSendOff[iRank-1] + vSendCount[iRank-1];
+        vRecvOff[iRank] = vRecvOff[iRank-1] + vRecvCount[iRank-1];
+    }
+    m_Recv.resize(vRecvOff[m_MPISize-1] + vRecvCount[m_MPISize-1]);
+
+    MPI_Alltoallv(m_Send.data(), vSendCount.data(), vSendOff.data(), MPI_DOUBLE,
+                  m_Recv.data(), vRecvCount.data(), vRecvOff.data(), MPI_DOUBLE, m_Comm);
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  To Slabs
+ * ==========
+ *  Moves the unknowns of pBlock, shaped like the field arrays, from the node blocks to the slabs
+ */
+
+void Poisson::toSlabs(Grid_t* simGrid, const double_t* pBlock) {
+
+    const vint_t& vMine  = m_Box[m_MPIRank];
+    vint_t        vStart = simGrid->getLocalStart();
+    int32_t       iZ0    = m_SlabFrom[m_MPIRank];
+    int32_t       iZ1    = m_SlabFrom[m_MPIRank+1];
+    index_t       nU1    = m_Unknowns[0];
+    index_t       nU2    = m_Unknowns[1];
+
+    vint_t vSendCount(m_MPISize), vRecvCount(m_MPISize);
+    m_Send.clear();
+    for(int32_t iRank=0; iRank<m_MPISize; iRank++) {
+        int32_t iFrom = max(vMine[2], m_SlabFrom[iRank]);
+        int32_t iTo   = min(vMine[5], m_SlabFrom[iRank+1]);
+        index_t nOld  = m_Send.size();
+        for(int32_t n3=iFrom; n3<iTo; n3++) {
+            for(int32_t n2=vMine[1]; n2<vMine[4]; n2++) {
+                index_t iIdx = simGrid->fieldIndex(vMine[0]-vStart[0], n2-vStart[1], n3-vStart[2]);
+                m_Send.insert(m_Send.end(), pBlock+iIdx, pBlock+iIdx+(vMine[3]-vMine[0]));
+            }
+        }
+        vSendCount[iRank] = (int32_t)(m_Send.size() - nOld);
+
+        const vint_t& vBox = m_Box[iRank];
+        int32_t nZ = max(0, min(vBox[5], iZ1) - max(vBox[2], iZ0));
+        vRecvCount[iRank] = nZ*(vBox[4]-vBox[1])*(vBox[3]-vBox[0]);
+    }
+
+    transpose(vSendCount, vRecvCount);
+
+    index_t k = 0;
+    for(int32_t iRank=0; iRank<m_MPISize; iRank++) {
+        const vint_t& vBox = m_Box[iRank];
+        for(int32_t n3=max(vBox[2], iZ0); n3<min(vBox[5], iZ1); n3++) {
+            for(int32_t n2=vBox[1]; n2<vBox[4]; n2++) {
+                double_t* pRow = m_Slab.data() + ((n3-iZ0)*nU2 + (n2-1))*nU1 + (vBox[0]-1);
+                for(int32_t n1=vBox[0]; n1<vBox[3]; n1++) {
+                    *pRow++ = m_Recv[k++];
+                }
+            }
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  From Slabs
+ * ============
+ *  Moves the slabs back to the unknowns of pBlock, shaped like the field arrays
+ */
+
+void Poisson::fromSlabs(Grid_t* simGrid, double_t* pBlock) {
+
+    const vint_t& vMine  = m_Box[m_MPIRank];
+    vint_t        vStart = simGrid->getLocalStart();
+    int32_t       iZ0    = m_SlabFrom[m_MPIRank];
+    int32_t       iZ1    = m_SlabFrom[m_MPIRank+1];
+    index_t       nU1    = m_Unknowns[0];
+    index_t       nU2    = m_Unknowns[1];
+
+    vint_t vSendCount(m_MPISize), vRecvCount(m_MPISize);
+    m_Send.clear();
+    for(int32_t iRank=0; iRank<m_MPISize; iRank++) {
+        const vint_t& vBox = m_Box[iRank];
+        index_t nOld = m_Send.size();
+        for(int32_t n3=max(vBox[2], iZ0); n3<min(vBox[5], iZ1); n3++) {
+            for(int32_t n2=vBox[1]; n2<vBox[4]; n2++) {
+                const double_t* pRow = m_Slab.data() + ((n3-iZ0)*nU2 + (n2-1))*nU1 + (vBox[0]-1);
+                m_Send.insert(m_Send.end(), pRow, pRow+(vBox[3]-vBox[0]));
+            }
+        }
+        vSendCount[iRank] = (int32_t)(m_Send.size() - nOld);
+
+        int32_t nZ = max(0, min(vMine[5], m_SlabFrom[iRank+1]) - max(vMine[2], m_SlabFrom[iRank]));
+        vRecvCount[iRank] = nZ*(vMine[4]-vMine[1])*(vMine[3]-vMine[0]);
+    }
+
+    transpose(vSendCount, vRecvCount);
+
+    index_t k = 0;
+    for(int32_t iRank=0; iRank<m_MPISize; iRank++) {
+        for(int32_t n3=max(vMine[2], m_SlabFrom[iRank]); n3<min(vMine[5], m_SlabFrom[iRank+1]); n3++) {
+            for(int32_t n2=vMine[1]; n2<vMine[4]; n2++) {
+                index_t iIdx = simGrid->fieldIndex(vMine[0]-vStart[0], n2-vStart[1], n3-vStart[2]);
+                for(int32_t n1=vMine[0]; n1<vMine[3]; n1++) {
+                    pBlock[iIdx++] = m_Recv[k++];
+                }
+            }
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  To Modes
+ * ==========
+ *  Moves the transformed slabs of x3 planes to slabs of x2 modes, with whole x3 lines per mode
+ */
+
+void Poisson::toModes() {
+
+    int32_t iZ0 = m_SlabFrom[m_MPIRank];
+    int32_t iZ1 = m_SlabFrom[m_MPIRank+1];
+    int32_t iK0 = m_ModeFrom[m_MPIRank];
+    int32_t iK1 = m_ModeFrom[m_MPIRank+1];
+    index_t nU1 = m_Unknowns[0];
+    index_t nU2 = m_Unknowns[1];
+    index_t nU3 = m_Unknowns[2];
+
+    vint_t vSendCount(m_MPISize), vRecvCount(m_MPISize);
+    m_Send.clear();
+    for(int32_t iRank=0; iRank<m_MPISize; iRank++) {
+        index_t nOld = m_Send.size();
+        for(int32_t n3=iZ0; n3<iZ1; n3++) {
+            const double_t* pRow = m_Slab.data() + ((n3-iZ0)*nU2 + m_ModeFrom[iRank])*nU1;
+            m_Send.insert(m_Send.end(), pRow, pRow+(m_ModeFrom[iRank+1]-m_ModeFrom[iRank])*nU1);
+        }
+        vSendCount[iRank] = (int32_t)(m_Send.size() - nOld);
+        vRecvCount[iRank] = (m_SlabFrom[iRank+1]-m_SlabFrom[iRank])*(iK1-iK0)*(int32_t)nU1;
+    }
+
+    transpose(vSendCount, vRecvCount);
+
+    index_t k = 0;
+    for(int32_t iRank=0; iRank<m_MPISize; iRank++) {
+        for(int32_t n3=m_SlabFrom[iRank]; n3<m_SlabFrom[iRank+1]; n3++) {
+            for(int32_t k2=iK0; k2<iK1; k2++) {
+                double_t* pRow = m_Modes.data() + ((k2-iK0)*nU3 + (n3-1))*nU1;
+                copy(m_Recv.begin()+k, m_Recv.begin()+k+nU1, pRow);
+                k += nU1;
+            }
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  From Modes
+ * ============
+ *  Moves the slabs of x2 modes back to slabs of x3 planes
+ */
+
+void Poisson::fromModes() {
+
+    int32_t iZ0 = m_SlabFrom[m_MPIRank];
+    int32_t iZ1 = m_SlabFrom[m_MPIRank+1];
+    int32_t iK0 = m_ModeFrom[m_MPIRank];
+    int32_t iK1 = m_ModeFrom[m_MPIRank+1];
+    index_t nU1 = m_Unknowns[0];
+    index_t nU2 = m_Unknowns[1];
+    index_t nU3 = m_Unknowns[2];
+
+    vint_t vSendCount(m_MPISize), vRecvCount(m_MPISize);
+    m_Send.clear();
+    for(int32_t iRank=0; iRank<m_MPISize; iRank++) {
+        index_t nOld = m_Send.size();
+        for(int32_t n3=m_SlabFrom[iRank]; n3<m_SlabFrom[iRank+1]; n3++) {
+            for(int32_t k2=iK0; k2<iK1; k2++) {
+                const double_t* pRow = m_Modes.data() + ((k2-iK0)*nU3 + (n3-1))*nU1;
+                m_Send.insert(m_Send.end(), pRow, pRow+nU1);
+            }
+        }
+        vSendCount[iRank] = (int32_t)(m_Send.size() - nOld);
+        vRecvCount[iRank] = (iZ1-iZ0)*(m_ModeFrom[iRank+1]-m_ModeFrom[iRank])*(int32_t)nU1;
+    }
+
+    transpose(vSendCount, vRecvCount);
+
+    index_t k = 0;
+    for(int32_t iRank=0; iRank<m_MPISize; iRank++) {
+        index_t nRun = (m_ModeFrom[iRank+1]-m_ModeFrom[iRank])*nU1;
+        for(int32_t n3=iZ0; n3<iZ1; n3++) {
+            double_t* pRow = m_Slab.data() + ((n3-iZ0)*nU2 + m_ModeFrom[iRank])*nU1;
+            copy(m_Recv.begin()+k, m_Recv.begin()+k+nRun, pRow);
+            k += nRun;
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Transform Slabs
+ * =================
+ *  Sine transforms of the slab planes in x1 and then x2, two lines at a time, split over the
+ *  threads by plane
+ */
+
+void Poisson::transformSlabs() {
+
+    int32_t nPlanes = m_SlabFrom[m_MPIRank+1] - m_SlabFrom[m_MPIRank];
+    index_t nU1     = m_Unknowns[0];
+    index_t nU2     = m_Unknowns[1];
+
+    m_Pool->Run([&](int32_t iT) {
+        complex_t* pWork = m_Work[iT].data();
+        int32_t    iFrom = (nPlanes*iT)/m_Threads;
+        int32_t    iTo   = (nPlanes*(iT+1))/m_Threads;
+        for(int32_t n3=iFrom; n3<iTo; n3++) {
+            double_t* pPlane = m_Slab.data() + n3*nU1*nU2;
+            for(index_t n2=0; n2<nU2; n2+=2) {
+                double_t* pB = (n2+1 < nU2 ? pPlane+(n2+1)*nU1 : NULL);
+                dstPair(pPlane+n2*nU1, pB, 1, pWork, m_Plan[0]);
+            }
+            for(index_t n1=0; n1<nU1; n1+=2) {
+                double_t* pB = (n1+1 < nU1 ? pPlane+n1+1 : NULL);
+                dstPair(pPlane+n1, pB, nU1, pWork, m_Plan[1]);
+            }
+        }
+    });
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Solve Modes
+ * =============
+ *  Solves the tridiagonal system in x3 of each pair of x1 and x2 modes, with the Thomas algorithm
+ *  run over all x1 modes at once. Includes the normalisation of the forward and inverse transforms.
+ */
+
+void Poisson::solveModes() {
+
+    int32_t  iK0    = m_ModeFrom[m_MPIRank];
+    int32_t  nModes = m_ModeFrom[m_MPIRank+1] - iK0;
+    index_t  nU1    = m_Unknowns[0];
+    index_t  nU3    = m_Unknowns[2];
+    double_t dScale = 4.0/(m_NGrid[0]*m_NGrid[1]*m_Width[0]*m_Width[1]);
+
+    m_Pool->Run([&](int32_t iT) {
+        double_t* pC    = m_Sweep[iT].data();
+        int32_t   iFrom = (nModes*iT)/m_Threads;
+        int32_t   iTo   = (nModes*(iT+1))/m_Threads;
+        for(int32_t k2=iFrom; k2<iTo; k2++) {
+
+            double_t* pD  = m_Modes.data() + k2*nU3*nU1;
+            double_t  dM2 = m_Mu[1][iK0+k2];
+            const double_t* pM1 = m_Mu[0].data();
+
+            // Forward sweep, where row z is node z+1 and couples to its neighbours by -1/width
+            for(index_t z=0; z<nU3; z++) {
+                double_t  dLow  = (z > 0 ? -m_InvWidth3[z] : 0.0);
+                double_t  dHigh = -m_InvWidth3[z+1];
+                double_t  dDiag = m_InvWidth3[z] + m_InvWidth3[z+1];
+                double_t  dDual = m_Dual3[z+1];
+                double_t* pRow  = pD + z*nU1;
+                double_t* pCRow = pC + z*nU1;
+                const double_t* pDPrev = (z > 0 ? pRow-nU1 : pRow);
+                const double_t* pCPrev = (z > 0 ? pCRow-nU1 : pCRow);
+                for(index_t k1=0; k1<nU1; k1++) {
+                    double_t dPrevC = (z > 0 ? pCPrev[k1] : 0.0);
+                    double_t dPrevD = (z > 0 ? pDPrev[k1] : 0.0);
+                    double_t dInv   = 1.0/((pM1[k1] + dM2)*dDual + dDiag - dLow*dPrevC);
+                    pCRow[k1] = dHigh*dInv;
+                    pRow[k1]  = (dScale*pRow[k1] - dLow*dPrevD)*dInv;
+                }
+            }
+
+            // Back substitution, updating row z-1 from row z
+            for(index_t z=nU3; z-- > 1;) {
+                double_t*       pRow  = pD + (z-1)*nU1;
+                const double_t* pNext = pRow + nU1;
+                const double_t* pCRow = pC + (z-1)*nU1;
+                for(index_t k1=0; k1<nU1; k1++) {
+                    pRow[k1] -= pCRow[k1]*pNext[k1];
+                }
+            }
+        }
+    });
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Precondition
+ * ==============
+ *  Sets the unknowns of pZ to the direct solution of pR, for the mean cell widths in x1 and x2
+ */
+
+void Poisson::precondition(Grid_t* simGrid, const double_t* pR, double_t* pZ) {
+
+    toSlabs(simGrid, pR);
+    transformSlabs();
+    toModes();
+    solveModes();
+    fromModes();
+    transformSlabs();
+    fromSlabs(simGrid, pZ);
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Apply Operator
+ * ================
+ *  Sets the unknowns of pAP to A pP. The guard cells of pP must be up to date.
+ */
+
+void Poisson::applyOperator(Grid_t* simGrid, const double_t* pP, double_t* pAP) {
+
+    vint_t  vStart = simGrid->getLocalStart();
+    vint_t  vDims  = simGrid->getFieldDims();
+    int32_t nG     = simGrid->getGuards();
+    index_t nS2    = vDims[0];
+    index_t nS3    = (index_t)vDims[0]*vDims[1];
+
+    const vint_t& vMine = m_Box[m_MPIRank];
+    int32_t i1From = vMine[0]-vStart[0], i1To = vMine[3]-vStart[0];
+    int32_t i2From = vMine[1]-vStart[1], i2To = vMine[4]-vStart[1];
+    int32_t i3From = vMine[2]-vStart[2], i3To = vMine[5]-vStart[2];
+
+    const double_t* pD1 = m_Dual[0].data() + nG;
+    const double_t* pW1 = m_InvWidth[0].data() + nG;
+
+    for(int32_t i3=i3From; i3<i3To; i3++) {
+        double_t dD3 = m_Dual[2][i3+nG];
+        double_t dW3 = m_InvWidth[2][i3+nG];
+        double_t dV3 = m_InvWidth[2][i3+nG-1];
+        for(int32_t i2=i2From; i2<i2To; i2++) {
+            double_t dD2 = m_Dual[1][i2+nG];
+            double_t dW2 = m_InvWidth[1][i2+nG];
+            double_t dV2 = m_InvWidth[1][i2+nG-1];
+            index_t  iIdx = simGrid->fieldIndex(0, i2, i3);
+            const double_t* __restrict__ p  = pP + iIdx;
+            double_t* __restrict__       ap = pAP + iIdx;
+            for(int32_t i1=i1From; i1<i1To; i1++) {
+                double_t dP = p[i1];
+                ap[i1] = dD2*dD3*((dP - p[i1-1])*pW1[i1-1] + (dP - p[i1+1])*pW1[i1])
+                       + pD1[i1]*dD3*((dP - p[i1-nS2])*dV2 + (dP - p[i1+nS2])*dW2)
+                       + pD1[i1]*dD2*((dP - p[i1-nS3])*dV3 + (dP - p[i1+nS3])*dW3);
+            }
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Dot
+ * =====
+ *  Returns the dot product of the unknowns of pA and pB over all nodes
+ */
+
+double_t Poisson::dot(Grid_t* simGrid, const double_t* pA, const double_t* pB) {
+
+    vint_t        vStart = simGrid->getLocalStart();
+    const vint_t& vMine  = m_Box[m_MPIRank];
+
+    double_t dSum = 0.0;
+    for(int32_t n3=vMine[2]; n3<vMine[5]; n3++) {
+        for(int32_t n2=vMine[1]; n2<vMine[4]; n2++) {
+            index_t iIdx = simGrid->fieldIndex(vMine[0]-vStart[0], n2-vStart[1], n3-vStart[2]);
+            for(int32_t n1=vMine[0]; n1<vMine[3]; n1++) {
+                dSum += pA[iIdx]*pB[iIdx];
+                iIdx++;
+            }
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &dSum, 1, MPI_DOUBLE, MPI_SUM, m_Comm);
+
+    return dSum;
+}
+
+// ********************************************************************************************** //
+
+// End Class Poisson
@@ -0,0 +1,140 @@
+/**
+ * ReyPIC – Poisson Header
+ */
+
+#ifndef CLASS_POISSON
+#define CLASS_POISSON
+
+// Class-specific macros
+#define POIS_NONE    0      // No initial field solve
+#define POIS_FFT     1      // Direct solve with sine transforms in x1 and x2
+#define POIS_PCG     2      // Conjugate gradients, preconditioned with the direct solve
+
+#include "config.hpp"
+
+#include "clsInput.hpp"
+#include "clsGrid.hpp"
+#include "clsSpecies.hpp"
+#include "clsHalo.hpp"
+
+#include <complex>
+
+typedef std::complex<double_t> complex_t;
+
+namespace reypic {
+
+class Poisson {
+
+public:
+
+   /**
+    * Constructor/Destructor
+    */
+
+    Poisson();
+    ~Poisson() {};
+
+   /**
+    * Setters/Getters/Checks
+    */
+
+    double_t getTime()       const {return m_Time;};
+    int32_t  getIterations() const {return m_Iterations;};
+    double_t getResidual()   const {return m_Residual;};
+
+    bool     isActive()      const {return m_Method != POIS_NONE;};
+
+   /**
+    * Methods
+    */
+
+    error_t Setup(Input_t*, Grid_t*);
+    error_t Solve(Grid_t*, std::vector<Species>&);
+
+private:
+
+   /**
+    * Structs
+    */
+
+    // Precomputed factors of a complex FFT of length nLen. Lengths that are not a power of two are
+    // done as a convolution of length nSize with Bluestein's algorithm.
+    struct plan {
+        index_t                nLen  = 0;
+        index_t                nSize = 0;
+        std::vector<complex_t> vTwiddle;          // Twiddle factors of the power of two FFT
+        std::vector<complex_t> vChirp;            // Bluestein chirp, empty for powers of two
+        std::vector<complex_t> vKernel;           // Transform of the conjugate chirp
+    };
+
+   /**
+    * Member Functions
+    */
+
+    void     setupPlan(index_t, plan&);
+    error_t  setupLayout(Grid_t*);
+    void     fftPow2(complex_t*, const plan&);
+    void     fft(complex_t*, complex_t*, const plan&);
+    void     dstPair(double_t*, double_t*, index_t, complex_t*, const plan&);
+    void     transpose(const vint_t&, const vint_t&);
+    void     toSlabs(Grid_t*, const double_t*);
+    void     fromSlabs(Grid_t*, double_t*);
+    void     toModes();
+    void     fromModes();
+    void     transformSlabs();
+    void     solveModes();
+    void     precondition(Grid_t*, const double_t*, double_t*);
+    void     applyOperator(Grid_t*, const double_t*, double_t*);
+    double_t dot(Grid_t*, const double_t*, const double_t*);
+
+   /**
+    * Member Variables
+    */
+
+    int32_t     m_MPISize   =  0;
+    int32_t     m_MPIRank   = -1;
+    bool        m_isMaster  = false;
+    MPI_Comm    m_Comm      = MPI_COMM_NULL;      // Cartesian communicator of the grid
+
+    // Settings
+    value_t     m_Method    = POIS_NONE;          // [poisson]   fft, pcg, auto or none
+    double_t    m_Tolerance = 1.0e-8;             // [tolerance] Residual relative to the charge
+    int32_t     m_MaxIter   = 200;                // [maxiter]   Most conjugate gradient iterations
+
+    ThreadPool_t* m_Pool    = NULL;
+    int32_t     m_Threads   = 1;
+
+    // Unknowns are the global nodes 1 to N-1, as the box walls are grounded conductors
+    vint_t      m_NGrid     = {1, 1, 1};          // Global cells
+    vint_t      m_Unknowns  = {0, 0, 0};          // Unknown nodes per dimension
+    vdouble_t   m_Width     = {1.0, 1.0};         // Cell width of the transforms in x1 and x2
+    std::vector<vint_t> m_Box;                    // First and last+1 unknown node per dimension, per node
+    vint_t      m_SlabFrom;                       // First x3 node of each node's slab, and the end
+    vint_t      m_ModeFrom;                       // First x2 mode of each node's modes, and the end
+
+    // Operator factors
+    vvdouble_t  m_Dual;                           // Node spacing per local field index, per dimension
+    vvdouble_t  m_InvWidth;                       // Inverse cell width per local field index, per dimension
+    vvdouble_t  m_Mu;                             // Eigenvalues of the transforms in x1 and x2
+    vdouble_t   m_Dual3;                          // Node spacing per global x3 node
+    vdouble_t   m_InvWidth3;                      // Inverse cell width per global x3 cell
+
+    // Transform data
+    plan        m_Plan[2];                        // Transforms in x1 and x2
+    vdouble_t   m_Slab;                           // x3 planes of this node, [x3][x2][x1]
+    vdouble_t   m_Modes;                          // x2 modes of this node, [x2][x3][x1]
+    vdouble_t   m_Send;
+    vdouble_t   m_Recv;
+    std::vector<std::vector<complex_t> > m_Work;  // FFT buffers per thread
+    vvdouble_t  m_Sweep;                          // Tridiagonal solver buffers per thread
+
+    // Statistics
+    double_t    m_Time       = 0.0;               // Time spent in Solve()
+    int32_t     m_Iterations = 0;                 // Conjugate gradient iterations
+    double_t    m_Residual   = 0.0;               // Final residual relative to the charge
+
+}; // End Class Poisson
+
+} // End NameSpace
+
+#endif
@@ -0,0 +1,202 @@
+/**
+ *  ReyPIC – Random Source
+ * ========================
+ *  Counter-based random number generator using Philox4x32-10
+ *  Salmon et al., Parallel Random Numbers: As Easy as 1, 2, 3, SC11
+ *
+ *  Each draw is a pure function of (seed, stream, counter), so a stream can be given to any unit
+ *  of work, for instance one grid cell, and the result does not depend on which thread or rank
+ *  processes it, or in which order.
+ */
+
+#include "clsRandom.hpp"
+
+using namespace std;
+using namespace reypic;
+
+// Philox constants
+#define PHILOX_M0  0xD2511F53U
+#define PHILOX_M1  0xCD9E8D57U
+#define PHILOX_W0  0x9E3779B9U
+#define PHILOX_W1  0xBB67AE85U
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Constructor
+ * ===================
+ *  Takes a seed and a stream number
+ */
+
+Random::Random(uint64_t iSeed, uint64_t iStream) {
+
+    m_Key[0] = (uint32_t)(iSeed);
+    m_Key[1] = (uint32_t)(iSeed >> 32);
+    m_Stream = iStream;
+
+}
+
+// ********************************************************************************************** //
+//                                      Setters and Getters                                       //
+// ********************************************************************************************** //
+
+/**
+ *  Set Counter
+ * =============
+ *  Moves the generator to a given block in its stream, for instance when restarting
+ */
+
+void Random::setCounter(uint64_t iCounter) {
+
+    m_Counter = iCounter;
+    m_Next    = 2;
+
+    return;
+}
+
+// ********************************************************************************************** //
+//                                       Main Class Methods                                       //
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Uniform
+ * ===================
+ *  Returns a uniform random number in the open interval (0,1)
+ */
+
+double_t Random::Uniform() {
+
+    if(m_Next > 1) nextBlock();
+
+    return m_Buffer[m_Next++];
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Normal
+ * ==================
+ *  Returns a normal distributed random number with zero mean and unit variance
+ *  Using the Box–Muller transform
+ */
+
+double_t Random::Normal() {
+
+    double_t dU1 = Uniform();
+    double_t dU2 = Uniform();
+
+    return sqrt(-2.0*log(dU1))*cos(2.0*M_PI*dU2);
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Uniform (Array)
+ * ===========================
+ *  Fills pOut with nOut uniform random numbers in the open interval (0,1)
+ *  Draws two numbers per counter directly into the array
+ */
+
+void Random::Uniform(double_t* pOut, index_t nOut) {
+
+    index_t nPair = nOut/2;
+
+    for(index_t i=0; i<nPair; i++) {
+        philox(m_Counter++, pOut+2*i);
+    }
+    if(nOut%2 == 1) {
+        pOut[nOut-1] = Uniform();
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Normal (Array)
+ * ==========================
+ *  Fills pOut with nOut normal distributed random numbers
+ *  The uniforms for the Box–Muller transform are drawn into the two halves of the array, and the
+ *  transform is then done as one unit-stride loop producing both the cosine and sine branches.
+ */
+
+void Random::Normal(double_t* pOut, index_t nOut) {
+
+    index_t   nPair = nOut/2;
+    double_t* pU1   = pOut;
+    double_t* pU2   = pOut + nPair;
+
+    Uniform(pOut, 2*nPair);
+
+    for(index_t i=0; i<nPair; i++) {
+        double_t dR  = sqrt(-2.0*log(pU1[i]));
+        double_t dTh = 2.0*M_PI*pU2[i];
+        pU1[i] = dR*cos(dTh);
+        pU2[i] = dR*sin(dTh);
+    }
+    if(nOut%2 == 1) {
+        pOut[nOut-1] = Normal();
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+//                                        Member Functions                                        //
+// ********************************************************************************************** //
+
+/**
+ *  Function :: nextBlock
+ * =======================
+ *  Refills the buffer used by the scalar Uniform()
+ */
+
+void Random::nextBlock() {
+
+    philox(m_Counter++, m_Buffer);
+    m_Next = 0;
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Function :: philox
+ * ====================
+ *  Runs Philox4x32 on a counter and converts the 128 bits to two doubles with 53 bits of
+ *  randomness each
+ */
+
+void Random::philox(uint64_t iCounter, double_t* pOut) const {
+
+    uint32_t aCtr[4] = {(uint32_t)iCounter, (uint32_t)(iCounter >> 32),
+                        (uint32_t)m_Stream, (uint32_t)(m_Stream >> 32)};
+    uint32_t aKey[2] = {m_Key[0], m_Key[1]};
+
+    for(int32_t iRound=0; iRound<RNG_ROUNDS; iRound++) {
+
+        uint64_t iProd0 = (uint64_t)PHILOX_M0 * aCtr[0];
+        uint64_t iProd1 = (uint64_t)PHILOX_M1 * aCtr[2];
+
+        uint32_t aNew[4] = {(uint32_t)(iProd1 >> 32) ^ aCtr[1] ^ aKey[0], (uint32_t)iProd1,
+                            (uint32_t)(iProd0 >> 32) ^ aCtr[3] ^ aKey[1], (uint32_t)iProd0};
+
+        aCtr[0] = aNew[0]; aCtr[1] = aNew[1]; aCtr[2] = aNew[2]; aCtr[3] = aNew[3];
+        aKey[0] += PHILOX_W0;
+        aKey[1] += PHILOX_W1;
+    }
+
+    uint64_t iBits0 = ((uint64_t)aCtr[0] << 32) | aCtr[1];
+    uint64_t iBits1 = ((uint64_t)aCtr[2] << 32) | aCtr[3];
+
+    pOut[0] = ((iBits0 >> 11) + 0.5) * (1.0/9007199254740992.0);
+    pOut[1] = ((iBits1 >> 11) + 0.5) * (1.0/9007199254740992.0);
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+// End Class Random
@@ -0,0 +1,66 @@
+/**
+ * ReyPIC – Random Header
+ */
+
+#ifndef CLASS_RANDOM
+#define CLASS_RANDOM
+
+// Class-specific macros
+#define RNG_ROUNDS   10     // Philox rounds
+
+#include "config.hpp"
+
+namespace reypic {
+
+class Random {
+
+public:
+
+   /**
+    * Constructor/Destructor
+    */
+
+    Random(uint64_t, uint64_t);
+    ~Random() {};
+
+   /**
+    * Setters/Getters
+    */
+
+    uint64_t getCounter() const {return m_Counter;};
+    void     setCounter(uint64_t);
+
+   /**
+    * Methods
+    */
+
+    double_t Uniform();
+    double_t Normal();
+    void     Uniform(double_t*, index_t);
+    void     Normal(double_t*, index_t);
+
+private:
+
+   /**
+    * Member Functions
+    */
+
+    void nextBlock();
+    void philox(uint64_t, double_t*) const;
+
+   /**
+    * Member Variables
+    */
+
+    uint32_t m_Key[2];         // Philox key from seed
+    uint64_t m_Stream;         // Stream number
+    uint64_t m_Counter = 0;    // Number of blocks drawn
+
+    double_t m_Buffer[2];      // Uniforms from last block
+    int32_t  m_Next    = 2;    // Next unused entry in m_Buffer
+
+}; // End Class Random
+
+} // End NameSpace
+
+#endif
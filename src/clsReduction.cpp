@@ -0,0 +1,204 @@
+/**
+ *  ReyPIC – Reduction Source
+ * ===========================
+ *  Collects the scalars a step needs summed, minimised or maximised over all nodes, and reduces
+ *  them together in one non-blocking MPI_Iallreduce. Each value carries its op, and a custom MPI
+ *  op combines the items by it, so one call covers any mix. The caller starts the reduction when
+ *  the step's values are added, and completes it when it needs the results, usually the next step,
+ *  so the latency of the reduction is hidden behind the work in between.
+ */
+
+#include "clsReduction.hpp"
+
+using namespace std;
+using namespace reypic;
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Constructor
+ * ===================
+ */
+
+Reduction::Reduction() {}
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Destructor
+ * ==================
+ */
+
+Reduction::~Reduction() {
+
+    Free();
+
+}
+
+// ********************************************************************************************** //
+//                                       Main Class Methods                                       //
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Setup
+ * =================
+ *  Creates the item type and the reduction op on a private copy of tComm. All nodes of tComm must
+ *  call it.
+ */
+
+bool Reduction::Setup(MPI_Comm tComm) {
+
+    Free();
+
+    MPI_Comm_dup(tComm, &m_Comm);
+
+    item         tItem;
+    int          aLength[2] = {1, 1};
+    MPI_Aint     aDisp[2], iBase;
+    MPI_Datatype aTypes[2]  = {MPI_DOUBLE, MPI_INT64_T};
+    MPI_Datatype tStruct;
+
+    MPI_Get_address(&tItem,        &iBase);
+    MPI_Get_address(&tItem.dValue, &aDisp[0]);
+    MPI_Get_address(&tItem.iOp,    &aDisp[1]);
+    aDisp[0] -= iBase;
+    aDisp[1] -= iBase;
+
+    MPI_Type_create_struct(2, aLength, aDisp, aTypes, &tStruct);
+    MPI_Type_create_resized(tStruct, 0, sizeof(item), &m_Type);
+    MPI_Type_free(&tStruct);
+    MPI_Type_commit(&m_Type);
+
+    if(MPI_Op_create(&Reduction::reduceItems, 1, &m_Op) != MPI_SUCCESS) return false;
+
+    m_Staged.clear();
+    m_Result.clear();
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Add
+ * ===============
+ *  Adds dValue to the next reduction, combined over nodes by iOp (RED_SUM, RED_MIN or RED_MAX).
+ *  Returns the slot of the result. All nodes must add the same ops in the same order.
+ */
+
+int32_t Reduction::Add(int32_t iOp, double_t dValue) {
+
+    item tItem;
+    tItem.dValue = dValue;
+    tItem.iOp    = iOp;
+    m_Staged.push_back(tItem);
+
+    return (int32_t)m_Staged.size()-1;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Start
+ * =================
+ *  Starts the reduction of the values added since the last call. A reduction still in flight is
+ *  completed first. All nodes must call it.
+ */
+
+void Reduction::Start() {
+
+    if(isPending()) Complete();
+
+    m_Send.swap(m_Staged);
+    m_Staged.clear();
+    m_Recv.resize(m_Send.size());
+
+    MPI_Iallreduce(m_Send.data(), m_Recv.data(), (int)m_Send.size(), m_Type, m_Op, m_Comm, &m_Request);
+    m_Count++;
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Complete
+ * ====================
+ *  Waits for the reduction in flight and makes its results available by slot. Returns false if
+ *  there was none.
+ */
+
+bool Reduction::Complete() {
+
+    if(!isPending()) return false;
+
+    double_t tStart = MPI_Wtime();
+    MPI_Wait(&m_Request, MPI_STATUS_IGNORE);
+    m_WaitTime += MPI_Wtime() - tStart;
+
+    m_Result.resize(m_Recv.size());
+    for(size_t i=0; i<m_Recv.size(); i++) {
+        m_Result[i] = m_Recv[i].dValue;
+    }
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Free
+ * ================
+ *  Completes a reduction in flight and releases the op, the type and the communicator
+ */
+
+void Reduction::Free() {
+
+    int32_t isFinalized = 0;
+    MPI_Finalized(&isFinalized);
+    if(isFinalized) return;
+
+    Complete();
+
+    if(m_Op != MPI_OP_NULL) {
+        MPI_Op_free(&m_Op);
+    }
+    if(m_Type != MPI_DATATYPE_NULL) {
+        MPI_Type_free(&m_Type);
+    }
+    if(m_Comm != MPI_COMM_NULL) {
+        MPI_Comm_free(&m_Comm);
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+//                                        Member Functions                                        //
+// ********************************************************************************************** //
+
+/**
+ *  Reduce Items
+ * ==============
+ *  The MPI op. Combines each item of pIn into the one of pInOut by its own op.
+ */
+
+void Reduction::reduceItems(void* pIn, void* pInOut, int* nLen, MPI_Datatype* pType) {
+
+    const item* pA = (const item*)pIn;
+    item*       pB = (item*)pInOut;
+
+    for(int i=0; i<*nLen; i++) {
+        switch(pB[i].iOp) {
+            case RED_SUM: pB[i].dValue += pA[i].dValue; break;
+            case RED_MIN: if(pA[i].dValue < pB[i].dValue) pB[i].dValue = pA[i].dValue; break;
+            case RED_MAX: if(pA[i].dValue > pB[i].dValue) pB[i].dValue = pA[i].dValue; break;
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+// End Class Reduction
@@ -0,0 +1,92 @@
+/**
+ * ReyPIC – Reduction Header
+ */
+
+#ifndef CLASS_REDUCTION
+#define CLASS_REDUCTION
+
+// Class-specific macros
+#define RED_SUM  0     // Sum over nodes
+#define RED_MIN  1     // Minimum over nodes
+#define RED_MAX  2     // Maximum over nodes
+
+#include "config.hpp"
+
+namespace reypic {
+
+class Reduction {
+
+public:
+
+   /**
+    * Constructor/Destructor
+    */
+
+    Reduction();
+    Reduction(const Reduction&) = delete;
+    ~Reduction();
+
+    Reduction& operator=(const Reduction&) = delete;
+
+   /**
+    * Setters/Getters/Checks
+    */
+
+    int32_t  getSize()     const {return (int32_t)m_Result.size();};
+    double_t getResult(int32_t iSlot) const {return m_Result[iSlot];};
+    double_t getWaitTime() const {return m_WaitTime;};
+    int32_t  getCount()    const {return m_Count;};
+
+    bool     isPending()   const {return m_Request != MPI_REQUEST_NULL;};
+
+   /**
+    * Methods
+    */
+
+    bool    Setup(MPI_Comm);
+    int32_t Add(int32_t, double_t);
+    void    Start();
+    bool    Complete();
+    void    Free();
+
+private:
+
+   /**
+    * Structs
+    */
+
+    // A value and how to combine it, so a single custom op can reduce a mixed buffer
+    struct item {
+        double_t dValue;
+        int64_t  iOp;
+    };
+
+   /**
+    * Member Functions
+    */
+
+    static void reduceItems(void*, void*, int*, MPI_Datatype*);
+
+   /**
+    * Member Variables
+    */
+
+    MPI_Comm          m_Comm    = MPI_COMM_NULL;     // Private copy of the communicator
+    MPI_Datatype      m_Type    = MPI_DATATYPE_NULL; // One item
+    MPI_Op            m_Op      = MPI_OP_NULL;       // Combines items by their own op
+    MPI_Request       m_Request = MPI_REQUEST_NULL;  // The reduction in flight
+
+    std::vector<item> m_Staged;                      // Values added since the last Start()
+    std::vector<item> m_Send;                        // Values of the reduction in flight
+    std::vector<item> m_Recv;
+    vdouble_t         m_Result;                      // Values of the last completed reduction
+
+    // Statistics
+    double_t          m_WaitTime = 0.0;              // Time spent waiting in Complete()
+    int32_t           m_Count    = 0;                // Reductions started
+
+}; // End Class Reduction
+
+} // End NameSpace
+
+#endif
@@ -5,7 +5,8 @@
  *
  *  Sequence:
  *  1. Read input file.
- *  2. Setup simulation. This creates the grid and the particle arrays.
+ *  2. Setup simulation. This creates the grid and the particle arrays, and solves for the initial
+ *     electrostatic field of the particles.
  *  3. Read restart information. Only if restart is specified. Exits if restart files do not match
  *     the setup from previous stage.
  *  4. Main simulation loop.
@@ -74,6 +75,10 @@ bool Simulation::setRunMode(value_t iRunMode) {
             m_RunMode = RUN_MODE_EXT_TEST;
             return true;
             break;
+        case RUN_MODE_BENCH:
+            m_RunMode = RUN_MODE_BENCH;
+            return true;
+            break;
     }
 
     return false;
@@ -140,23 +145,41 @@ error_t Simulation::Setup() {
         printf(" ===============\n");
     }
 
-    errVal = simInput.ReadVariable(INPUT_CONF, 0, "nodes", &m_Nodes, INVAR_INT);
+    errVal = simInput.ReadVariable(INPUT_CONF, 0, "nodes", &m_NodeDims, INVAR_VINT);
     if(errVal != ERR_NONE) return errVal;
 
     errVal = simInput.ReadVariable(INPUT_CONF, 0, "threads", &m_Threads, INVAR_INT);
     if(errVal != ERR_NONE) return errVal;
 
-    // Force m_Nodes to be equal to m_MPISize.
-    // This makes m_Nodes redundant as an input variable, but the intention is to have m_Nodes be
-    // able to split the domain in other dimensions than x1.
+    errVal = simInput.ReadVariable(INPUT_CONF, 0, "pinning", &m_Pinning, INVAR_INT);
+    if(errVal != ERR_NONE) return errVal;
+
+    // The total number of nodes is always the number of MPI processes.
+    // A single nodes value lets the grid choose the split; n1,n2,n3 sets the nodes per dimension,
+    // where 0 lets the grid choose that dimension.
     m_Nodes = m_MPISize;
+    if(m_NodeDims.size() == 1) {
+        m_NodeDims = {0, 0, 0};
+    }
 
     if(m_Nodes < 1)   m_Nodes = 1;
     if(m_Threads < 1) m_Threads = 1;
 
+    // The node threads are started once here and shared by the grid and all species
+    if(!simPool.Setup(m_Threads, m_Pinning != 0)) return ERR_SETUP;
+
     if(m_isMaster) {
+        vint_t vCores = simPool.getCores();
         printf("  Nodes: %d\n", m_Nodes);
         printf("  Threads/node: %d\n", m_Threads);
+        if(m_Pinning != 0 && vCores.empty()) {
+            printf("  Warning: More threads than cores to pin them to, threads are not pinned\n");
+        }
+        if(vCores.empty()) {
+            printf("  Thread pinning: off\n");
+        } else {
+            printf("  Thread pinning: cores %d to %d on master\n", vCores.front(), vCores.back());
+        }
         printf("\n");
         printf("  Simulation Setup\n");
         printf(" ==================\n");
@@ -174,11 +197,23 @@ error_t Simulation::Setup() {
     errVal = simInput.ReadVariable(INPUT_SIM, 0, "tmax", &m_TMax, INVAR_DOUBLE);
     if(errVal != ERR_NONE) return errVal;
 
-    // if(m_isMaster) {
-    //     printf("\n");
-    //     printf("  EMF Setup\n");
-    //     printf(" ===========\n");
-    // }
+    errVal = simInput.ReadVariable(INPUT_SIM, 0, "sort", &m_SortEvery, INVAR_INT);
+    if(errVal != ERR_NONE) return errVal;
+    if(m_SortEvery < 0) m_SortEvery = 0;
+
+    errVal = simInput.ReadVariable(INPUT_SIM, 0, "balance", &m_BalanceEvery, INVAR_INT);
+    if(errVal != ERR_NONE) return errVal;
+    if(m_BalanceEvery < 0) m_BalanceEvery = 0;
+
+    errVal = simInput.ReadVariable(INPUT_SIM, 0, "imbalance", &m_BalanceLimit, INVAR_DOUBLE);
+    if(errVal != ERR_NONE) return errVal;
+    if(m_BalanceLimit < 1.0) {
+        if(m_isMaster) printf("  Simulation Error: imbalance must be at least 1.0\n");
+        return ERR_SETUP;
+    }
+
+    errVal = simCheckpoint.Setup(&simInput);
+    if(errVal != ERR_NONE) return errVal;
 
     if(m_isMaster) {
         printf("\n");
@@ -186,9 +221,18 @@ error_t Simulation::Setup() {
         printf(" ============\n");
     }
 
-    error_t errGrid = simGrid.Setup(&simInput);
+    error_t errGrid = simGrid.Setup(&simInput, m_NodeDims, &simPool);
     if(errGrid != ERR_NONE) return errGrid;
 
+    if(m_isMaster) {
+        printf("\n");
+        printf("  EMF Setup\n");
+        printf(" ===========\n");
+    }
+
+    error_t errEMF = simEMF.Setup(&simInput, &simGrid, m_TimeStep);
+    if(errEMF != ERR_NONE) return errEMF;
+
     if(m_isMaster) {
         printf("\n");
         printf("  Species Setup\n");
@@ -197,10 +241,82 @@ error_t Simulation::Setup() {
 
     for(int32_t indSpecies=0; indSpecies<m_NumSpecies; indSpecies++) {
         simSpecies.push_back(indSpecies);
-        error_t errSpecies = simSpecies[indSpecies].Setup(&simInput, &simGrid);
+        error_t errSpecies = simSpecies[indSpecies].Setup(&simInput, &simGrid, m_Threads);
         if(errSpecies != ERR_NONE) return errSpecies;
     }
 
+    if(!simMigration.Setup(simGrid.getComm(), m_NumSpecies)) return ERR_SETUP;
+
+    if(m_isMaster) {
+        printf("\n");
+        printf("  Initial Fields\n");
+        printf(" ================\n");
+    }
+
+    error_t errPoisson = simPoisson.Setup(&simInput, &simGrid);
+    if(errPoisson != ERR_NONE) return errPoisson;
+
+    // A restart replaces the fields anyway
+    if(!simCheckpoint.isRestart()) {
+        errPoisson = simPoisson.Solve(&simGrid, simSpecies);
+        if(errPoisson != ERR_NONE) return errPoisson;
+    }
+
+    if(m_isMaster) {
+        printf("\n");
+        printf("  Diagnostics Setup\n");
+        printf(" ===================\n");
+    }
+
+    error_t errDiag = simDiagnostics.Setup(&simInput, &simGrid, simSpecies);
+    if(errDiag != ERR_NONE) return errDiag;
+
+    if(m_isMaster) {
+        printf("\n");
+    }
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Read Restart
+ * ==============
+ *  If restart is set, replaces the fields and particles from Setup() with the latest checkpoint,
+ *  and continues from its step. Fails if the checkpoint does not match the setup, or if its time
+ *  does not match tmin and dt.
+ */
+
+error_t Simulation::ReadRestart() {
+
+    if(!simCheckpoint.isRestart()) return ERR_NONE;
+
+    if(m_isMaster) {
+        printf("  Restart\n");
+        printf(" =========\n");
+    }
+
+    index_t  iStep = 0;
+    double_t dTime = 0.0;
+    error_t  errVal = simCheckpoint.Read(&simGrid, simSpecies, &iStep, &dTime);
+    if(errVal != ERR_NONE) return errVal;
+
+    if(fabs(m_TMin + iStep*m_TimeStep - dTime) > 1.0e-9*fmax(1.0, fabs(dTime))) {
+        if(m_isMaster) printf("  Simulation Error: checkpoint time %g does not match tmin and dt\n", dTime);
+        return ERR_SETUP;
+    }
+
+    // Tiles and node boxes follow the restored boundaries
+    for(int32_t indSpecies=0; indSpecies<m_NumSpecies; indSpecies++) {
+        simSpecies[indSpecies].Rebalance(&simGrid);
+    }
+    simEMF.Rebalance(&simGrid);
+    errVal = simMigration.Exchange(simSpecies);
+    if(errVal != ERR_NONE) return errVal;
+
+    m_Step = iStep;
+
     if(m_isMaster) {
         printf("\n");
     }
@@ -210,4 +326,274 @@ error_t Simulation::Setup() {
 
 // ********************************************************************************************** //
 
+/**
+ *  Main Loop
+ * ===========
+ *  Advances the simulation from tmin to tmax in steps of dt.
+ *  Each step pushes all species while depositing their current, completes the current on the
+ *  grid, advances the fields with it, and moves particles that left the node to their new node.
+ *  The field guard cells for the next step are exchanged while the particles move, and once more
+ *  before the first step and after the node boundaries moved.
+ *  Every m_SortEvery steps, the particles are sorted by cell before the push, and every
+ *  m_BalanceEvery steps, the load balance between nodes is checked after the step.
+ *  On exit, the master prints the push rate in particle pushes per second per core, including
+ *  deposition, averaged over all nodes. With sorting, it also prints the time spent sorting and the
+ *  push time per particle in the steps just before and just after a sort.
+ *  In benchmark mode, the array kernels, the batched equation evaluation, the cell lookup, the
+ *  guard cell exchanges with and without overlap, and the input reader are timed, and then only
+ *  the field solver is run for the same number of steps. In test mode, the loop is not run, but
+ *  the equation evaluation is checked the same way as in benchmark mode.
+ */
+
+error_t Simulation::MainLoop() {
+
+    if(m_RunMode == RUN_MODE_TEST || m_RunMode == RUN_MODE_EXT_TEST) {
+        Benchmark_t tBench;
+        return tBench.Check(&simPool, &simGrid, simSpecies);
+    }
+
+    if(m_TimeStep <= 0.0) {
+        if(m_isMaster) printf("  Simulation Error: Time step dt must be positive\n");
+        return ERR_EXEC;
+    }
+
+    index_t  nSteps = (index_t)round((m_TMax-m_TMin)/m_TimeStep);
+    if(m_RunMode == RUN_MODE_BENCH) {
+        Benchmark_t tBench;
+        return tBench.Run(nSteps, &simInput, &simPool, &simGrid, &simEMF, simSpecies);
+    }
+
+    double_t dPush  = 0.0;   // Time spent in the pusher
+    double_t dCurr  = 0.0;   // Time spent completing the current
+    double_t dMigr  = 0.0;   // Time spent migrating particles
+    double_t dCost  = 0.0;   // Push time since the last load balance check
+    double_t dBal   = 0.0;   // Time spent balancing
+    int32_t  nBal   = 0;     // Number of times the boundaries moved
+    double_t nPush  = 0.0;   // Number of particle pushes
+
+    double_t dSort   = 0.0;  // Time spent sorting
+    int32_t  nSorts  = 0;    // Number of sorts
+    double_t dBefore = 0.0;  // Push time per particle in steps before a sort
+    double_t dAfter  = 0.0;  // Push time per particle in steps after a sort
+    double_t dLast   = 0.0;  // Push time per particle in the previous step
+
+    if(m_isMaster) {
+        printf("  Main Loop\n");
+        printf(" ===========\n");
+        printf("  Steps: %ld\n", (long)nSteps);
+    }
+
+    // Errors leave the loop through here, so that the dump writer is always stopped before main
+    // finalises MPI
+    error_t  errLoop = ERR_NONE;
+    double_t dStart  = MPI_Wtime();
+
+    simGrid.fieldHalo.Exchange();
+
+    for(; m_Step<nSteps; m_Step++) {
+
+        m_Time = m_TMin + m_Step*m_TimeStep;
+
+        bool isSorted = (m_SortEvery > 0 && m_Step > 0 && m_Step % m_SortEvery == 0);
+        if(isSorted) {
+            double_t dTick = MPI_Wtime();
+            for(int32_t indSpecies=0; indSpecies<m_NumSpecies; indSpecies++) {
+                simSpecies[indSpecies].Sort(&simGrid);
+            }
+            dSort   += MPI_Wtime() - dTick;
+            dBefore += dLast;
+            nSorts++;
+        }
+
+        simGrid.ClearCurrent();
+
+        double_t dTick = MPI_Wtime();
+        double_t nStep = 0.0;
+        for(int32_t indSpecies=0; indSpecies<m_NumSpecies; indSpecies++) {
+            simSpecies[indSpecies].Push(&simGrid, m_TimeStep);
+            nStep += simSpecies[indSpecies].Part.getSize();
+        }
+        dTick  = MPI_Wtime() - dTick;
+        dPush += dTick;
+        dCost += dTick;
+        nPush += nStep;
+        dLast  = (nStep > 0.0 ? dTick/nStep : 0.0);
+        if(isSorted) dAfter += dLast;
+
+        dTick = MPI_Wtime();
+        simGrid.ReduceCurrent();
+        dCurr += MPI_Wtime() - dTick;
+
+        simEMF.Advance(&simGrid);
+
+        // The field guard cells for the next push are exchanged while the particles migrate
+        simGrid.fieldHalo.Start();
+        dTick = MPI_Wtime();
+        error_t errMigr = simMigration.Exchange(simSpecies);
+        dMigr += MPI_Wtime() - dTick;
+        simGrid.fieldHalo.Finish();
+        if(errMigr != ERR_NONE) {errLoop = errMigr; break;}
+
+        if(m_BalanceEvery > 0 && (m_Step+1) % m_BalanceEvery == 0 && m_Step+1 < nSteps) {
+            bool isMoved = false;
+            dTick = MPI_Wtime();
+            error_t errVal = balanceLoad(dCost, &isMoved);
+            if(errVal != ERR_NONE) {errLoop = errVal; break;}
+            if(isMoved) simGrid.fieldHalo.Exchange();
+            dBal += MPI_Wtime() - dTick;
+            dCost = 0.0;
+            if(isMoved) nBal++;
+        }
+
+        if(simDiagnostics.isDumpStep(m_Step+1)) {
+            error_t errVal = simDiagnostics.Write(m_Step+1, m_TMin+(m_Step+1)*m_TimeStep, &simGrid, simSpecies);
+            if(errVal != ERR_NONE) {errLoop = errVal; break;}
+        }
+
+        error_t errHist = simDiagnostics.History(m_Step+1, m_TMin+(m_Step+1)*m_TimeStep, &simGrid, simSpecies);
+        if(errHist != ERR_NONE) {errLoop = errHist; break;}
+
+        if(simCheckpoint.isCheckpointStep(m_Step+1)) {
+            error_t errVal = simCheckpoint.Write(m_Step+1, m_TMin+(m_Step+1)*m_TimeStep, &simGrid, simSpecies);
+            if(errVal != ERR_NONE) {errLoop = errVal; break;}
+        }
+    }
+    m_Time = m_TMin + nSteps*m_TimeStep;
+
+    error_t errDiag = simDiagnostics.Finish();
+    if(errLoop != ERR_NONE) return errLoop;
+    if(errDiag != ERR_NONE) return errDiag;
+
+    double_t dTotal = MPI_Wtime() - dStart;
+
+    // Push rate per core, and sorting and migration statistics, summed over nodes
+    double_t aStats[7] = {(dPush > 0.0 ? nPush/dPush/m_Threads : 0.0), dSort, dBefore, dAfter,
+                          dMigr, (double_t)simMigration.getSent(), (double_t)simMigration.getLost()};
+    double_t aSum[7]   = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    MPI_Reduce(aStats, aSum, 7, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if(m_isMaster) {
+        printf("  Run time: %.3f s, push time: %.3f s, current reduction: %.3f s\n",
+               dTotal, dPush, dCurr);
+        printf("  Push rate: %.3e pushes/s/core\n", aSum[0]/m_MPISize);
+        if(simEMF.isActive()) {
+            printf("  Field solver: %.3f s, guard cell exchange: %.3f s\n", simEMF.getTime(), simEMF.getHaloTime());
+        }
+        printf("  Migration: %.3f s, %.0f particles sent, %.0f lost through the boundary\n",
+               aSum[4]/m_MPISize, aSum[5], aSum[6]);
+        if(m_BalanceEvery > 0) {
+            printf("  Load balancing: %d rebalances in %.3f s\n", nBal, dBal);
+        }
+        if(simDiagnostics.getDumps() > 0) {
+            printf("  Diagnostics: %d dumps, %.1f MB in %.3f s, writing took %.3f s\n",
+                   simDiagnostics.getDumps(), simDiagnostics.getBytes()/1048576.0,
+                   simDiagnostics.getTime(), simDiagnostics.getWriteTime());
+        }
+        if(simDiagnostics.getLines() > 0) {
+            printf("  History: %d lines in %.3f s, waiting for reductions took %.3f s\n",
+                   simDiagnostics.getLines(), simDiagnostics.getHistTime(), simDiagnostics.getHistWait());
+        }
+        if(simCheckpoint.getCount() > 0) {
+            printf("  Checkpoints: %d written, %.1f MB in %.3f s\n", simCheckpoint.getCount(),
+                   simCheckpoint.getBytes()/1048576.0, simCheckpoint.getTime());
+        }
+        if(simDiagnostics.isAsync()) {
+            printf("  Diagnostics queue: max depth %d, %d late, %d dropped\n", simDiagnostics.getMaxDepth(),
+                   simDiagnostics.getLate(), simDiagnostics.getDropped());
+        }
+        if(simGrid.getTileSize()[0] > 0) {
+            for(int32_t indSpecies=0; indSpecies<m_NumSpecies; indSpecies++) {
+                printf("  Tile rebins for species %d: %d, %ld particles moved between tiles\n", indSpecies,
+                       simSpecies[indSpecies].getRebins(), (long)simSpecies[indSpecies].getTileMoves());
+            }
+        }
+        if(nSorts > 0) {
+            printf("  Sorting: %d sorts in %.3f s, push time %.1f ns/particle before and %.1f after\n",
+                   nSorts, aSum[1]/m_MPISize, 1.0e9*aSum[2]/(nSorts*m_MPISize),
+                   1.0e9*aSum[3]/(nSorts*m_MPISize));
+        }
+        printf("\n");
+    }
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+//                                        Member Functions                                        //
+// ********************************************************************************************** //
+
+/**
+ *  Balance Load
+ * ==============
+ *  Compares the push cost dCost of all nodes since the last check. If the slowest node takes more
+ *  than m_BalanceLimit times the mean, the grid boundaries are moved to even out the number of
+ *  particles per node, and the particles outside their new node are migrated. The push cost is
+ *  what decides, as it includes effects like cache use that counts miss, but particles per cell
+ *  plane are what can be split between nodes.
+ *  Logs the cost imbalance, and the particle imbalance before and after. Sets pMoved to whether
+ *  the boundaries moved.
+ */
+
+error_t Simulation::balanceLoad(double_t dCost, bool* pMoved) {
+
+    double_t nPart = 0.0;
+    for(int32_t indSpecies=0; indSpecies<m_NumSpecies; indSpecies++) {
+        nPart += simSpecies[indSpecies].Part.getSize();
+    }
+
+    double_t aLocal[2] = {dCost, nPart};
+    double_t aMax[2], aSum[2];
+    MPI_Allreduce(aLocal, aMax, 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(aLocal, aSum, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    double_t dCostRatio = (aSum[0] > 0.0 ? aMax[0]*m_MPISize/aSum[0] : 1.0);
+    double_t dPartRatio = (aSum[1] > 0.0 ? aMax[1]*m_MPISize/aSum[1] : 1.0);
+
+    *pMoved = false;
+    if(dCostRatio <= m_BalanceLimit) return ERR_NONE;
+
+    // Particles per global cell plane, per dimension
+    vint_t     vCells = simGrid.getGlobalCells();
+    vvdouble_t vLoad(3);
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        vLoad[iDim].assign(vCells[iDim], 0.0);
+    }
+    for(int32_t indSpecies=0; indSpecies<m_NumSpecies; indSpecies++) {
+        simSpecies[indSpecies].AddLoad(&simGrid, vLoad);
+    }
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        MPI_Allreduce(MPI_IN_PLACE, vLoad[iDim].data(), vCells[iDim], MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    }
+
+    error_t errVal = simGrid.Rebalance(vLoad, pMoved);
+    if(errVal != ERR_NONE) return errVal;
+
+    double_t dNewRatio = dPartRatio;
+    if(*pMoved) {
+        for(int32_t indSpecies=0; indSpecies<m_NumSpecies; indSpecies++) {
+            simSpecies[indSpecies].Rebalance(&simGrid);
+        }
+        simEMF.Rebalance(&simGrid);
+        errVal = simMigration.Exchange(simSpecies);
+        if(errVal != ERR_NONE) return errVal;
+
+        nPart = 0.0;
+        for(int32_t indSpecies=0; indSpecies<m_NumSpecies; indSpecies++) {
+            nPart += simSpecies[indSpecies].Part.getSize();
+        }
+        double_t nMax;
+        MPI_Allreduce(&nPart, &nMax, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        dNewRatio = nMax*m_MPISize/aSum[1];
+    }
+
+    if(m_isMaster) {
+        printf("  Balance: step %ld, cost imbalance %.2f, particle imbalance %.2f -> %.2f%s\n",
+               (long)m_Step+1, dCostRatio, dPartRatio, dNewRatio, (*pMoved ? "" : ", boundaries kept"));
+    }
+
+    return ERR_NONE;
+}
+
+// ********************************************************************************************** //
+
 // End Class Input
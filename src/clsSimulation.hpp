@@ -10,10 +10,23 @@
 #include "clsInput.hpp"
 #include "clsGrid.hpp"
 #include "clsSpecies.hpp"
+#include "clsMigration.hpp"
+#include "clsDiagnostics.hpp"
+#include "clsCheckpoint.hpp"
+#include "clsEMF.hpp"
+#include "clsPoisson.hpp"
+#include "clsBenchmark.hpp"
 
 typedef reypic::Input                Input_t;
 typedef reypic::Grid                 Grid_t;
 typedef std::vector<reypic::Species> Species_t;
+typedef reypic::Migration            Migration_t;
+typedef reypic::ThreadPool           ThreadPool_t;
+typedef reypic::Diagnostics          Diagnostics_t;
+typedef reypic::Checkpoint           Checkpoint_t;
+typedef reypic::EMF                  EMF_t;
+typedef reypic::Poisson              Poisson_t;
+typedef reypic::Benchmark            Benchmark_t;
 
 namespace reypic {
 
@@ -43,8 +56,8 @@ public:
 
     error_t ReadInput();    // Read input file
     error_t Setup();
-    void    ReadRestart();
-    void    MainLoop();
+    error_t ReadRestart();
+    error_t MainLoop();
     error_t AbortExec(error_t);
     error_t Finalize(error_t);
 
@@ -52,12 +65,24 @@ public:
     * Properties
     */
 
-    Input_t   simInput;
-    Grid_t    simGrid;
-    Species_t simSpecies;
+    ThreadPool_t simPool;
+    Input_t     simInput;
+    Grid_t      simGrid;
+    EMF_t       simEMF;
+    Poisson_t   simPoisson;
+    Species_t   simSpecies;
+    Migration_t simMigration;
+    Diagnostics_t simDiagnostics;
+    Checkpoint_t simCheckpoint;
 
 private:
 
+   /**
+    * Member Functions
+    */
+
+    error_t balanceLoad(double_t, bool*);
+
    /**
     * Member Variables
     */
@@ -73,7 +98,11 @@ private:
     bool     m_isMaster    = false;           // True if this node is master
 
     int32_t  m_Nodes      =  1;
+    vint_t   m_NodeDims   = {0, 0, 0};
     int32_t  m_Threads    =  1;
+    int32_t  m_Pinning    =  1;              // Pin threads to cores if not 0
+    int32_t  m_BalanceEvery = 0;              // Steps between load balance checks, 0 for none
+    double_t m_BalanceLimit = 1.2;            // Max over mean node cost that triggers rebalancing
 
     // Physics
     double_t m_N0         = 1.0;
@@ -82,6 +111,9 @@ private:
     double_t m_TimeStep   = 1.0;
     double_t m_TMin       = 0.0;
     double_t m_TMax       = 1.0;
+    int32_t  m_SortEvery  = 0;                // Steps between particle sorts, 0 for none
+    double_t m_Time       = 0.0;
+    index_t  m_Step       = 0;
 
 };
 
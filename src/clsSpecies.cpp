@@ -3,10 +3,26 @@
  */
 
 #include "clsSpecies.hpp"
+#include <atomic>
+#include <mutex>
+#include <algorithm>
 
 using namespace std;
 using namespace reypic;
 
+// Adds dValue to *pValue, atomically if isAtomic is set
+static inline void addCurrent(double_t* pValue, double_t dValue, bool isAtomic) {
+    if(!isAtomic) {
+        *pValue += dValue;
+        return;
+    }
+    double_t dOld, dNew;
+    __atomic_load(pValue, &dOld, __ATOMIC_RELAXED);
+    do {
+        dNew = dOld + dValue;
+    } while(!__atomic_compare_exchange(pValue, &dOld, &dNew, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
 // ********************************************************************************************** //
 
 /**
@@ -36,10 +52,12 @@ Species::Species(int32_t indNumber) {
  *  Sets up the species
  */
 
-int Species::Setup(Input_t* simInput, Grid_t* simGrid) {
+int Species::Setup(Input_t* simInput, Grid_t* simGrid, int32_t nThreads) {
 
     error_t errVal;
 
+    m_Threads = nThreads;
+
     // Species Name
     errVal = simInput->ReadVariable(INPUT_SPECIES, m_Number, "name", &m_Name, INVAR_STRING);
     if(errVal != ERR_NONE) return errVal;
@@ -90,25 +108,605 @@ int Species::Setup(Input_t* simInput, Grid_t* simGrid) {
         return ERR_SETUP;
     }
 
-    if(m_isMaster) {
-        printf("  Species by name '%s' created\n", m_Name.c_str());
-    }
-
     // Extract grid info
     m_GridXMin = simGrid->getBoxMin();
     m_GridXMax = simGrid->getBoxMax();
 
+    // Species Profile Function
+    if(m_ProfileType == "func") {
+        errVal = simInput->ReadVariable(INPUT_SPECIES, m_Number, "profilefunc", &m_ProfileEq, INVAR_STRING);
+        if(errVal != ERR_NONE) return errVal;
+    }
+
+    // Momentum Distribution
+    errVal = simInput->ReadVariable(INPUT_SPECIES, m_Number, "thermal", &m_Thermal, INVAR_VDOUBLE);
+    if(errVal != ERR_NONE) return errVal;
+    errVal = simInput->ReadVariable(INPUT_SPECIES, m_Number, "fluid", &m_Fluid, INVAR_VDOUBLE);
+    if(errVal != ERR_NONE) return errVal;
+    if(m_Thermal.size() != 3 || m_Fluid.size() != 3) {
+        if(m_isMaster) {
+            printf("  Species Error: thermal and fluid must have 3 components\n");
+        }
+        return ERR_SETUP;
+    }
+
+    // Distribution Mode
+    string_t sDist = "thermal";
+    errVal = simInput->ReadVariable(INPUT_SPECIES, m_Number, "distribution", &sDist, INVAR_STRING);
+    if(errVal != ERR_NONE) return errVal;
+    if(sDist == "thermal") {
+        m_DistMode = MOM_THERMAL;
+    } else
+    if(sDist == "twiss") {
+        m_DistMode = MOM_TWISS;
+    } else {
+        if(m_isMaster) {
+            printf("  Species Error: Invalid distribution '%s'\n", sDist.c_str());
+        }
+        return ERR_SETUP;
+    }
+
+    // Twiss Parameters
+    if(m_DistMode == MOM_TWISS) {
+        errVal = simInput->ReadVariable(INPUT_SPECIES, m_Number, "emittance", &m_Emittance, INVAR_DOUBLE);
+        if(errVal != ERR_NONE) return errVal;
+        errVal = simInput->ReadVariable(INPUT_SPECIES, m_Number, "alpha", &m_Alpha0, INVAR_DOUBLE);
+        if(errVal != ERR_NONE) return errVal;
+        errVal = simInput->ReadVariable(INPUT_SPECIES, m_Number, "beta", &m_Beta0, INVAR_DOUBLE);
+        if(errVal != ERR_NONE) return errVal;
+        errVal = simInput->ReadVariable(INPUT_SPECIES, m_Number, "gamma", &m_Gamma0, INVAR_DOUBLE);
+        if(errVal != ERR_NONE) return errVal;
+        errVal = simInput->ReadVariable(INPUT_SPECIES, m_Number, "beamcentre", &m_BeamCentre, INVAR_VDOUBLE);
+        if(errVal != ERR_NONE) return errVal;
+
+        if(m_Emittance <= 0.0 || m_Beta0 <= 0.0) {
+            if(m_isMaster) {
+                printf("  Species Error: Twiss distribution needs emittance > 0 and beta > 0\n");
+            }
+            return ERR_SETUP;
+        }
+        if(m_Fluid[0] <= 0.0) {
+            if(m_isMaster) {
+                printf("  Species Error: Twiss distribution needs a fluid momentum in x1 > 0\n");
+            }
+            return ERR_SETUP;
+        }
+
+        // Gamma is given by alpha and beta, so check it if it is set
+        double_t dGamma = (1.0 + m_Alpha0*m_Alpha0)/m_Beta0;
+        if(m_Gamma0 == 0.0) {
+            m_Gamma0 = dGamma;
+        } else
+        if(fabs(m_Gamma0 - dGamma) > 1.0e-6*dGamma) {
+            if(m_isMaster) {
+                printf("  Species Error: Twiss gamma %.4g does not match (1+alpha^2)/beta = %.4g\n",
+                       m_Gamma0, dGamma);
+            }
+            return ERR_SETUP;
+        }
+
+        if(m_BeamCentre.size() == 0) {
+            m_BeamCentre = {0.5*(m_GridXMin[1]+m_GridXMax[1]), 0.5*(m_GridXMin[2]+m_GridXMax[2])};
+        }
+        if(m_BeamCentre.size() != 2) {
+            if(m_isMaster) {
+                printf("  Species Error: beamcentre must have 2 components (x2, x3)\n");
+            }
+            return ERR_SETUP;
+        }
+
+        if(m_isMaster) {
+            double_t dEps = m_Emittance/m_Fluid[0];
+            printf("  Twiss beam: sigma_x = %.4g, sigma_x' = %.4g\n",
+                   sqrt(dEps*m_Beta0), sqrt(dEps*m_Gamma0));
+        }
+    }
+
+    // Random Seed
+    errVal = simInput->ReadVariable(INPUT_SPECIES, m_Number, "seed", &m_Seed, INVAR_INT);
+    if(errVal != ERR_NONE) return errVal;
+
+    if(m_isMaster) {
+        printf("  Species by name '%s' created\n", m_Name.c_str());
+    }
+
     // Create particles
-    if(!setupSpeciesProfile()) {
+    if(!setupSpeciesProfile(simGrid)) {
         if(m_isMaster) {
             printf("  Species Error: Failed to evaulate species profile\n");
         }
         return ERR_SETUP;
     }
 
+    // Particle tiles
+    if(simGrid->getTileSize()[0] > 0) {
+        if(!setupTiles(simGrid)) return ERR_SETUP;
+        if(m_isMaster) {
+            size_t nBuf = m_TileJ.size();
+            for(auto& vItem : m_TileF) nBuf += vItem.size();
+            printf("  Tiles: %d x %d x %d per node, %.0f kB of fields per thread, %.1f MB of tile buffers\n",
+                   m_TileN[0], m_TileN[1], m_TileN[2], m_TileF[0].size()*sizeof(double_t)/1024.0,
+                   nBuf*sizeof(double_t)/1048576.0);
+        }
+    }
+
     return ERR_NONE;
 }
 
+// ********************************************************************************************** //
+
+/**
+ *  Push
+ * ======
+ *  Advances all particles by one time step dt using the relativistic Boris pusher, and deposits
+ *  their current on the grid.
+ *  The work is split over the grid's threads according to its deposition strategy:
+ *  - private: each thread takes a contiguous range of particles and deposits into its own buffers,
+ *    which the grid sums in ReduceCurrent().
+ *  - colour:  particles are binned into slabs along x1 of at least PUSH_SLAB cells. Even slabs are
+ *    pushed in parallel first, then odd slabs, so no two threads write the same cells.
+ *  - atomic:  contiguous ranges as for private, but depositing directly into J with atomic adds.
+ *  With one thread, all strategies deposit directly into J. With tiles, the particles are pushed
+ *  tile by tile instead, see pushTiled().
+ */
+
+void Species::Push(Grid_t* simGrid, double_t dt) {
+
+    index_t nPart    = Part.getSize();
+    int32_t nThreads = simGrid->getThreads();
+    bool    isAtomic = (simGrid->getDeposit() != DEP_PRIVATE);
+
+    // Particles outside the node after the push are flagged for migration
+    vdouble_t vMin = simGrid->getLocalMin();
+    vdouble_t vMax = simGrid->getLocalMax();
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        m_NodeMin[iDim] = vMin[iDim];
+        m_NodeMax[iDim] = vMax[iDim];
+    }
+    m_Leavers.resize(nThreads);
+    for(auto& vItem : m_Leavers) vItem.clear();
+
+    if(m_Tiled) {
+        pushTiled(simGrid, dt);
+        return;
+    }
+
+    if(nThreads == 1) {
+        window wNode;
+        nodeWindow(simGrid, 0, wNode);
+        pushRange(simGrid, wNode, 0, nPart, NULL, dt, false, &m_Leavers[0]);
+        return;
+    }
+
+    // Too few cells to colour falls back to atomics
+    if(simGrid->getDeposit() == DEP_COLOUR) {
+        if(pushColoured(simGrid, dt)) return;
+    }
+
+    index_t nChunk = ((nPart + nThreads*PUSH_BLOCK - 1)/(nThreads*PUSH_BLOCK))*PUSH_BLOCK;
+
+    simGrid->getPool()->Run([&](int32_t iT) {
+        index_t iFrom = min(nPart, iT*nChunk);
+        index_t iTo   = min(nPart, iFrom+nChunk);
+        window  wNode;
+        nodeWindow(simGrid, iT, wNode);
+        pushRange(simGrid, wNode, iFrom, iTo, NULL, dt, isAtomic, &m_Leavers[iT]);
+    });
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Sort
+ * ======
+ *  Reorders the particles by local cell, with x1 running fastest, using a parallel counting sort in
+ *  two levels, so that no thread needs counts for every cell.
+ *  1. Each thread finds the cells of a contiguous range of particles and counts them per bucket,
+ *     where a bucket is a range of cells with SORT_BUCKETS buckets per thread.
+ *  2. The counts are turned into write offsets, by bucket and then by thread, and each thread
+ *     writes the indices of its particles to their bucket.
+ *  3. The buckets are split into one range per thread with about equal numbers of particles. Each
+ *     thread counts its particles per cell, and copies them in cell order to a second store, which
+ *     is then swapped with the particle store.
+ *  The sort is stable, so the result does not depend on the number of threads. Particles in guard
+ *  cells or outside the node are sorted with the nearest local cell.
+ *  With tiles, the cells are numbered tile by tile, so the sort also bins the particles by tile.
+ */
+
+void Species::Sort(Grid_t* simGrid) {
+
+    index_t nPart    = Part.getSize();
+    int32_t nThreads = simGrid->getThreads();
+    vint_t  vCells   = simGrid->getLocalCells();
+    index_t nCells   = (index_t)vCells[0]*vCells[1]*vCells[2];
+
+    if(nPart == 0) {
+        if(m_Tiled) {
+            m_TileStart.assign(m_TileBase.size(), 0);
+            m_TilesValid = true;
+        }
+        return;
+    }
+
+    m_SortKey.resize(nPart);
+    m_SortIdx.resize(nPart);
+    if(!m_SortBuf.Reserve(Part.getCapacity()) || !m_SortBuf.Resize(nPart)) return;
+
+    index_t nPer    = max((index_t)1, (nCells + nThreads*SORT_BUCKETS - 1)/(nThreads*SORT_BUCKETS));
+    index_t nBucket = (nCells + nPer - 1)/nPer;
+
+    vector<index_t> vCount(nThreads*nBucket, 0);   // Counts, then write offsets, per thread and bucket
+    vector<index_t> vBucket(nBucket+1, 0);         // First particle of each bucket
+    vector<index_t> vRange(nThreads+1, nBucket);   // First bucket of each thread in the cell pass
+    vector<index_t> vCellStart(m_Tiled ? nCells : 0);
+    ThreadPool_t*   pPool = simGrid->getPool();
+
+    index_t nChunk = ((nPart + nThreads*PUSH_BLOCK - 1)/(nThreads*PUSH_BLOCK))*PUSH_BLOCK;
+
+    window wNode;
+    nodeWindow(simGrid, 0, wNode);
+
+    // Cell of each particle, and bucket counts per thread
+    pPool->Run([&](int32_t iT) {
+        index_t  iFrom = min(nPart, iT*nChunk);
+        index_t  iTo   = min(nPart, iFrom+nChunk);
+        index_t* pCount = &vCount[iT*nBucket];
+        double_t aXi[3][PUSH_BLOCK];
+        const double_t* pX[3] = {Part.X1, Part.X2, Part.X3};
+        for(index_t iStart=iFrom; iStart<iTo; iStart+=PUSH_BLOCK) {
+            int32_t nBlock = (int32_t)min((index_t)PUSH_BLOCK, iTo-iStart);
+            for(int32_t iDim=0; iDim<3; iDim++) {
+                logicalPos(simGrid, wNode, iDim, pX[iDim]+iStart, nBlock, aXi[iDim]);
+            }
+            for(int32_t i=0; i<nBlock; i++) {
+                int32_t i1 = min(max((int32_t)floor(aXi[0][i]), 0), vCells[0]-1);
+                int32_t i2 = min(max((int32_t)floor(aXi[1][i]), 0), vCells[1]-1);
+                int32_t i3 = min(max((int32_t)floor(aXi[2][i]), 0), vCells[2]-1);
+                int32_t iKey = i1 + vCells[0]*(i2 + vCells[1]*i3);
+                if(m_Tiled) {
+                    int32_t t1 = m_TileOf[0][i1], t2 = m_TileOf[1][i2], t3 = m_TileOf[2][i3];
+                    int32_t n1 = m_TileLo[0][t1+1] - m_TileLo[0][t1];
+                    int32_t n2 = m_TileLo[1][t2+1] - m_TileLo[1][t2];
+                    iKey = (int32_t)m_TileBase[t1 + m_TileN[0]*(t2 + m_TileN[1]*t3)]
+                         + (i1 - m_TileLo[0][t1]) + n1*((i2 - m_TileLo[1][t2]) + n2*(i3 - m_TileLo[2][t3]));
+                }
+                m_SortKey[iStart+i] = iKey;
+                pCount[iKey/nPer]++;
+            }
+        }
+    });
+
+    // Write offsets per bucket and thread
+    index_t iOffset = 0;
+    for(index_t b=0; b<nBucket; b++) {
+        vBucket[b] = iOffset;
+        for(int32_t iT=0; iT<nThreads; iT++) {
+            index_t nCount = vCount[iT*nBucket+b];
+            vCount[iT*nBucket+b] = iOffset;
+            iOffset += nCount;
+        }
+    }
+    vBucket[nBucket] = nPart;
+
+    // Particle indices by bucket
+    pPool->Run([&](int32_t iT) {
+        index_t  iFrom = min(nPart, iT*nChunk);
+        index_t  iTo   = min(nPart, iFrom+nChunk);
+        index_t* pNext = &vCount[iT*nBucket];
+        for(index_t i=iFrom; i<iTo; i++) {
+            m_SortIdx[pNext[m_SortKey[i]/nPer]++] = i;
+        }
+    });
+
+    // Buckets per thread, split by particles
+    vRange[0] = 0;
+    index_t b = 0;
+    for(int32_t iT=1; iT<nThreads; iT++) {
+        index_t nTarget = (nPart*iT)/nThreads;
+        while(b < nBucket && vBucket[b] < nTarget) b++;
+        vRange[iT] = b;
+    }
+
+    // Count each thread's particles per cell, and copy them in cell order
+    pPool->Run([&](int32_t iT) {
+        index_t bFrom = vRange[iT];
+        index_t bTo   = vRange[iT+1];
+        if(bFrom >= bTo) return;
+
+        index_t cFrom = bFrom*nPer;
+        index_t cTo   = min(bTo*nPer, nCells);
+        index_t eFrom = vBucket[bFrom];
+        index_t eTo   = vBucket[bTo];
+
+        vector<index_t> vNext(cTo-cFrom, 0);
+        for(index_t e=eFrom; e<eTo; e++) {
+            vNext[m_SortKey[m_SortIdx[e]]-cFrom]++;
+        }
+        index_t iNext = eFrom;
+        for(index_t c=0; c<cTo-cFrom; c++) {
+            index_t nCount = vNext[c];
+            vNext[c] = iNext;
+            if(m_Tiled) vCellStart[cFrom+c] = iNext;
+            iNext += nCount;
+        }
+
+        double_t* pSrc[7] = {Part.X1, Part.X2, Part.X3, Part.U1, Part.U2, Part.U3, Part.W};
+        double_t* pDst[7] = {m_SortBuf.X1, m_SortBuf.X2, m_SortBuf.X3,
+                             m_SortBuf.U1, m_SortBuf.U2, m_SortBuf.U3, m_SortBuf.W};
+        for(index_t e=eFrom; e<eTo; e++) {
+            index_t i     = m_SortIdx[e];
+            index_t iDest = vNext[m_SortKey[i]-cFrom]++;
+            for(int32_t iA=0; iA<7; iA++) {
+                pDst[iA][iDest] = pSrc[iA][i];
+            }
+            m_SortBuf.Tag[iDest] = Part.Tag[i];
+        }
+    });
+
+    // With tiles, the first particle of each tile is the first particle of its first cell
+    if(m_Tiled) {
+        index_t nTiles = m_TileBase.size()-1;
+        m_TileStart.resize(nTiles+1);
+        for(index_t iTile=0; iTile<nTiles; iTile++) {
+            m_TileStart[iTile] = vCellStart[m_TileBase[iTile]];
+        }
+        m_TileStart[nTiles] = nPart;
+        m_TilesValid = true;
+    }
+
+    Part.Swap(m_SortBuf);
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Pack Leavers
+ * ==============
+ *  Removes the particles flagged as leaving the node in the last push, and packs them into vSend
+ *  by direction, with the directions numbered as in the halo exchange. Each particle is packed as
+ *  PART_ARRAYS values, with the tag stored bitwise in a double.
+ *  The holes are filled in place with the last particles that stay, so only as many particles are
+ *  moved as have left. Returns the number of particles removed.
+ */
+
+index_t Species::PackLeavers(vvdouble_t& vSend) {
+
+    vSend.resize(27);
+    for(auto& vItem : vSend) vItem.clear();
+
+    // The lists are in particle order per thread, but not across threads, or with colouring
+    vector<index_t> vIdx;
+    for(auto& vItem : m_Leavers) {
+        vIdx.insert(vIdx.end(), vItem.begin(), vItem.end());
+        vItem.clear();
+    }
+    sort(vIdx.begin(), vIdx.end());
+
+    index_t nPart  = Part.getSize();
+    index_t nLeave = vIdx.size();
+    index_t nKeep  = nPart - nLeave;
+    if(nLeave == 0) return 0;
+
+    for(index_t iL=0; iL<nLeave; iL++) {
+        index_t   i     = vIdx[iL];
+        double_t  aX[3] = {Part.X1[i], Part.X2[i], Part.X3[i]};
+        int32_t   iDir  = 0;
+        for(int32_t iDim=2; iDim>=0; iDim--) {
+            iDir = 3*iDir + (aX[iDim] < m_NodeMin[iDim] ? 0 : (aX[iDim] >= m_NodeMax[iDim] ? 2 : 1));
+        }
+        double_t dTag;
+        memcpy(&dTag, &Part.Tag[i], sizeof(double_t));
+        vSend[iDir].insert(vSend[iDir].end(), {Part.X1[i], Part.X2[i], Part.X3[i],
+                                               Part.U1[i], Part.U2[i], Part.U3[i], Part.W[i], dTag});
+    }
+
+    // Fill holes below nKeep from the end, skipping particles that are leaving themselves
+    index_t iTail = nPart;
+    index_t iBack = nLeave;
+    for(index_t iL=0; iL<nLeave && vIdx[iL]<nKeep; iL++) {
+        iTail--;
+        while(iBack > 0 && vIdx[iBack-1] == iTail) {
+            iBack--;
+            iTail--;
+        }
+        Part.Copy(iTail, vIdx[iL]);
+    }
+    Part.Resize(nKeep);
+
+    // A tiled push moves its leavers behind the tiles, so the bins only break after a rebalance
+    if(m_Tiled && (!m_TilesValid || vIdx[0] < m_TileStart.back())) m_TilesValid = false;
+
+    return nLeave;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Add Load
+ * ==========
+ *  Adds the number of particles in each global cell plane to vLoad, per dimension
+ */
+
+void Species::AddLoad(Grid_t* simGrid, vvdouble_t& vLoad) {
+
+    index_t   nPart   = Part.getSize();
+    double_t* pX[3]   = {Part.X1, Part.X2, Part.X3};
+    int32_t   aCell[PUSH_BLOCK];
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        for(index_t iStart=0; iStart<nPart; iStart+=PUSH_BLOCK) {
+            int32_t nBlock = (int32_t)min((index_t)PUSH_BLOCK, nPart-iStart);
+            simGrid->cellOf(iDim, pX[iDim]+iStart, nBlock, aCell);
+            for(int32_t i=0; i<nBlock; i++) {
+                vLoad[iDim][aCell[i]] += 1.0;
+            }
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Add Charge
+ * ============
+ *  Adds the charge of the particles to the nodes in pQ, an array shaped like the field arrays,
+ *  with the linear weights whose charge the current deposition conserves. Charge on guard nodes is
+ *  left for the caller to add onto the nodes owning them.
+ */
+
+void Species::AddCharge(Grid_t* simGrid, double_t* pQ) {
+
+    index_t nPart = Part.getSize();
+    window  wNode;
+    nodeWindow(simGrid, 0, wNode);
+
+    index_t nS1 = wNode.stride[0];
+    index_t nS2 = wNode.stride[1];
+    index_t nS3 = wNode.stride[2];
+
+    double_t* pX[3] = {Part.X1, Part.X2, Part.X3};
+    double_t  aXi[3][PUSH_BLOCK];
+
+    for(index_t iStart=0; iStart<nPart; iStart+=PUSH_BLOCK) {
+        int32_t nBlock = (int32_t)min((index_t)PUSH_BLOCK, nPart-iStart);
+        for(int32_t iDim=0; iDim<3; iDim++) {
+            logicalPos(simGrid, wNode, iDim, pX[iDim]+iStart, nBlock, aXi[iDim]);
+        }
+        for(int32_t i=0; i<nBlock; i++) {
+            int32_t  i1    = (int32_t)floor(aXi[0][i]);
+            int32_t  i2    = (int32_t)floor(aXi[1][i]);
+            int32_t  i3    = (int32_t)floor(aXi[2][i]);
+            double_t f1    = aXi[0][i] - i1;
+            double_t f2    = aXi[1][i] - i2;
+            double_t f3    = aXi[2][i] - i3;
+            double_t dQ    = m_Charge*Part.W[iStart+i];
+            index_t  iBase = simGrid->fieldIndex(i1, i2, i3);
+
+            pQ[iBase]             += dQ*(1-f1)*(1-f2)*(1-f3);
+            pQ[iBase+nS1]         += dQ*f1*(1-f2)*(1-f3);
+            pQ[iBase+nS2]         += dQ*(1-f1)*f2*(1-f3);
+            pQ[iBase+nS1+nS2]     += dQ*f1*f2*(1-f3);
+            pQ[iBase+nS3]         += dQ*(1-f1)*(1-f2)*f3;
+            pQ[iBase+nS1+nS3]     += dQ*f1*(1-f2)*f3;
+            pQ[iBase+nS2+nS3]     += dQ*(1-f1)*f2*f3;
+            pQ[iBase+nS1+nS2+nS3] += dQ*f1*f2*f3;
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Moments
+ * =========
+ *  Sets pEnergy to the kinetic energy of the species on this node, the sum of W*m*(gamma-1) in
+ *  units of c^2, and pMaxU to the largest |u| of its particles, or 0 if there are none
+ */
+
+void Species::Moments(Grid_t* simGrid, double_t* pEnergy, double_t* pMaxU) {
+
+    index_t       nPart    = Part.getSize();
+    ThreadPool_t* pPool    = simGrid->getPool();
+    int32_t       nThreads = pPool->getThreads();
+    vdouble_t     vEnergy(nThreads, 0.0), vMaxU2(nThreads, 0.0);
+
+    pPool->Run([&](int32_t iT) {
+        index_t  iFrom = nPart*iT/nThreads;
+        index_t  iTo   = nPart*(iT+1)/nThreads;
+        double_t aEnergy[PUSH_BLOCK], aU2[PUSH_BLOCK];
+        for(index_t iStart=iFrom; iStart<iTo; iStart+=PUSH_BLOCK) {
+            int32_t nBlock = (int32_t)min((index_t)PUSH_BLOCK, iTo-iStart);
+            for(int32_t i=0; i<nBlock; i++) {
+                index_t  iP  = iStart+i;
+                double_t dU2 = Part.U1[iP]*Part.U1[iP] + Part.U2[iP]*Part.U2[iP] + Part.U3[iP]*Part.U3[iP];
+                aU2[i]       = dU2;
+                aEnergy[i]   = Part.W[iP]*dU2/(1.0 + sqrt(1.0 + dU2)); // gamma-1 without cancellation
+            }
+            vEnergy[iT] += m::sum(aEnergy, nBlock);
+            vMaxU2[iT]   = max(vMaxU2[iT], m::max(aU2, nBlock));
+        }
+    });
+
+    *pEnergy = m_Mass*m::sum(vEnergy.data(), nThreads);
+    *pMaxU   = sqrt(m::max(vMaxU2.data(), nThreads));
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Rebalance
+ * ===========
+ *  Adapts the species to a new node box after the grid boundaries moved. The tiles are rebuilt, and
+ *  all particles outside the new box are flagged for migration as if they had left in a push.
+ */
+
+void Species::Rebalance(Grid_t* simGrid) {
+
+    if(m_Tiled) setupTiles(simGrid);
+
+    vdouble_t vMin = simGrid->getLocalMin();
+    vdouble_t vMax = simGrid->getLocalMax();
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        m_NodeMin[iDim] = vMin[iDim];
+        m_NodeMax[iDim] = vMax[iDim];
+    }
+    m_Leavers.resize(1);
+    for(auto& vItem : m_Leavers) vItem.clear();
+
+    index_t nPart = Part.getSize();
+    for(index_t i=0; i<nPart; i++) {
+        if(Part.X1[i] < m_NodeMin[0] || Part.X1[i] >= m_NodeMax[0] ||
+           Part.X2[i] < m_NodeMin[1] || Part.X2[i] >= m_NodeMax[1] ||
+           Part.X3[i] < m_NodeMin[2] || Part.X3[i] >= m_NodeMax[2]) {
+            m_Leavers[0].push_back(i);
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Append Particles
+ * ==================
+ *  Adds nNew particles packed as by PackLeavers()
+ *  With tiles, they are added behind the last tile, and binned at the start of the next push.
+ *  Returns false if there was no room for them.
+ */
+
+bool Species::AppendParticles(const double_t* pBuf, index_t nNew) {
+
+    if(nNew == 0) return true;
+
+    index_t iFirst;
+    if(!Part.Append(nNew, &iFirst)) return false;
+
+    for(index_t i=0; i<nNew; i++) {
+        const double_t* pItem = pBuf + i*PART_ARRAYS;
+        Part.X1[iFirst+i] = pItem[0];
+        Part.X2[iFirst+i] = pItem[1];
+        Part.X3[iFirst+i] = pItem[2];
+        Part.U1[iFirst+i] = pItem[3];
+        Part.U2[iFirst+i] = pItem[4];
+        Part.U3[iFirst+i] = pItem[5];
+        Part.W[iFirst+i]  = pItem[6];
+        memcpy(&Part.Tag[iFirst+i], &pItem[7], sizeof(index_t));
+    }
+
+    return true;
+}
+
 // ********************************************************************************************** //
 //                                        Member Functions                                        //
 // ********************************************************************************************** //
@@ -118,21 +716,99 @@ int Species::Setup(Input_t* simInput, Grid_t* simGrid) {
  * ==========================
  */
 
-bool Species::setupSpeciesProfile() {
+bool Species::setupSpeciesProfile(Grid_t* simGrid) {
 
     vstring_t vsGridVars = {"x1","x2","x3","l1","l2","l3","u1","u2","u3"};
-    // vdouble_t vdGridVals = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
-    //
-    // for(int i=0; i<3; i++) {
-    //     vdGridVals[3+i] = m_GridXMin[i];
-    //     vdGridVals[6+i] = m_GridXMax[i];
-    // }
 
     if(m_ProfileType == "uniform") {
 
     } else
     if(m_ProfileType == "func") {
 
+        if(!m_ProfileFunc.setVariables(vsGridVars)) return false;
+        if(!m_ProfileFunc.setEquation(m_ProfileEq)) return false;
+    }
+
+    return createParticles(simGrid);
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Create Particles
+ * ==================
+ *  Places m_PerCell particles on a regular sub-grid in each cell owned by this node and weights
+ *  them by the species profile. The cells are split into contiguous ranges, one per thread. Each
+ *  cell has its own random stream from its global index, so the result is the same for any number
+ *  of threads and nodes.
+ *  For a func profile, a first pass counts the particles with non-zero weight in each range so
+ *  that the second pass can write directly into the particle arrays.
+ */
+
+bool Species::createParticles(Grid_t* simGrid) {
+
+    double_t tStart = MPI_Wtime();
+
+    // Cell edges and widths from grid
+    m_CellEdge   = simGrid->gridEdge;
+    m_CellDelta  = simGrid->gridDelta;
+    m_CellStart  = simGrid->getLocalStart();
+    m_NCells     = simGrid->getLocalCells();
+    m_NCellsGlob = simGrid->getGlobalCells();
+
+    index_t nCells   = (index_t)m_NCells[0]*m_NCells[1]*m_NCells[2];
+    index_t nPerCell = (index_t)m_PerCell[0]*m_PerCell[1]*m_PerCell[2];
+    index_t nThreads = (index_t)m_Threads;
+    if(nThreads > nCells) nThreads = nCells;
+    if(nThreads < 1)      return false;
+
+    ThreadPool_t* pPool = simGrid->getPool();
+
+    // Split cells into ranges
+    vector<index_t> vFrom(nThreads+1);
+    for(index_t iT=0; iT<=nThreads; iT++) {
+        vFrom[iT] = (nCells*iT)/nThreads;
+    }
+
+    // Count particles per range
+    vector<index_t> vCount(nThreads, 0);
+    vector<index_t> vOffset(nThreads, 0);
+    vector<char>    vOK(nThreads, 1);
+
+    if(m_ProfileType == "uniform" && m_DistMode != MOM_TWISS) {
+        for(index_t iT=0; iT<nThreads; iT++) {
+            vCount[iT] = (vFrom[iT+1]-vFrom[iT])*nPerCell;
+        }
+    } else {
+        pPool->Run([&](int32_t iT) {
+            if((index_t)iT >= nThreads) return;
+            vOK[iT] = loadCells(vFrom[iT], vFrom[iT+1], false, 0, &vCount[iT]);
+        });
+    }
+
+    index_t nTotal = 0;
+    for(index_t iT=0; iT<nThreads; iT++) {
+        if(!vOK[iT]) return false;
+        vOffset[iT] = nTotal;
+        nTotal     += vCount[iT];
+    }
+
+    // Allocate and fill
+    Part.Clear();
+    if(!Part.Resize(nTotal)) return false;
+
+    pPool->Run([&](int32_t iT) {
+        if((index_t)iT >= nThreads) return;
+        vOK[iT] = loadCells(vFrom[iT], vFrom[iT+1], true, vOffset[iT], &vCount[iT]);
+    });
+
+    for(index_t iT=0; iT<nThreads; iT++) {
+        if(!vOK[iT]) return false;
+    }
+
+    if(m_isMaster) {
+        printf("  Created %lu particles using %d threads in %.3f s\n",
+               (unsigned long)nTotal, (int)nThreads, MPI_Wtime()-tStart);
     }
 
     return true;
@@ -140,6 +816,1222 @@ bool Species::setupSpeciesProfile() {
 
 // ********************************************************************************************** //
 
+/**
+ *  Load Particles in Cells
+ * =========================
+ *  Processes local cells with linear index cFrom to cTo, with x1 running fastest.
+ *  If doWrite is false, only counts the particles with non-zero weight into pCount.
+ *  If doWrite is true, writes them to Part from index iOffset.
+ *  Particle tags are the global cell index times the number of particles per cell plus the
+ *  particle's index in the cell, so they are unique and independent of the thread split.
+ *  For a Twiss beam, the profile gives the density on the beam axis. The density of each cell is
+ *  scaled by the mean of the transverse Gaussian over the cell, and the sub-grid points in x2 and
+ *  x3 are moved to the matching quantiles of the Gaussian within the cell. The particles stay in
+ *  their cell, and a cell too far out for the Gaussian to register gets no particles.
+ */
+
+bool Species::loadCells(index_t cFrom, index_t cTo, bool doWrite, index_t iOffset, index_t* pCount) {
+
+    index_t   nPerCell = (index_t)m_PerCell[0]*m_PerCell[1]*m_PerCell[2];
+    uint64_t  iSeed    = ((uint64_t)(uint32_t)m_Seed << 32) | (uint32_t)m_Number;
+    bool      isFunc   = (m_ProfileType == "func");
+    index_t   iPart    = iOffset;
+    index_t   nCount   = 0;
+
+    // Per-cell scratch arrays for the profile variables x1,x2,x3,l1,l2,l3,u1,u2,u3, density and
+    // normal draws. Both distributions use 3 draws per particle, for Twiss they are u1, x2', x3'.
+    index_t         nDraw = 3*nPerCell;
+    bool            isTwiss = (m_DistMode == MOM_TWISS);
+    double_t        dSigX   = (isTwiss ? sqrt(m_Emittance/m_Fluid[0]*m_Beta0) : 0.0);
+    vvdouble_t      vZT     = {vdouble_t(m_PerCell[1]), vdouble_t(m_PerCell[2])};
+    vvdouble_t      vVars(9, vdouble_t(nPerCell));
+    vdouble_t       vDens(nPerCell, 1.0);
+    vdouble_t       vZ(nDraw);
+    const double_t* pVars[9];
+    const double_t* pZ = vZ.data();
+
+    for(int32_t iVar=0; iVar<9; iVar++) {
+        pVars[iVar] = vVars[iVar].data();
+    }
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        vVars[3+iDim].assign(nPerCell, m_GridXMin[iDim]);
+        vVars[6+iDim].assign(nPerCell, m_GridXMax[iDim]);
+    }
+
+    for(index_t iCell=cFrom; iCell<cTo; iCell++) {
+
+        // Global cell indices and linear index from the local linear index
+        index_t  aInd[3]  = {m_CellStart[0] + iCell % m_NCells[0],
+                             m_CellStart[1] + (iCell/m_NCells[0]) % m_NCells[1],
+                             m_CellStart[2] + iCell/((index_t)m_NCells[0]*m_NCells[1])};
+        index_t  iGlobal  = aInd[0] + m_NCellsGlob[0]*(aInd[1] + (index_t)m_NCellsGlob[1]*aInd[2]);
+        double_t aEdge[3];
+        double_t aDelta[3];
+        double_t dVolume  = 1.0;
+
+        for(int32_t iDim=0; iDim<3; iDim++) {
+            aEdge[iDim]  = m_CellEdge[iDim][aInd[iDim]];
+            aDelta[iDim] = m_CellDelta[iDim][aInd[iDim]];
+            dVolume     *= aDelta[iDim];
+        }
+
+        // Regular sub-grid positions
+        index_t k = 0;
+        for(int32_t p3=0; p3<m_PerCell[2]; p3++) {
+            for(int32_t p2=0; p2<m_PerCell[1]; p2++) {
+                for(int32_t p1=0; p1<m_PerCell[0]; p1++) {
+                    vVars[0][k] = aEdge[0] + (p1+0.5)*aDelta[0]/m_PerCell[0];
+                    vVars[1][k] = aEdge[1] + (p2+0.5)*aDelta[1]/m_PerCell[1];
+                    vVars[2][k] = aEdge[2] + (p3+0.5)*aDelta[2]/m_PerCell[2];
+                    k++;
+                }
+            }
+        }
+
+        if(isFunc) {
+            if(!m_ProfileFunc.EvalBatch(pVars, nPerCell, vDens.data())) return false;
+        }
+
+        // Cell edges in units of the beam size, and the mean of the Gaussian over the cell
+        double_t aZA[2], aZB[2];
+        double_t dMean = 1.0;
+        if(isTwiss) {
+            for(int32_t iDim=0; iDim<2; iDim++) {
+                aZA[iDim] = (aEdge[iDim+1] - m_BeamCentre[iDim])/dSigX;
+                aZB[iDim] = aZA[iDim] + aDelta[iDim+1]/dSigX;
+                dMean    *= twissMass(aZA[iDim], aZB[iDim])*sqrt(2.0*M_PI)*dSigX/aDelta[iDim+1];
+            }
+            for(k=0; k<nPerCell; k++) {
+                vDens[k] = (isFunc ? vDens[k] : 1.0)*dMean;
+            }
+        }
+
+        if(!doWrite) {
+            for(k=0; k<nPerCell; k++) {
+                if(vDens[k] > 0.0) nCount++;
+            }
+            continue;
+        }
+
+        // Draws are made for all particles in the cell, so they do not depend on the profile
+        Random_t rngCell(iSeed, iGlobal);
+        rngCell.Normal(vZ.data(), nDraw);
+
+        if(isTwiss && dMean > 0.0) {
+            for(int32_t iDim=0; iDim<2; iDim++) {
+                int32_t nSub = m_PerCell[iDim+1];
+                for(int32_t iSub=0; iSub<nSub; iSub++) {
+                    vZT[iDim][iSub] = twissQuantile(aZA[iDim], aZB[iDim], (iSub+0.5)/nSub);
+                }
+            }
+        }
+
+        for(k=0; k<nPerCell; k++) {
+
+            if(vDens[k] <= 0.0) continue;
+
+            Part.X1[iPart]  = vVars[0][k];
+            Part.U1[iPart]  = m_Fluid[0] + m_Thermal[0]*pZ[k];
+            Part.W[iPart]   = vDens[k]*dVolume/nPerCell;
+            Part.Tag[iPart] = iGlobal*nPerCell + k;
+
+            if(isTwiss) {
+                // Store the unit normal pairs, applyTwiss() maps them to phase space
+                Part.X2[iPart] = vZT[0][(k/m_PerCell[0]) % m_PerCell[1]];
+                Part.X3[iPart] = vZT[1][k/((index_t)m_PerCell[0]*m_PerCell[1])];
+                Part.U2[iPart] = pZ[1*nPerCell+k];
+                Part.U3[iPart] = pZ[2*nPerCell+k];
+            } else {
+                Part.X2[iPart] = vVars[1][k];
+                Part.X3[iPart] = vVars[2][k];
+                Part.U2[iPart] = m_Fluid[1] + m_Thermal[1]*pZ[1*nPerCell+k];
+                Part.U3[iPart] = m_Fluid[2] + m_Thermal[2]*pZ[2*nPerCell+k];
+            }
+
+            iPart++;
+            nCount++;
+        }
+    }
+
+    if(doWrite && isTwiss) {
+        applyTwiss(iOffset, iPart);
+    }
+
+    *pCount = nCount;
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Apply Twiss Parameters
+ * ========================
+ *  Maps unit normal pairs (z, z') stored in X2/U2 and X3/U3 for particles iFrom to iTo onto the
+ *  transverse phase space ellipse given by the Twiss parameters and emittance:
+ *    x  = sqrt(eps*beta) z
+ *    x' = sqrt(eps/beta) (z' - alpha z)
+ *  which has <x^2> = eps*beta, <xx'> = -eps*alpha and <x'^2> = eps*gamma.
+ *  The emittance is normalised, so the geometric emittance is eps/u1 with u1 the fluid momentum,
+ *  and the transverse momentum is u = x' u1.
+ *  The loader gives z as a quantile within the particle's cell and z' as a free draw, which is the
+ *  distribution of z' given z, so the weighted particles still have the moments above.
+ */
+
+void Species::applyTwiss(index_t iFrom, index_t iTo) {
+
+    double_t  dEps   = m_Emittance/m_Fluid[0];
+    double_t  dSigX  = sqrt(dEps*m_Beta0);
+    double_t  dSigP  = sqrt(dEps/m_Beta0);
+    double_t  dAlpha = m_Alpha0;
+
+    double_t* pX[2]  = {Part.X2, Part.X3};
+    double_t* pU[2]  = {Part.U2, Part.U3};
+    double_t* pU1    = Part.U1;
+
+    for(int32_t iDim=0; iDim<2; iDim++) {
+
+        double_t* pXD     = pX[iDim];
+        double_t* pUD     = pU[iDim];
+        double_t  dCentre = m_BeamCentre[iDim];
+
+        for(index_t i=iFrom; i<iTo; i++) {
+            double_t dZ  = pXD[i];
+            double_t dZP = pUD[i];
+            pXD[i] = dCentre + dSigX*dZ;
+            pUD[i] = pU1[i]*dSigP*(dZP - dAlpha*dZ);
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Twiss Mass
+ * ============
+ *  Returns the probability of a unit normal variable lying between zA and zB. The difference is
+ *  taken between the tails on the side of the interval, so it keeps its precision far from the
+ *  beam centre.
+ */
+
+double_t Species::twissMass(double_t zA, double_t zB) const {
+
+    if(zA >= 0.0) return 0.5*(erfc(zA*M_SQRT1_2) - erfc(zB*M_SQRT1_2));
+    if(zB <= 0.0) return 0.5*(erfc(-zB*M_SQRT1_2) - erfc(-zA*M_SQRT1_2));
+
+    return 1.0 - 0.5*erfc(-zA*M_SQRT1_2) - 0.5*erfc(zB*M_SQRT1_2);
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Twiss Quantile
+ * ================
+ *  Returns the z in [zA,zB] below which a fraction dU of the unit normal distribution within the
+ *  interval lies. An interval above the centre is mirrored below it, where the lower tail is
+ *  accurate, and the root is found by Newton steps that fall back to bisection when they leave
+ *  the bracket.
+ */
+
+double_t Species::twissQuantile(double_t zA, double_t zB, double_t dU) const {
+
+    if(zA >= 0.0) return -twissQuantile(-zB, -zA, 1.0-dU);
+
+    double_t dFA    = 0.5*erfc(-zA*M_SQRT1_2);
+    double_t dFB    = 0.5*erfc(-zB*M_SQRT1_2);
+    double_t dTarg  = dFA + dU*(dFB - dFA);
+    double_t zLo    = zA;
+    double_t zHi    = zB;
+    double_t dZ     = zA + dU*(zB - zA);
+    double_t dTol   = 1.0e-12*(zB - zA);
+
+    for(int32_t iIter=0; iIter<64; iIter++) {
+
+        double_t dF   = 0.5*erfc(-dZ*M_SQRT1_2) - dTarg;
+        double_t dPdf = exp(-0.5*dZ*dZ)/sqrt(2.0*M_PI);
+
+        if(dF < 0.0) zLo = dZ; else zHi = dZ;
+
+        double_t zNew = (dPdf > 0.0 ? dZ - dF/dPdf : zLo);
+        if(zNew <= zLo || zNew >= zHi) zNew = 0.5*(zLo + zHi);
+        if(fabs(zNew - dZ) < dTol) return zNew;
+
+        dZ = zNew;
+    }
+
+    return dZ;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Push Range
+ * ============
+ *  Pushes and deposits particles iFrom to iTo in blocks of PUSH_BLOCK, gathering from and
+ *  depositing to the arrays of wView. If pIdx is given, the range is of entries in pIdx, otherwise
+ *  of particles.
+ *  Each block is copied into local arrays, so the gather, push and deposit work on contiguous data
+ *  in cache also when the particles are reached through pIdx.
+ *  Particles that ended up outside the node are added to pLeave.
+ *  Returns the number of particles that ended up outside the window's allowed range.
+ */
+
+index_t Species::pushRange(Grid_t* simGrid, const window& wView, index_t iFrom, index_t iTo,
+                           const index_t* pIdx, double_t dt, bool isAtomic, vector<index_t>* pLeave) {
+
+    index_t   aIdx[PUSH_BLOCK];
+    double_t  aPart[7][PUSH_BLOCK];
+    double_t  aField[6][PUSH_BLOCK];
+    double_t  aXi[3][PUSH_BLOCK];
+    index_t   nOut = 0;
+
+    double_t* pArr[7] = {Part.X1, Part.X2, Part.X3, Part.U1, Part.U2, Part.U3, Part.W};
+
+    for(index_t iStart=iFrom; iStart<iTo; iStart+=PUSH_BLOCK) {
+
+        int32_t nBlock = (int32_t)min((index_t)PUSH_BLOCK, iTo-iStart);
+
+        for(int32_t i=0; i<nBlock; i++) {
+            aIdx[i] = (pIdx == NULL ? iStart+i : pIdx[iStart+i]);
+        }
+
+        // Load
+        for(int32_t iA=0; iA<7; iA++) {
+            for(int32_t i=0; i<nBlock; i++) {
+                aPart[iA][i] = pArr[iA][aIdx[i]];
+            }
+        }
+
+        gatherFields(simGrid, wView, nBlock, aPart, aField, aXi);
+        pushBlock(nBlock, aPart, aField, dt);
+        nOut += depositBlock(simGrid, wView, nBlock, aPart, aXi, m_Charge/dt, isAtomic);
+
+        for(int32_t i=0; i<nBlock; i++) {
+            if(aPart[0][i] < m_NodeMin[0] || aPart[0][i] >= m_NodeMax[0] ||
+               aPart[1][i] < m_NodeMin[1] || aPart[1][i] >= m_NodeMax[1] ||
+               aPart[2][i] < m_NodeMin[2] || aPart[2][i] >= m_NodeMax[2]) {
+                pLeave->push_back(aIdx[i]);
+            }
+        }
+
+        // Store positions and momenta
+        for(int32_t iA=0; iA<6; iA++) {
+            for(int32_t i=0; i<nBlock; i++) {
+                pArr[iA][aIdx[i]] = aPart[iA][i];
+            }
+        }
+    }
+
+    return nOut;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Push Coloured
+ * ===============
+ *  Bins the particles into an even number of slabs along x1 with a parallel counting sort on their
+ *  local cell, and pushes even and odd slabs in two passes. Within a pass, threads take slabs from
+ *  a shared counter. A particle moves less than a cell per step, so it deposits at most one cell
+ *  outside its slab, and slabs of PUSH_SLAB cells or more of the same colour never overlap.
+ *  Returns false if there are too few local cells for two slabs per colour.
+ */
+
+bool Species::pushColoured(Grid_t* simGrid, double_t dt) {
+
+    index_t nPart    = Part.getSize();
+    int32_t nThreads = simGrid->getThreads();
+    int32_t nCells   = simGrid->getLocalCells()[0];
+    int32_t nSlabs   = min(4*nThreads, nCells/PUSH_SLAB);
+
+    nSlabs -= nSlabs%2;
+    if(nSlabs < 4) return false;
+
+    m_SlabOf.resize(nPart);
+    m_SlabIdx.resize(nPart);
+
+    vector<index_t> vCount(nThreads*nSlabs, 0);
+    vector<index_t> vStart(nSlabs+1, 0);
+    ThreadPool_t*   pPool = simGrid->getPool();
+
+    index_t nChunk = ((nPart + nThreads*PUSH_BLOCK - 1)/(nThreads*PUSH_BLOCK))*PUSH_BLOCK;
+
+    window wNode;
+    nodeWindow(simGrid, 0, wNode);
+
+    // Count particles per slab and thread
+    pPool->Run([&](int32_t iT) {
+        index_t  iFrom = min(nPart, iT*nChunk);
+        index_t  iTo   = min(nPart, iFrom+nChunk);
+        double_t aXi[PUSH_BLOCK];
+        for(index_t iStart=iFrom; iStart<iTo; iStart+=PUSH_BLOCK) {
+            int32_t nBlock = (int32_t)min((index_t)PUSH_BLOCK, iTo-iStart);
+            logicalPos(simGrid, wNode, 0, Part.X1+iStart, nBlock, aXi);
+            for(int32_t i=0; i<nBlock; i++) {
+                int32_t iCell = min(max((int32_t)floor(aXi[i]), 0), nCells-1);
+                int32_t iSlab = (int32_t)(((int64_t)iCell*nSlabs)/nCells);
+                m_SlabOf[iStart+i] = iSlab;
+                vCount[iT*nSlabs+iSlab]++;
+            }
+        }
+    });
+
+    // Offsets, by slab and then by thread
+    index_t nSum = 0;
+    for(int32_t iS=0; iS<nSlabs; iS++) {
+        vStart[iS] = nSum;
+        for(int32_t iT=0; iT<nThreads; iT++) {
+            index_t nCount = vCount[iT*nSlabs+iS];
+            vCount[iT*nSlabs+iS] = nSum;
+            nSum += nCount;
+        }
+    }
+    vStart[nSlabs] = nSum;
+
+    // Scatter particle indices
+    pPool->Run([&](int32_t iT) {
+        index_t  iFrom = min(nPart, iT*nChunk);
+        index_t  iTo   = min(nPart, iFrom+nChunk);
+        index_t* pNext = &vCount[iT*nSlabs];
+        for(index_t i=iFrom; i<iTo; i++) {
+            m_SlabIdx[pNext[m_SlabOf[i]]++] = i;
+        }
+    });
+
+    // Push even slabs, then odd slabs
+    for(int32_t iColour=0; iColour<2; iColour++) {
+        atomic<int32_t> iNext(0);
+        pPool->Run([&](int32_t iT) {
+            int32_t iSlab;
+            while((iSlab = iColour + 2*iNext++) < nSlabs) {
+                pushRange(simGrid, wNode, vStart[iSlab], vStart[iSlab+1], m_SlabIdx.data(), dt, false,
+                          &m_Leavers[iT]);
+            }
+        });
+    }
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Setup Tiles
+ * =============
+ *  Splits the local cells into tiles of at least tilesize cells per dimension. Each tile pushes its
+ *  particles from a copy of the fields on the tile plus TILE_MARGIN cells, and deposits its current
+ *  on the same window. The tile size should be chosen so that this fits in L2 cache.
+ */
+
+bool Species::setupTiles(Grid_t* simGrid) {
+
+    vint_t  vSize    = simGrid->getTileSize();
+    vint_t  vCells   = simGrid->getLocalCells();
+    int32_t nThreads = simGrid->getThreads();
+
+    m_TileN.assign(3, 1);
+    m_TileLo.assign(3, vint_t());
+    m_TileOf.assign(3, vint_t());
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        if(vSize[iDim] < TILE_MARGIN) {
+            if(m_isMaster) {
+                printf("  Species Error: Tile size %d in x%d is less than the tile margin %d\n",
+                       vSize[iDim], iDim+1, TILE_MARGIN);
+            }
+            return false;
+        }
+        int32_t nTiles = max(1, vCells[iDim]/vSize[iDim]);
+        m_TileN[iDim] = nTiles;
+        m_TileLo[iDim].resize(nTiles+1);
+        m_TileOf[iDim].resize(vCells[iDim]);
+        for(int32_t iT=0; iT<=nTiles; iT++) {
+            m_TileLo[iDim][iT] = (int32_t)(((int64_t)vCells[iDim]*iT)/nTiles);
+        }
+        for(int32_t iT=0; iT<nTiles; iT++) {
+            for(int32_t iC=m_TileLo[iDim][iT]; iC<m_TileLo[iDim][iT+1]; iC++) {
+                m_TileOf[iDim][iC] = iT;
+            }
+        }
+    }
+
+    int32_t nTiles = m_TileN[0]*m_TileN[1]*m_TileN[2];
+    index_t nMaxVol = 0;
+
+    m_Tiled = true;
+    m_TileBase.assign(nTiles+1, 0);
+    m_TileJOff.assign(nTiles+1, 0);
+
+    for(int32_t iTile=0; iTile<nTiles; iTile++) {
+        window wTile;
+        tileWindow(simGrid, iTile, wTile);
+        index_t nVol  = wTile.stride[2]*(wTile.hi[2]-wTile.lo[2]);
+        index_t nCell = 1;
+        int32_t aT[3] = {iTile%m_TileN[0], (iTile/m_TileN[0])%m_TileN[1], iTile/(m_TileN[0]*m_TileN[1])};
+        for(int32_t iDim=0; iDim<3; iDim++) {
+            nCell *= m_TileLo[iDim][aT[iDim]+1] - m_TileLo[iDim][aT[iDim]];
+        }
+        m_TileBase[iTile+1] = m_TileBase[iTile] + nCell;
+        m_TileJOff[iTile+1] = m_TileJOff[iTile] + 3*nVol;
+        nMaxVol = max(nMaxVol, nVol);
+    }
+
+    m_TileJ.assign(m_TileJOff[nTiles], 0.0);
+    m_TileF.assign(nThreads, vdouble_t(6*nMaxVol));
+    m_TilesValid = false;
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Node Window
+ * =============
+ *  Sets wView to the node's field arrays including guard cells, with the current arrays that
+ *  thread iThread deposits into
+ */
+
+void Species::nodeWindow(Grid_t* simGrid, int32_t iThread, window& wView) {
+
+    vint_t  vCells  = simGrid->getLocalCells();
+    vint_t  vDims   = simGrid->getFieldDims();
+    int32_t nGuards = simGrid->getGuards();
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        wView.lo[iDim]   = -nGuards;
+        wView.hi[iDim]   = vCells[iDim] + nGuards;
+        wView.okLo[iDim] = -HUGE_VAL;
+        wView.okHi[iDim] =  HUGE_VAL;
+    }
+    wView.stride[0] = 1;
+    wView.stride[1] = (index_t)vDims[0];
+    wView.stride[2] = (index_t)vDims[0]*vDims[1];
+
+    wView.F[0] = simGrid->E1;
+    wView.F[1] = simGrid->E2;
+    wView.F[2] = simGrid->E3;
+    wView.F[3] = simGrid->B1;
+    wView.F[4] = simGrid->B2;
+    wView.F[5] = simGrid->B3;
+    simGrid->currentArrays(iThread, wView.J);
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Tile Window
+ * =============
+ *  Sets wView to the window of tile iTile, which is the tile plus TILE_MARGIN cells, cut at the
+ *  guard cells. The current arrays point to the tile's part of m_TileJ, and the field arrays are
+ *  left unset.
+ *  A particle that starts a step inside its tile stays in the window for TILE_MARGIN-1 steps. The
+ *  allowed range stops one cell short of the window, so a particle found outside it is rebinned
+ *  before its next step. Tiles on the edge of the node have no limit outwards.
+ */
+
+void Species::tileWindow(Grid_t* simGrid, int32_t iTile, window& wView) {
+
+    vint_t  vCells  = simGrid->getLocalCells();
+    int32_t nGuards = simGrid->getGuards();
+    int32_t aT[3]   = {iTile%m_TileN[0], (iTile/m_TileN[0])%m_TileN[1], iTile/(m_TileN[0]*m_TileN[1])};
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        int32_t iT = aT[iDim];
+        wView.lo[iDim]   = max(m_TileLo[iDim][iT]   - TILE_MARGIN, -nGuards);
+        wView.hi[iDim]   = min(m_TileLo[iDim][iT+1] + TILE_MARGIN, vCells[iDim] + nGuards);
+        wView.okLo[iDim] = (iT == 0               ? -HUGE_VAL : wView.lo[iDim] + 1.0);
+        wView.okHi[iDim] = (iT == m_TileN[iDim]-1 ?  HUGE_VAL : wView.hi[iDim] - 2.0);
+    }
+    wView.stride[0] = 1;
+    wView.stride[1] = (index_t)(wView.hi[0]-wView.lo[0]);
+    wView.stride[2] = (index_t)(wView.hi[1]-wView.lo[1])*wView.stride[1];
+
+    index_t nVol = wView.stride[2]*(wView.hi[2]-wView.lo[2]);
+    for(int32_t iC=0; iC<3; iC++) {
+        wView.J[iC] = m_TileJ.data() + m_TileJOff[iTile] + iC*nVol;
+    }
+    for(int32_t iF=0; iF<6; iF++) {
+        wView.F[iF] = NULL;
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Run Tiles
+ * ===========
+ *  Calls fTile(iThread, iTile) once for every tile on the threads of pPool.
+ *  Each thread starts with a queue of consecutive tiles holding about the same number of
+ *  particles. It takes tiles from the front of its own queue, and when that is empty steals from
+ *  the back of the other threads' queues, so dense tiles do not leave threads idle.
+ */
+
+void Species::runTiles(ThreadPool_t* pPool, const function<void(int32_t,int32_t)>& fTile) {
+
+    int32_t nThreads = pPool->getThreads();
+    int32_t nTiles   = (int32_t)m_TileBase.size()-1;
+
+    if(nThreads == 1) {
+        for(int32_t iTile=0; iTile<nTiles; iTile++) fTile(0, iTile);
+        return;
+    }
+
+    vint_t        vHead(nThreads, 0);
+    vint_t        vTail(nThreads, 0);
+    vector<mutex> vLock(nThreads);
+
+    // Split by particles plus one per tile, so that empty tiles are also spread out
+    index_t nWork = m_TileStart[nTiles] + nTiles;
+    index_t nDone = 0;
+    int32_t iTile = 0;
+    for(int32_t iT=0; iT<nThreads; iT++) {
+        vHead[iT] = iTile;
+        index_t nTarget = (nWork*(iT+1))/nThreads;
+        while(iTile < nTiles && (nDone < nTarget || iT == nThreads-1)) {
+            nDone += m_TileStart[iTile+1] - m_TileStart[iTile] + 1;
+            iTile++;
+        }
+        vTail[iT] = iTile;
+    }
+
+    pPool->Run([&](int32_t iT) {
+        while(true) {
+            int32_t iNext = -1;
+            {
+                lock_guard<mutex> lOwn(vLock[iT]);
+                if(vHead[iT] < vTail[iT]) iNext = vHead[iT]++;
+            }
+            for(int32_t iV=1; iNext < 0 && iV<nThreads; iV++) {
+                int32_t iVictim = (iT+iV)%nThreads;
+                lock_guard<mutex> lVictim(vLock[iVictim]);
+                if(vHead[iVictim] < vTail[iVictim]) iNext = --vTail[iVictim];
+            }
+            if(iNext < 0) break;
+            fTile(iT, iNext);
+        }
+    });
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Push Tiled
+ * ============
+ *  Pushes the particles tile by tile. Particles that arrived from other nodes are first moved into
+ *  their tiles, and the bins are only rebuilt with a full sort if they are not valid.
+ *  Each tile copies E and B on its window into a buffer of the thread, and deposits its current on
+ *  its own window. Once all tiles are done, each tile collects the current on its cells from the
+ *  windows of its neighbours, so no two threads write the same cells.
+ *  Last, the particles that left their tile's allowed range are moved to the tile they are in, and
+ *  those that left the node are moved behind the last tile, where PackLeavers() removes them
+ *  without touching the tiles.
+ */
+
+void Species::pushTiled(Grid_t* simGrid, double_t dt) {
+
+    int32_t nThreads = simGrid->getThreads();
+    int32_t nTiles   = (int32_t)m_TileBase.size()-1;
+
+    if(m_TilesValid && Part.getSize() > m_TileStart.back()) {
+        index_t         nFrom   = m_TileStart.back();
+        index_t         nArrive = Part.getSize() - nFrom;
+        vector<index_t> vIdx(nArrive);
+        vint_t          vTarget(nArrive);
+        for(index_t i=0; i<nArrive; i++) vIdx[i] = nFrom+i;
+        findTiles(simGrid, vIdx.data(), nArrive, vTarget.data());
+        if(!moveTiles(simGrid, vIdx, vTarget)) m_TilesValid = false;
+    }
+
+    if(!m_TilesValid) {
+        Sort(simGrid);
+        m_Rebins++;
+    }
+
+    m_TileMove.resize(nThreads);
+    for(auto& vItem : m_TileMove) vItem.clear();
+
+    const double_t* pGrid[6] = {simGrid->E1, simGrid->E2, simGrid->E3,
+                                simGrid->B1, simGrid->B2, simGrid->B3};
+
+    runTiles(simGrid->getPool(), [&](int32_t iT, int32_t iTile) {
+
+        window wTile;
+        tileWindow(simGrid, iTile, wTile);
+
+        int32_t n1   = wTile.hi[0]-wTile.lo[0];
+        index_t nVol = wTile.stride[2]*(wTile.hi[2]-wTile.lo[2]);
+        memset(wTile.J[0], 0, 3*nVol*sizeof(double_t));
+
+        if(m_TileStart[iTile] == m_TileStart[iTile+1]) return;
+
+        double_t* pCopy = m_TileF[iT].data();
+        for(int32_t iF=0; iF<6; iF++) {
+            wTile.F[iF] = pCopy + iF*nVol;
+            for(int32_t i3=wTile.lo[2]; i3<wTile.hi[2]; i3++) {
+                for(int32_t i2=wTile.lo[1]; i2<wTile.hi[1]; i2++) {
+                    index_t iRow = (i2-wTile.lo[1])*wTile.stride[1] + (i3-wTile.lo[2])*wTile.stride[2];
+                    memcpy(pCopy + iF*nVol + iRow, pGrid[iF] + simGrid->fieldIndex(wTile.lo[0], i2, i3),
+                           n1*sizeof(double_t));
+                }
+            }
+        }
+
+        if(pushRange(simGrid, wTile, m_TileStart[iTile], m_TileStart[iTile+1], NULL, dt, false,
+                     &m_Leavers[iT]) > 0) {
+            findStrays(simGrid, wTile, m_TileStart[iTile], m_TileStart[iTile+1], &m_TileMove[iT]);
+        }
+    });
+
+    runTiles(simGrid->getPool(), [&](int32_t iT, int32_t iTile) {
+        reduceTile(simGrid, iTile);
+    });
+
+    // Strays go to their new tile and leavers behind the last tile
+    vector<index_t> vLeave, vIdx;
+    for(int32_t iT=0; iT<nThreads; iT++) {
+        vLeave.insert(vLeave.end(), m_Leavers[iT].begin(), m_Leavers[iT].end());
+        vIdx.insert(vIdx.end(), m_TileMove[iT].begin(), m_TileMove[iT].end());
+    }
+    if(vLeave.empty() && vIdx.empty()) return;
+
+    sort(vLeave.begin(), vLeave.end());
+    vIdx.insert(vIdx.end(), vLeave.begin(), vLeave.end());
+    sort(vIdx.begin(), vIdx.end());
+    vIdx.erase(unique(vIdx.begin(), vIdx.end()), vIdx.end());
+
+    vint_t vTarget(vIdx.size());
+    findTiles(simGrid, vIdx.data(), vIdx.size(), vTarget.data());
+    for(size_t k=0; k<vIdx.size(); k++) {
+        if(binary_search(vLeave.begin(), vLeave.end(), vIdx[k])) vTarget[k] = nTiles;
+    }
+
+    if(!moveTiles(simGrid, vIdx, vTarget)) {
+        m_TilesValid = false;
+        return;
+    }
+
+    index_t nPart = Part.getSize();
+    for(auto& vItem : m_Leavers) vItem.clear();
+    for(index_t i=nPart-vLeave.size(); i<nPart; i++) {
+        m_Leavers[0].push_back(i);
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Find Strays
+ * =============
+ *  Adds to pStray the particles iFrom to iTo that are outside the allowed range of wView
+ */
+
+void Species::findStrays(Grid_t* simGrid, const window& wView, index_t iFrom, index_t iTo,
+                         vector<index_t>* pStray) {
+
+    double_t        aXi[3][PUSH_BLOCK];
+    const double_t* pX[3] = {Part.X1, Part.X2, Part.X3};
+
+    for(index_t iStart=iFrom; iStart<iTo; iStart+=PUSH_BLOCK) {
+        int32_t nBlock = (int32_t)min((index_t)PUSH_BLOCK, iTo-iStart);
+        for(int32_t iDim=0; iDim<3; iDim++) {
+            logicalPos(simGrid, wView, iDim, pX[iDim]+iStart, nBlock, aXi[iDim]);
+        }
+        for(int32_t i=0; i<nBlock; i++) {
+            bool isOut = false;
+            for(int32_t iDim=0; iDim<3; iDim++) {
+                isOut |= (aXi[iDim][i] < wView.okLo[iDim] || aXi[iDim][i] >= wView.okHi[iDim]);
+            }
+            if(isOut) pStray->push_back(iStart+i);
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Find Tiles
+ * ============
+ *  Writes to pTile the tile of the local cell of each of the nIdx particles listed in pIdx, with
+ *  particles outside the node in the tile of the nearest local cell, as in Sort()
+ */
+
+void Species::findTiles(Grid_t* simGrid, const index_t* pIdx, index_t nIdx, int32_t* pTile) {
+
+    vint_t   vCells = simGrid->getLocalCells();
+    double_t aX[3][PUSH_BLOCK];
+    double_t aXi[3][PUSH_BLOCK];
+
+    window wNode;
+    nodeWindow(simGrid, 0, wNode);
+
+    const double_t* pX[3] = {Part.X1, Part.X2, Part.X3};
+
+    for(index_t iStart=0; iStart<nIdx; iStart+=PUSH_BLOCK) {
+        int32_t nBlock = (int32_t)min((index_t)PUSH_BLOCK, nIdx-iStart);
+        for(int32_t iDim=0; iDim<3; iDim++) {
+            for(int32_t i=0; i<nBlock; i++) {
+                aX[iDim][i] = pX[iDim][pIdx[iStart+i]];
+            }
+            logicalPos(simGrid, wNode, iDim, aX[iDim], nBlock, aXi[iDim]);
+        }
+        for(int32_t i=0; i<nBlock; i++) {
+            int32_t aT[3];
+            for(int32_t iDim=0; iDim<3; iDim++) {
+                int32_t iCell = min(max((int32_t)floor(aXi[iDim][i]), 0), vCells[iDim]-1);
+                aT[iDim] = m_TileOf[iDim][iCell];
+            }
+            pTile[iStart+i] = aT[0] + m_TileN[0]*(aT[1] + m_TileN[1]*aT[2]);
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Move Tiles
+ * ============
+ *  Moves the particles listed in vIdx, in increasing order, to the tiles in vTarget, where a target
+ *  equal to the number of tiles is the space behind the last tile. Particles already behind the
+ *  last tile must all be listed. The rest of the tiles keep their particles in place, except that
+ *  holes are filled with the tile's last particles, and that a tile whose range has moved copies
+ *  only the particles that fall outside the overlap of the old and new range.
+ *  The order within a tile is not kept, which the next full sort restores. Returns false without
+ *  moving anything if more than 1/TILE_MOVES of the particles would be copied. Each copy here is
+ *  sequential and done twice, while a full sort scatters every particle, so it only pays off then.
+ */
+
+bool Species::moveTiles(Grid_t* simGrid, const vector<index_t>& vIdx, const vint_t& vTarget) {
+
+    index_t       nTiles   = m_TileBase.size()-1;
+    index_t       nPart    = Part.getSize();
+    index_t       nMove    = vIdx.size();
+    int32_t       nThreads = simGrid->getThreads();
+    ThreadPool_t* pPool    = simGrid->getPool();
+
+    if(nMove == 0) return true;
+
+    // Ranges before the move, with the space behind the last tile as one more range
+    vector<index_t> vOld(m_TileStart);
+    vOld.push_back(nPart);
+
+    vector<index_t> vFirst(nTiles+2, nMove); // First entry in vIdx of each range
+    vector<index_t> vKeep(nTiles+1, 0);      // Particles that stay in each range
+    vector<index_t> vIn(nTiles+1, 0);        // Particles moving into each range
+    vector<index_t> vNew(nTiles+2, 0);       // Ranges after the move
+
+    index_t k = 0;
+    for(index_t t=0; t<=nTiles; t++) {
+        vFirst[t] = k;
+        while(k < nMove && vIdx[k] < vOld[t+1]) k++;
+    }
+    for(index_t t=0; t<=nTiles; t++) {
+        vKeep[t] = vOld[t+1] - vOld[t] - (vFirst[t+1] - vFirst[t]);
+    }
+    for(k=0; k<nMove; k++) {
+        vIn[vTarget[k]]++;
+    }
+    for(index_t t=0; t<=nTiles; t++) {
+        vNew[t+1] = vNew[t] + vKeep[t] + vIn[t];
+    }
+
+    // Kept particles to copy when a range moves by more than it overlaps, and where they and the
+    // moving particles go in the buffer
+    vector<index_t> vShift(nTiles+1, 0);
+    vector<index_t> vShiftAt(nTiles+1, 0);
+    vector<index_t> vInAt(nTiles+1, 0);
+    index_t nShift = 0;
+    for(index_t t=0; t<=nTiles; t++) {
+        index_t nDist = (vNew[t] > vOld[t] ? vNew[t]-vOld[t] : vOld[t]-vNew[t]);
+        vShift[t]   = min(nDist, vKeep[t]);
+        vShiftAt[t] = nMove + nShift;
+        nShift     += vShift[t];
+        if(t < nTiles) vInAt[t+1] = vInAt[t] + vIn[t];
+    }
+    if(TILE_MOVES*(nMove + nShift) > nPart) return false;
+
+    if(!m_SortBuf.Resize(nMove + nShift)) return false;
+
+    auto fCopy = [](Particles_t& tTo, index_t iTo, const Particles_t& tFrom, index_t iFrom) {
+        tTo.X1[iTo]  = tFrom.X1[iFrom];
+        tTo.X2[iTo]  = tFrom.X2[iFrom];
+        tTo.X3[iTo]  = tFrom.X3[iFrom];
+        tTo.U1[iTo]  = tFrom.U1[iFrom];
+        tTo.U2[iTo]  = tFrom.U2[iFrom];
+        tTo.U3[iTo]  = tFrom.U3[iFrom];
+        tTo.W[iTo]   = tFrom.W[iFrom];
+        tTo.Tag[iTo] = tFrom.Tag[iFrom];
+    };
+
+    // Moving particles go to the buffer by target
+    vector<index_t> vNext(vInAt);
+    for(k=0; k<nMove; k++) {
+        fCopy(m_SortBuf, vNext[vTarget[k]]++, Part, vIdx[k]);
+    }
+
+    // Each thread does a range of tiles. The holes in each range are filled with its last particles
+    // that stay, and the kept particles outside the overlap of the old and new range go to the
+    // buffer. Once all threads are done, they are written to the part of the new range outside the
+    // overlap, and the moving particles behind them. Only those parts are written, so no particle
+    // that stays in place is overwritten.
+    pPool->Run([&](int32_t iT) {
+        index_t tFrom = ((nTiles+1)*iT)/nThreads;
+        index_t tTo   = ((nTiles+1)*(iT+1))/nThreads;
+        for(index_t t=tFrom; t<tTo; t++) {
+            index_t iTail = vOld[t+1];
+            index_t iBack = vFirst[t+1];
+            for(index_t j=vFirst[t]; j<vFirst[t+1] && vIdx[j]<vOld[t]+vKeep[t]; j++) {
+                iTail--;
+                while(iBack > vFirst[t] && vIdx[iBack-1] == iTail) {
+                    iBack--;
+                    iTail--;
+                }
+                Part.Copy(iTail, vIdx[j]);
+            }
+            index_t iSrc = (vNew[t] > vOld[t] ? vOld[t] : vOld[t]+vKeep[t]-vShift[t]);
+            for(index_t i=0; i<vShift[t]; i++) {
+                fCopy(m_SortBuf, vShiftAt[t]+i, Part, iSrc+i);
+            }
+        }
+    });
+
+    pPool->Run([&](int32_t iT) {
+        index_t tFrom = ((nTiles+1)*iT)/nThreads;
+        index_t tTo   = ((nTiles+1)*(iT+1))/nThreads;
+        for(index_t t=tFrom; t<tTo; t++) {
+            index_t iDst = (vNew[t] > vOld[t] ? vNew[t]+vKeep[t]-vShift[t] : vNew[t]);
+            for(index_t i=0; i<vShift[t]; i++) {
+                fCopy(Part, iDst+i, m_SortBuf, vShiftAt[t]+i);
+            }
+            for(index_t i=0; i<vIn[t]; i++) {
+                fCopy(Part, vNew[t]+vKeep[t]+i, m_SortBuf, vInAt[t]+i);
+            }
+        }
+    });
+
+    m_TileStart.assign(vNew.begin(), vNew.begin()+nTiles+1);
+    m_TileMoves += nMove;
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Reduce Tile
+ * =============
+ *  Adds the current deposited on the cells of tile iTile by itself and its neighbours to J.
+ *  Tiles on the edge of the node also own the guard cells beyond them. The windows reach less than
+ *  a tile into the neighbours, so only the 26 nearest tiles can overlap.
+ */
+
+void Species::reduceTile(Grid_t* simGrid, int32_t iTile) {
+
+    vint_t    vCells  = simGrid->getLocalCells();
+    int32_t   nGuards = simGrid->getGuards();
+    int32_t   aT[3]   = {iTile%m_TileN[0], (iTile/m_TileN[0])%m_TileN[1], iTile/(m_TileN[0]*m_TileN[1])};
+    double_t* pJ[3]   = {simGrid->J1, simGrid->J2, simGrid->J3};
+    int32_t   aLo[3], aHi[3];
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        int32_t iT = aT[iDim];
+        aLo[iDim] = (iT == 0               ? -nGuards                : m_TileLo[iDim][iT]);
+        aHi[iDim] = (iT == m_TileN[iDim]-1 ? vCells[iDim] + nGuards : m_TileLo[iDim][iT+1]);
+    }
+
+    for(int32_t iDir=0; iDir<27; iDir++) {
+
+        int32_t aN[3] = {aT[0] + iDir%3 - 1, aT[1] + (iDir/3)%3 - 1, aT[2] + iDir/9 - 1};
+        if(aN[0] < 0 || aN[1] < 0 || aN[2] < 0) continue;
+        if(aN[0] >= m_TileN[0] || aN[1] >= m_TileN[1] || aN[2] >= m_TileN[2]) continue;
+
+        window wNeighbour;
+        tileWindow(simGrid, aN[0] + m_TileN[0]*(aN[1] + m_TileN[1]*aN[2]), wNeighbour);
+
+        int32_t aFrom[3], aTo[3];
+        for(int32_t iDim=0; iDim<3; iDim++) {
+            aFrom[iDim] = max(aLo[iDim], wNeighbour.lo[iDim]);
+            aTo[iDim]   = min(aHi[iDim], wNeighbour.hi[iDim]);
+        }
+        if(aFrom[0] >= aTo[0] || aFrom[1] >= aTo[1] || aFrom[2] >= aTo[2]) continue;
+
+        for(int32_t iC=0; iC<3; iC++) {
+            for(int32_t i3=aFrom[2]; i3<aTo[2]; i3++) {
+                for(int32_t i2=aFrom[1]; i2<aTo[1]; i2++) {
+                    double_t*       pDst = pJ[iC] + simGrid->fieldIndex(aFrom[0], i2, i3);
+                    const double_t* pSrc = wNeighbour.J[iC] + (aFrom[0]-wNeighbour.lo[0])
+                                         + (i2-wNeighbour.lo[1])*wNeighbour.stride[1]
+                                         + (i3-wNeighbour.lo[2])*wNeighbour.stride[2];
+                    for(int32_t i1=0; i1<aTo[0]-aFrom[0]; i1++) {
+                        pDst[i1] += pSrc[i1];
+                    }
+                }
+            }
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Logical Position
+ * ==================
+ *  Converts nX positions pX in dimension iDim to local logical coordinates, where the integer part
+ *  is the local cell and the fraction the position within it. Values are clamped to the cells of
+ *  wView, leaving room for the upper node of the cell.
+ */
+
+void Species::logicalPos(Grid_t* simGrid, const window& wView, int32_t iDim, const double_t* pX,
+                         int32_t nX, double_t* pXi) {
+
+    int32_t         aCell[PUSH_BLOCK];
+    const double_t* pEdge   = simGrid->gridEdge[iDim].data();
+    const double_t* pDelta  = simGrid->gridDelta[iDim].data();
+    int32_t         iStart  = simGrid->getLocalStart()[iDim];
+    double_t        dLow    = (double_t)wView.lo[iDim];
+    double_t        dHigh   = (double_t)(wView.hi[iDim] - 1) - 1.0e-9;
+
+    simGrid->cellOf(iDim, pX, nX, aCell);
+
+    for(int32_t i=0; i<nX; i++) {
+        int32_t  iCell = aCell[i];
+        double_t dXi   = (iCell - iStart) + (pX[i] - pEdge[iCell])/pDelta[iCell];
+        pXi[i] = min(max(dXi, dLow), dHigh);
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Gather Fields
+ * ===============
+ *  Interpolates E and B from wView to the positions of the nBlock particles in pPart, and writes
+ *  them to pField in the order E1, E2, E3, B1, B2, B3. The logical positions are written to pXi
+ *  for the current deposition.
+ *  Uses linear weighting on the non-uniform grid at the Yee positions of the field solver. Each
+ *  component is half a cell off the nodes in the dimensions it is staggered in, which are its own
+ *  for E and the other two for B, as for the current from the deposition.
+ */
+
+void Species::gatherFields(Grid_t* simGrid, const window& wView, int32_t nBlock, double_t (*pPart)[PUSH_BLOCK],
+                           double_t (*pField)[PUSH_BLOCK], double_t (*pXi)[PUSH_BLOCK]) {
+
+    const double_t* const* pGrid = wView.F;
+
+    // Dimensions each component is staggered in
+    static const int32_t aStag[6][3] = {{1,0,0}, {0,1,0}, {0,0,1}, {0,1,1}, {1,0,1}, {1,1,0}};
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        logicalPos(simGrid, wView, iDim, pPart[iDim], nBlock, pXi[iDim]);
+    }
+
+    const index_t* aS = wView.stride;
+
+    for(int32_t i=0; i<nBlock; i++) {
+
+        // Lower point and fraction on the nodes and on the half-cell points
+        int32_t  aC[2][3];
+        double_t aF[2][3];
+        for(int32_t iDim=0; iDim<3; iDim++) {
+            double_t dX = pXi[iDim][i];
+            double_t dH = max(dX - 0.5, (double_t)wView.lo[iDim]);
+            aC[0][iDim] = (int32_t)floor(dX);
+            aC[1][iDim] = (int32_t)floor(dH);
+            aF[0][iDim] = dX - aC[0][iDim];
+            aF[1][iDim] = dH - aC[1][iDim];
+        }
+
+        for(int32_t iF=0; iF<6; iF++) {
+            const int32_t* pS = aStag[iF];
+            double_t f1    = aF[pS[0]][0];
+            double_t f2    = aF[pS[1]][1];
+            double_t f3    = aF[pS[2]][2];
+            index_t  iBase = (aC[pS[0]][0]-wView.lo[0])*aS[0] + (aC[pS[1]][1]-wView.lo[1])*aS[1]
+                           + (aC[pS[2]][2]-wView.lo[2])*aS[2];
+
+            const double_t* pF = pGrid[iF] + iBase;
+            pField[iF][i] = (1-f3)*((1-f2)*((1-f1)*pF[0]           + f1*pF[aS[0]])
+                                  +    f2 *((1-f1)*pF[aS[1]]       + f1*pF[aS[0]+aS[1]]))
+                          +    f3 *((1-f2)*((1-f1)*pF[aS[2]]       + f1*pF[aS[0]+aS[2]])
+                                  +    f2 *((1-f1)*pF[aS[1]+aS[2]] + f1*pF[aS[0]+aS[1]+aS[2]]));
+        }
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Push Block
+ * ============
+ *  Relativistic Boris push of the nBlock particles in pPart in the fields pField.
+ *  Momenta are u = gamma*v/c and fields are normalised so that the charge to mass ratio is
+ *  m_Charge/m_Mass. The loop has no branches or calls, so it vectorises under -march=native.
+ */
+
+void Species::pushBlock(int32_t nBlock, double_t (*pPart)[PUSH_BLOCK], double_t (*pField)[PUSH_BLOCK],
+                        double_t dt) {
+
+    double_t  dQM = 0.5*dt*m_Charge/m_Mass;
+
+    double_t* __restrict__ pX1 = pPart[0];
+    double_t* __restrict__ pX2 = pPart[1];
+    double_t* __restrict__ pX3 = pPart[2];
+    double_t* __restrict__ pU1 = pPart[3];
+    double_t* __restrict__ pU2 = pPart[4];
+    double_t* __restrict__ pU3 = pPart[5];
+
+    const double_t* __restrict__ pE1 = pField[0];
+    const double_t* __restrict__ pE2 = pField[1];
+    const double_t* __restrict__ pE3 = pField[2];
+    const double_t* __restrict__ pB1 = pField[3];
+    const double_t* __restrict__ pB2 = pField[4];
+    const double_t* __restrict__ pB3 = pField[5];
+
+    for(int32_t i=0; i<nBlock; i++) {
+
+        // Half electric acceleration
+        double_t dUm1 = pU1[i] + dQM*pE1[i];
+        double_t dUm2 = pU2[i] + dQM*pE2[i];
+        double_t dUm3 = pU3[i] + dQM*pE3[i];
+
+        // Magnetic rotation
+        double_t dGam = 1.0/sqrt(1.0 + dUm1*dUm1 + dUm2*dUm2 + dUm3*dUm3);
+        double_t dT1  = dQM*pB1[i]*dGam;
+        double_t dT2  = dQM*pB2[i]*dGam;
+        double_t dT3  = dQM*pB3[i]*dGam;
+        double_t dS   = 2.0/(1.0 + dT1*dT1 + dT2*dT2 + dT3*dT3);
+
+        double_t dUp1 = dUm1 + dUm2*dT3 - dUm3*dT2;
+        double_t dUp2 = dUm2 + dUm3*dT1 - dUm1*dT3;
+        double_t dUp3 = dUm3 + dUm1*dT2 - dUm2*dT1;
+
+        dUm1 += (dUp2*dT3 - dUp3*dT2)*dS;
+        dUm2 += (dUp3*dT1 - dUp1*dT3)*dS;
+        dUm3 += (dUp1*dT2 - dUp2*dT1)*dS;
+
+        // Half electric acceleration
+        dUm1 += dQM*pE1[i];
+        dUm2 += dQM*pE2[i];
+        dUm3 += dQM*pE3[i];
+
+        pU1[i] = dUm1;
+        pU2[i] = dUm2;
+        pU3[i] = dUm3;
+
+        // Move
+        dGam = dt/sqrt(1.0 + dUm1*dUm1 + dUm2*dUm2 + dUm3*dUm3);
+        pX1[i] += dUm1*dGam;
+        pX2[i] += dUm2*dGam;
+        pX3[i] += dUm3*dGam;
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Deposit Block
+ * ===============
+ *  Deposits the current of the nBlock particles in pPart, which have moved from the logical
+ *  positions pXi, into the current arrays of wView. dQ is the charge divided by the time step.
+ *  Uses the zigzag scheme of Umeda et al., a Villasenor-Buneman type scheme for linear weighting
+ *  that splits the move at a relay point into at most one segment per cell. Each segment adds its
+ *  charge flux to the faces of its cell with the weights averaged along the segment, which are the
+ *  weights of its midpoint plus the d2*d3/12 term of the 3D Villasenor-Buneman scheme. Since this
+ *  is done in logical coordinates, the charge on the nodes is conserved exactly on the non-uniform
+ *  grid, and ReduceCurrent() converts the flux to current density with the node spacings.
+ *  J1 at (i1,i2,i3) is the flux in x1 between nodes i1 and i1+1 at nodes i2 and i3, and similarly
+ *  for J2 and J3.
+ *  Returns the number of particles that ended up outside the allowed range of wView.
+ */
+
+int32_t Species::depositBlock(Grid_t* simGrid, const window& wView, int32_t nBlock, double_t (*pPart)[PUSH_BLOCK],
+                              double_t (*pXi)[PUSH_BLOCK], double_t dQ, bool isAtomic) {
+
+    double_t aNew[3][PUSH_BLOCK];
+    int32_t  nOut = 0;
+
+    for(int32_t iDim=0; iDim<3; iDim++) {
+        logicalPos(simGrid, wView, iDim, pPart[iDim], nBlock, aNew[iDim]);
+        for(int32_t i=0; i<nBlock; i++) {
+            nOut += (aNew[iDim][i] < wView.okLo[iDim] || aNew[iDim][i] >= wView.okHi[iDim]);
+        }
+    }
+
+    const index_t* aS = wView.stride;
+
+    for(int32_t i=0; i<nBlock; i++) {
+
+        int32_t  aC[2][3];  // Cell of each segment
+        double_t aD[2][3];  // Logical displacement of each segment
+        double_t aW[2][3];  // Weight of each segment's midpoint
+
+        double_t dQW = dQ*pPart[6][i];
+
+        for(int32_t iDim=0; iDim<3; iDim++) {
+            double_t dX1 = pXi[iDim][i];
+            double_t dX2 = aNew[iDim][i];
+            int32_t  iC1 = (int32_t)floor(dX1);
+            int32_t  iC2 = (int32_t)floor(dX2);
+            double_t dXr = min((double_t)(min(iC1, iC2)+1), max((double_t)max(iC1, iC2), 0.5*(dX1+dX2)));
+
+            aC[0][iDim] = iC1;
+            aC[1][iDim] = iC2;
+            aD[0][iDim] = dXr - dX1;
+            aD[1][iDim] = dX2 - dXr;
+            aW[0][iDim] = 0.5*(dX1 + dXr) - iC1;
+            aW[1][iDim] = 0.5*(dXr + dX2) - iC2;
+        }
+
+        for(int32_t iSeg=0; iSeg<2; iSeg++) {
+
+            index_t iBase = (aC[iSeg][0]-wView.lo[0])*aS[0] + (aC[iSeg][1]-wView.lo[1])*aS[1]
+                          + (aC[iSeg][2]-wView.lo[2])*aS[2];
+
+            for(int32_t iDim=0; iDim<3; iDim++) {
+
+                int32_t  iA = (iDim+1)%3;
+                int32_t  iB = (iDim+2)%3;
+                double_t dF = dQW*aD[iSeg][iDim];
+                double_t wA = aW[iSeg][iA];
+                double_t wB = aW[iSeg][iB];
+                double_t dC = aD[iSeg][iA]*aD[iSeg][iB]/12.0;
+
+                double_t* pBase = wView.J[iDim] + iBase;
+                addCurrent(pBase,                 dF*((1-wA)*(1-wB) + dC), isAtomic);
+                addCurrent(pBase + aS[iA],        dF*(wA*(1-wB) - dC),     isAtomic);
+                addCurrent(pBase + aS[iB],        dF*((1-wA)*wB - dC),     isAtomic);
+                addCurrent(pBase + aS[iA]+aS[iB], dF*(wA*wB + dC),         isAtomic);
+            }
+        }
+    }
+
+    return nOut;
+}
+
+// ********************************************************************************************** //
+
 /**
  *  Check if profile is valid
  * ===========================
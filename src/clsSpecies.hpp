@@ -5,16 +5,29 @@
 #ifndef CLASS_SPECIES
 #define CLASS_SPECIES
 
+// Class-specific macros
+#define PUSH_BLOCK   256    // Particles per block in the pusher
+#define PUSH_SLAB    3      // Minimum slab width in cells for coloured deposition
+#define TILE_MARGIN  3      // Cells around a tile in its local field copy
+#define SORT_BUCKETS 64     // Cell ranges per thread in the first level of the sort
+#define TILE_MOVES   1      // Full rebin when moving particles between tiles copies more than all of them
+
 #include "config.hpp"
 #include "functions.hpp"
 
 #include "clsInput.hpp"
 #include "clsGrid.hpp"
 #include "clsMath.hpp"
+#include "clsParticles.hpp"
+#include "clsRandom.hpp"
+
+#include <functional>
 
-typedef reypic::Input Input_t;
-typedef reypic::Grid  Grid_t;
-typedef reypic::Math  Math_t;
+typedef reypic::Input     Input_t;
+typedef reypic::Grid      Grid_t;
+typedef reypic::Math      Math_t;
+typedef reypic::Particles Particles_t;
+typedef reypic::Random    Random_t;
 
 namespace reypic {
 
@@ -33,25 +46,73 @@ public:
     * Methods
     */
 
-    int Setup(Input_t*, Grid_t*);
+    int  Setup(Input_t*, Grid_t*, int32_t);
+    void Push(Grid_t*, double_t);
+    void Sort(Grid_t*);
+    index_t PackLeavers(vvdouble_t&);
+    bool AppendParticles(const double_t*, index_t);
+    void AddLoad(Grid_t*, vvdouble_t&);
+    void AddCharge(Grid_t*, double_t*);
+    void Moments(Grid_t*, double_t*, double_t*);
+    void Rebalance(Grid_t*);
 
    /**
     * Properties
     */
 
-    double_t X[];   // Particle position
-    double_t V[];   // Particle velocity
-    double_t W[];   // Particle weight
-    index_t  Tag[]; // Particle tag
+    Particles_t Part; // Particle arrays
+
+    string_t getName()   {return m_Name;};
+    int32_t  getSeed()   {return m_Seed;};
+    int32_t  getRebins() {return m_Rebins;};
+    index_t  getTileMoves() {return m_TileMoves;};
 
 private:
 
+   /**
+    * Structs
+    */
+
+    // A box of local cells with field arrays covering it. Particles outside [okLo,okHi) in logical
+    // coordinates have left their tile.
+    struct window {
+        int32_t         lo[3];      // First local cell per dimension
+        int32_t         hi[3];      // One past the last local cell
+        index_t         stride[3];  // Index strides of the arrays
+        double_t        okLo[3];    // Range particles may stay in
+        double_t        okHi[3];
+        const double_t* F[6];       // E1, E2, E3, B1, B2, B3 at cell lo
+        double_t*       J[3];       // J1, J2, J3 at cell lo
+    };
+
    /**
     * Member Functions
     */
 
-    bool setupSpeciesProfile();
-    bool createParticles();
+    bool setupSpeciesProfile(Grid_t*);
+    bool createParticles(Grid_t*);
+    bool loadCells(index_t, index_t, bool, index_t, index_t*);
+    void applyTwiss(index_t, index_t);
+    double_t twissMass(double_t, double_t) const;
+    double_t twissQuantile(double_t, double_t, double_t) const;
+    bool setupTiles(Grid_t*);
+    void nodeWindow(Grid_t*, int32_t, window&);
+    void tileWindow(Grid_t*, int32_t, window&);
+    void runTiles(ThreadPool_t*, const std::function<void(int32_t,int32_t)>&);
+    void pushTiled(Grid_t*, double_t);
+    void findStrays(Grid_t*, const window&, index_t, index_t, std::vector<index_t>*);
+    void findTiles(Grid_t*, const index_t*, index_t, int32_t*);
+    bool moveTiles(Grid_t*, const std::vector<index_t>&, const vint_t&);
+    void reduceTile(Grid_t*, int32_t);
+    index_t pushRange(Grid_t*, const window&, index_t, index_t, const index_t*, double_t, bool,
+                      std::vector<index_t>*);
+    bool pushColoured(Grid_t*, double_t);
+    void logicalPos(Grid_t*, const window&, int32_t, const double_t*, int32_t, double_t*);
+    void gatherFields(Grid_t*, const window&, int32_t, double_t (*)[PUSH_BLOCK], double_t (*)[PUSH_BLOCK],
+                      double_t (*)[PUSH_BLOCK]);
+    void pushBlock(int32_t, double_t (*)[PUSH_BLOCK], double_t (*)[PUSH_BLOCK], double_t);
+    int32_t depositBlock(Grid_t*, const window&, int32_t, double_t (*)[PUSH_BLOCK], double_t (*)[PUSH_BLOCK],
+                         double_t, bool);
     bool validProfile(string_t);
 
    /**
@@ -62,6 +123,7 @@ private:
     int32_t   m_MPISize     =  0;              // Number of nodes
     int32_t   m_MPIRank     = -1;              // Node number
     bool      m_isMaster    = false;           // True if this node is master
+    int32_t   m_Threads     = 1;               // Number of threads for particle loading
 
     vdouble_t m_GridXMin    = {0.0, 0.0, 0.0}; // Grid lower boundaries
     vdouble_t m_GridXMax    = {0.0, 0.0, 0.0}; // Grid upper boundaries
@@ -69,7 +131,9 @@ private:
     string_t  m_Name        = "";              // Species name
     int32_t   m_Number      = -1;              // Species number
     string_t  m_ProfileType = "uniform";       // Species profile
+    string_t  m_ProfileEq   = "";              // Species profile equation
     Math_t    m_ProfileFunc;                   // Species profile function
+    int32_t   m_Seed        = 0;               // Random seed
 
     double_t  m_Charge      = 0;               // Species charge
     double_t  m_Mass        = 1;               // Species mass
@@ -77,13 +141,50 @@ private:
 
     value_t   m_DistMode    = MOM_THERMAL;     // Initiate particles using thermal or twiss
 
-    double_t  m_Thermal[3]  = {0.0, 0.0, 0.0}; // Thermal distribution
-    double_t  m_Fluid[3]    = {0.0, 0.0, 0.0}; // Fluid momentum
+    vdouble_t m_Thermal     = {0.0, 0.0, 0.0}; // Thermal distribution
+    vdouble_t m_Fluid       = {0.0, 0.0, 0.0}; // Fluid momentum
 
     double_t  m_Emittance   = 0.0;             // Initial rms emittance, normalised
     double_t  m_Alpha0      = 0.0;             // Initial alpha function value
     double_t  m_Beta0       = 0.0;             // Initial beta function value
     double_t  m_Gamma0      = 0.0;             // Initial gamma function value
+    vdouble_t m_BeamCentre  = {};              // Transverse beam centre in x2 and x3
+
+    // Loader state shared by threads
+    vvdouble_t m_CellEdge;                     // Cell edges per dimension
+    vvdouble_t m_CellDelta;                    // Cell widths per dimension
+    vint_t     m_CellStart;                    // First local cell per dimension
+    vint_t     m_NCells;                       // Number of local cells per dimension
+    vint_t     m_NCellsGlob;                   // Number of global cells per dimension
+
+    // Sorting
+    vint_t               m_SortKey;            // Local cell of each particle
+    std::vector<index_t> m_SortIdx;            // Particle indices ordered by sort bucket
+    Particles_t          m_SortBuf;            // Target of the permutation, swapped with Part
+
+    // Tiles
+    bool                 m_Tiled      = false; // Particles are kept in per tile bins
+    bool                 m_TilesValid = false; // Bins match the particle positions
+    int32_t              m_Rebins     = 0;     // Number of times the bins were rebuilt
+    index_t              m_TileMoves  = 0;     // Number of particles moved between bins
+    vint_t               m_TileN;              // Tiles per dimension
+    std::vector<vint_t>  m_TileLo;             // First cell of each tile per dimension, and the end
+    std::vector<vint_t>  m_TileOf;             // Tile of each local cell per dimension
+    std::vector<index_t> m_TileBase;           // First sort key of each tile
+    std::vector<index_t> m_TileStart;          // First particle of each tile, and the end
+    std::vector<index_t> m_TileJOff;           // Start of each tile's current in m_TileJ
+    vdouble_t            m_TileJ;              // Current deposited by each tile on its window
+    vvdouble_t           m_TileF;              // Field copy of the tile being pushed, per thread
+    std::vector<std::vector<index_t>> m_TileMove; // Particles outside their tile's range, per thread
+
+    // Migration
+    double_t             m_NodeMin[3];         // Box of the node at the last push
+    double_t             m_NodeMax[3];
+    std::vector<std::vector<index_t>> m_Leavers; // Particles that left the node, per thread
+
+    // Coloured deposition
+    vint_t               m_SlabOf;             // Slab of each particle
+    std::vector<index_t> m_SlabIdx;            // Particle indices sorted by slab
 
     // Options
     vstring_t m_okProfiles = {"uniform","func"};
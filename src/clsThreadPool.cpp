@@ -0,0 +1,278 @@
+/**
+ *  ReyPIC – Thread Pool Source
+ * =============================
+ *  A fixed set of threads per node that the particle and grid kernels share.
+ *
+ *  The threads are started once in Setup() and wait for work, so a kernel can be split over them
+ *  every step without creating threads each time. Run() hands a task to all threads and returns
+ *  when all of them are done. The calling thread takes part as thread 0, and is the only thread
+ *  that calls MPI, so MPI only needs to provide MPI_THREAD_FUNNELED.
+ *  With pinning, each thread is bound to one core of the cores this process may run on. When
+ *  several processes on a node all see the same cores, as when the launcher does not bind them,
+ *  each process takes its own share of them in order of its rank on the node.
+ */
+
+#include "clsThreadPool.hpp"
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+using namespace std;
+using namespace reypic;
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Constructor
+ * ===================
+ */
+
+ThreadPool::ThreadPool() {
+
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Class Destructor
+ * ==================
+ */
+
+ThreadPool::~ThreadPool() {
+
+    Stop();
+}
+
+// ********************************************************************************************** //
+//                                       Main Class Methods                                       //
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Setup
+ * =================
+ *  Starts nThreads-1 worker threads. If doPin is true, the calling thread and the workers are
+ *  pinned to cores. Must be called by all processes, as pinning looks at the other processes on
+ *  the node.
+ */
+
+bool ThreadPool::Setup(int32_t nThreads, bool doPin) {
+
+    Stop();
+
+    m_Threads = (nThreads < 1 ? 1 : nThreads);
+    m_Cores.clear();
+    m_Stop    = false;
+
+    if(doPin) {
+        m_Cores = nodeCores(m_Threads);
+        pinThread(0);
+    }
+
+    for(int32_t iT=1; iT<m_Threads; iT++) {
+        m_Workers.push_back(thread(&ThreadPool::worker, this, iT));
+    }
+
+    return true;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Run
+ * ===============
+ *  Calls fTask(iThread) on every thread, with iThread from 0 to getThreads()-1, and waits for all
+ *  of them to return. Tasks must not call Run() themselves.
+ */
+
+void ThreadPool::Run(const function<void(int32_t)>& fTask) {
+
+    if(m_Workers.empty()) {
+        fTask(0);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lHold(m_Lock);
+        m_Task    = &fTask;
+        m_Pending = (int32_t)m_Workers.size();
+        m_Generation++;
+    }
+    m_Start.notify_all();
+
+    fTask(0);
+
+    unique_lock<mutex> lHold(m_Lock);
+    m_Done.wait(lHold, [this]() {return m_Pending == 0;});
+    m_Task = NULL;
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Unpin
+ * =================
+ *  Lets the calling thread run on all cores the process could run on before pinning. For threads
+ *  outside the pool, which are started from the pinned thread 0 and would otherwise share its core.
+ */
+
+void ThreadPool::Unpin() {
+
+    if(m_Cores.empty()) return;
+
+#ifdef __linux__
+    cpu_set_t tSet;
+    CPU_ZERO(&tSet);
+    for(int32_t iCPU : m_Mask) CPU_SET(iCPU, &tSet);
+    pthread_setaffinity_np(pthread_self(), sizeof(tSet), &tSet);
+#endif
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Method :: Stop
+ * ================
+ *  Stops and joins the worker threads
+ */
+
+void ThreadPool::Stop() {
+
+    {
+        lock_guard<mutex> lHold(m_Lock);
+        m_Stop = true;
+    }
+    m_Start.notify_all();
+
+    for(auto& tItem : m_Workers) tItem.join();
+    m_Workers.clear();
+
+    return;
+}
+
+// ********************************************************************************************** //
+//                                        Member Functions                                        //
+// ********************************************************************************************** //
+
+/**
+ *  Node Cores
+ * ============
+ *  Returns the core for each of nThreads threads. The cores are taken in order from the affinity
+ *  mask of the process. If all processes on the node have the same mask, process k of the node
+ *  starts at core k*nThreads. If any process has more threads than cores to give them, no process
+ *  is pinned, as threads sharing a core are slower than threads the system can move around.
+ */
+
+vint_t ThreadPool::nodeCores(int32_t nThreads) {
+
+    vint_t vMask;
+
+#ifdef __linux__
+    cpu_set_t tSet;
+    CPU_ZERO(&tSet);
+    if(sched_getaffinity(0, sizeof(tSet), &tSet) == 0) {
+        for(int32_t iCPU=0; iCPU<CPU_SETSIZE; iCPU++) {
+            if(CPU_ISSET(iCPU, &tSet)) vMask.push_back(iCPU);
+        }
+    }
+#endif
+
+    int32_t  iLocal = 0;
+    int32_t  nLocal = 1;
+    MPI_Comm mNode;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &mNode);
+    MPI_Comm_rank(mNode, &iLocal);
+    MPI_Comm_size(mNode, &nLocal);
+
+    // Compare the masks by size and first core
+    int32_t aLocal[2] = {(int32_t)vMask.size(), (vMask.empty() ? -1 : vMask[0])};
+    int32_t aMin[2], aMax[2];
+    MPI_Allreduce(aLocal, aMin, 2, MPI_INT, MPI_MIN, mNode);
+    MPI_Allreduce(aLocal, aMax, 2, MPI_INT, MPI_MAX, mNode);
+    MPI_Comm_free(&mNode);
+
+    m_Mask = vMask;
+
+    bool    isShared = (aMin[0] == aMax[0] && aMin[1] == aMax[1]);
+    int32_t nMask    = (int32_t)vMask.size();
+    int32_t iFirst   = (isShared ? iLocal*nThreads : 0);
+    int32_t nNeed    = (isShared ? nLocal*nThreads : nThreads);
+
+    int32_t iFits = (nMask > 0 && nNeed <= nMask ? 1 : 0);
+    int32_t iAll  = 0;
+    MPI_Allreduce(&iFits, &iAll, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+
+    vint_t vCores;
+    if(iAll == 0) return vCores;
+
+    for(int32_t iT=0; iT<nThreads; iT++) {
+        vCores.push_back(vMask[iFirst+iT]);
+    }
+
+    return vCores;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Pin Thread
+ * ============
+ *  Binds the calling thread to the core of thread iThread, if there is one
+ */
+
+void ThreadPool::pinThread(int32_t iThread) {
+
+    if(iThread >= (int32_t)m_Cores.size()) return;
+
+#ifdef __linux__
+    cpu_set_t tSet;
+    CPU_ZERO(&tSet);
+    CPU_SET(m_Cores[iThread], &tSet);
+    pthread_setaffinity_np(pthread_self(), sizeof(tSet), &tSet);
+#endif
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Worker
+ * ========
+ *  Main function of worker thread iThread. Waits for a new task, runs it, and reports back.
+ */
+
+void ThreadPool::worker(int32_t iThread) {
+
+    pinThread(iThread);
+
+    uint64_t iSeen = 0;
+
+    while(true) {
+
+        const function<void(int32_t)>* pTask;
+        {
+            unique_lock<mutex> lHold(m_Lock);
+            m_Start.wait(lHold, [&]() {return m_Stop || m_Generation != iSeen;});
+            if(m_Stop) return;
+            iSeen = m_Generation;
+            pTask = m_Task;
+        }
+
+        (*pTask)(iThread);
+
+        lock_guard<mutex> lHold(m_Lock);
+        if(--m_Pending == 0) m_Done.notify_one();
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+// End Class ThreadPool
@@ -0,0 +1,79 @@
+/**
+ * ReyPIC – Thread Pool Header
+ */
+
+#ifndef CLASS_THREADPOOL
+#define CLASS_THREADPOOL
+
+#include "config.hpp"
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace reypic {
+
+class ThreadPool {
+
+public:
+
+   /**
+    * Constructor/Destructor
+    */
+
+    ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+   /**
+    * Setters/Getters
+    */
+
+    int32_t getThreads() const {return m_Threads;};
+    vint_t  getCores()   const {return m_Cores;};
+
+   /**
+    * Methods
+    */
+
+    bool Setup(int32_t, bool);
+    void Run(const std::function<void(int32_t)>&);
+    void Unpin();
+    void Stop();
+
+private:
+
+   /**
+    * Member Functions
+    */
+
+    vint_t nodeCores(int32_t);
+    void   pinThread(int32_t);
+    void   worker(int32_t);
+
+   /**
+    * Member Variables
+    */
+
+    int32_t                  m_Threads    = 1;     // Threads including the calling thread
+    vint_t                   m_Cores;              // Core of each thread, empty if not pinned
+    vint_t                   m_Mask;               // Cores the process could run on before pinning
+    std::vector<std::thread> m_Workers;            // Threads 1 and up
+
+    // Task hand-over, guarded by m_Lock
+    std::mutex               m_Lock;
+    std::condition_variable  m_Start;              // Signals a new task or stop to the workers
+    std::condition_variable  m_Done;               // Signals the last worker finishing
+    const std::function<void(int32_t)>* m_Task = NULL;
+    uint64_t                 m_Generation = 0;     // Number of tasks started
+    int32_t                  m_Pending    = 0;     // Workers still running the current task
+    bool                     m_Stop       = false;
+
+}; // End Class ThreadPool
+
+} // End NameSpace
+
+#endif
@@ -31,6 +31,7 @@ typedef int16_t                             value_t;
 #define RUN_MODE_FULL      1
 #define RUN_MODE_TEST      2
 #define RUN_MODE_EXT_TEST  3
+#define RUN_MODE_BENCH     4
 
 // Error Modes
 #define ERR_NONE           0
@@ -51,6 +52,7 @@ typedef int16_t                             value_t;
 #define INPUT_GRID         3
 #define INPUT_EMF          4
 #define INPUT_SPECIES      5
+#define INPUT_DIAG         6
 
 // Input File Types
 #define INVAR_INT          1
@@ -65,4 +67,9 @@ typedef int16_t                             value_t;
 #define MOM_THERMAL        1
 #define MOM_TWISS          2
 
+// Current Deposition
+#define DEP_PRIVATE        0
+#define DEP_COLOUR         1
+#define DEP_ATOMIC         2
+
 #endif
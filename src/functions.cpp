@@ -1,9 +1,16 @@
 /**
  * ReyPIC – Functions Source
+ *
+ *  The array kernels keep M_LANES independent accumulators, which the compiler maps onto SIMD
+ *  registers without reordering the floating point operations of any single accumulator. Sums
+ *  are pairwise over blocks of M_BLOCK elements, so the round-off grows with the logarithm of the
+ *  length rather than the length. The threaded kernels split the array into one contiguous range
+ *  per thread, so their sums depend on the number of threads in the last bits.
  */
 
 #include "config.hpp"
 #include "functions.hpp"
+#include "clsThreadPool.hpp"
 
 using namespace std;
 
@@ -12,15 +19,16 @@ using namespace std;
 /**
  *  Linspace
  * ==========
- *  Generayes array aReturn of length nVal from valMin to valMax
+ *  Generates array aReturn of length nVal from valMin to valMax
  */
 
-void m::linspace(double valMin, double valMax, int nVal, double* aReturn) {
+template<typename T>
+void m::linspace(typename same<T>::type valMin, typename same<T>::type valMax, size_t nVal, T* aReturn) {
 
-    double valSpan = valMax - valMin;
-    double delVal  = valSpan/(nVal-1);
+    T valSpan = valMax - valMin;
+    T delVal  = valSpan/(nVal-1);
 
-    for(int i=0; i<nVal; i++) {
+    for(size_t i=0; i<nVal; i++) {
         aReturn[i] = i*delVal + valMin;
     }
 
@@ -35,15 +43,26 @@ void m::linspace(double valMin, double valMax, int nVal, double* aReturn) {
  *  Returns minimum value from array aData with length nData
  */
 
-double m::min(double* aData, int nData) {
+template<typename T>
+T m::min(const T* aData, size_t nData) {
 
-    double valMin = aData[0];
+    T      aMin[M_LANES];
+    size_t nVec = nData - nData % M_LANES;
 
-    for(int i=1; i<nData; i++) {
-        if(aData[i] < valMin) {
-            valMin = aData[i];
+    for(size_t k=0; k<M_LANES; k++) aMin[k] = aData[0];
+    for(size_t i=0; i<nVec; i+=M_LANES) {
+        for(size_t k=0; k<M_LANES; k++) {
+            aMin[k] = (aData[i+k] < aMin[k] ? aData[i+k] : aMin[k]);
         }
     }
+    for(size_t i=nVec; i<nData; i++) {
+        if(aData[i] < aMin[0]) aMin[0] = aData[i];
+    }
+
+    T valMin = aMin[0];
+    for(size_t k=1; k<M_LANES; k++) {
+        if(aMin[k] < valMin) valMin = aMin[k];
+    }
 
     return valMin;
 }
@@ -56,15 +75,26 @@ double m::min(double* aData, int nData) {
  *  Return maximum value from array aData with length nData
  */
 
-double m::max(double* aData, int nData) {
+template<typename T>
+T m::max(const T* aData, size_t nData) {
 
-    double valMax = aData[0];
+    T      aMax[M_LANES];
+    size_t nVec = nData - nData % M_LANES;
 
-    for(int i=1; i<nData; i++) {
-        if(aData[i] > valMax) {
-            valMax = aData[i];
+    for(size_t k=0; k<M_LANES; k++) aMax[k] = aData[0];
+    for(size_t i=0; i<nVec; i+=M_LANES) {
+        for(size_t k=0; k<M_LANES; k++) {
+            aMax[k] = (aData[i+k] > aMax[k] ? aData[i+k] : aMax[k]);
         }
     }
+    for(size_t i=nVec; i<nData; i++) {
+        if(aData[i] > aMax[0]) aMax[0] = aData[i];
+    }
+
+    T valMax = aMax[0];
+    for(size_t k=1; k<M_LANES; k++) {
+        if(aMax[k] > valMax) valMax = aMax[k];
+    }
 
     return valMax;
 }
@@ -77,12 +107,13 @@ double m::max(double* aData, int nData) {
  *  Returns minimum value and index indMin from array aData with length nData
  */
 
-double m::minind(double* aData, int nData, int* indMin) {
+template<typename T>
+T m::minind(const T* aData, size_t nData, size_t* indMin) {
 
-    double valMin = aData[0];
-          *indMin = 0;
+    T valMin = aData[0];
+     *indMin = 0;
 
-    for(int i=1; i<nData; i++) {
+    for(size_t i=1; i<nData; i++) {
         if(aData[i] < valMin) {
              valMin = aData[i];
             *indMin = i;
@@ -100,12 +131,13 @@ double m::minind(double* aData, int nData, int* indMin) {
  *  Returns maximum value and index indMax from array aData with length nData
  */
 
-double m::maxind(double* aData, int nData, int* indMax) {
+template<typename T>
+T m::maxind(const T* aData, size_t nData, size_t* indMax) {
 
-    double valMax = aData[0];
-          *indMax = 0;
+    T valMax = aData[0];
+     *indMax = 0;
 
-    for(int i=1; i<nData; i++) {
+    for(size_t i=1; i<nData; i++) {
         if(aData[i] > valMax) {
              valMax = aData[i];
             *indMax = i;
@@ -120,18 +152,35 @@ double m::maxind(double* aData, int nData, int* indMax) {
 /**
  *  Sum
  * ======
- *  Returns sum of array aData with length nData
+ *  Returns sum of array aData with length nData. Halves are summed separately down to M_BLOCK
+ *  elements, which are summed in M_LANES accumulators.
  */
 
-double m::sum(double* aData, int nData) {
+template<typename T>
+T m::sum(const T* aData, size_t nData) {
+
+    if(nData > M_BLOCK) {
+        size_t nHalf = (nData/2 + M_BLOCK-1)/M_BLOCK*M_BLOCK;
+        return sum(aData, nHalf) + sum(aData+nHalf, nData-nHalf);
+    }
 
-    double valSum = 0.0;
+    T      aSum[M_LANES] = {};
+    size_t nVec = nData - nData % M_LANES;
 
-    for(int i=0; i<nData; i++) {
-        valSum += aData[i];
+    for(size_t i=0; i<nVec; i+=M_LANES) {
+        for(size_t k=0; k<M_LANES; k++) {
+            aSum[k] += aData[i+k];
+        }
+    }
+    for(size_t i=nVec; i<nData; i++) {
+        aSum[i-nVec] += aData[i];
     }
 
-    return valSum;
+    for(size_t nWidth=M_LANES/2; nWidth>0; nWidth/=2) {
+        for(size_t k=0; k<nWidth; k++) aSum[k] += aSum[k+nWidth];
+    }
+
+    return aSum[0];
 }
 
 // ********************************************************************************************** //
@@ -142,15 +191,69 @@ double m::sum(double* aData, int nData) {
  *  Returns average value valAvg from array aData with length nData
  */
 
-double m::avg(double* aData, int nData) {
+template<typename T>
+T m::avg(const T* aData, size_t nData) {
+
+    return sum(aData, nData)/nData;
+}
 
-    double valSum = 0.0;
+// ********************************************************************************************** //
+
+/**
+ *  Min, Max and Sum
+ * ==================
+ *  Returns the minimum, maximum and sum of array aData with length nData in a single pass, with
+ *  the same results as min(), max() and sum()
+ */
 
-    for(int i=0; i<nData; i++) {
-        valSum += aData[i];
+template<typename T>
+void m::minmaxsum(const T* aData, size_t nData, T* valMin, T* valMax, T* valSum) {
+
+    if(nData > M_BLOCK) {
+        size_t nHalf = (nData/2 + M_BLOCK-1)/M_BLOCK*M_BLOCK;
+        T      valMin2, valMax2, valSum2;
+        minmaxsum(aData,       nHalf,       valMin,   valMax,   valSum);
+        minmaxsum(aData+nHalf, nData-nHalf, &valMin2, &valMax2, &valSum2);
+        if(valMin2 < *valMin) *valMin = valMin2;
+        if(valMax2 > *valMax) *valMax = valMax2;
+        *valSum += valSum2;
+        return;
+    }
+
+    T      aMin[M_LANES], aMax[M_LANES], aSum[M_LANES] = {};
+    size_t nVec = nData - nData % M_LANES;
+
+    for(size_t k=0; k<M_LANES; k++) {
+        aMin[k] = aData[0];
+        aMax[k] = aData[0];
+    }
+    for(size_t i=0; i<nVec; i+=M_LANES) {
+        for(size_t k=0; k<M_LANES; k++) {
+            T dVal  = aData[i+k];
+            aMin[k] = (dVal < aMin[k] ? dVal : aMin[k]);
+            aMax[k] = (dVal > aMax[k] ? dVal : aMax[k]);
+            aSum[k] += dVal;
+        }
+    }
+    for(size_t i=nVec; i<nData; i++) {
+        if(aData[i] < aMin[0]) aMin[0] = aData[i];
+        if(aData[i] > aMax[0]) aMax[0] = aData[i];
+        aSum[i-nVec] += aData[i];
     }
 
-    return valSum/nData;
+    for(size_t k=1; k<M_LANES; k++) {
+        if(aMin[k] < aMin[0]) aMin[0] = aMin[k];
+        if(aMax[k] > aMax[0]) aMax[0] = aMax[k];
+    }
+    for(size_t nWidth=M_LANES/2; nWidth>0; nWidth/=2) {
+        for(size_t k=0; k<nWidth; k++) aSum[k] += aSum[k+nWidth];
+    }
+
+    *valMin = aMin[0];
+    *valMax = aMax[0];
+    *valSum = aSum[0];
+
+    return;
 }
 
 // ********************************************************************************************** //
@@ -161,9 +264,10 @@ double m::avg(double* aData, int nData) {
  *  Scales an array aData with length nData by a value valScale
  */
 
-void m::scale(double* aData, int nData, double valScale) {
+template<typename T>
+void m::scale(T* aData, size_t nData, typename same<T>::type valScale) {
 
-    for(int i=0; i<nData; i++) {
+    for(size_t i=0; i<nData; i++) {
         aData[i] *= valScale;
     }
 
@@ -175,12 +279,13 @@ void m::scale(double* aData, int nData, double valScale) {
 /**
  *  Offset Array
  * ==============
- *  Offsets an array aData with length nData by a value valScale
+ *  Offsets an array aData with length nData by a value valOffset
  */
 
-void m::offset(double* aData, int nData, double valOffset) {
+template<typename T>
+void m::offset(T* aData, size_t nData, typename same<T>::type valOffset) {
 
-    for(int i=0; i<nData; i++) {
+    for(size_t i=0; i<nData; i++) {
         aData[i] += valOffset;
     }
 
@@ -188,3 +293,187 @@ void m::offset(double* aData, int nData, double valOffset) {
 }
 
 // ********************************************************************************************** //
+//                                        Threaded Kernels                                        //
+// ********************************************************************************************** //
+
+/**
+ *  Thread Range
+ * ==============
+ *  Returns the number of threads to use for nData elements, and sets the range of thread iThread
+ *  to [*iFrom, *iTo). The ranges start on a multiple of M_BLOCK, so the pairwise sums line up.
+ */
+
+static int32_t threadRange(reypic::ThreadPool* pPool, size_t nData, int32_t iThread, size_t* iFrom, size_t* iTo) {
+
+    size_t nThreads = nData/M_THREAD_MIN;
+    if(nThreads > (size_t)pPool->getThreads()) nThreads = pPool->getThreads();
+    if(nThreads < 1) nThreads = 1;
+
+    size_t nBlocks = (nData + M_BLOCK-1)/M_BLOCK;
+    *iFrom = std::min(nData, nBlocks*iThread/nThreads*M_BLOCK);
+    *iTo   = std::min(nData, nBlocks*(iThread+1)/nThreads*M_BLOCK);
+
+    return (int32_t)nThreads;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Threaded Min, Max, Sum and Average
+ * ====================================
+ *  As min(), max(), sum() and avg(), with each thread of pPool reducing its own range
+ */
+
+template<typename T>
+T m::min(reypic::ThreadPool* pPool, const T* aData, size_t nData) {
+
+    T valMin;
+    minmaxsum(pPool, aData, nData, &valMin, (T*)NULL, (T*)NULL);
+
+    return valMin;
+}
+
+template<typename T>
+T m::max(reypic::ThreadPool* pPool, const T* aData, size_t nData) {
+
+    T valMax;
+    minmaxsum(pPool, aData, nData, (T*)NULL, &valMax, (T*)NULL);
+
+    return valMax;
+}
+
+template<typename T>
+T m::sum(reypic::ThreadPool* pPool, const T* aData, size_t nData) {
+
+    T valSum;
+    minmaxsum(pPool, aData, nData, (T*)NULL, (T*)NULL, &valSum);
+
+    return valSum;
+}
+
+template<typename T>
+T m::avg(reypic::ThreadPool* pPool, const T* aData, size_t nData) {
+
+    return sum(pPool, aData, nData)/nData;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Threaded Min, Max and Sum
+ * ===========================
+ *  As minmaxsum(), with each thread of pPool reducing its own range. Only the results with a
+ *  non-NULL pointer are computed, so the single reductions read the array once as well.
+ */
+
+template<typename T>
+void m::minmaxsum(reypic::ThreadPool* pPool, const T* aData, size_t nData, T* valMin, T* valMax, T* valSum) {
+
+    size_t  iFrom, iTo;
+    int32_t nThreads = threadRange(pPool, nData, 0, &iFrom, &iTo);
+
+    vector<T> vMin(nThreads), vMax(nThreads), vSum(nThreads);
+    auto fReduce = [&](int32_t iThread) {
+        size_t iLo, iHi;
+        threadRange(pPool, nData, iThread, &iLo, &iHi);
+        if(iLo >= iHi) return;
+        if(valMin != NULL && valMax != NULL && valSum != NULL) {
+            minmaxsum(aData+iLo, iHi-iLo, &vMin[iThread], &vMax[iThread], &vSum[iThread]);
+            return;
+        }
+        if(valMin != NULL) vMin[iThread] = min(aData+iLo, iHi-iLo);
+        if(valMax != NULL) vMax[iThread] = max(aData+iLo, iHi-iLo);
+        if(valSum != NULL) vSum[iThread] = sum(aData+iLo, iHi-iLo);
+    };
+
+    if(nThreads > 1) {
+        pPool->Run([&](int32_t iThread) {if(iThread < nThreads) fReduce(iThread);});
+    } else {
+        fReduce(0);
+    }
+
+    if(valMin != NULL) *valMin = min(vMin.data(), nThreads);
+    if(valMax != NULL) *valMax = max(vMax.data(), nThreads);
+    if(valSum != NULL) {
+        *valSum = vSum[0];
+        for(int32_t iThread=1; iThread<nThreads; iThread++) *valSum += vSum[iThread];
+    }
+
+    return;
+}
+
+// ********************************************************************************************** //
+
+/**
+ *  Threaded Scale and Offset
+ * ===========================
+ *  As scale() and offset(), with each thread of pPool updating its own range
+ */
+
+template<typename T>
+void m::scale(reypic::ThreadPool* pPool, T* aData, size_t nData, typename same<T>::type valScale) {
+
+    size_t  iFrom, iTo;
+    int32_t nThreads = threadRange(pPool, nData, 0, &iFrom, &iTo);
+    if(nThreads < 2) {
+        scale(aData, nData, valScale);
+        return;
+    }
+
+    pPool->Run([&](int32_t iThread) {
+        size_t iLo, iHi;
+        if(iThread >= nThreads) return;
+        threadRange(pPool, nData, iThread, &iLo, &iHi);
+        if(iLo < iHi) scale(aData+iLo, iHi-iLo, valScale);
+    });
+
+    return;
+}
+
+template<typename T>
+void m::offset(reypic::ThreadPool* pPool, T* aData, size_t nData, typename same<T>::type valOffset) {
+
+    size_t  iFrom, iTo;
+    int32_t nThreads = threadRange(pPool, nData, 0, &iFrom, &iTo);
+    if(nThreads < 2) {
+        offset(aData, nData, valOffset);
+        return;
+    }
+
+    pPool->Run([&](int32_t iThread) {
+        size_t iLo, iHi;
+        if(iThread >= nThreads) return;
+        threadRange(pPool, nData, iThread, &iLo, &iHi);
+        if(iLo < iHi) offset(aData+iLo, iHi-iLo, valOffset);
+    });
+
+    return;
+}
+
+// ********************************************************************************************** //
+//                                       Instantiations                                           //
+// ********************************************************************************************** //
+
+#define M_INSTANTIATE(T) \
+    template void m::linspace<T>(T, T, size_t, T*); \
+    template T    m::min<T>(const T*, size_t); \
+    template T    m::max<T>(const T*, size_t); \
+    template T    m::minind<T>(const T*, size_t, size_t*); \
+    template T    m::maxind<T>(const T*, size_t, size_t*); \
+    template T    m::sum<T>(const T*, size_t); \
+    template T    m::avg<T>(const T*, size_t); \
+    template void m::minmaxsum<T>(const T*, size_t, T*, T*, T*); \
+    template void m::scale<T>(T*, size_t, T); \
+    template void m::offset<T>(T*, size_t, T); \
+    template T    m::min<T>(reypic::ThreadPool*, const T*, size_t); \
+    template T    m::max<T>(reypic::ThreadPool*, const T*, size_t); \
+    template T    m::sum<T>(reypic::ThreadPool*, const T*, size_t); \
+    template T    m::avg<T>(reypic::ThreadPool*, const T*, size_t); \
+    template void m::minmaxsum<T>(reypic::ThreadPool*, const T*, size_t, T*, T*, T*); \
+    template void m::scale<T>(reypic::ThreadPool*, T*, size_t, T); \
+    template void m::offset<T>(reypic::ThreadPool*, T*, size_t, T);
+
+M_INSTANTIATE(float)
+M_INSTANTIATE(double)
+
+// ********************************************************************************************** //
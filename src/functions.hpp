@@ -5,19 +5,42 @@
 #ifndef MAIN_FUNCTIONS
 #define MAIN_FUNCTIONS
 
+// Array kernel macros
+#define M_LANES      32      // Independent accumulators per kernel, enough to hide the add latency
+#define M_BLOCK      1024    // Elements summed directly before the pairwise summation takes over
+#define M_THREAD_MIN 65536   // Fewest elements per thread for the threaded kernels
+
 #include "config.hpp"
 
+namespace reypic {
+class ThreadPool;
+}
+
 namespace m {
 
-    void   linspace(double, double, int, double*);
-    double min(double*, int);
-    double max(double*, int);
-    double minind(double*, int, int*);
-    double maxind(double*, int, int*);
-    double sum(double*, int);
-    double avg(double*, int);
-    void   scale(double*, int, double);
-    void   offset(double*, int, double);
+    // Makes a value argument follow the array type instead of taking part in the deduction
+    template<typename T> struct same {typedef T type;};
+
+    // Serial kernels
+    template<typename T> void linspace(typename same<T>::type, typename same<T>::type, size_t, T*);
+    template<typename T> T    min(const T*, size_t);
+    template<typename T> T    max(const T*, size_t);
+    template<typename T> T    minind(const T*, size_t, size_t*);
+    template<typename T> T    maxind(const T*, size_t, size_t*);
+    template<typename T> T    sum(const T*, size_t);
+    template<typename T> T    avg(const T*, size_t);
+    template<typename T> void minmaxsum(const T*, size_t, T*, T*, T*);
+    template<typename T> void scale(T*, size_t, typename same<T>::type);
+    template<typename T> void offset(T*, size_t, typename same<T>::type);
+
+    // Threaded kernels, serial below M_THREAD_MIN elements per thread
+    template<typename T> T    min(reypic::ThreadPool*, const T*, size_t);
+    template<typename T> T    max(reypic::ThreadPool*, const T*, size_t);
+    template<typename T> T    sum(reypic::ThreadPool*, const T*, size_t);
+    template<typename T> T    avg(reypic::ThreadPool*, const T*, size_t);
+    template<typename T> void minmaxsum(reypic::ThreadPool*, const T*, size_t, T*, T*, T*);
+    template<typename T> void scale(reypic::ThreadPool*, T*, size_t, typename same<T>::type);
+    template<typename T> void offset(reypic::ThreadPool*, T*, size_t, typename same<T>::type);
 
 } // End namespace
 
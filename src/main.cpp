@@ -27,13 +27,26 @@ int main(int argc, char* argv[]) {
     // Variables
     error_t errMPI;
     int     iRank;
+    int     iThreadLevel = MPI_THREAD_SINGLE;
     bool    isMaster = false;
 
    /**
     *  Initialise
     */
 
-    errMPI = MPI_Init(&argc, &argv);
+    // The compute threads never call MPI, so MPI_THREAD_FUNNELED is enough, and avoids the locking
+    // some libraries add for MPI_THREAD_MULTIPLE. Only the asynchronous diagnostics writer needs
+    // it, so the input file is read once before MPI starts to find out if it is used.
+    int32_t iAsync = 0;
+    if(argc > 1) {
+        Input preInput;
+        if(preInput.ReadFile(argv[argc-1]) == ERR_NONE && preInput.SplitSections() == ERR_NONE) {
+            preInput.ReadVariable(INPUT_DIAG, 0, "async", &iAsync, INVAR_INT);
+        }
+    }
+
+    int iThreadWant = (iAsync != 0 ? MPI_THREAD_MULTIPLE : MPI_THREAD_FUNNELED);
+    errMPI = MPI_Init_thread(&argc, &argv, iThreadWant, &iThreadLevel);
     if(errMPI != MPI_SUCCESS) {
         return abortExec(ERR_MPI_INIT);
     }
@@ -47,6 +60,10 @@ int main(int argc, char* argv[]) {
         printf(" ******************************\n");
         printf("  Version: %s\n", BUILD);
         printf("\n");
+        if(iThreadLevel < MPI_THREAD_FUNNELED) {
+            printf("  Warning: MPI library does not support threads, use threads = 1\n");
+            printf("\n");
+        }
     }
 
     // Check that there is a minimum of one argument
@@ -68,6 +85,7 @@ int main(int argc, char* argv[]) {
     for(int i=1; i<argc; i++) {
         if(strcmp(argv[i], "-t")  == 0) Sim.setRunMode(RUN_MODE_TEST);
         if(strcmp(argv[i], "-tt") == 0) Sim.setRunMode(RUN_MODE_EXT_TEST);
+        if(strcmp(argv[i], "-b")  == 0) Sim.setRunMode(RUN_MODE_BENCH);
     }
     Sim.setInputFile(argv[argc-1]);
 
@@ -83,6 +101,21 @@ int main(int argc, char* argv[]) {
         return abortExec(errSim);
     }
 
+    // Continue from a checkpoint, if restart is set
+    errSim = Sim.ReadRestart();
+    if(errSim != ERR_NONE) {
+        return abortExec(errSim);
+    }
+
+   /**
+    *  Run Simulation
+    */
+
+    errSim = Sim.MainLoop();
+    if(errSim != ERR_NONE) {
+        return abortExec(errSim);
+    }
+
    /**
     * THE END!
     */